@@ -142,6 +142,7 @@ typedef struct _EFI_FS {
 	EFI_GRUB_FILE         *RootFile;
 	VOID                  *GrubDevice;
 	CHAR16                *DevicePathString;
+	struct _DISK_CACHE    *DiskCache;
 } EFI_FS;
 
 /* Mirrors a similar construct from GRUB, while EFI-zing it */
@@ -173,6 +174,7 @@ extern CHAR16 *GrubGetUuid(EFI_FS *This);
 extern BOOLEAN GrubFSProbe(EFI_FS *This);
 extern EFI_STATUS GrubDeviceInit(EFI_FS *This);
 extern EFI_STATUS GrubDeviceExit(EFI_FS *This);
+extern VOID GrubDiskCacheStats(EFI_FS *This, Print_t Printer);
 extern VOID GrubTimeToEfiTime(const INT32 t, EFI_TIME *tp);
 extern VOID CopyPathRelative(CHAR8 *dest, CHAR8 *src, INTN len);
 extern EFI_STATUS GrubOpen(EFI_GRUB_FILE *File);
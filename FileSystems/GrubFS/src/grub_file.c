@@ -137,13 +137,264 @@ grub_device_iterate(grub_device_iterate_hook_t hook, void *hook_data)
 */
 grub_disk_read_hook_t grub_file_progress_hook = NULL;
 
+/*
+ * Per-volume disk cache. GRUB filesystems re-read the same metadata sectors
+ * many times during lookups, so reads are served from DISK_CACHE_BLOCK sized
+ * aligned blocks kept in LRU order within a DISK_CACHE_SIZE budget. Adjacent
+ * missing blocks are fetched with one request; reads of DISK_CACHE_BYPASS
+ * bytes or more (file data) go straight to the disk.
+ */
+#if !defined(DISK_CACHE_SIZE)
+#define DISK_CACHE_SIZE         (1024 * 1024)
+#endif
+#define DISK_CACHE_BLOCK        4096
+#define DISK_CACHE_BYPASS       (64 * 1024)
+#define DISK_CACHE_ENTRIES      (DISK_CACHE_SIZE / DISK_CACHE_BLOCK)
+#define DISK_CACHE_BUCKETS      (DISK_CACHE_ENTRIES * 2)
+#define DISK_CACHE_NONE         ((UINT32) -1)
+
+typedef struct {
+	UINT64                 Block;          /* Disk offset / DISK_CACHE_BLOCK */
+	UINT32                 HashNext;
+	UINT32                 LruPrev;        /* More recently used */
+	UINT32                 LruNext;        /* Less recently used */
+	BOOLEAN                Valid;
+} DISK_CACHE_ENTRY;
+
+typedef struct _DISK_CACHE {
+	UINT8                 *Data;
+	UINT32                 Lru;            /* Most recently used entry, list is circular */
+	UINT32                 MediaId;        /* Of the media the entries were read from */
+	UINT32                 Bucket[DISK_CACHE_BUCKETS];
+	DISK_CACHE_ENTRY       Entry[DISK_CACHE_ENTRIES];
+	/* Counters */
+	UINT64                 Hits;
+	UINT64                 Misses;
+	UINT64                 Requests;       /* Read requests sent to the disk */
+	UINT64                 Bypassed;
+} DISK_CACHE;
+
+#define DISK_CACHE_HASH(b)      ((UINT32) ((b) ^ ((b) >> 11)) % DISK_CACHE_BUCKETS)
+
+static EFI_BLOCK_IO_MEDIA *
+DiskMedia(EFI_FS *FileSystem)
+{
+	if (FileSystem->BlockIo2 != NULL)
+		return FileSystem->BlockIo2->Media;
+	return FileSystem->BlockIo->Media;
+}
+
+static EFI_STATUS
+DiskRead(EFI_FS *FileSystem, UINT64 Offset, UINTN Size, VOID *Buf)
+{
+	EFI_BLOCK_IO_MEDIA *Media = DiskMedia(FileSystem);
+
+	if (FileSystem->DiskCache != NULL)
+		FileSystem->DiskCache->Requests++;
+
+	if (FileSystem->DiskIo2 != NULL)
+		return FileSystem->DiskIo2->ReadDiskEx(FileSystem->DiskIo2, Media->MediaId,
+				Offset, &(FileSystem->DiskIo2Token), Size, Buf);
+	return FileSystem->DiskIo->ReadDisk(FileSystem->DiskIo, Media->MediaId,
+			Offset, Size, Buf);
+}
+
+/* Drop all entries, they are for the media MediaId from now on */
+static VOID
+DiskCacheReset(DISK_CACHE *Cache, UINT32 MediaId)
+{
+	UINT32 i;
+
+	for (i = 0; i < DISK_CACHE_BUCKETS; i++)
+		Cache->Bucket[i] = DISK_CACHE_NONE;
+	/* All entries start in the LRU list as invalid ones */
+	for (i = 0; i < DISK_CACHE_ENTRIES; i++) {
+		Cache->Entry[i].Valid = FALSE;
+		Cache->Entry[i].LruNext = (i + 1) % DISK_CACHE_ENTRIES;
+		Cache->Entry[i].LruPrev = (i + DISK_CACHE_ENTRIES - 1) % DISK_CACHE_ENTRIES;
+	}
+	Cache->Lru = 0;
+	Cache->MediaId = MediaId;
+}
+
+static DISK_CACHE *
+DiskCacheGet(EFI_FS *FileSystem)
+{
+	DISK_CACHE *Cache = FileSystem->DiskCache;
+	EFI_BLOCK_IO_MEDIA *Media = DiskMedia(FileSystem);
+
+	if (Cache != NULL) {
+		/* Removable media was changed, what we have is from the old one */
+		if (Cache->MediaId != Media->MediaId)
+			DiskCacheReset(Cache, Media->MediaId);
+		return Cache;
+	}
+
+	Cache = AllocateZeroPool(sizeof(DISK_CACHE));
+	if (Cache == NULL)
+		return NULL;
+	Cache->Data = AllocatePool(DISK_CACHE_SIZE);
+	if (Cache->Data == NULL) {
+		FreePool(Cache);
+		return NULL;
+	}
+	DiskCacheReset(Cache, Media->MediaId);
+
+	FileSystem->DiskCache = Cache;
+	return Cache;
+}
+
+static UINT32
+DiskCacheLookup(DISK_CACHE *Cache, UINT64 Block)
+{
+	UINT32 i;
+
+	for (i = Cache->Bucket[DISK_CACHE_HASH(Block)]; i != DISK_CACHE_NONE; i = Cache->Entry[i].HashNext) {
+		if (Cache->Entry[i].Block == Block)
+			break;
+	}
+	return i;
+}
+
+/* Make entry i the most recently used one */
+static VOID
+DiskCacheTouch(DISK_CACHE *Cache, UINT32 i)
+{
+	DISK_CACHE_ENTRY *e = &Cache->Entry[i];
+	UINT32 Head = Cache->Lru;
+
+	if (i == Head)
+		return;
+	Cache->Entry[e->LruPrev].LruNext = e->LruNext;
+	Cache->Entry[e->LruNext].LruPrev = e->LruPrev;
+	e->LruNext = Head;
+	e->LruPrev = Cache->Entry[Head].LruPrev;
+	Cache->Entry[e->LruPrev].LruNext = i;
+	Cache->Entry[Head].LruPrev = i;
+	Cache->Lru = i;
+}
+
+/* Recycle the least recently used entry for Block */
+static UINT32
+DiskCacheInsert(DISK_CACHE *Cache, UINT64 Block)
+{
+	UINT32 i = Cache->Entry[Cache->Lru].LruPrev;
+	UINT32 *Link;
+	DISK_CACHE_ENTRY *e = &Cache->Entry[i];
+
+	if (e->Valid) {
+		for (Link = &Cache->Bucket[DISK_CACHE_HASH(e->Block)]; *Link != i; Link = &Cache->Entry[*Link].HashNext)
+			;
+		*Link = e->HashNext;
+	}
+	e->Block = Block;
+	e->Valid = TRUE;
+	e->HashNext = Cache->Bucket[DISK_CACHE_HASH(Block)];
+	Cache->Bucket[DISK_CACHE_HASH(Block)] = i;
+	DiskCacheTouch(Cache, i);
+	return i;
+}
+
+/* Read Count missing blocks from First with one request and cache them */
+static EFI_STATUS
+DiskCacheFill(EFI_FS *FileSystem, DISK_CACHE *Cache, UINT64 First, UINTN Count, UINT8 *Tmp)
+{
+	EFI_STATUS Status;
+	UINTN j;
+
+	Status = DiskRead(FileSystem, First * DISK_CACHE_BLOCK, Count * DISK_CACHE_BLOCK, Tmp);
+	if (EFI_ERROR(Status))
+		return Status;
+	for (j = 0; j < Count; j++)
+		CopyMem(Cache->Data + (UINTN) DiskCacheInsert(Cache, First + j) * DISK_CACHE_BLOCK,
+				Tmp + j * DISK_CACHE_BLOCK, DISK_CACHE_BLOCK);
+	return EFI_SUCCESS;
+}
+
+static EFI_STATUS
+DiskCacheRead(EFI_FS *FileSystem, UINT64 Offset, UINTN Size, UINT8 *Buf)
+{
+	DISK_CACHE *Cache;
+	EFI_STATUS Status;
+	UINT64 First, Last, Block, MissStart = 0;
+	UINTN Misses = 0, Pos, Len;
+	UINT32 i;
+	UINT8 *Tmp;
+	EFI_BLOCK_IO_MEDIA *Media = DiskMedia(FileSystem);
+
+	Cache = DiskCacheGet(FileSystem);
+	First = Offset / DISK_CACHE_BLOCK;
+	Last = (Offset + Size - 1) / DISK_CACHE_BLOCK;
+	/* Large reads and reads touching the last partial block are not cached */
+	if (Cache == NULL || Size >= DISK_CACHE_BYPASS ||
+			(Last + 1) * DISK_CACHE_BLOCK > (Media->LastBlock + 1) * Media->BlockSize) {
+		if (Cache != NULL)
+			Cache->Bypassed++;
+		return DiskRead(FileSystem, Offset, Size, Buf);
+	}
+
+	/* Pass 1: fetch missing blocks, adjacent ones with a single request */
+	Tmp = AllocatePool((UINTN) (Last - First + 1) * DISK_CACHE_BLOCK);
+	if (Tmp == NULL)
+		return DiskRead(FileSystem, Offset, Size, Buf);
+	for (Block = First; Block <= Last + 1; Block++) {
+		i = (Block <= Last) ? DiskCacheLookup(Cache, Block) : DISK_CACHE_NONE;
+		if (Block <= Last && i == DISK_CACHE_NONE) {
+			Cache->Misses++;
+			if (Misses++ == 0)
+				MissStart = Block;
+			continue;
+		}
+		if (Block <= Last) {
+			/* Keep it away from the LRU end while the misses are filled */
+			Cache->Hits++;
+			DiskCacheTouch(Cache, i);
+		}
+		if (Misses > 0) {
+			Status = DiskCacheFill(FileSystem, Cache, MissStart, Misses, Tmp);
+			if (EFI_ERROR(Status)) {
+				FreePool(Tmp);
+				return Status;
+			}
+			Misses = 0;
+		}
+	}
+	FreePool(Tmp);
+
+	/* Pass 2: copy out, everything is cached now */
+	for (Block = First, Pos = 0; Block <= Last; Block++) {
+		i = DiskCacheLookup(Cache, Block);
+		if (i == DISK_CACHE_NONE)
+			return DiskRead(FileSystem, Offset, Size, Buf);
+		DiskCacheTouch(Cache, i);
+		Len = DISK_CACHE_BLOCK - (UINTN) ((Offset + Pos) % DISK_CACHE_BLOCK);
+		if (Len > Size - Pos)
+			Len = Size - Pos;
+		CopyMem(Buf + Pos, Cache->Data + (UINTN) i * DISK_CACHE_BLOCK + (UINTN) ((Offset + Pos) % DISK_CACHE_BLOCK), Len);
+		Pos += Len;
+	}
+	return EFI_SUCCESS;
+}
+
+VOID
+GrubDiskCacheStats(EFI_FS *FileSystem, Print_t Printer)
+{
+	DISK_CACHE *Cache = FileSystem->DiskCache;
+
+	if (Cache == NULL)
+		return;
+	Printer(L"Disk cache %s: %ld hits, %ld misses (%ld%% hit rate), %ld disk reads, %ld bypassed\n",
+		FileSystem->DevicePathString, Cache->Hits, Cache->Misses,
+		(Cache->Hits + Cache->Misses) ? DivU64x64Remainder(Cache->Hits * 100, Cache->Hits + Cache->Misses, NULL) : 0,
+		Cache->Requests, Cache->Bypassed);
+}
+
 grub_err_t
 grub_disk_read(grub_disk_t disk, grub_disk_addr_t sector,
 		grub_off_t offset, grub_size_t size, void *buf)
 {
 	EFI_STATUS Status;
 	EFI_FS* FileSystem = (EFI_FS *) disk->data;
-  EFI_BLOCK_IO_MEDIA *Media;
 
 //	ASSERT(FileSystem != NULL);
 //	ASSERT(FileSystem->DiskIo != NULL);
@@ -154,23 +405,13 @@ grub_disk_read(grub_disk_t disk, grub_disk_addr_t sector,
     return GRUB_ERR_BAD_ARGUMENT;
   }
 
-    if (FileSystem->BlockIo2 != NULL)
-    {
-      Media = FileSystem->BlockIo2->Media;
-    } else {
-      Media = FileSystem->BlockIo->Media;
-    }
+	if (size == 0)
+		return 0;
+
 	/* NB: We could get the actual blocksize through FileSystem->BlockIo->Media->BlockSize
 	 * but GRUB uses the fixed GRUB_DISK_SECTOR_SIZE, so we follow suit
 	 */
-    if (FileSystem->DiskIo2 != NULL)
-    {
-      Status = FileSystem->DiskIo2->ReadDiskEx(FileSystem->DiskIo2, Media->MediaId,
-                                               sector * GRUB_DISK_SECTOR_SIZE + offset, &(FileSystem->DiskIo2Token), size, buf);
-    } else {
-        Status = FileSystem->DiskIo->ReadDisk(FileSystem->DiskIo, Media->MediaId,
-			sector * GRUB_DISK_SECTOR_SIZE + offset, size, buf);
-    }
+	Status = DiskCacheRead(FileSystem, sector * GRUB_DISK_SECTOR_SIZE + offset, size, buf);
 
 	if (EFI_ERROR(Status)) {
 		PrintStatusError(Status, L"Could not read block at address %08x", sector);
@@ -294,6 +535,13 @@ GrubDeviceExit(EFI_FS *FileSystem)
 	grub_device_close_2((grub_device_t) FileSystem->GrubDevice);
 	RemoveEntryList((LIST_ENTRY *)FileSystem);
 
+	if (FileSystem->DiskCache != NULL) {
+		GrubDiskCacheStats(FileSystem, PrintInfo);
+		FreePool(FileSystem->DiskCache->Data);
+		FreePool(FileSystem->DiskCache);
+		FileSystem->DiskCache = NULL;
+	}
+
 	return EFI_SUCCESS;
 }
 
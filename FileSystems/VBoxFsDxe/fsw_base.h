@@ -52,13 +52,14 @@
 #ifndef _FSW_BASE_H_
 #define _FSW_BASE_H_
 //#define HOST_EFI 1
+#ifndef HOST_POSIX
 #define VBOX
+#endif
 
 #ifdef VBOX
 #include "VBoxFswParam.h"
-#endif
-
 #include <Protocol/MsgLog.h> 
+#endif
 
 #ifndef FSW_DEBUG_LEVEL
 /**
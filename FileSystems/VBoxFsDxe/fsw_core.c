@@ -63,8 +63,6 @@ const char* fsw_errors[] = {
 
 static void fsw_blockcache_free(struct fsw_volume *vol);
 
-#define MAX_CACHE_LEVEL (5)
-
 
 /**
  * Mount a volume with a given file system driver. This function is called by the
@@ -186,6 +184,199 @@ void fsw_set_blocksize_(struct fsw_volume *vol, fsw_u32 phys_blocksize, fsw_u32
     vol->log_blocksize = log_blocksize;
 }
 
+/*
+ * Block cache internals. Entries are found through a hash table of chains
+ * and kept in one circular LRU list per cache level; both link entries by
+ * index so that the entry array can be reallocated. When the cache reaches
+ * bcache_max entries, the least recently used unreferenced block of the
+ * lowest level is reused.
+ */
+
+#define FSW_BCACHE_HASH(vol, bno) (((bno) ^ ((bno) >> 13)) & (vol)->bcache_hash_mask)
+
+static fsw_u32 fsw_blockcache_lookup(struct VOLSTRUCTNAME *vol, fsw_u32 phys_bno)
+{
+  fsw_u32 i;
+
+  if (vol->bcache_hash == NULL)
+    return FSW_BCACHE_NONE;
+  for (i = vol->bcache_hash[FSW_BCACHE_HASH(vol, phys_bno)]; i != FSW_BCACHE_NONE; i = vol->bcache[i].hash_next) {
+    if (vol->bcache[i].phys_bno == phys_bno)
+      break;
+  }
+  return i;
+}
+
+static void fsw_blockcache_hash_remove(struct VOLSTRUCTNAME *vol, fsw_u32 i)
+{
+  fsw_u32 *link = &vol->bcache_hash[FSW_BCACHE_HASH(vol, vol->bcache[i].phys_bno)];
+
+  while (*link != i)
+    link = &vol->bcache[*link].hash_next;
+  *link = vol->bcache[i].hash_next;
+}
+
+static void fsw_blockcache_lru_remove(struct VOLSTRUCTNAME *vol, fsw_u32 i)
+{
+  struct fsw_blockcache *e = &vol->bcache[i];
+  fsw_u32 level = e->cache_level;
+
+  if (e->lru_next == i) {
+    vol->bcache_lru[level] = FSW_BCACHE_NONE;
+  } else {
+    vol->bcache[e->lru_prev].lru_next = e->lru_next;
+    vol->bcache[e->lru_next].lru_prev = e->lru_prev;
+    if (vol->bcache_lru[level] == i)
+      vol->bcache_lru[level] = e->lru_next;
+  }
+}
+
+static void fsw_blockcache_lru_insert(struct VOLSTRUCTNAME *vol, fsw_u32 i)
+{
+  struct fsw_blockcache *e = &vol->bcache[i];
+  fsw_u32 head = vol->bcache_lru[e->cache_level];
+
+  if (head == FSW_BCACHE_NONE) {
+    e->lru_prev = e->lru_next = i;
+  } else {
+    e->lru_next = head;
+    e->lru_prev = vol->bcache[head].lru_prev;
+    vol->bcache[e->lru_prev].lru_next = i;
+    vol->bcache[head].lru_prev = i;
+  }
+  vol->bcache_lru[e->cache_level] = i;
+}
+
+static void fsw_blockcache_insert(struct VOLSTRUCTNAME *vol, fsw_u32 i, fsw_u32 phys_bno, fsw_u32 cache_level)
+{
+  struct fsw_blockcache *e = &vol->bcache[i];
+
+  e->phys_bno = phys_bno;
+  e->cache_level = cache_level;
+  e->refcount = 0;
+  e->hash_next = vol->bcache_hash[FSW_BCACHE_HASH(vol, phys_bno)];
+  vol->bcache_hash[FSW_BCACHE_HASH(vol, phys_bno)] = i;
+  fsw_blockcache_lru_insert(vol, i);
+}
+
+/**
+ * Enlarge the entry array to new_bcache_size entries and rebuild the hash table
+ * so that there are at least as many buckets as entries.
+ */
+
+static fsw_status_t fsw_blockcache_grow(struct VOLSTRUCTNAME *vol, fsw_u32 new_bcache_size)
+{
+  fsw_status_t    status;
+  fsw_u32         i, hash_size;
+  struct fsw_blockcache *new_bcache = NULL;
+  fsw_u32         *new_hash = NULL;
+
+  status = fsw_alloc(new_bcache_size * sizeof(struct fsw_blockcache), &new_bcache);
+  if (status)
+    return status;
+  for (hash_size = 16; hash_size < new_bcache_size; hash_size <<= 1)
+    ;
+  if (hash_size - 1 != vol->bcache_hash_mask || vol->bcache_hash == NULL) {
+    status = fsw_alloc(hash_size * sizeof(fsw_u32), &new_hash);
+    if (status) {
+      fsw_free(new_bcache);
+      return status;
+    }
+  }
+
+  if (vol->bcache_size > 0)
+    fsw_memcpy(new_bcache, vol->bcache, vol->bcache_size * sizeof(struct fsw_blockcache));
+  for (i = vol->bcache_size; i < new_bcache_size; i++) {
+    new_bcache[i].refcount = 0;
+    new_bcache[i].cache_level = 0;
+    new_bcache[i].phys_bno = (fsw_u32)FSW_INVALID_BNO;
+    new_bcache[i].data = NULL;
+  }
+  if (vol->bcache != NULL)
+    fsw_free(vol->bcache);
+  vol->bcache = new_bcache;
+  vol->bcache_size = new_bcache_size;
+
+  if (new_hash != NULL) {
+    if (vol->bcache_hash != NULL)
+      fsw_free(vol->bcache_hash);
+    vol->bcache_hash = new_hash;
+    vol->bcache_hash_mask = hash_size - 1;
+    for (i = 0; i < hash_size; i++)
+      new_hash[i] = FSW_BCACHE_NONE;
+    for (i = 0; i < vol->bcache_used; i++) {
+      if (vol->bcache[i].phys_bno != (fsw_u32)FSW_INVALID_BNO) {
+        vol->bcache[i].hash_next = new_hash[FSW_BCACHE_HASH(vol, vol->bcache[i].phys_bno)];
+        new_hash[FSW_BCACHE_HASH(vol, vol->bcache[i].phys_bno)] = i;
+      }
+    }
+  }
+  return FSW_SUCCESS;
+}
+
+/**
+ * Find an entry for a new block: an emptied one, a never used one, the least
+ * recently used unreferenced one once the cache is full, or a new one.
+ */
+
+static fsw_status_t fsw_blockcache_take(struct VOLSTRUCTNAME *vol, fsw_u32 *index_out)
+{
+  fsw_status_t    status;
+  fsw_u32         i, level, head;
+
+  if (vol->bcache_size == 0) {
+    for (level = 0; level <= FSW_MAX_CACHE_LEVEL; level++)
+      vol->bcache_lru[level] = FSW_BCACHE_NONE;
+    vol->bcache_free = FSW_BCACHE_NONE;
+    vol->bcache_used = 0;
+    vol->bcache_max = FSW_BCACHE_MAX_SIZE / vol->phys_blocksize;
+    if (vol->bcache_max < 16)
+      vol->bcache_max = 16;
+  }
+
+  if (vol->bcache_free != FSW_BCACHE_NONE) {
+    i = vol->bcache_free;
+    vol->bcache_free = vol->bcache[i].hash_next;
+    *index_out = i;
+    return FSW_SUCCESS;
+  }
+
+  if (vol->bcache_used >= vol->bcache_max) {
+    // recycle the least recently used block, lowest levels first
+    for (level = 0; level <= FSW_MAX_CACHE_LEVEL; level++) {
+      head = vol->bcache_lru[level];
+      if (head == FSW_BCACHE_NONE)
+        continue;
+      i = head;
+      do {
+        i = vol->bcache[i].lru_prev;
+        if (vol->bcache[i].refcount == 0) {
+          fsw_blockcache_hash_remove(vol, i);
+          fsw_blockcache_lru_remove(vol, i);
+          vol->bcache[i].phys_bno = (fsw_u32)FSW_INVALID_BNO;
+          *index_out = i;
+          return FSW_SUCCESS;
+        }
+      } while (i != head);
+    }
+    // everything is in use, go over the cap
+  }
+
+  if (vol->bcache_used >= vol->bcache_size) {
+    // enlarge / create the cache
+    if (vol->bcache_size < 16)
+      status = fsw_blockcache_grow(vol, 16);
+    else if (vol->bcache_size < vol->bcache_max && (vol->bcache_size << 1) > vol->bcache_max)
+      status = fsw_blockcache_grow(vol, vol->bcache_max);
+    else
+      status = fsw_blockcache_grow(vol, vol->bcache_size << 1);
+    if (status)
+      return status;
+  }
+  *index_out = vol->bcache_used++;
+  return FSW_SUCCESS;
+}
+
 /**
  * Get a block of data from the disk. This function is called by the file system driver
  * or by core functions. It calls through to the host driver's device access routine.
@@ -206,89 +397,91 @@ void fsw_set_blocksize_(struct fsw_volume *vol, fsw_u32 phys_blocksize, fsw_u32
 fsw_status_t fsw_block_get_(struct VOLSTRUCTNAME *vol, fsw_u32 phys_bno, fsw_u32 cache_level, void **buffer_out)
 {
   fsw_status_t    status;
-  fsw_u32         i, discard_level, new_bcache_size;
-  struct fsw_blockcache *new_bcache = NULL;
-  
+  fsw_u32         i;
+  struct fsw_blockcache *e;
+
   // TODO: allow the host driver to do its own caching; just call through if
   //  the appropriate function pointers are set
-  
-  if (cache_level > MAX_CACHE_LEVEL)
-    cache_level = MAX_CACHE_LEVEL;
-  
+
+  if (cache_level > FSW_MAX_CACHE_LEVEL)
+    cache_level = FSW_MAX_CACHE_LEVEL;
+
   // check block cache
-  for (i = 0; i < vol->bcache_size; i++) {
-    if (vol->bcache[i].phys_bno == phys_bno) {
-      // cache hit!
-      if (vol->bcache[i].cache_level < cache_level)
-        vol->bcache[i].cache_level = cache_level;  // promote the entry
-      vol->bcache[i].refcount++;
-      *buffer_out = vol->bcache[i].data;
-      return FSW_SUCCESS;
-    }
-  }
-  
-  // find a free entry in the cache table
-  for (i = 0; i < vol->bcache_size; i++) {
-    if (vol->bcache[i].phys_bno == (fsw_u32)FSW_INVALID_BNO)
-      break;
+  i = fsw_blockcache_lookup(vol, phys_bno);
+  if (i != FSW_BCACHE_NONE) {
+    // cache hit!
+    e = &vol->bcache[i];
+    fsw_blockcache_lru_remove(vol, i);
+    if (e->cache_level < cache_level)
+      e->cache_level = cache_level;  // promote the entry
+    fsw_blockcache_lru_insert(vol, i);
+    e->refcount++;
+    *buffer_out = e->data;
+    return FSW_SUCCESS;
   }
-  if (i >= vol->bcache_size) {
-    for (discard_level = 0; discard_level <= MAX_CACHE_LEVEL; discard_level++) {
-      for (i = 0; i < vol->bcache_size; i++) {
-        if (vol->bcache[i].refcount == 0 && vol->bcache[i].cache_level <= discard_level)
-          break;
-      }
-      if (i < vol->bcache_size)
-        break;
-    }
+
+  status = fsw_blockcache_take(vol, &i);
+  if (status)
+    return status;
+  e = &vol->bcache[i];
+
+  // read the data
+  if (e->data == NULL)
+    status = fsw_alloc(vol->phys_blocksize, &e->data);
+  if (status == FSW_SUCCESS)
+    status = vol->host_table->read_block(vol, phys_bno, e->data);
+  if (status) {
+    e->hash_next = vol->bcache_free;
+    vol->bcache_free = i;
+    return status;
   }
-  if (i >= vol->bcache_size) {
-    // enlarge / create the cache
-    if (vol->bcache_size < 16)
-      new_bcache_size = 16;
-    else
-      new_bcache_size = vol->bcache_size << 1;
-    status = fsw_alloc(new_bcache_size * sizeof(struct fsw_blockcache), &new_bcache);
-    if (status != FSW_SUCCESS) {
-      if (new_bcache) {
-        fsw_free(new_bcache);
-      }
-      return status;
-    }
-    if (vol->bcache_size > 0) {
-      fsw_memcpy(new_bcache, vol->bcache, vol->bcache_size * sizeof(struct fsw_blockcache));
-    }
-    for (i = vol->bcache_size; i < new_bcache_size; i++) {
-      new_bcache[i].refcount = 0;
-      new_bcache[i].cache_level = 0;
-      new_bcache[i].phys_bno = (fsw_u32)FSW_INVALID_BNO;
-      new_bcache[i].data = NULL;
-    }
-    i = vol->bcache_size;
-    
-    // switch caches
-    if (vol->bcache != NULL)
-      fsw_free(vol->bcache);
-    vol->bcache = new_bcache;
-    vol->bcache_size = new_bcache_size;
+
+  fsw_blockcache_insert(vol, i, phys_bno, cache_level);
+  e->refcount = 1;
+  *buffer_out = e->data;
+  return FSW_SUCCESS;
+}
+
+/**
+ * Read up to count consecutive blocks starting at phys_bno into the block cache with
+ * one device request. Stops at the first block that is already cached. Used for
+ * readahead, so errors are left for the following fsw_block_get to report.
+ */
+
+static void fsw_block_readahead(struct VOLSTRUCTNAME *vol, fsw_u32 phys_bno, fsw_u32 count, fsw_u32 cache_level)
+{
+  fsw_status_t    status;
+  fsw_u32         n, i, j;
+  fsw_u8          *buffer = NULL;
+  struct fsw_blockcache *e;
+
+  for (n = 0; n < count; n++) {
+    if (fsw_blockcache_lookup(vol, phys_bno + n) != FSW_BCACHE_NONE)
+      break;
   }
-  vol->bcache[i].phys_bno = (fsw_u32)FSW_INVALID_BNO;
-  
-  // read the data
-  if (vol->bcache[i].data == NULL) {
-    status = fsw_alloc(vol->phys_blocksize, &vol->bcache[i].data);
+  if (n < 2)
+    return;
+
+  status = fsw_alloc(n * vol->phys_blocksize, &buffer);
+  if (status)
+    return;
+  status = vol->host_table->read_blocks(vol, phys_bno, n, buffer);
+  for (j = 0; status == FSW_SUCCESS && j < n; j++) {
+    status = fsw_blockcache_take(vol, &i);
     if (status)
-      return status;
+      break;
+    e = &vol->bcache[i];
+    if (e->data == NULL)
+      status = fsw_alloc(vol->phys_blocksize, &e->data);
+    if (status) {
+      e->hash_next = vol->bcache_free;
+      vol->bcache_free = i;
+      break;
+    }
+    fsw_memcpy(e->data, buffer + j * vol->phys_blocksize, vol->phys_blocksize);
+    fsw_blockcache_insert(vol, i, phys_bno + j, cache_level);
   }
-  status = vol->host_table->read_block(vol, phys_bno, vol->bcache[i].data);
-  if (status)
-    return status;
-  
-  vol->bcache[i].phys_bno = phys_bno;
-  vol->bcache[i].cache_level = cache_level;
-  vol->bcache[i].refcount = 1;
-  *buffer_out = vol->bcache[i].data;
-  return FSW_SUCCESS;
+  fsw_free(buffer);
 }
 
 /**
@@ -302,15 +495,14 @@ void fsw_block_release_(struct VOLSTRUCTNAME *vol, fsw_u32 phys_bno, void *buffe
   if (!vol) {
     return;
   }
-  
+
   // TODO: allow the host driver to do its own caching; just call through if
   //  the appropriate function pointers are set
-  
+
   // update block cache
-  for (i = 0; i < vol->bcache_size; i++) {
-    if (vol->bcache[i].phys_bno == phys_bno && vol->bcache[i].refcount > 0)
-      vol->bcache[i].refcount--;
-  }
+  i = fsw_blockcache_lookup(vol, phys_bno);
+  if (i != FSW_BCACHE_NONE && vol->bcache[i].refcount > 0)
+    vol->bcache[i].refcount--;
 }
 
 /**
@@ -325,7 +517,7 @@ static void fsw_blockcache_free(struct fsw_volume *vol)
     return;
   }
   
-  for (i = 0; i < vol->bcache_size; i++) {
+  for (i = 0; i < vol->bcache_used; i++) {
     if (vol->bcache[i].data != NULL)
       fsw_free(vol->bcache[i].data);
   }
@@ -333,7 +525,12 @@ static void fsw_blockcache_free(struct fsw_volume *vol)
     fsw_free(vol->bcache);
     vol->bcache = NULL;
   }
+  if (vol->bcache_hash != NULL) {
+    fsw_free(vol->bcache_hash);
+    vol->bcache_hash = NULL;
+  }
   vol->bcache_size = 0;
+  vol->bcache_used = 0;
 }
 
 /**
@@ -1023,6 +1220,7 @@ fsw_status_t fsw_shandle_open_(struct fsw_dnode *dno, struct fsw_shandle *shand)
   
   shand->dnode = dno;
   shand->pos = 0;
+  shand->last_end = 0;
   shand->extent.type = FSW_EXTENT_TYPE_INVALID;
   
   return FSW_SUCCESS;
@@ -1056,7 +1254,8 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
   fsw_u8          *buffer, *block_buffer;
   fsw_u32         buflen, copylen, pos;
   fsw_u32         log_bno, pos_in_extent, phys_bno, pos_in_physblock;
-  fsw_u32         cache_level;
+  fsw_u32         cache_level, count;
+  int             sequential;
   
   if (shand->pos >= dno->size) {   // already at EOF
     *buffer_size_inout = 0;
@@ -1068,6 +1267,7 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
   buflen = *buffer_size_inout;
   pos = (fsw_u32)shand->pos;
   cache_level = (dno->type != FSW_DNODE_TYPE_FILE) ? 1 : 0;
+  sequential = (shand->pos == shand->last_end);
   // restrict read to file size
   if (buflen > dno->size - pos)
     buflen = (fsw_u32)(dno->size - pos);
@@ -1098,18 +1298,39 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
       // convert to physical block number and offset
       phys_bno = shand->extent.phys_start + pos_in_extent / vol->phys_blocksize;
       pos_in_physblock = pos_in_extent & (vol->phys_blocksize - 1);
-      copylen = vol->phys_blocksize - pos_in_physblock;
-      if (copylen > buflen)
-        copylen = buflen;
-      
-      // get one physical block
-      status = fsw_block_get(vol, phys_bno, cache_level, (void **)&block_buffer);
-      if (status)
-        return status;
-      
-      // copy data from it
-      fsw_memcpy(buffer, block_buffer + pos_in_physblock, copylen);
-      fsw_block_release(vol, phys_bno, block_buffer);
+      // whole physical blocks left in the extent
+      count = (shand->extent.log_count * vol->log_blocksize - pos_in_extent) / vol->phys_blocksize;
+
+      if (pos_in_physblock == 0 && buflen >= vol->phys_blocksize && count > 0 && vol->host_table->read_blocks != NULL) {
+        // fast path: whole blocks go straight into the caller's buffer
+        if (count > buflen / vol->phys_blocksize)
+          count = buflen / vol->phys_blocksize;
+        copylen = count * vol->phys_blocksize;
+        status = vol->host_table->read_blocks(vol, phys_bno, count, buffer);
+        if (status)
+          return status;
+
+      } else {
+        copylen = vol->phys_blocksize - pos_in_physblock;
+        if (copylen > buflen)
+          copylen = buflen;
+
+        // sequential access through the cache reads a window ahead
+        if (sequential && vol->host_table->read_blocks != NULL && count > 1) {
+          if (count > FSW_READAHEAD_SIZE / vol->phys_blocksize)
+            count = FSW_READAHEAD_SIZE / vol->phys_blocksize;
+          fsw_block_readahead(vol, phys_bno, count, cache_level);
+        }
+
+        // get one physical block
+        status = fsw_block_get(vol, phys_bno, cache_level, (void **)&block_buffer);
+        if (status)
+          return status;
+
+        // copy data from it
+        fsw_memcpy(buffer, block_buffer + pos_in_physblock, copylen);
+        fsw_block_release(vol, phys_bno, block_buffer);
+      }
       
     } else if (shand->extent.type == FSW_EXTENT_TYPE_BUFFER) {
       copylen = shand->extent.log_count * vol->log_blocksize - pos_in_extent;
@@ -1132,6 +1353,7 @@ fsw_status_t fsw_shandle_read(struct fsw_shandle *shand, fsw_u32 *buffer_size_in
   
   *buffer_size_inout = (fsw_u32)(pos - shand->pos);
   shand->pos = pos;
+  shand->last_end = pos;
   
   return FSW_SUCCESS;
 }
@@ -62,6 +62,19 @@ extern const char* fsw_errors[];
 #define FSW_DNODE_CACHE_SIZE (0)
 #endif
 
+/** Memory cap for the block cache in bytes. It is exceeded only if all cached blocks are in use. */
+#ifndef FSW_BCACHE_MAX_SIZE
+#define FSW_BCACHE_MAX_SIZE (4 * 1024 * 1024)
+#endif
+
+/** Size of the readahead window for sequential reads through the block cache, in bytes. */
+#ifndef FSW_READAHEAD_SIZE
+#define FSW_READAHEAD_SIZE (64 * 1024)
+#endif
+
+/** Highest block cache level, see fsw_block_get. */
+#define FSW_MAX_CACHE_LEVEL (5)
+
 /** Maximum size for a path, specifically symlink target paths. */
 #ifndef VBOX
 #define FSW_PATH_MAX (4096)
@@ -78,6 +91,9 @@ extern const char* fsw_errors[];
 /** Indicates that the block cache entry is empty. */
 #define FSW_INVALID_BNO (~0UL)
 
+/** Terminates block cache hash chains and LRU lists. */
+#define FSW_BCACHE_NONE ((fsw_u32)~0UL)
+
 #define USE_FULL_LOWERCASE 0
 //
 // Byte-swapping macros
@@ -256,6 +272,9 @@ struct fsw_blockcache {
     fsw_u32     cache_level;        //!< Level of importance of this block
     fsw_u32     phys_bno;           //!< Physical block number
     void        *data;              //!< Block data buffer
+    fsw_u32     hash_next;          //!< Next entry in the same hash bucket or in the free list
+    fsw_u32     lru_prev;           //!< Circular LRU list of the cache level: more recently used entry
+    fsw_u32     lru_next;           //!< Circular LRU list of the cache level: less recently used entry
 };
 
 /**
@@ -273,6 +292,12 @@ struct fsw_volume {
 
     struct fsw_blockcache *bcache;  //!< Array of block cache entries
     fsw_u32     bcache_size;        //!< Number of entries in the block cache array
+    fsw_u32     bcache_used;        //!< Number of entries taken into use, the rest were never used
+    fsw_u32     bcache_max;         //!< Number of entries allowed by FSW_BCACHE_MAX_SIZE
+    fsw_u32     bcache_free;        //!< List of emptied entries, linked by hash_next
+    fsw_u32     *bcache_hash;       //!< Hash buckets, indexes of the first entry in a chain
+    fsw_u32     bcache_hash_mask;   //!< Number of hash buckets - 1
+    fsw_u32     bcache_lru[FSW_MAX_CACHE_LEVEL + 1];  //!< Most recently used entry per cache level
 
     void        *host_data;         //!< Hook for a host-specific data structure
     struct fsw_host_table *host_table;      //!< Dispatch table for host-specific functions
@@ -348,6 +373,7 @@ struct fsw_shandle {
     struct fsw_dnode *dnode;        //!< The dnode this handle reads data from
 
     fsw_u64     pos;                //!< Current file pointer in bytes
+    fsw_u64     last_end;           //!< End of the previous read, to detect sequential access
     struct fsw_extent extent;       //!< Current extent
 };
 
@@ -392,6 +418,7 @@ struct fsw_host_table
                                      fsw_u32 old_phys_blocksize, fsw_u32 old_log_blocksize,
                                      fsw_u32 new_phys_blocksize, fsw_u32 new_log_blocksize);
     fsw_status_t (*read_block)(struct fsw_volume *vol, fsw_u32 phys_bno, void *buffer);
+    fsw_status_t (*read_blocks)(struct fsw_volume *vol, fsw_u32 phys_bno, fsw_u32 count, void *buffer);  //!< Optional, reads consecutive blocks at once
 };
 
 /**
@@ -53,6 +53,8 @@ struct fsw_posix_volume {
     struct fsw_volume           *vol;           //!< FSW volume structure
 
     int                         fd;             //!< System file descriptor for data access
+    fsw_u32                     read_count;     //!< Number of blocks read from the device
+    fsw_u32                     request_count;  //!< Number of read requests to the device
 
 };
 
@@ -55,8 +55,8 @@ typedef signed char         fsw_s8;
 typedef unsigned char       fsw_u8;
 typedef short               fsw_s16;
 typedef unsigned short      fsw_u16;
-typedef long                fsw_s32;
-typedef unsigned long       fsw_u32;
+typedef int                 fsw_s32;
+typedef unsigned int        fsw_u32;
 typedef long long           fsw_s64;
 typedef unsigned long long  fsw_u64;
 
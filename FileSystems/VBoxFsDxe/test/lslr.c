@@ -37,6 +37,8 @@
 
 #include "fsw_posix.h"
 
+#include <sys/time.h>
+
 
 //extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(ext2);
 //extern struct fsw_fstype_table FSW_FSTYPE_TABLE_NAME(reiserfs);
@@ -49,6 +51,8 @@ static struct fsw_fstype_table *fstypes[] = {
     NULL
 };
 
+static int quiet = 0;
+
 static int listdir(struct fsw_posix_volume *vol, char *path, int level)
 {
     struct fsw_posix_dir *dir;
@@ -62,9 +66,11 @@ static int listdir(struct fsw_posix_volume *vol, char *path, int level)
         return 1;
     }
     while ((dent = fsw_posix_readdir(dir)) != NULL) {
-        for (i = 0; i < level*2; i++)
-            fputc(' ', stdout);
-        printf("%d  %s\n", dent->d_type, dent->d_name);
+        if (!quiet) {
+            for (i = 0; i < level*2; i++)
+                fputc(' ', stdout);
+            printf("%d  %s\n", dent->d_type, dent->d_name);
+        }
 
         if (dent->d_type == DT_DIR) {
             snprintf(subpath, 4095, "%s%s/", path, dent->d_name);
@@ -100,13 +106,71 @@ static int catfile(struct fsw_posix_volume *vol, char *path)
     return 0;
 }
 
+static int readfile(struct fsw_posix_volume *vol, char *path, int chunk)
+{
+    struct fsw_posix_file *file;
+    char *buf;
+
+    file = fsw_posix_open(vol, path, 0, 0);
+    if (file == NULL) {
+        printf("open(%s) call failed.\n", path);
+        return 1;
+    }
+    buf = malloc(chunk);
+    while (fsw_posix_read(file, buf, chunk) > 0)
+        ;
+    free(buf);
+    fsw_posix_close(file);
+
+    return 0;
+}
+
+/**
+ * Benchmark: list the tree under path (ending with '/') or read the file
+ * at path in chunks passes times, and report time and number of blocks
+ * and requests read from the device for each pass.
+ */
+
+static int benchmark(struct fsw_posix_volume *vol, char *path, int passes, int chunk)
+{
+    struct timeval start, end;
+    fsw_u32 reads, requests;
+    int i, r;
+
+    quiet = 1;
+    for (i = 0; i < passes; i++) {
+        reads = vol->read_count;
+        requests = vol->request_count;
+        gettimeofday(&start, NULL);
+        if (path[strlen(path) - 1] == '/')
+            r = listdir(vol, path, 0);
+        else
+            r = readfile(vol, path, chunk);
+        if (r)
+            return 1;
+        gettimeofday(&end, NULL);
+        printf("pass %d: %ld ms, %lu blocks in %lu requests, %lu cache entries\n", i + 1,
+               (long)((end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000),
+               (unsigned long)(vol->read_count - reads), (unsigned long)(vol->request_count - requests),
+               (unsigned long)vol->vol->bcache_used);
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     struct fsw_posix_volume *vol;
     int i;
+    int bench = 0;
 
-    if (argc != 2) {
-        printf("Usage: lslr <file/device>\n");
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+        bench = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 2 || (!bench && argc != 2) || argc > 5) {
+        printf("Usage: lslr <file/device>\n"
+               "       lslr -b <file/device> [path] [passes] [chunk]\n");
         return 1;
     }
 
@@ -122,6 +186,13 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (bench) {
+        i = benchmark(vol, argc > 2 ? argv[2] : "/", argc > 3 ? atoi(argv[3]) : 3,
+                      argc > 4 ? atoi(argv[4]) : 65536);
+        fsw_posix_unmount(vol);
+        return i;
+    }
+
     //listdir(vol, "/System/Library/Extensions/udf.kext/", 0);
     //listdir(vol, "/System/Library/Extensions/AppleACPIPlatform.kext/", 0);
     //listdir(vol, "/System/Library/Extensions/", 0);
@@ -157,14 +157,269 @@ BOOLEAN IsXsdtEntryMerged(UINT32 Index)
   return 0 != XsdtReplaceSizes[Index];
 }
 
+//
+// Catalogs of the XSDT and RSDT entries. PatchACPI() builds them once the
+// tables are final, then tables are found through hash chains by signature
+// and by signature and OEM table id instead of scans of the whole table.
+// Drops only clear entries, the tables are compacted once by
+// PostCleanupRSDT() and PostCleanupXSDT() and the catalogs end there.
+// Whoever writes an entry meanwhile calls AcpiCatalogUpdate().
+//
+#define ACPI_CATALOG_MAX_ENTRIES  512 // the XSDT is reallocated to one page
+#define ACPI_CATALOG_BUCKETS      64
+
+typedef struct {
+  UINT32  Signature;
+  UINT64  TableId;
+  INT32   SigNext;  // next entry of the signature bucket, in table order
+  INT32   IdNext;   // next entry of the signature+table id bucket, in table order
+} ACPI_CATALOG_ENTRY;
+
+typedef struct {
+  ACPI_CATALOG_ENTRY  Entry[ACPI_CATALOG_MAX_ENTRIES];
+  INT32               Sig[ACPI_CATALOG_BUCKETS];
+  INT32               Id[ACPI_CATALOG_BUCKETS];
+  UINT32              Count;
+  BOOLEAN             Active;
+  BOOLEAN             IsRsdt;   // entries are the 32-bit ones of the RSDT
+} ACPI_CATALOG;
+
+STATIC ACPI_CATALOG       mXsdtCatalog;
+STATIC ACPI_CATALOG       mRsdtCatalog;
+
+// ACPI/patched file names, open addressing
+STATIC ACPI_PATCHED_AML   **mPatchedAmlIndex = NULL;
+STATIC UINTN              mPatchedAmlSlots = 0;
+
+STATIC UINTN AcpiCatalogHash(UINT32 Signature, UINT64 TableId, BOOLEAN WithId)
+{
+  UINT32  Hash = 2166136261u;
+  UINTN   i;
+
+  for (i = 0; i < 4; i++) {
+    Hash = (Hash ^ (UINT8)(Signature >> (i * 8))) * 16777619u;
+  }
+  for (i = 0; WithId && i < 8; i++) {
+    Hash = (Hash ^ (UINT8)RShiftU64(TableId, i * 8)) * 16777619u;
+  }
+  return Hash % ACPI_CATALOG_BUCKETS;
+}
+
+STATIC EFI_ACPI_DESCRIPTION_HEADER* AcpiCatalogTable(ACPI_CATALOG *Catalog, UINT32 Index)
+{
+  if (Catalog->IsRsdt) {
+    return RsdtEntryFromIndex(Index);
+  }
+  return XsdtEntryFromIndex(Index);
+}
+
+STATIC VOID AcpiCatalogLink(ACPI_CATALOG *Catalog, UINT32 Index)
+{
+  ACPI_CATALOG_ENTRY  *Entry = &Catalog->Entry[Index];
+  INT32               *Link;
+
+  // keep table order - MatchIndex of ScanXSDT2() counts in it
+  Link = &Catalog->Sig[AcpiCatalogHash(Entry->Signature, 0, FALSE)];
+  while (*Link >= 0 && *Link < (INT32)Index) {
+    Link = &Catalog->Entry[*Link].SigNext;
+  }
+  Entry->SigNext = *Link;
+  *Link = (INT32)Index;
+
+  Link = &Catalog->Id[AcpiCatalogHash(Entry->Signature, Entry->TableId, TRUE)];
+  while (*Link >= 0 && *Link < (INT32)Index) {
+    Link = &Catalog->Entry[*Link].IdNext;
+  }
+  Entry->IdNext = *Link;
+  *Link = (INT32)Index;
+}
+
+STATIC VOID AcpiCatalogUnlink(ACPI_CATALOG *Catalog, UINT32 Index)
+{
+  ACPI_CATALOG_ENTRY  *Entry = &Catalog->Entry[Index];
+  INT32               *Link;
+
+  Link = &Catalog->Sig[AcpiCatalogHash(Entry->Signature, 0, FALSE)];
+  while (*Link >= 0 && *Link != (INT32)Index) {
+    Link = &Catalog->Entry[*Link].SigNext;
+  }
+  if (*Link >= 0) {
+    *Link = Entry->SigNext;
+  }
+
+  Link = &Catalog->Id[AcpiCatalogHash(Entry->Signature, Entry->TableId, TRUE)];
+  while (*Link >= 0 && *Link != (INT32)Index) {
+    Link = &Catalog->Entry[*Link].IdNext;
+  }
+  if (*Link >= 0) {
+    *Link = Entry->IdNext;
+  }
+}
+
+//
+// Takes the table now at Index of the XSDT or RSDT into its catalog, after
+// the entry was written or appended
+//
+STATIC VOID AcpiCatalogUpdate(ACPI_CATALOG *Catalog, UINT32 Index)
+{
+  EFI_ACPI_DESCRIPTION_HEADER *Table;
+
+  if (!Catalog->Active) {
+    return;
+  }
+  if (Index >= ACPI_CATALOG_MAX_ENTRIES) {
+    // lookups go back to scanning the table
+    DBG("ACPI catalog full at %a entry %d\n", Catalog->IsRsdt ? "RSDT" : "XSDT", Index);
+    Catalog->Active = FALSE;
+    return;
+  }
+  if (Index < Catalog->Count) {
+    AcpiCatalogUnlink(Catalog, Index);
+  } else {
+    Catalog->Count = Index + 1;
+  }
+  Table = AcpiCatalogTable(Catalog, Index);
+  if (Table) {
+    Catalog->Entry[Index].Signature = Table->Signature;
+    Catalog->Entry[Index].TableId = Table->OemTableId;
+    AcpiCatalogLink(Catalog, Index);
+  }
+}
+
+STATIC VOID AcpiCatalogInit(ACPI_CATALOG *Catalog, BOOLEAN IsRsdt, UINT32 Count)
+{
+  UINT32 Index;
+
+  Catalog->Active = FALSE;
+  Catalog->IsRsdt = IsRsdt;
+  Catalog->Count = 0;
+  for (Index = 0; Index < ACPI_CATALOG_BUCKETS; Index++) {
+    Catalog->Sig[Index] = -1;
+    Catalog->Id[Index] = -1;
+  }
+  if (Count <= ACPI_CATALOG_MAX_ENTRIES) {
+    Catalog->Active = TRUE;
+    for (Index = 0; Index < Count; Index++) {
+      AcpiCatalogUpdate(Catalog, Index);
+    }
+  }
+  DBG("ACPI catalog: %d %a entries%a\n", Count, IsRsdt ? "RSDT" : "XSDT", Catalog->Active ? "" : ", too many - not used");
+}
+
+STATIC UINT32 PatchedAmlHash(CHAR16 *FileName)
+{
+  UINT32  Hash = 2166136261u;
+  CHAR16  Char;
+
+  for (; *FileName != 0; FileName++) {
+    Char = *FileName;
+    if (Char >= L'a' && Char <= L'z') {
+      Char -= L'a' - L'A';
+    }
+    Hash = (Hash ^ (UINT8)Char) * 16777619u;
+    Hash = (Hash ^ (UINT8)(Char >> 8)) * 16777619u;
+  }
+  return Hash;
+}
+
+/** Returns the ACPIPatchedAML entry of FileName, compared case-insensitively, or NULL. */
+STATIC ACPI_PATCHED_AML* FindPatchedAml(CHAR16 *FileName)
+{
+  ACPI_PATCHED_AML  *Aml;
+  UINTN             Slot;
+
+  if (mPatchedAmlIndex == NULL) {
+    for (Aml = ACPIPatchedAML; Aml; Aml = Aml->Next) {
+      if (0 == StriCmp(Aml->FileName, FileName)) {
+        return Aml;
+      }
+    }
+    return NULL;
+  }
+  Slot = PatchedAmlHash(FileName) & (mPatchedAmlSlots - 1);
+  while ((Aml = mPatchedAmlIndex[Slot]) != NULL) {
+    if (0 == StriCmp(Aml->FileName, FileName)) {
+      return Aml;
+    }
+    Slot = (Slot + 1) & (mPatchedAmlSlots - 1);
+  }
+  return NULL;
+}
+
+//
+// Builds the catalogs from the XSDT and RSDT and indexes the ACPI/patched file names
+//
+STATIC VOID AcpiCatalogBuild(VOID)
+{
+  ACPI_PATCHED_AML  *Aml;
+  UINT32            Count;
+  UINTN             Slot;
+
+  mXsdtCatalog.Active = FALSE;
+  mRsdtCatalog.Active = FALSE;
+  if (Xsdt) {
+    AcpiCatalogInit(&mXsdtCatalog, FALSE, XsdtTableCount());
+  }
+  if (Rsdt) {
+    AcpiCatalogInit(&mRsdtCatalog, TRUE, RsdtTableCount());
+  }
+
+  Count = 0;
+  for (Aml = ACPIPatchedAML; Aml; Aml = Aml->Next) {
+    Count++;
+  }
+  for (mPatchedAmlSlots = 16; mPatchedAmlSlots < Count * 2; mPatchedAmlSlots *= 2);
+  mPatchedAmlIndex = AllocateZeroPool(mPatchedAmlSlots * sizeof(*mPatchedAmlIndex));
+  if (mPatchedAmlIndex == NULL) {
+    return;
+  }
+  for (Aml = ACPIPatchedAML; Aml; Aml = Aml->Next) {
+    Slot = PatchedAmlHash(Aml->FileName) & (mPatchedAmlSlots - 1);
+    while (mPatchedAmlIndex[Slot] != NULL && StriCmp(mPatchedAmlIndex[Slot]->FileName, Aml->FileName) != 0) {
+      Slot = (Slot + 1) & (mPatchedAmlSlots - 1);
+    }
+    // the first of equal names wins, as in the list
+    if (mPatchedAmlIndex[Slot] == NULL) {
+      mPatchedAmlIndex[Slot] = Aml;
+    }
+  }
+}
+
+STATIC VOID AcpiCatalogFree(VOID)
+{
+  mXsdtCatalog.Active = FALSE;
+  mRsdtCatalog.Active = FALSE;
+  if (mPatchedAmlIndex) {
+    FreePool(mPatchedAmlIndex);
+    mPatchedAmlIndex = NULL;
+  }
+  mPatchedAmlSlots = 0;
+}
+
 UINT32* ScanRSDT2(UINT32 Signature, UINT64 TableId, UINTN MatchIndex)
 {
   if (!Rsdt || (0 == Signature && 0 == TableId)) {
     return NULL;
   }
 
-  UINT32 Count = RsdtTableCount();
   UINTN MatchingCount = 0;
+  if (mRsdtCatalog.Active && 0 != Signature) {
+    // same walk over the catalog chain, entries are checked against the RSDT as it is now
+    INT32 Index;
+    EFI_ACPI_DESCRIPTION_HEADER* Table;
+    for (Index = mRsdtCatalog.Sig[AcpiCatalogHash(Signature, 0, FALSE)]; Index >= 0; Index = mRsdtCatalog.Entry[Index].SigNext) {
+      Table = RsdtEntryFromIndex(Index);
+      if (Table && Table->Signature == Signature) {
+        if ((0 == TableId || Table->OemTableId == TableId) && (IGNORE_INDEX == MatchIndex || MatchingCount == MatchIndex)) {
+          return RsdtEntryPtrFromIndex(Index);
+        }
+        ++MatchingCount;
+      }
+    }
+    return NULL;
+  }
+
+  UINT32 Count = RsdtTableCount();
   UINT32* Ptr = RsdtEntryPtrFromIndex(0);
   UINT32* EndPtr = RsdtEntryPtrFromIndex(Count);
   for (; Ptr < EndPtr; Ptr++) {
@@ -195,8 +450,33 @@ UINT64* ScanXSDT2(UINT32 Signature, UINT64 TableId, UINTN MatchIndex)
     return NULL;
   }
 
-  UINT32 Count = XsdtTableCount();
   UINTN MatchingCount = 0;
+  if (mXsdtCatalog.Active && 0 != Signature) {
+    // same walk over the catalog chain, entries are checked against the XSDT as it is now
+    INT32 Index;
+    EFI_ACPI_DESCRIPTION_HEADER* Table;
+    if (0 != TableId && IGNORE_INDEX == MatchIndex) {
+      for (Index = mXsdtCatalog.Id[AcpiCatalogHash(Signature, TableId, TRUE)]; Index >= 0; Index = mXsdtCatalog.Entry[Index].IdNext) {
+        Table = XsdtEntryFromIndex(Index);
+        if (Table && Table->Signature == Signature && Table->OemTableId == TableId) {
+          return XsdtEntryPtrFromIndex(Index);
+        }
+      }
+      return NULL;
+    }
+    for (Index = mXsdtCatalog.Sig[AcpiCatalogHash(Signature, 0, FALSE)]; Index >= 0; Index = mXsdtCatalog.Entry[Index].SigNext) {
+      Table = XsdtEntryFromIndex(Index);
+      if (Table && Table->Signature == Signature) {
+        if ((0 == TableId || Table->OemTableId == TableId) && (IGNORE_INDEX == MatchIndex || MatchingCount == MatchIndex)) {
+          return XsdtEntryPtrFromIndex(Index);
+        }
+        ++MatchingCount;
+      }
+    }
+    return NULL;
+  }
+
+  UINT32 Count = XsdtTableCount();
   UINT64* Ptr = XsdtEntryPtrFromIndex(0);
   UINT64* EndPtr = XsdtEntryPtrFromIndex(Count);
   for (; Ptr < EndPtr; Ptr++) {
@@ -279,6 +559,33 @@ VOID GetAcpiTablesList()
 }
 
 
+STATIC VOID DropRsdtEntry(UINT32* Ptr, UINT32 Signature, UINT64 TableId, UINT32 Length)
+{
+  EFI_ACPI_DESCRIPTION_HEADER* Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)*Ptr;
+  if (!Table) {
+    // skip NULL entry
+    return;
+  }
+  CHAR8 sign[5], OTID[9];
+  sign[4] = 0;
+  OTID[8] = 0;
+  CopyMem(&sign, &Table->Signature, 4);
+  CopyMem(&OTID, &Table->OemTableId, 8);
+  //DBG(" Found table: %a  %a\n", sign, OTID);
+  if (!((Signature && Table->Signature == Signature) &&
+        (!TableId || Table->OemTableId == TableId) &&
+        (!Length || Table->Length == Length))) {
+    return;
+  }
+  if (IsXsdtEntryMerged(IndexFromXsdtEntryPtr(Ptr))) {
+    DBG(" attempt to drop already merged table[%d]: %a  %a  %d ignored\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
+    return;
+  }
+  // drop matching table by simply replacing entry with NULL
+  *Ptr = 0;
+  DBG(" Table[%d]: %a  %a  %d dropped\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
+}
+
 void DropTableFromRSDT(UINT32 Signature, UINT64 TableId, UINT32 Length)
 {
   if (!Rsdt || (0 == Signature && 0 == TableId)) {
@@ -292,32 +599,54 @@ void DropTableFromRSDT(UINT32 Signature, UINT64 TableId, UINT32 Length)
   CopyMem(OTID, &TableId, 8);
   DBG("Drop tables from RSDT, SIGN=%a TableID=%a Length=%d\n", sign, OTID, (INT32)Length);
 
+  if (mRsdtCatalog.Active && Signature) {
+    INT32 Index;
+    if (TableId) {
+      for (Index = mRsdtCatalog.Id[AcpiCatalogHash(Signature, TableId, TRUE)]; Index >= 0; Index = mRsdtCatalog.Entry[Index].IdNext) {
+        DropRsdtEntry(RsdtEntryPtrFromIndex(Index), Signature, TableId, Length);
+      }
+    } else {
+      for (Index = mRsdtCatalog.Sig[AcpiCatalogHash(Signature, 0, FALSE)]; Index >= 0; Index = mRsdtCatalog.Entry[Index].SigNext) {
+        DropRsdtEntry(RsdtEntryPtrFromIndex(Index), Signature, TableId, Length);
+      }
+    }
+    return;
+  }
+
   UINT32 Count = RsdtTableCount();
   //DBG(" Rsdt has tables count=%d\n", Count);
   UINT32* Ptr = RsdtEntryPtrFromIndex(0);
   UINT32* EndPtr = RsdtEntryPtrFromIndex(Count);
   for (; Ptr < EndPtr; Ptr++) {
-    EFI_ACPI_DESCRIPTION_HEADER* Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)*Ptr;
-    if (!Table) {
-      // skip NULL entry
-      continue;
-    }
-    CopyMem(&sign, &Table->Signature, 4);
-    CopyMem(&OTID, &Table->OemTableId, 8);
-    //DBG(" Found table: %a  %a\n", sign, OTID);
-    if (!((Signature && Table->Signature == Signature) &&
-          (!TableId || Table->OemTableId == TableId) &&
-          (!Length || Table->Length == Length))) {
-      continue;
-    }
-    if (IsXsdtEntryMerged(IndexFromXsdtEntryPtr(Ptr))) {
-      DBG(" attempt to drop already merged table[%d]: %a  %a  %d ignored\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
-      continue;
-    }
-    // drop matching table by simply replacing entry with NULL
-    *Ptr = 0;
-    DBG(" Table[%d]: %a  %a  %d dropped\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
+    DropRsdtEntry(Ptr, Signature, TableId, Length);
+  }
+}
+
+STATIC VOID DropXsdtEntry(UINT64* Ptr, UINT32 Signature, UINT64 TableId, UINT32 Length)
+{
+  EFI_ACPI_DESCRIPTION_HEADER* Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)ReadUnaligned64(Ptr);
+  if (!Table) {
+    // skip NULL entry
+    return;
+  }
+  CHAR8 sign[5], OTID[9];
+  sign[4] = 0;
+  OTID[8] = 0;
+  CopyMem(&sign, &Table->Signature, 4);
+  CopyMem(&OTID, &Table->OemTableId, 8);
+  //DBG(" Found table: %a  %a\n", sign, OTID);
+  if (!((Signature && Table->Signature == Signature) &&
+        (!TableId || Table->OemTableId == TableId) &&
+        (!Length || Table->Length == Length))) {
+    return;
   }
+  if (IsXsdtEntryMerged(IndexFromXsdtEntryPtr(Ptr))) {
+    DBG(" attempt to drop already merged table[%d]: %a  %a  %d ignored\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
+    return;
+  }
+  // drop matching table by simply replacing entry with NULL
+  WriteUnaligned64(Ptr, 0);
+  DBG(" Table[%d]: %a  %a  %d dropped\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
 }
 
 void DropTableFromXSDT(UINT32 Signature, UINT64 TableId, UINT32 Length)
@@ -333,31 +662,26 @@ void DropTableFromXSDT(UINT32 Signature, UINT64 TableId, UINT32 Length)
   CopyMem(OTID, &TableId, 8);
   DBG("Drop tables from XSDT, SIGN=%a TableID=%a Length=%d\n", sign, OTID, (INT32)Length);
 
+  if (mXsdtCatalog.Active && Signature) {
+    INT32 Index;
+    if (TableId) {
+      for (Index = mXsdtCatalog.Id[AcpiCatalogHash(Signature, TableId, TRUE)]; Index >= 0; Index = mXsdtCatalog.Entry[Index].IdNext) {
+        DropXsdtEntry(XsdtEntryPtrFromIndex(Index), Signature, TableId, Length);
+      }
+    } else {
+      for (Index = mXsdtCatalog.Sig[AcpiCatalogHash(Signature, 0, FALSE)]; Index >= 0; Index = mXsdtCatalog.Entry[Index].SigNext) {
+        DropXsdtEntry(XsdtEntryPtrFromIndex(Index), Signature, TableId, Length);
+      }
+    }
+    return;
+  }
+
   UINT32 Count = XsdtTableCount();
   //DBG(" Xsdt has tables count=%d\n", Count);
   UINT64* Ptr = XsdtEntryPtrFromIndex(0);
   UINT64* EndPtr = XsdtEntryPtrFromIndex(Count);
   for (; Ptr < EndPtr; Ptr++) {
-    EFI_ACPI_DESCRIPTION_HEADER* Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)ReadUnaligned64(Ptr);
-    if (!Table) {
-      // skip NULL entry
-      continue;
-    }
-    CopyMem(&sign, &Table->Signature, 4);
-    CopyMem(&OTID, &Table->OemTableId, 8);
-    //DBG(" Found table: %a  %a\n", sign, OTID);
-    if (!((Signature && Table->Signature == Signature) &&
-          (!TableId || Table->OemTableId == TableId) &&
-          (!Length || Table->Length == Length))) {
-      continue;
-    }
-    if (IsXsdtEntryMerged(IndexFromXsdtEntryPtr(Ptr))) {
-      DBG(" attempt to drop already merged table[%d]: %a  %a  %d ignored\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
-      continue;
-    }
-    // drop matching table by simply replacing entry with NULL
-    WriteUnaligned64(Ptr, 0);
-    DBG(" Table[%d]: %a  %a  %d dropped\n", IndexFromXsdtEntryPtr(Ptr), sign, OTID, (INT32)Table->Length);
+    DropXsdtEntry(Ptr, Signature, TableId, Length);
   }
 }
 
@@ -398,6 +722,10 @@ VOID PatchAllTables()
   UINT32 Count = XsdtTableCount();
   UINT64* Ptr = XsdtEntryPtrFromIndex(0);
   UINT64* EndPtr = XsdtEntryPtrFromIndex(Count);
+  ACPI_PATCH_LIST Patches;
+
+  // built once, the same patches go to every SSDT
+  InitAcpiPatches(&Patches, FALSE);
   for (; Ptr < EndPtr; Ptr++) {
     BOOLEAN Patched = FALSE;
     EFI_ACPI_DESCRIPTION_HEADER* Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)ReadUnaligned64(Ptr);
@@ -433,26 +761,12 @@ VOID PatchAllTables()
     if (NewTable->Signature == EFI_ACPI_4_0_SECONDARY_SYSTEM_DESCRIPTION_TABLE_SIGNATURE) {
       if (gSettings.PatchDsdtNum > 0) {
         //DBG("Patching SSDT:\n");
-        UINT32 i;
     CHAR8  OTID[9];
     OTID[8] = 0;
     CopyMem(OTID, &NewTable->OemTableId, 8);
     DBG("Patching SSDT %a Length=%d\n",  OTID, (INT32)Len);
 
-        for (i = 0; i < gSettings.PatchDsdtNum; i++) {
-          if (!gSettings.PatchDsdtFind[i] || !gSettings.LenToFind[i]) {
-            continue;
-          }
-          DBG("%d. [%a]:", i, gSettings.PatchDsdtLabel[i]);
-          if (!gSettings.PatchDsdtMenuItem[i].BValue) {
-            DBG(" disabled\n");
-            continue;
-          }
-          Len = FixAny((UINT8*)NewTable, Len,
-                       gSettings.PatchDsdtFind[i], gSettings.LenToFind[i],
-                       gSettings.PatchDsdtReplace[i], gSettings.LenToReplace[i]);
-          //DBG(" OK\n");
-        }
+        Len = ApplyAcpiPatches(&Patches, (UINT8*)NewTable, Len);
       }
       // fixup length and checksum
       NewTable->Length = Len;
@@ -467,12 +781,14 @@ VOID PatchAllTables()
     }
     if (Patched) {
       WriteUnaligned64(Ptr, BufferPtr);
+      AcpiCatalogUpdate(&mXsdtCatalog, IndexFromXsdtEntryPtr(Ptr));
       FixChecksum(NewTable);
     }
     else {
       gBS->FreePages(BufferPtr, EFI_SIZE_TO_PAGES(Len + 4096));
     }
   }
+  FreeAcpiPatches(&Patches);
 }
 
 EFI_STATUS InsertTable(VOID* TableEntry, UINTN Length)
@@ -502,6 +818,7 @@ EFI_STATUS InsertTable(VOID* TableEntry, UINTN Length)
       UINT32* Ptr = RsdtEntryPtrFromIndex(RsdtTableCount());
       *Ptr = (UINT32)(UINTN)BufferPtr;
       Rsdt->Header.Length += sizeof(UINT32);
+      AcpiCatalogUpdate(&mRsdtCatalog, IndexFromRsdtEntryPtr(Ptr));
       //DBG("Rsdt->Length = %d\n", Rsdt->Header.Length);
     }
     //insert into XSDT
@@ -509,6 +826,7 @@ EFI_STATUS InsertTable(VOID* TableEntry, UINTN Length)
       UINT64* Ptr = XsdtEntryPtrFromIndex(XsdtTableCount());
       WriteUnaligned64(Ptr, BufferPtr);
       Xsdt->Header.Length += sizeof(UINT64);
+      AcpiCatalogUpdate(&mXsdtCatalog, IndexFromXsdtEntryPtr(Ptr));
       //DBG("Xsdt->Length = %d\n", Xsdt->Header.Length);
     }
   }
@@ -597,11 +915,13 @@ EFI_STATUS ReplaceOrInsertTable(VOID* TableEntry, UINTN Length, UINTN MatchIndex
         // keep track of new table size in case it needs to be freed later
         SaveMergedXsdtEntrySize(Index, Length);
         WriteUnaligned64(Ptr, BufferPtr);
+        AcpiCatalogUpdate(&mXsdtCatalog, Index);
         Status = EFI_SUCCESS;
       } else if (AUTOMERGE_PASS2 == Pass) {
         Ptr = XsdtEntryPtrFromIndex(XsdtTableCount());
         WriteUnaligned64(Ptr, BufferPtr);
         Xsdt->Header.Length += sizeof(UINT64);
+        AcpiCatalogUpdate(&mXsdtCatalog, IndexFromXsdtEntryPtr(Ptr));
         //DBG("Xsdt->Length = %d\n", Xsdt->Header.Length);
         Status = EFI_SUCCESS;
       }
@@ -750,31 +1070,43 @@ EFI_STATUS SaveBufferToDisk(VOID *Buffer, UINTN Length, CHAR16 *DirName, CHAR16
 }
 
 //
-// Remembering saved tables
+// Remembering saved tables, a set of table addresses with open addressing
 //
 #define SAVED_TABLES_ALLOC_ENTRIES  64
 VOID   **mSavedTables = NULL;
 UINTN   mSavedTablesEntries = 0;
 UINTN   mSavedTablesNum = 0;
 
+STATIC UINTN SavedTableSlot(VOID **Tables, UINTN Entries, VOID *TableEntry)
+{
+  UINTN Slot = (UINTN)(((UINT64)(UINTN)TableEntry >> 4) * 2654435761u) & (Entries - 1);
+
+  while (Tables[Slot] != NULL && Tables[Slot] != TableEntry) {
+    Slot = (Slot + 1) & (Entries - 1);
+  }
+  return Slot;
+}
+
 /** Returns TRUE is TableEntry is already saved. */
 BOOLEAN IsTableSaved(VOID *TableEntry)
 {
-  UINTN   Index;
-
-  if (mSavedTables != NULL) {
-    for (Index = 0; Index < mSavedTablesNum; Index++) {
-      if (mSavedTables[Index] == TableEntry) {
-        return TRUE;
-      }
-    }
+  if (mSavedTables == NULL || TableEntry == NULL) {
+    return FALSE;
   }
-  return FALSE;
+  return mSavedTables[SavedTableSlot(mSavedTables, mSavedTablesEntries, TableEntry)] == TableEntry;
 }
 
 /** Adds TableEntry to mSavedTables if not already there. */
 VOID MarkTableAsSaved(VOID *TableEntry)
 {
+  VOID    **Tables;
+  UINTN   Entries;
+  UINTN   Index;
+
+  if (TableEntry == NULL) {
+    return;
+  }
+
   //
   // If mSavedTables does not exists yet - allocate it
   //
@@ -792,35 +1124,40 @@ VOID MarkTableAsSaved(VOID *TableEntry)
   // If TableEntry is not in mSavedTables - add it
   //
   //DBG(" MarkTableAsSaved %p", TableEntry);
-  if (IsTableSaved(TableEntry)) {
+  Index = SavedTableSlot(mSavedTables, mSavedTablesEntries, TableEntry);
+  if (mSavedTables[Index] == TableEntry) {
     // already saved
     //DBG(" - already saved\n");
     return;
   }
 
   //
-  // If mSavedTables is full - extend it
+  // If mSavedTables is half full - double it and take the tables over
   //
-  if (mSavedTablesNum + 1 >= mSavedTablesEntries) {
-    // not enough space
+  if ((mSavedTablesNum + 1) * 2 > mSavedTablesEntries) {
     //DBG(" - extending mSavedTables from %d", mSavedTablesEntries);
-    mSavedTables = ReallocatePool(
-                                  sizeof(*mSavedTables) * mSavedTablesEntries,
-                                  sizeof(*mSavedTables) * (mSavedTablesEntries + SAVED_TABLES_ALLOC_ENTRIES),
-                                  mSavedTables
-                                  );
-    if (mSavedTables == NULL) {
+    Entries = mSavedTablesEntries * 2;
+    Tables = AllocateZeroPool(sizeof(*Tables) * Entries);
+    if (Tables == NULL) {
       return;
     }
-    mSavedTablesEntries = mSavedTablesEntries + SAVED_TABLES_ALLOC_ENTRIES;
+    for (Index = 0; Index < mSavedTablesEntries; Index++) {
+      if (mSavedTables[Index] != NULL) {
+        Tables[SavedTableSlot(Tables, Entries, mSavedTables[Index])] = mSavedTables[Index];
+      }
+    }
+    FreePool(mSavedTables);
+    mSavedTables = Tables;
+    mSavedTablesEntries = Entries;
+    Index = SavedTableSlot(mSavedTables, mSavedTablesEntries, TableEntry);
     //DBG(" to %d", mSavedTablesEntries);
   }
 
   //
   // Add TableEntry to mSavedTables
   //
-  mSavedTables[mSavedTablesNum] = TableEntry;
-  //DBG(" - added to index %d\n", mSavedTablesNum);
+  mSavedTables[Index] = TableEntry;
+  //DBG(" - added to index %d\n", Index);
   mSavedTablesNum++;
 }
 
@@ -1638,25 +1975,16 @@ void LoadAllPatchedAML(CHAR16* AcpiOemPath, UINTN Pass)
       UINTN Index;
       DBG("Sorted\n");
       for (Index = 0; Index < gSettings.SortedACPICount; Index++) {
-        ACPI_PATCHED_AML *ACPIPatchedAMLTmp;
-        for (ACPIPatchedAMLTmp = ACPIPatchedAML; ACPIPatchedAMLTmp; ACPIPatchedAMLTmp = ACPIPatchedAMLTmp->Next) {
-          if (0 == StriCmp(ACPIPatchedAMLTmp->FileName, gSettings.SortedACPI[Index]) && ACPIPatchedAMLTmp->MenuItem.BValue) {
-            if (BVALUE_ATTEMPTED != ACPIPatchedAMLTmp->MenuItem.BValue)
-              DBG("Disabled: %s, skip\n", ACPIPatchedAMLTmp->FileName);
-            ACPIPatchedAMLTmp->MenuItem.BValue = BVALUE_ATTEMPTED;
-            break;
-          }
-        }
-        if (!ACPIPatchedAMLTmp) { // NULL when not disabled
+        ACPI_PATCHED_AML *ACPIPatchedAMLTmp = FindPatchedAml(gSettings.SortedACPI[Index]);
+        if (ACPIPatchedAMLTmp && ACPIPatchedAMLTmp->MenuItem.BValue) {
+          if (BVALUE_ATTEMPTED != ACPIPatchedAMLTmp->MenuItem.BValue)
+            DBG("Disabled: %s, skip\n", ACPIPatchedAMLTmp->FileName);
+          ACPIPatchedAMLTmp->MenuItem.BValue = BVALUE_ATTEMPTED;
+        } else {
           DBG("Inserting table[%d]:%s from %s: ", Index, gSettings.SortedACPI[Index], AcpiOemPath);
-          if (LoadPatchedAML(AcpiOemPath, gSettings.SortedACPI[Index], Pass)) {
+          if (LoadPatchedAML(AcpiOemPath, gSettings.SortedACPI[Index], Pass) && ACPIPatchedAMLTmp) {
             // avoid inserting table again on second pass
-            for (ACPI_PATCHED_AML* temp2 = ACPIPatchedAML; temp2; temp2 = temp2->Next) {
-              if (0 == StriCmp(temp2->FileName, gSettings.SortedACPI[Index])) {
-                temp2->MenuItem.BValue = BVALUE_ATTEMPTED;
-                break;
-              }
-            }
+            ACPIPatchedAMLTmp->MenuItem.BValue = BVALUE_ATTEMPTED;
           }
         }
       }
@@ -2080,6 +2408,9 @@ EFI_STATUS PatchACPI(IN REFIT_VOLUME *Volume, CHAR8 *OSVersion)
   //  as those tables may need to be freed if patched later.
   XsdtReplaceSizes = AllocateZeroPool(XsdtTableCount() * sizeof(*XsdtReplaceSizes));
 
+  // from here on tables are looked up through the catalogs, until the XSDT and RSDT are compacted
+  AcpiCatalogBuild();
+
   // Load merged ACPI files from ACPI/patched
   LoadAllPatchedAML(AcpiOemPath, AUTOMERGE_PASS1);
 
@@ -2261,6 +2592,7 @@ EFI_STATUS PatchACPI(IN REFIT_VOLUME *Volume, CHAR8 *OSVersion)
   }
 
   // remove NULL entries from RSDT and XSDT
+  AcpiCatalogFree();
   PostCleanupRSDT();
   PostCleanupXSDT();
 
@@ -0,0 +1,768 @@
+/*
+ *  AmlTree.c
+ *
+ *  Object tree of an AML table.
+ *
+ *  aml_parse_tree() walks the table once and records every Scope, Device,
+ *  Processor, PowerResource, ThermalZone and Method with its offset and
+ *  PkgLength. Devices also remember their _ADR and _HID. Fixes then delete
+ *  objects, append AML_CHUNK nodes to a body or replace bytes inside a body,
+ *  nothing is moved yet.
+ *  aml_write_tree() writes the table back in one pass: untouched objects are
+ *  copied as they are, edited ones and all their outers get new PkgLength
+ *  fields. This replaces move_data() and CorrectOuters() for such fixes.
+ *
+ *  Method, If, Else, While, Field, Buffer and Package objects are recorded
+ *  as leaves, their bodies are not parsed and are kept as they are apart
+ *  from replaced bytes. A size change inside a leaf is taken only if no
+ *  object with a PkgLength of its own (an If in a Method, say) may hold it,
+ *  as nothing would correct that PkgLength. A body holding something the
+ *  parser does not know (a method call at scope level, say) is parsed up to
+ *  that point only, the rest of it is kept as it is too.
+ *
+ */
+
+#include "AmlTree.h"
+
+#ifndef DEBUG_ALL
+#define DEBUG_AML 0
+#else
+#define DEBUG_AML DEBUG_ALL
+#endif
+
+#if DEBUG_AML == 0
+#define DBG(...)
+#else
+#define DBG(...) DebugLog(DEBUG_AML, __VA_ARGS__)
+#endif
+
+#define AML_EXT(op)           (0x5B00 | (op))
+#define AML_SCOPE_OP          0x10
+#define AML_METHOD_OP         0x14
+#define AML_DEVICE_OP         AML_EXT(0x82)
+#define AML_PROCESSOR_OP      AML_EXT(0x83)
+#define AML_POWER_RES_OP      AML_EXT(0x84)
+#define AML_THERMAL_ZONE_OP   AML_EXT(0x85)
+
+static BOOLEAN aml_is_lead_char(UINT8 c)
+{
+  return (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+// PkgLength at pos, 0 if it does not fit before end
+static UINT32 aml_read_pkg(CONST UINT8* aml, UINT32 pos, UINT32 end, UINT8* bytes)
+{
+  UINT32 count, value, i;
+
+  if (pos >= end) {
+    return 0;
+  }
+  count = aml[pos] >> 6;
+  if (pos + count >= end) {
+    return 0;
+  }
+  *bytes = (UINT8)(count + 1);
+  if (count == 0) {
+    return aml[pos] & 0x3F;
+  }
+  value = aml[pos] & 0x0F;
+  for (i = 1; i <= count; i++) {
+    value |= (UINT32)aml[pos + i] << (8 * i - 4);
+  }
+  return value;
+}
+
+// offset past the NameString at pos, 0 if there is none; name gets the last NameSeg
+static UINT32 aml_skip_name(CONST UINT8* aml, UINT32 pos, UINT32 end, CHAR8* name)
+{
+  UINT32 segs = 1;
+
+  if (pos < end && aml[pos] == '\\') {
+    pos++;
+  } else {
+    while (pos < end && aml[pos] == '^') {
+      pos++;
+    }
+  }
+  if (pos >= end) {
+    return 0;
+  }
+  if (aml[pos] == 0x00) { // NullName
+    if (name) {
+      name[0] = 0;
+    }
+    return pos + 1;
+  }
+  if (aml[pos] == 0x2E) { // DualNamePrefix
+    segs = 2;
+    pos++;
+  } else if (aml[pos] == 0x2F) { // MultiNamePrefix
+    if (pos + 1 >= end) {
+      return 0;
+    }
+    segs = aml[pos + 1];
+    pos += 2;
+  }
+  if (segs == 0 || pos + 4 * segs > end || !aml_is_lead_char(aml[pos])) {
+    return 0;
+  }
+  pos += 4 * segs;
+  if (name) {
+    CopyMem(name, aml + pos - 4, 4);
+    name[4] = 0;
+  }
+  return pos;
+}
+
+// offset past a data object or a simple TermArg at pos, 0 if it is not known;
+// value gets integer constants
+static UINT32 aml_skip_arg(CONST UINT8* aml, UINT32 pos, UINT32 end, UINT32* value)
+{
+  UINT32 size, i;
+  UINT8  bytes;
+  UINT8  op;
+
+  if (pos >= end) {
+    return 0;
+  }
+  op = aml[pos];
+  switch (op) {
+    case 0x00: // Zero
+    case 0x01: // One
+    case 0xFF: // Ones
+      if (value) {
+        *value = (op == 0xFF) ? MAX_UINT32 : op;
+      }
+      return pos + 1;
+
+    case 0x0A: // BytePrefix
+    case 0x0B: // WordPrefix
+    case 0x0C: // DWordPrefix
+    case 0x0E: // QWordPrefix
+      size = (op == 0x0A) ? 1 : (op == 0x0B) ? 2 : (op == 0x0C) ? 4 : 8;
+      if (pos + 1 + size > end) {
+        return 0;
+      }
+      if (value) {
+        *value = 0;
+        for (i = 0; i < size && i < 4; i++) {
+          *value |= (UINT32)aml[pos + 1 + i] << (8 * i);
+        }
+      }
+      return pos + 1 + size;
+
+    case 0x0D: // String
+      for (pos++; pos < end; pos++) {
+        if (aml[pos] == 0) {
+          return pos + 1;
+        }
+      }
+      return 0;
+
+    case 0x11: // Buffer
+    case 0x12: // Package
+    case 0x13: // VarPackage
+      size = aml_read_pkg(aml, pos + 1, end, &bytes);
+      if (size < bytes || pos + 1 + size > end) {
+        return 0;
+      }
+      return pos + 1 + size;
+
+    case 0x5B: // Revision
+      return (pos + 1 < end && aml[pos + 1] == 0x30) ? pos + 2 : 0;
+
+    case 0x72: // Add
+    case 0x74: // Subtract
+    case 0x77: // Multiply
+    case 0x79: // ShiftLeft
+    case 0x7A: // ShiftRight
+    case 0x7B: // And
+    case 0x7D: // Or
+      pos = aml_skip_arg(aml, pos + 1, end, NULL);
+      if (pos) {
+        pos = aml_skip_arg(aml, pos, end, NULL);
+      }
+      if (pos) {
+        pos = aml_skip_arg(aml, pos, end, NULL); // Target
+      }
+      return pos;
+
+    default:
+      if (op >= 0x60 && op <= 0x6E) { // LocalX, ArgX
+        return pos + 1;
+      }
+      // a name reference, method calls are not known here
+      return aml_skip_name(aml, pos, end, NULL);
+  }
+}
+
+static AML_OBJECT* aml_new_object(AML_TREE* tree, AML_OBJECT* parent, UINT16 op,
+                                  UINT32 start, UINT32 pkg, UINT8 bytes, UINT32 end)
+{
+  AML_OBJECT* object = (AML_OBJECT*)AllocateZeroPool(sizeof(AML_OBJECT));
+
+  if (!object) {
+    return NULL;
+  }
+  object->Op = op;
+  object->Start = start;
+  object->Pkg = pkg;
+  object->PkgBytes = bytes;
+  object->End = end;
+  object->Parent = parent;
+  if (parent->Last) {
+    parent->Last->Next = object;
+  } else {
+    parent->First = object;
+  }
+  parent->Last = object;
+  tree->LastLink->Link = object;
+  tree->LastLink = object;
+  tree->Count++;
+  return object;
+}
+
+static VOID aml_parse_body(AML_TREE* tree, AML_OBJECT* parent, UINT32 pos, UINT32 end);
+
+// offset past the term at pos, 0 if it is not known
+static UINT32 aml_parse_term(AML_TREE* tree, AML_OBJECT* parent, UINT32 pos, UINT32 end)
+{
+  CONST UINT8* aml = tree->Aml;
+  AML_OBJECT*  object;
+  UINT16       op = aml[pos];
+  UINT32       oplen = 1;
+  UINT32       size, body, next, value = 0;
+  UINT8        bytes;
+  CHAR8        name[5];
+
+  if (op == 0x5B) {
+    if (pos + 1 >= end) {
+      return 0;
+    }
+    op = AML_EXT(aml[pos + 1]);
+    oplen = 2;
+  }
+
+  switch (op) {
+    case AML_SCOPE_OP:
+    case AML_METHOD_OP:
+    case AML_DEVICE_OP:
+    case AML_PROCESSOR_OP:
+    case AML_POWER_RES_OP:
+    case AML_THERMAL_ZONE_OP:
+      size = aml_read_pkg(aml, pos + oplen, end, &bytes);
+      next = pos + oplen + size;
+      if (size < bytes || next > end) {
+        return 0;
+      }
+      object = aml_new_object(tree, parent, op, pos, pos + oplen, bytes, next);
+      if (!object) {
+        return 0;
+      }
+      body = aml_skip_name(aml, pos + oplen + bytes, next, object->Name);
+      if (!body || op == AML_METHOD_OP) {
+        object->Leaf = TRUE;
+        return next;
+      }
+      if (op == AML_PROCESSOR_OP) {
+        body += 6; // ProcID, PblkAddr, PblkLen
+      } else if (op == AML_POWER_RES_OP) {
+        body += 3; // SystemLevel, ResourceOrder
+      }
+      if (body <= next) {
+        aml_parse_body(tree, object, body, next);
+      }
+      return next;
+
+    case 0xA0:          // If
+    case 0xA1:          // Else
+    case 0xA2:          // While
+    case AML_EXT(0x81): // Field
+    case AML_EXT(0x86): // IndexField
+    case AML_EXT(0x87): // BankField
+      size = aml_read_pkg(aml, pos + oplen, end, &bytes);
+      next = pos + oplen + size;
+      if (size < bytes || next > end) {
+        return 0;
+      }
+      object = aml_new_object(tree, parent, op, pos, pos + oplen, bytes, next);
+      if (!object) {
+        return 0;
+      }
+      object->Leaf = TRUE;
+      return next;
+
+    case 0x08: // Name
+      body = aml_skip_name(aml, pos + 1, end, name);
+      next = body ? aml_skip_arg(aml, body, end, &value) : 0;
+      if (next && aml[body] >= 0x11 && aml[body] <= 0x13) { // Buffer, Package, VarPackage
+        size = aml_read_pkg(aml, body + 1, next, &bytes);
+        object = aml_new_object(tree, parent, aml[body], body, body + 1, bytes, next);
+        if (!object) {
+          return 0;
+        }
+        object->Leaf = TRUE;
+      }
+      if (next && parent->Op == AML_DEVICE_OP) {
+        // the forms CmpAdr() and CmpPNP() accept
+        if (AsciiStrCmp(name, "_ADR") == 0 && (aml[body] <= 0x01 || (aml[body] >= 0x0A && aml[body] <= 0x0C))) {
+          parent->HasAdr = TRUE;
+          parent->Adr = value;
+        } else if (AsciiStrCmp(name, "_HID") == 0 && aml[body] == 0x0C) {
+          parent->Hid = value;
+        }
+      }
+      return next;
+
+    case 0x06: // Alias
+      next = aml_skip_name(aml, pos + 1, end, NULL);
+      return next ? aml_skip_name(aml, next, end, NULL) : 0;
+
+    case 0x15: // External
+      next = aml_skip_name(aml, pos + 1, end, NULL);
+      return (next && next + 2 <= end) ? next + 2 : 0;
+
+    case AML_EXT(0x01): // Mutex
+      next = aml_skip_name(aml, pos + 2, end, NULL);
+      return (next && next + 1 <= end) ? next + 1 : 0;
+
+    case AML_EXT(0x02): // Event
+      return aml_skip_name(aml, pos + 2, end, NULL);
+
+    case AML_EXT(0x80): // OperationRegion
+      next = aml_skip_name(aml, pos + 2, end, NULL);
+      next = (next && next + 1 <= end) ? aml_skip_arg(aml, next + 1, end, NULL) : 0;
+      return next ? aml_skip_arg(aml, next, end, NULL) : 0;
+
+    case AML_EXT(0x88): // DataTableRegion
+      next = aml_skip_name(aml, pos + 2, end, NULL);
+      next = next ? aml_skip_arg(aml, next, end, NULL) : 0;
+      next = next ? aml_skip_arg(aml, next, end, NULL) : 0;
+      return next ? aml_skip_arg(aml, next, end, NULL) : 0;
+
+    case AML_EXT(0x13): // CreateField
+      next = aml_skip_arg(aml, pos + 2, end, NULL);
+      next = next ? aml_skip_arg(aml, next, end, NULL) : 0;
+      next = next ? aml_skip_arg(aml, next, end, NULL) : 0;
+      return next ? aml_skip_name(aml, next, end, NULL) : 0;
+
+    case 0x8A: // CreateDWordField
+    case 0x8B: // CreateWordField
+    case 0x8C: // CreateByteField
+    case 0x8D: // CreateBitField
+    case 0x8F: // CreateQWordField
+      next = aml_skip_arg(aml, pos + 1, end, NULL);
+      next = next ? aml_skip_arg(aml, next, end, NULL) : 0;
+      return next ? aml_skip_name(aml, next, end, NULL) : 0;
+
+    case 0xA3: // Noop
+      return pos + 1;
+
+    default:
+      return 0;
+  }
+}
+
+static VOID aml_parse_body(AML_TREE* tree, AML_OBJECT* parent, UINT32 pos, UINT32 end)
+{
+  UINT32 next;
+
+  while (pos < end) {
+    next = aml_parse_term(tree, parent, pos, end);
+    if (!next) {
+      DBG("AML tree: opcode 0x%02x at 0x%x not known, rest of %a kept as is\n", tree->Aml[pos], pos, parent->Name);
+      tree->Complete = FALSE;
+      return;
+    }
+    pos = next;
+  }
+}
+
+//
+// Parses an AML table of length bytes. The tree refers to the table, which
+// must stay in place until aml_write_tree() or aml_destroy_tree().
+//
+AML_TREE* aml_parse_tree(UINT8* aml, UINT32 length)
+{
+  AML_TREE*   tree;
+  AML_OBJECT* root;
+
+  if (!aml || length < sizeof(EFI_ACPI_DESCRIPTION_HEADER)) {
+    return NULL;
+  }
+  tree = (AML_TREE*)AllocateZeroPool(sizeof(AML_TREE));
+  root = (AML_OBJECT*)AllocateZeroPool(sizeof(AML_OBJECT));
+  if (!tree || !root) {
+    if (tree) {
+      FreePool(tree);
+    }
+    return NULL;
+  }
+  CopyMem(root->Name, aml, 4);
+  root->End = length;
+  tree->Aml = aml;
+  tree->Length = length;
+  tree->Root = root;
+  tree->LastLink = root;
+  tree->Complete = TRUE;
+  aml_parse_body(tree, root, sizeof(EFI_ACPI_DESCRIPTION_HEADER), length);
+  DBG("AML tree: %a parsed, %d objects%a\n", root->Name, tree->Count, tree->Complete ? "" : ", not complete");
+  return tree;
+}
+
+static VOID aml_free_chunk(AML_CHUNK* node)
+{
+  AML_CHUNK* child = node->First;
+  AML_CHUNK* next;
+
+  while (child) {
+    next = child->Next;
+    aml_free_chunk(child);
+    child = next;
+  }
+  if (node->Buffer) {
+    FreePool(node->Buffer);
+  }
+  FreePool(node);
+}
+
+VOID aml_destroy_tree(AML_TREE* tree)
+{
+  AML_OBJECT* object;
+  AML_OBJECT* next;
+
+  if (!tree) {
+    return;
+  }
+  for (object = tree->Root; object; object = next) {
+    next = object->Link;
+    if (object->Append) {
+      aml_free_chunk(object->Append);
+    }
+    FreePool(object);
+  }
+  if (tree->Splices) {
+    FreePool(tree->Splices);
+  }
+  FreePool(tree);
+}
+
+// TRUE if the object or one of its outers is deleted
+BOOLEAN aml_tree_is_deleted(AML_OBJECT* object)
+{
+  for (; object; object = object->Parent) {
+    if (object->Deleted) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// first device of that name in table order
+AML_OBJECT* aml_tree_find_device(AML_TREE* tree, CONST CHAR8* name)
+{
+  AML_OBJECT* object;
+
+  for (object = tree->Root; object; object = object->Link) {
+    if (object->Op == AML_DEVICE_OP && CompareMem(object->Name, name, 4) == 0 && !aml_tree_is_deleted(object)) {
+      return object;
+    }
+  }
+  return NULL;
+}
+
+// first device with Name (_ADR, adr)
+AML_OBJECT* aml_tree_find_adr(AML_TREE* tree, UINT32 adr)
+{
+  AML_OBJECT* object;
+
+  for (object = tree->Root; object; object = object->Link) {
+    if (object->Op == AML_DEVICE_OP && object->HasAdr && object->Adr == adr && !aml_tree_is_deleted(object)) {
+      return object;
+    }
+  }
+  return NULL;
+}
+
+// first device with Name (_HID, EisaId ("PNPxxxx")), pnp=0x0A03 for PNP0A03
+AML_OBJECT* aml_tree_find_pnp(AML_TREE* tree, UINT16 pnp)
+{
+  AML_OBJECT* object;
+  UINT32      hid = 0xD041 | ((UINT32)(pnp >> 8) << 16) | ((UINT32)(pnp & 0xFF) << 24);
+
+  for (object = tree->Root; object; object = object->Link) {
+    if (object->Op == AML_DEVICE_OP && object->Hid == hid && !aml_tree_is_deleted(object)) {
+      return object;
+    }
+  }
+  return NULL;
+}
+
+// innermost object holding offset, deleted ones too; the table itself if there is none
+AML_OBJECT* aml_tree_find_offset(AML_TREE* tree, UINT32 offset)
+{
+  AML_OBJECT* owner = tree->Root;
+  AML_OBJECT* child = owner->First;
+
+  while (child && offset >= child->Start) {
+    if (offset >= child->End) {
+      child = child->Next;
+      continue;
+    }
+    owner = child;
+    child = child->First;
+  }
+  return owner;
+}
+
+// object of that opcode and name right in the body of parent
+AML_OBJECT* aml_tree_find_child(AML_OBJECT* parent, UINT16 op, CONST CHAR8* name)
+{
+  AML_OBJECT* object;
+
+  for (object = parent->First; object; object = object->Next) {
+    if (object->Op == op && !object->Deleted && CompareMem(object->Name, name, 4) == 0) {
+      return object;
+    }
+  }
+  return NULL;
+}
+
+static VOID aml_mark_changed(AML_OBJECT* object)
+{
+  while (object && !object->Changed) {
+    object->Changed = TRUE;
+    object = object->Parent;
+  }
+}
+
+// node is written at the end of the body of object and freed with the tree
+VOID aml_tree_append(AML_OBJECT* object, AML_CHUNK* node)
+{
+  if (!object || !node) {
+    return;
+  }
+  if (!object->Append) {
+    object->Append = aml_create_node(NULL);
+    if (!object->Append) {
+      return;
+    }
+  }
+  aml_add_to_parent(object->Append, node);
+  aml_mark_changed(object);
+}
+
+VOID aml_tree_delete(AML_OBJECT* object)
+{
+  if (!object || !object->Parent) {
+    return;
+  }
+  object->Deleted = TRUE;
+  aml_mark_changed(object->Parent);
+}
+
+//
+// TRUE if some byte of the body of leaf before offset may start an object
+// with a PkgLength that holds offset. Bytes that only look like such an
+// object count as well, the caller then does without the tree.
+//
+static BOOLEAN aml_leaf_nests(AML_TREE* tree, AML_OBJECT* leaf, UINT32 offset)
+{
+  CONST UINT8* aml = tree->Aml;
+  UINT32       pos, oplen, size;
+  UINT8        bytes;
+
+  for (pos = leaf->Pkg + leaf->PkgBytes; pos < offset; pos++) {
+    switch (aml[pos]) {
+      case 0x10: // Scope
+      case 0x11: // Buffer
+      case 0x12: // Package
+      case 0x13: // VarPackage
+      case 0x14: // Method
+      case 0xA0: // If
+      case 0xA1: // Else
+      case 0xA2: // While
+        oplen = 1;
+        break;
+      case 0x5B: // Field, Device, Processor, PowerResource, ThermalZone, IndexField, BankField
+        if (pos + 1 >= offset || aml[pos + 1] < 0x81 || aml[pos + 1] > 0x87) {
+          continue;
+        }
+        oplen = 2;
+        break;
+      default:
+        continue;
+    }
+    size = aml_read_pkg(aml, pos + oplen, leaf->End, &bytes);
+    if (size >= bytes && pos + oplen + size > offset && pos + oplen + size <= leaf->End) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+//
+// Replaces length bytes at offset with size bytes of data, which must stay
+// valid until aml_write_tree(). Replacements come by offset and do not
+// overlap. FALSE if the bytes are not inside the body of one object, that is
+// if they touch an opcode or a PkgLength or cross the end of an object, and
+// if the size changes inside a leaf that may hold objects of its own.
+//
+BOOLEAN aml_tree_replace(AML_TREE* tree, UINT32 offset, UINT32 length, CONST UINT8* data, UINT32 size)
+{
+  AML_OBJECT* owner = tree->Root;
+  AML_OBJECT* child = owner->First;
+  AML_SPLICE* splice;
+  UINT32      end = offset + length;
+
+  if (end > tree->Length || end < offset ||
+      (tree->SpliceCount > 0 && offset < tree->Splices[tree->SpliceCount - 1].Offset + tree->Splices[tree->SpliceCount - 1].Length)) {
+    return FALSE;
+  }
+  // the innermost object holding the bytes
+  while (child && end > child->Start) {
+    if (offset >= child->End) {
+      child = child->Next;
+      continue;
+    }
+    if (offset < child->Pkg + child->PkgBytes || end > child->End) {
+      return FALSE;
+    }
+    owner = child;
+    child = child->First;
+  }
+  if (size != length && owner->Leaf && aml_leaf_nests(tree, owner, offset)) {
+    MsgLog("AML tree: 0x%x may be inside an object the tree does not hold, size change refused\n", offset);
+    return FALSE;
+  }
+
+  if (tree->SpliceCount == tree->SpliceCapacity) {
+    splice = (AML_SPLICE*)ReallocatePool(tree->SpliceCapacity * sizeof(AML_SPLICE),
+                                         (tree->SpliceCapacity + 32) * sizeof(AML_SPLICE), tree->Splices);
+    if (!splice) {
+      return FALSE;
+    }
+    tree->Splices = splice;
+    tree->SpliceCapacity += 32;
+  }
+  splice = &tree->Splices[tree->SpliceCount++];
+  splice->Offset = offset;
+  splice->Length = length;
+  splice->Data = data;
+  splice->Size = size;
+  owner->Delta += (INT32)size - (INT32)length;
+  aml_mark_changed(owner);
+  return TRUE;
+}
+
+static UINT32 aml_object_size(AML_OBJECT* object)
+{
+  AML_OBJECT* child;
+  UINT32      size;
+
+  if (!object->Changed) {
+    object->NewSize = object->End - object->Start;
+    return object->NewSize;
+  }
+  size = object->End - object->Start - object->PkgBytes + object->Delta;
+  for (child = object->First; child; child = child->Next) {
+    if (child->Deleted) {
+      size -= child->End - child->Start;
+    } else if (child->Changed) {
+      size += aml_object_size(child) - (child->End - child->Start);
+    }
+  }
+  if (object->Append) {
+    size += aml_calculate_size(object->Append);
+  }
+  if (object->PkgBytes) {
+    size += aml_get_size_length(size - (object->Pkg - object->Start));
+  }
+  object->NewSize = size;
+  return size;
+}
+
+// copies [from, to) of the table with the replacements in it; *splice is the first one not written yet
+static UINT32 aml_copy_range(AML_TREE* tree, UINTN* splice, UINT32 from, UINT32 to, UINT8* out, UINT32 offset)
+{
+  AML_SPLICE* replace;
+
+  while (*splice < tree->SpliceCount && tree->Splices[*splice].Offset < from) {
+    (*splice)++; // in a deleted object
+  }
+  for (; *splice < tree->SpliceCount && tree->Splices[*splice].Offset < to; (*splice)++) {
+    replace = &tree->Splices[*splice];
+    CopyMem(out + offset, tree->Aml + from, replace->Offset - from);
+    offset += replace->Offset - from;
+    CopyMem(out + offset, replace->Data, replace->Size);
+    offset += replace->Size;
+    from = replace->Offset + replace->Length;
+  }
+  CopyMem(out + offset, tree->Aml + from, to - from);
+  return offset + to - from;
+}
+
+static UINT32 aml_write_object(AML_TREE* tree, AML_OBJECT* object, UINTN* splice, UINT8* out, UINT32 offset)
+{
+  AML_OBJECT* child;
+  UINT32      pos;
+
+  if (!object->Changed) {
+    CopyMem(out + offset, tree->Aml + object->Start, object->End - object->Start);
+    return offset + object->End - object->Start;
+  }
+  pos = object->Pkg;
+  CopyMem(out + offset, tree->Aml + object->Start, pos - object->Start);
+  offset += pos - object->Start;
+  if (object->PkgBytes) {
+    offset = aml_write_size(object->NewSize - (pos - object->Start), (CHAR8*)out, offset);
+    pos += object->PkgBytes;
+  }
+  for (child = object->First; child; child = child->Next) {
+    offset = aml_copy_range(tree, splice, pos, child->Start, out, offset);
+    if (!child->Deleted) {
+      offset = aml_write_object(tree, child, splice, out, offset);
+    }
+    pos = child->End;
+  }
+  offset = aml_copy_range(tree, splice, pos, object->End, out, offset);
+  if (object->Append) {
+    offset = aml_write_node(object->Append, (CHAR8*)out, offset);
+  }
+  return offset;
+}
+
+//
+// Writes the edited table back over the parsed one and returns its new
+// length, the header Length included. The caller must have room for the
+// growth, as for move_data(). The tree is stale afterwards.
+//
+UINT32 aml_write_tree(AML_TREE* tree)
+{
+  UINT8*  out;
+  UINT32  size;
+  UINTN   splice = 0;
+
+  if (!tree) {
+    return 0;
+  }
+  if (!tree->Root->Changed) {
+    return tree->Length;
+  }
+  size = aml_object_size(tree->Root);
+  out = (UINT8*)AllocatePool(size);
+  if (!out) {
+    MsgLog("AML tree: no memory to write %a, fixes not applied\n", tree->Root->Name);
+    return tree->Length;
+  }
+  if (aml_write_object(tree, tree->Root, &splice, out, 0) != size) {
+    MsgLog("AML tree: %a size mismatch, fixes not applied\n", tree->Root->Name);
+    FreePool(out);
+    return tree->Length;
+  }
+  ((EFI_ACPI_DESCRIPTION_HEADER*)out)->Length = size;
+  CopyMem(tree->Aml, out, size);
+  FreePool(out);
+  DBG("AML tree: %a written, 0x%x -> 0x%x bytes\n", tree->Root->Name, tree->Length, size);
+  return size;
+}
@@ -0,0 +1,76 @@
+/*
+ *  AmlTree.h
+ *
+ *  Object tree of an AML table, for fixes that insert or remove objects.
+ *  The table is parsed once, fixes are recorded as edits of the tree and
+ *  the table is written back once with all PkgLength fields recomputed.
+ *
+ */
+
+#ifndef _AML_TREE_H
+#define _AML_TREE_H
+
+#include "AmlGenerator.h"
+
+typedef struct aml_object AML_OBJECT;
+
+struct aml_object
+{
+  UINT16       Op;        // AML opcode, 0x5Bxx for extended opcodes
+  UINT8        PkgBytes;  // size of the PkgLength encoding, 0 for the table itself
+  BOOLEAN      Deleted;
+  BOOLEAN      Changed;   // the object or something inside it was edited
+  BOOLEAN      HasAdr;
+  BOOLEAN      Leaf;      // the body is not parsed, it is kept as it is
+  CHAR8        Name[5];   // last NameSeg of the object name
+  UINT32       Start;     // offset of the opcode in the table
+  UINT32       Pkg;       // offset of the PkgLength
+  UINT32       End;       // offset past the object
+  UINT32       Adr;       // Name (_ADR, ...) of a device
+  UINT32       Hid;       // Name (_HID, EisaId (...)) of a device, as stored in AML
+  UINT32       NewSize;   // size after the edits, set while writing the tree
+  INT32        Delta;     // size change by replaced bytes right in the body
+
+  AML_OBJECT   *Parent;
+  AML_OBJECT   *First;    // objects in the body, in table order
+  AML_OBJECT   *Last;
+  AML_OBJECT   *Next;
+  AML_OBJECT   *Link;     // all objects of the tree, in table order
+  AML_CHUNK    *Append;   // nodes to be written at the end of the body
+};
+
+typedef struct
+{
+  UINT32       Offset;
+  UINT32       Length;    // bytes replaced in the table
+  CONST UINT8  *Data;
+  UINT32       Size;      // bytes written instead
+} AML_SPLICE;
+
+typedef struct
+{
+  UINT8        *Aml;
+  UINT32       Length;
+  AML_OBJECT   *Root;     // the whole table, its body starts after the header
+  AML_OBJECT   *LastLink;
+  UINTN        Count;
+  BOOLEAN      Complete;  // FALSE if some body could not be parsed to its end
+  AML_SPLICE   *Splices;  // by offset
+  UINTN        SpliceCount;
+  UINTN        SpliceCapacity;
+} AML_TREE;
+
+AML_TREE*   aml_parse_tree(UINT8* aml, UINT32 length);
+VOID        aml_destroy_tree(AML_TREE* tree);
+AML_OBJECT* aml_tree_find_device(AML_TREE* tree, CONST CHAR8* name);
+AML_OBJECT* aml_tree_find_adr(AML_TREE* tree, UINT32 adr);
+AML_OBJECT* aml_tree_find_pnp(AML_TREE* tree, UINT16 pnp);
+AML_OBJECT* aml_tree_find_child(AML_OBJECT* parent, UINT16 op, CONST CHAR8* name);
+AML_OBJECT* aml_tree_find_offset(AML_TREE* tree, UINT32 offset);
+BOOLEAN     aml_tree_is_deleted(AML_OBJECT* object);
+VOID        aml_tree_append(AML_OBJECT* object, AML_CHUNK* node);
+VOID        aml_tree_delete(AML_OBJECT* object);
+BOOLEAN     aml_tree_replace(AML_TREE* tree, UINT32 offset, UINT32 length, CONST UINT8* data, UINT32 size);
+UINT32      aml_write_tree(AML_TREE* tree);
+
+#endif /* !_AML_TREE_H */
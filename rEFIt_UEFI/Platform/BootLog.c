@@ -111,40 +111,173 @@ EFI_FILE_PROTOCOL* GetDebugLogFile()
 }
 
 
+//
+// DEBUG_LOG is kept open and written in batches: messages are collected
+// in mDebugLogBuffer and flushed when it fills up and from a timer. Before
+// an image is started it is flushed and closed, the next message reopens
+// it. After a failed open the next try waits for another buffer's worth
+// of messages. At ExitBootServices it is flushed and closed for good.
+//
+#define DEBUG_LOG_BUFFER_SIZE     (16 * 1024)
+#define DEBUG_LOG_FLUSH_INTERVAL  EFI_TIMER_PERIOD_SECONDS(1)
+
+STATIC EFI_FILE_PROTOCOL  *mDebugLogFile = NULL;
+STATIC EFI_EVENT          mDebugLogTimer = NULL;
+STATIC BOOLEAN            mDebugLogClosed = FALSE;
+STATIC BOOLEAN            mDebugLogOpened = FALSE;
+STATIC UINTN              mDebugLogRetryLen = 0;
+STATIC CHAR8              mDebugLogBuffer[DEBUG_LOG_BUFFER_SIZE];
+STATIC UINTN              mDebugLogBufferLen = 0;
+
+STATIC VOID DebugLogFileWrite(IN CHAR8 *Text, IN UINTN TextLen)
+{
+  if (mDebugLogFile != NULL && TextLen > 0) {
+    mDebugLogFile->Write(mDebugLogFile, &TextLen, Text);
+  }
+}
+
+// Must be called at TPL_CALLBACK, keeps the buffer while the file is not open
+STATIC VOID DebugLogFileFlush(VOID)
+{
+  if (mDebugLogFile == NULL) {
+    return;
+  }
+  if (mDebugLogBufferLen > 0) {
+    DebugLogFileWrite(mDebugLogBuffer, mDebugLogBufferLen);
+    mDebugLogBufferLen = 0;
+  }
+  mDebugLogFile->Flush(mDebugLogFile);
+}
+
+STATIC VOID EFIAPI DebugLogTimerNotify(IN EFI_EVENT Event, IN VOID *Context)
+{
+  if (mDebugLogBufferLen > 0) {
+    DebugLogFileFlush();
+  }
+}
+
+//
+// Opens DEBUG_LOG and positions at its end.
+//
+STATIC BOOLEAN DebugLogFileOpen(VOID)
+{
+  EFI_FILE_INFO *Info;
+
+  mDebugLogFile = GetDebugLogFile();
+  if (mDebugLogFile == NULL) {
+    return FALSE;
+  }
+  // Advance to the EOF so we append
+  Info = EfiLibFileInfo(mDebugLogFile);
+  if (Info == NULL) {
+    mDebugLogFile->Close(mDebugLogFile);
+    mDebugLogFile = NULL;
+    return FALSE;
+  }
+  mDebugLogFile->SetPosition(mDebugLogFile, Info->FileSize);
+  FreePool(Info);
+
+  if (!EFI_ERROR(gBS->CreateEvent(EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_CALLBACK,
+                                  DebugLogTimerNotify, NULL, &mDebugLogTimer))) {
+    gBS->SetTimer(mDebugLogTimer, TimerPeriodic, DEBUG_LOG_FLUSH_INTERVAL);
+  }
+  return TRUE;
+}
+
 VOID SaveMessageToDebugLogFile(IN CHAR8 *LastMessage)
 {
-  STATIC BOOLEAN          FirstTimeSave = TRUE;
-//  STATIC UINTN            Position = 0;
-  CHAR8                   *MemLogBuffer;
-  UINTN                   MemLogLen;
-  CHAR8                   *Text;
   UINTN                   TextLen;
-  EFI_FILE_HANDLE         LogFile;
-  
-  MemLogBuffer = GetMemLogBuffer();
-  MemLogLen = GetMemLogLen();
-  Text = LastMessage;
+  EFI_TPL                 OldTpl;
+  BOOLEAN                 CanWrite;
+
+  if (mDebugLogClosed) {
+    return;
+  }
   TextLen = AsciiStrLen(LastMessage);
 
-  LogFile = GetDebugLogFile();
-  
-  // Write to the log file
-  if (LogFile != NULL) {
-    // Advance to the EOF so we append
-    EFI_FILE_INFO *Info = EfiLibFileInfo(LogFile);
-    if (Info) {
-      LogFile->SetPosition(LogFile, Info->FileSize);
-      // If we haven't had root before this write out whole log
-      if (FirstTimeSave) {
-        Text = MemLogBuffer;
-        TextLen = MemLogLen;
-        FirstTimeSave = FALSE;
-      }
-      // Write out this message
-      LogFile->Write(LogFile, &TextLen, Text);
+  // file system can not be used above TPL_CALLBACK, only buffer then
+  OldTpl = gBS->RaiseTPL(TPL_HIGH_LEVEL);
+  gBS->RestoreTPL(OldTpl);
+  CanWrite = (OldTpl <= TPL_CALLBACK);
+  if (!CanWrite && !mDebugLogOpened) {
+    return;
+  }
+
+  // keep the timer away from the buffer
+  if (CanWrite) {
+    OldTpl = gBS->RaiseTPL(TPL_CALLBACK);
+  }
+
+  if (CanWrite && mDebugLogFile == NULL) {
+    if (mDebugLogRetryLen > TextLen) {
+      mDebugLogRetryLen -= TextLen;
+    } else if (DebugLogFileOpen()) {
+      mDebugLogRetryLen = 0;
+    } else {
+      mDebugLogRetryLen = DEBUG_LOG_BUFFER_SIZE;
+    }
+  }
+
+  if (!mDebugLogOpened) {
+    // first message also brings the whole log collected so far
+    if (mDebugLogFile != NULL) {
+      mDebugLogOpened = TRUE;
+      DebugLogFileWrite(GetMemLogBuffer(), GetMemLogLen());
+    }
+  } else {
+    // while the file can not be opened messages wait in the buffer as long as it has room
+    if (CanWrite && mDebugLogBufferLen + TextLen > DEBUG_LOG_BUFFER_SIZE) {
+      DebugLogFileFlush();
     }
-    LogFile->Close(LogFile);
+    if (CanWrite && mDebugLogFile != NULL && TextLen > DEBUG_LOG_BUFFER_SIZE) {
+      DebugLogFileWrite(LastMessage, TextLen);
+    } else if (mDebugLogBufferLen + TextLen <= DEBUG_LOG_BUFFER_SIZE) {
+      CopyMem(mDebugLogBuffer + mDebugLogBufferLen, LastMessage, TextLen);
+      mDebugLogBufferLen += TextLen;
+    }
+  }
+
+  if (CanWrite) {
+    gBS->RestoreTPL(OldTpl);
+  }
+}
+
+//
+// Writes out buffered messages and closes DEBUG_LOG, called before an
+// image is started: the image may take over or unmount the volume.
+//
+VOID FlushDebugLog(VOID)
+{
+  EFI_TPL OldTpl;
+
+  if (mDebugLogFile == NULL) {
+    return;
+  }
+  OldTpl = gBS->RaiseTPL(TPL_CALLBACK);
+  DebugLogFileFlush();
+  if (mDebugLogTimer != NULL) {
+    gBS->CloseEvent(mDebugLogTimer);
+    mDebugLogTimer = NULL;
+  }
+  mDebugLogFile->Close(mDebugLogFile);
+  mDebugLogFile = NULL;
+  gBS->RestoreTPL(OldTpl);
+}
+
+//
+// Called from ExitBootServices event at TPL_CALLBACK, the last point the
+// file system can be used: buffered messages are written out, reopening
+// the file if needed, and it is closed. Later messages stay in the mem
+// log only.
+//
+VOID CloseDebugLog(VOID)
+{
+  if (mDebugLogFile == NULL && mDebugLogBufferLen > 0) {
+    DebugLogFileOpen();
   }
+  FlushDebugLog();
+  mDebugLogBufferLen = 0;
+  mDebugLogClosed = TRUE;
 }
 
 VOID EFIAPI MemLogCallback(IN INTN DebugMode, IN CHAR8 *LastMessage)
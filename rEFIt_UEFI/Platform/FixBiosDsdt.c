@@ -6,6 +6,7 @@
 // NForce additions by Oscar09, 2013
 
 #include "StateGenerator.h"
+#include "AmlTree.h"
 #include <IndustryStandard/PciCommand.h>
 
 #ifdef DBG
@@ -1517,12 +1518,33 @@ BOOLEAN CustProperties(AML_CHUNK* pack, UINT32 Dev)
   return Injected;
 }
 
-//len = DeleteDevice("AZAL", dsdt, len);
-UINT32 DeleteDevice(/*CONST*/ CHAR8 *Name, UINT8 *dsdt, UINT32 len)
+//
+// Fixes on the AML tree (AmlTree.c). Only the edits that add or remove
+// whole devices are done on the tree: DeleteDevice() for FIX_UNUSED and
+// AddMCHC()/AddIMEI(), each with its byte scan as fallback for objects the
+// tree does not hold, so an incomplete parse never loses a fix. All other
+// fixes keep shifting bytes with move_data() and CorrectOuters() on the
+// written table. They find their device by byte patterns the tree does not
+// model (_ADR/_HID in If bodies, resource buffers, Method bodies for FIXWAK,
+// FIXSHUTDOWN_ASUS and FIXGPE), and each would need its own fallback and
+// checks against the byte path before it can move.
+//
+
+//
+// Deletes the first device of that name in table order, found by bytes as
+// before. A device the tree holds is deleted in the tree. One it does not
+// hold (inside an If, or after a term the parser does not know) is deleted
+// by moving bytes after the tree is written. CorrectOuters() does not know
+// every outer, so the tree is not parsed again and *Tree stays NULL: then
+// only bytes are moved, as before the tree.
+//
+//len = DeleteDevice("AZAL", dsdt, len, &Tree);
+UINT32 DeleteDevice(/*CONST*/ CHAR8 *Name, UINT8 *dsdt, UINT32 len, AML_TREE **Tree)
 {
   UINT32 i, j;
   INT32 size = 0, sizeoffset;
-  MsgLog(" deleting device %a\n", Name);
+  AML_OBJECT *Object;
+
   for (i=20; i<len; i++) {
     j = CmpDev(dsdt, i, (UINT8*)Name);
     if (j != 0) {
@@ -1530,6 +1552,22 @@ UINT32 DeleteDevice(/*CONST*/ CHAR8 *Name, UINT8 *dsdt, UINT32 len)
       if (!size) {
         continue;
       }
+      if (*Tree) {
+        Object = aml_tree_find_offset(*Tree, j - 2);
+        if (aml_tree_is_deleted(Object)) {
+          continue; // goes with an outer device
+        }
+        if (Object->Start == j - 2) {
+          MsgLog(" deleting device %a\n", Name);
+          aml_tree_delete(Object);
+          return len;
+        }
+        len = aml_write_tree(*Tree);
+        aml_destroy_tree(*Tree);
+        *Tree = NULL;
+        return DeleteDevice(Name, dsdt, len, Tree);
+      }
+      MsgLog(" deleting device %a\n", Name);
       sizeoffset = - 2 - size;
       len = move_data(j-2, dsdt, len, sizeoffset);
       //to correct outers we have to calculate offset
@@ -1540,6 +1578,31 @@ UINT32 DeleteDevice(/*CONST*/ CHAR8 *Name, UINT8 *dsdt, UINT32 len)
   return len;
 }
 
+//device of that name, or with that _ADR if not 0, anywhere in the table
+BOOLEAN DsdtHasDevice(UINT8 *dsdt, UINT32 len, CHAR8 *Name, UINT32 Adr)
+{
+  UINT32 i;
+
+  for (i=0x20; len >= 10 && i < len - 10; i++) {
+    if ((Adr && CmpAdr(dsdt, i, Adr) && devFind(dsdt, i)) || CmpDev(dsdt, i, (UINT8*)Name)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+//the tree knows the parsed part of the table only, the rest is searched by bytes
+BOOLEAN TreeHasDevice(AML_TREE *Tree, CHAR8 *Name, UINT32 Adr)
+{
+  if ((Adr && aml_tree_find_adr(Tree, Adr)) || aml_tree_find_device(Tree, Name)) {
+    return TRUE;
+  }
+  if (Tree->Complete) {
+    return FALSE;
+  }
+  return DsdtHasDevice(Tree->Aml, Tree->Length, Name, Adr);
+}
+
 UINT32 GetPciDevice(UINT8 *dsdt, UINT32 len)
 {
   UINT32 i;
@@ -1580,6 +1643,60 @@ UINT32 GetPciDevice(UINT8 *dsdt, UINT32 len)
 }
 
 
+//
+// The PCI root in the tree. When the tree does not hold it, the tree is
+// written back and dropped, *Tree is NULL and *PciAdr is the device found
+// by GetPciDevice() for the byte path, 0 if there is none.
+//
+AML_OBJECT *GetPciRootObject(UINT8 *dsdt, UINT32 *len, AML_TREE **Tree, UINT32 *PciAdr)
+{
+  AML_OBJECT *Pci = NULL;
+
+  *PciAdr = 0;
+  if (*Tree) {
+    Pci = aml_tree_find_pnp(*Tree, 0x0A03);
+    if (!Pci) {
+      Pci = aml_tree_find_pnp(*Tree, 0x0A08);
+    }
+    if (Pci) {
+      return Pci;
+    }
+    *len = aml_write_tree(*Tree);
+    aml_destroy_tree(*Tree);
+    *Tree = NULL;
+  }
+  *PciAdr = GetPciDevice(dsdt, *len);
+  return NULL;
+}
+
+//
+// Byte path of AddMCHC() and AddIMEI(): root goes to the end of the PCI
+// root device at PCIADR, its size and those of its outers are corrected.
+// root is destroyed.
+//
+UINT32 AddToPciRootBytes(UINT8 *dsdt, UINT32 len, UINT32 PCIADR, AML_CHUNK *root)
+{
+  UINT32 k, PCISIZE;
+  INT32  sizeoffset;
+  CHAR8  *device;
+
+  aml_calculate_size(root);
+  device = AllocateZeroPool(root->Size);
+  sizeoffset = root->Size;
+  aml_write_node(root, device, 0);
+  aml_destroy_node(root);
+  PCISIZE = get_size(dsdt, PCIADR);
+  len = move_data(PCIADR + PCISIZE, dsdt, len, sizeoffset);
+  CopyMem(dsdt + PCIADR + PCISIZE, device, sizeoffset);
+  // Fix PCIX size
+  k = write_size(PCIADR, dsdt, len, sizeoffset);
+  sizeoffset += k;
+  len += k;
+  len = CorrectOuters(dsdt, len, PCIADR-3, sizeoffset);
+  FreePool(device);
+  return len;
+}
+
 // Find PCIRootUID and all need Fix Device
 VOID  findPciRoot (UINT8 *dsdt, UINT32 len)
 {
@@ -1804,6 +1921,338 @@ UINT32 FixRenameByBridge2 (UINT8* dsdt, UINT32 len, CHAR8* TgtBrgName, UINT8* To
   return len;
 }
 
+//
+// Batched find/replace. All patches of a batch are matched in one scan of
+// the table, through buckets by first byte like the kext PATCH_MATCHER, and
+// size changes are applied by one write of the AML tree instead of one
+// move_data() and CorrectOuters() per hit.
+//
+// The result is that of calling FixAny() for each patch in config order.
+// A patch whose Find contains or is part of an earlier Find, or may appear
+// in what an earlier patch writes, starts a new batch. A batch whose hits
+// still overlap is done by FixAny() after all.
+//
+typedef struct {
+  UINT32  Offset;
+  UINT32  Patch;
+} ACPI_PATCH_HIT;
+
+// TRUE if one Find contains the other, so their hits would always overlap
+BOOLEAN AcpiPatchShadows(UINTN A, UINTN B)
+{
+  UINT8   *Long = gSettings.PatchDsdtFind[A];
+  UINT8   *Short = gSettings.PatchDsdtFind[B];
+  UINT32  LenLong = gSettings.LenToFind[A];
+  UINT32  LenShort = gSettings.LenToFind[B];
+  UINT32  k;
+
+  if (LenLong < LenShort) {
+    Long = gSettings.PatchDsdtFind[B];
+    Short = gSettings.PatchDsdtFind[A];
+    LenLong = gSettings.LenToFind[B];
+    LenShort = gSettings.LenToFind[A];
+  }
+  for (k = 0; k + LenShort <= LenLong; k++) {
+    if (CompareMem(Long + k, Short, LenShort) == 0) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+// TRUE if Find of B may match over bytes written by a Replace of A
+BOOLEAN AcpiPatchFeeds(UINTN A, UINTN B)
+{
+  UINT8   *Rep = gSettings.PatchDsdtReplace[A];
+  UINT8   *Old = gSettings.PatchDsdtFind[A];
+  UINT8   *Find = gSettings.PatchDsdtFind[B];
+  UINT32  LenTR = gSettings.LenToReplace[A];
+  UINT32  LenTF = gSettings.LenToFind[B];
+  BOOLEAN SameSize = (gSettings.LenToFind[A] == LenTR);
+  BOOLEAN Changed;
+  INT32   d;
+  UINT32  k, From, To;
+
+  // Find placed at d relative to Replace, overlapping it by one byte at least
+  for (d = 1 - (INT32)LenTF; d < (INT32)LenTR; d++) {
+    From = (d > 0) ? (UINT32)d : 0;
+    To = MIN(LenTR, (UINT32)(d + (INT32)LenTF));
+    Changed = !SameSize;
+    for (k = From; k < To; k++) {
+      if (Rep[k] != Find[k - d]) {
+        break;
+      }
+      if (SameSize && Rep[k] != Old[k]) {
+        Changed = TRUE;
+      }
+    }
+    // bytes the Replace leaves as they were are matched in the original table
+    if (k == To && Changed) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+VOID InitAcpiPatches(ACPI_PATCH_LIST *List, BOOLEAN ByBridge)
+{
+  ACPI_PATCH  *Patch;
+  UINTN       i, j, First = 0;
+  UINTN       Batch = 0;
+
+  List->Count = 0;
+  List->Patches = NULL;
+  if (gSettings.PatchDsdtNum == 0) {
+    return;
+  }
+  List->Patches = AllocateZeroPool(gSettings.PatchDsdtNum * sizeof(ACPI_PATCH));
+  if (!List->Patches) {
+    return;
+  }
+
+  for (i = 0; i < gSettings.PatchDsdtNum; i++) {
+    if (!gSettings.PatchDsdtFind[i] || !gSettings.LenToFind[i]) {
+      continue;
+    }
+    if (!gSettings.PatchDsdtMenuItem[i].BValue) {
+      if (ByBridge) {
+        MsgLog(" - [%a]: disabled\n", gSettings.PatchDsdtLabel[i]);
+      } else {
+        DebugLog(1, "%d. [%a]: disabled\n", i, gSettings.PatchDsdtLabel[i]);
+      }
+      continue;
+    }
+    if (!gSettings.PatchDsdtReplace[i] || !gSettings.LenToReplace[i]) {
+      DBG(" - [%a]: invalid patch!\n", gSettings.PatchDsdtLabel[i]);
+      continue;
+    }
+    Patch = &List->Patches[List->Count];
+    Patch->Index = i;
+    Patch->ByBridge = ByBridge && gSettings.PatchDsdtTgt[i];
+    Patch->Ssdt = !ByBridge;
+
+    if (List->Count > 0) {
+      if (Patch->ByBridge || List->Patches[First].ByBridge) {
+        Batch++;
+      } else {
+        for (j = First; j < List->Count; j++) {
+          if (AcpiPatchShadows(List->Patches[j].Index, i) ||
+              AcpiPatchFeeds(List->Patches[j].Index, i)) {
+            Batch++;
+            break;
+          }
+        }
+      }
+      if (Batch != List->Patches[First].Batch) {
+        First = List->Count;
+      }
+    }
+    Patch->Batch = Batch;
+    List->Count++;
+  }
+  DBG("%d DSDT patches in %d batches\n", List->Count, List->Count ? Batch + 1 : 0);
+}
+
+VOID FreeAcpiPatches(ACPI_PATCH_LIST *List)
+{
+  if (List->Patches) {
+    FreePool(List->Patches);
+  }
+  List->Patches = NULL;
+  List->Count = 0;
+}
+
+// the label the FixAny() log follows, SSDT patches show it in the debug log only
+VOID AcpiPatchLabel(ACPI_PATCH *Patch)
+{
+  if (Patch->Ssdt) {
+    DebugLog(1, "%d. [%a]:", Patch->Index, gSettings.PatchDsdtLabel[Patch->Index]);
+  } else {
+    MsgLog(" - [%a]:", gSettings.PatchDsdtLabel[Patch->Index]);
+  }
+}
+
+// the batch one patch at a time, as it was done before
+UINT32 FixAnyEach(UINT8 *dsdt, UINT32 len, ACPI_PATCH *Patches, UINTN Count)
+{
+  UINTN i, n;
+
+  for (i = 0; i < Count; i++) {
+    n = Patches[i].Index;
+    AcpiPatchLabel(&Patches[i]);
+    if (Patches[i].ByBridge) {
+      len = FixRenameByBridge2(dsdt, len, gSettings.PatchDsdtTgt[n],
+                               gSettings.PatchDsdtFind[n], gSettings.LenToFind[n],
+                               gSettings.PatchDsdtReplace[n], gSettings.LenToReplace[n]);
+    } else {
+      len = FixAny(dsdt, len, gSettings.PatchDsdtFind[n], gSettings.LenToFind[n],
+                   gSettings.PatchDsdtReplace[n], gSettings.LenToReplace[n]);
+    }
+  }
+  return len;
+}
+
+UINT32 FixAnyBatch(UINT8 *dsdt, UINT32 len, ACPI_PATCH *Patches, UINTN Count)
+{
+  INT32           Bucket[256];
+  ACPI_PATCH      *Patch;
+  ACPI_PATCH_HIT  *Hits = NULL;
+  UINTN           NumHits = 0, MaxHits = 0;
+  UINTN           i, n, m, h;
+  INT32           p;
+  UINT32          Pos, Busy = 0;
+  UINT32          Shift, From;
+  UINT32          OrgLen = len;
+  BOOLEAN         Resize = FALSE;
+  BOOLEAN         Overlap = FALSE;
+  AML_TREE        *Tree = NULL;
+
+  for (i = 0; i < 256; i++) {
+    Bucket[i] = -1;
+  }
+  // chained backwards, so each bucket lists its patches in config order
+  for (i = Count; i-- > 0; ) {
+    Patch = &Patches[i];
+    n = Patch->Index;
+    Patch->Hits = 0;
+    Patch->NextPos = 0;
+    Patch->Next = -1;
+    if (gSettings.LenToFind[n] + sizeof(EFI_ACPI_DESCRIPTION_HEADER) > len) {
+      continue;
+    }
+    Patch->Next = Bucket[gSettings.PatchDsdtFind[n][0]];
+    Bucket[gSettings.PatchDsdtFind[n][0]] = (INT32)i;
+  }
+
+  for (Pos = 20; Pos < len && !Overlap; Pos++) {
+    for (p = Bucket[dsdt[Pos]]; p >= 0; p = Patch->Next) {
+      Patch = &Patches[p];
+      n = Patch->Index;
+      // same bounds as FindBin() in FixAny()
+      if (Pos < Patch->NextPos || Pos + gSettings.LenToFind[n] >= len ||
+          CompareMem(dsdt + Pos, gSettings.PatchDsdtFind[n], gSettings.LenToFind[n]) != 0) {
+        continue;
+      }
+      if (Pos < Busy) {
+        Overlap = TRUE;
+        break;
+      }
+      if (NumHits == MaxHits) {
+        Hits = ReallocatePool(MaxHits * sizeof(ACPI_PATCH_HIT), (MaxHits + 64) * sizeof(ACPI_PATCH_HIT), Hits);
+        if (!Hits) {
+          return FixAnyEach(dsdt, len, Patches, Count);
+        }
+        MaxHits += 64;
+      }
+      Hits[NumHits].Offset = Pos;
+      Hits[NumHits].Patch = (UINT32)p;
+      NumHits++;
+      Patch->Hits++;
+      Patch->NextPos = Busy = Pos + gSettings.LenToFind[n];
+      if (gSettings.LenToFind[n] != gSettings.LenToReplace[n]) {
+        Resize = TRUE;
+      }
+    }
+  }
+
+  if (Overlap) {
+    DBG(" patches overlap, one by one\n");
+  } else if (Resize) {
+    // all size changes must be taken by the tree, before anything is written
+    Tree = aml_parse_tree(dsdt, len);
+    if (Tree && !Tree->Complete) {
+      DBG(" DSDT not fully parsed, one by one\n");
+      aml_destroy_tree(Tree);
+      Tree = NULL;
+    }
+    for (i = 0; Tree && i < NumHits; i++) {
+      n = Patches[Hits[i].Patch].Index;
+      if (gSettings.LenToFind[n] != gSettings.LenToReplace[n] &&
+          !aml_tree_replace(Tree, Hits[i].Offset, gSettings.LenToFind[n],
+                            gSettings.PatchDsdtReplace[n], gSettings.LenToReplace[n])) {
+        DBG(" hit at %x not in a body, one by one\n", Hits[i].Offset);
+        aml_destroy_tree(Tree);
+        Tree = NULL;
+      }
+    }
+  }
+  if (Overlap || (Resize && !Tree)) {
+    if (Hits) {
+      FreePool(Hits);
+    }
+    return FixAnyEach(dsdt, len, Patches, Count);
+  }
+
+  for (i = 0; i < NumHits; i++) {
+    n = Patches[Hits[i].Patch].Index;
+    if (gSettings.LenToFind[n] == gSettings.LenToReplace[n]) {
+      CopyMem(dsdt + Hits[i].Offset, gSettings.PatchDsdtReplace[n], gSettings.LenToReplace[n]);
+    }
+  }
+  if (Tree) {
+    len = aml_write_tree(Tree);
+    aml_destroy_tree(Tree);
+  }
+
+  // the log FixAny() writes, its offsets are from the end of the previous
+  // hit of the patch in the table as the patches before it left it
+  for (i = 0; i < Count; i++) {
+    n = Patches[i].Index;
+    AcpiPatchLabel(&Patches[i]);
+    MsgLog(" pattern %02x%02x%02x%02x,", gSettings.PatchDsdtFind[n][0], gSettings.PatchDsdtFind[n][1],
+           gSettings.PatchDsdtFind[n][2], gSettings.PatchDsdtFind[n][3]);
+    if (gSettings.LenToFind[n] + sizeof(EFI_ACPI_DESCRIPTION_HEADER) > OrgLen) {
+      MsgLog(" the patch is too large!\n");
+      continue;
+    }
+    if (!Patches[i].Hits) {
+      MsgLog(" bin not found / already patched!\n");
+      continue;
+    }
+    MsgLog(" patched at: [");
+    Shift = 0;
+    From = 20;
+    for (h = 0; h < NumHits; h++) {
+      m = Patches[Hits[h].Patch].Index;
+      Pos = Hits[h].Offset + Shift;
+      if (Hits[h].Patch == i) {
+        MsgLog(" (%x)", Pos - From);
+        From = Pos + gSettings.LenToReplace[n];
+      }
+      if (Hits[h].Patch <= i) {
+        Shift += gSettings.LenToReplace[m] - gSettings.LenToFind[m];
+      }
+    }
+    MsgLog(" ]\n");
+  }
+  if (Hits) {
+    FreePool(Hits);
+  }
+  return len;
+}
+
+//
+// Applies the patches batch by batch and returns the new length of the table
+//
+UINT32 ApplyAcpiPatches(ACPI_PATCH_LIST *List, UINT8 *Table, UINT32 Len)
+{
+  UINTN First, Last;
+
+  for (First = 0; First < List->Count; First = Last) {
+    for (Last = First + 1; Last < List->Count; Last++) {
+      if (List->Patches[Last].Batch != List->Patches[First].Batch) {
+        break;
+      }
+    }
+    if (List->Patches[First].ByBridge) {
+      Len = FixAnyEach(Table, Len, &List->Patches[First], Last - First);
+    } else {
+      Len = FixAnyBatch(Table, Len, &List->Patches[First], Last - First);
+    }
+  }
+  return Len;
+}
+
 UINT32 FIXDarwin (UINT8* dsdt, UINT32 len)
 {
   CONST UINT32  adr  = 0x24;
@@ -3363,33 +3812,29 @@ UINT32 FIXSBUS (UINT8 *dsdt, UINT32 len)
 
 //CHAR8 dataMCHC[] = {0x44,0x00,0x00,0x00};
 
-UINT32 AddMCHC (UINT8 *dsdt, UINT32 len)
+//
+// AddMCHC() and AddIMEI() append to the PCI root in *Tree. A PCI root the
+// tree does not hold, or no tree, takes them the byte way as DeleteDevice()
+// does, *Tree is NULL then.
+//
+UINT32 AddMCHC (UINT8 *dsdt, UINT32 len, AML_TREE **Tree)
 {
-  UINT32    i, k = 0;
-  UINT32    PCIADR, PCISIZE = 0; //, Size;
-  INT32     sizeoffset;
+  AML_OBJECT *Pci;
+  UINT32 PCIADR;
   AML_CHUNK *root;
   AML_CHUNK *device;
 //  AML_CHUNK *met, *met2;
 //  AML_CHUNK *pack;
-  CHAR8     *mchc;
 
-  PCIADR = GetPciDevice(dsdt, len);
-  if (PCIADR) {
-    PCISIZE = get_size(dsdt, PCIADR);
-  }
-  if (!PCISIZE) {
+  Pci = GetPciRootObject(dsdt, &len, Tree, &PCIADR);
+  if (!Pci && !PCIADR) {
 //    DBG("wrong PCI0 address, patch MCHC will not be applied\n");
     return len;
   }
   //Find Device MCHC by name
-  for (i=0x20; len >= 10 && i < len - 10; i++) {
-    k = CmpDev(dsdt, i, (UINT8*)"MCHC");
-    if (k != 0) {
-      DBG("device name (MCHC) found at %x, don't add!\n", k);
-   //   break;
-      return len;
-    }
+  if (Pci ? TreeHasDevice(*Tree, "MCHC", 0) : DsdtHasDevice(dsdt, len, "MCHC", 0)) {
+    DBG("device name (MCHC) found, don't add!\n");
+    return len;
   }
 
   DBG("Start Add MCHC\n");
@@ -3430,34 +3875,22 @@ UINT32 AddMCHC (UINT8 *dsdt, UINT32 len)
   aml_add_buffer(met, dtgp_1, sizeof(dtgp_1));
   // finish Method(_DSM,4,NotSerialized)
 */
-  aml_calculate_size(root);
-  mchc = AllocateZeroPool(root->Size);
-  sizeoffset = root->Size;
-  aml_write_node(root, mchc, 0);
-  aml_destroy_node(root);
   // always add on PCIX back
-  PCISIZE = get_size(dsdt, PCIADR);
-  len = move_data(PCIADR + PCISIZE, dsdt, len, sizeoffset);
-  CopyMem(dsdt + PCIADR + PCISIZE, mchc, sizeoffset);
-  // Fix PCIX size
-  k = write_size(PCIADR, dsdt, len, sizeoffset);
-  sizeoffset += k;
-  len += k;
-  len = CorrectOuters(dsdt, len, PCIADR-3, sizeoffset);
-  FreePool(mchc);
+  if (!Pci) {
+    return AddToPciRootBytes(dsdt, len, PCIADR, root);
+  }
+  aml_tree_append(Pci, root);
   return len;
 }
 
-UINT32 AddIMEI (UINT8 *dsdt, UINT32 len)
+UINT32 AddIMEI (UINT8 *dsdt, UINT32 len, AML_TREE **Tree)
 {
-  UINT32  i, k = 0;
-  UINT32 PCIADR, PCISIZE = 0;
-  INT32 sizeoffset;
+  AML_OBJECT *Pci;
+  UINT32 PCIADR;
   AML_CHUNK *root;
   AML_CHUNK *device;
   AML_CHUNK *met, *met2;
   AML_CHUNK *pack;
-  CHAR8 *imei;
   UINT32 FakeID;
   UINT32 FakeVen;
 
@@ -3466,34 +3899,15 @@ UINT32 AddIMEI (UINT8 *dsdt, UINT32 len)
     FakeVen = gSettings.FakeIMEI & 0xFFFF;
   }
 
-  PCIADR = GetPciDevice(dsdt, len);
-  if (PCIADR) {
-    PCISIZE = get_size(dsdt, PCIADR);
-  }
-  if (!PCISIZE) {
+  Pci = GetPciRootObject(dsdt, &len, Tree, &PCIADR);
+  if (!Pci && !PCIADR) {
 //    DBG("wrong PCI0 address, patch IMEI will not be applied\n");
     return len;
   }
-  // Find Device IMEI
-  if (IMEIADR1) {
-    for (i=0x20; len >= 10 && i < len - 10; i++) {
-      if (CmpAdr(dsdt, i, IMEIADR1)) {
-        k = devFind(dsdt, i);
-        if (k) {
-          MsgLog("device (IMEI) found at %x, don't add!\n", k);
-          //         break;
-          return len;
-        }
-      }
-    }
-  }
-  //Find Device IMEI by name
-  for (i=0x20; len >= 10 && i < len - 10; i++) {
-    k = CmpDev(dsdt, i, (UINT8*)"IMEI");
-    if (k != 0) {
-      MsgLog("device name (IMEI) found at %x, don't add!\n", k);
-      return len;
-    }
+  // Find Device IMEI by address or by name
+  if (Pci ? TreeHasDevice(*Tree, "IMEI", IMEIADR1) : DsdtHasDevice(dsdt, len, "IMEI", IMEIADR1)) {
+    MsgLog("device (IMEI) found, don't add!\n");
+    return len;
   }
 
   MsgLog("Start Add IMEI\n");
@@ -3517,20 +3931,11 @@ UINT32 AddIMEI (UINT8 *dsdt, UINT32 len)
   // finish Method(_DSM,4,NotSerialized)
   }
 
-  aml_calculate_size(root);
-  imei = AllocateZeroPool(root->Size);
-  sizeoffset = root->Size;
-  aml_write_node(root, imei, 0);
-  aml_destroy_node(root);
   // always add on PCIX back
-  len = move_data(PCIADR+PCISIZE, dsdt, len, sizeoffset);
-  CopyMem(dsdt+PCIADR+PCISIZE, imei, sizeoffset);
-  // Fix PCIX size
-  k = write_size(PCIADR, dsdt, len, sizeoffset);
-  sizeoffset += k;
-  len += k;
-  len = CorrectOuters(dsdt, len, PCIADR-3, sizeoffset);
-  FreePool(imei);
+  if (!Pci) {
+    return AddToPciRootBytes(dsdt, len, PCIADR, root);
+  }
+  aml_tree_append(Pci, root);
   return len;
 }
 
@@ -5304,8 +5709,9 @@ VOID RenameDevices(UINT8* table)
 VOID FixBiosDsdt (UINT8* temp, EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* fadt, CHAR8 *OSVersion)
 {
   UINT32 DsdtLen;
-
-  UINTN i;
+  AML_TREE *Tree;
+  BOOLEAN AddMchc;
+  ACPI_PATCH_LIST Patches;
 
   if (!temp) {
     return;
@@ -5331,32 +5737,9 @@ VOID FixBiosDsdt (UINT8* temp, EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* fadt,
   //arbitrary fixes
   if (gSettings.PatchDsdtNum > 0) {
     MsgLog("Patching DSDT:\n");
-    for (i = 0; i < gSettings.PatchDsdtNum; i++) {
-      if (!gSettings.PatchDsdtFind[i] || !gSettings.LenToFind[i]) {
-        continue;
-      }
-
-      MsgLog(" - [%a]:", gSettings.PatchDsdtLabel[i]); //yyyy
-      if (gSettings.PatchDsdtMenuItem[i].BValue) {
-        if (!gSettings.PatchDsdtTgt[i]) {
-              DsdtLen = FixAny(temp, DsdtLen,
-                           gSettings.PatchDsdtFind[i], gSettings.LenToFind[i],
-                           gSettings.PatchDsdtReplace[i], gSettings.LenToReplace[i]);
-
-        }else{
-    //      DBG("Patching: renaming in bridge\n");
-          DsdtLen = FixRenameByBridge2(temp, DsdtLen,
-                           gSettings.PatchDsdtTgt[i],
-                           gSettings.PatchDsdtFind[i],
-                           gSettings.LenToFind[i],
-                           gSettings.PatchDsdtReplace[i],
-                           gSettings.LenToReplace[i]);
-
-        }
-      } else {
-        MsgLog(" disabled\n");
-      }
-    }
+    InitAcpiPatches(&Patches, TRUE);
+    DsdtLen = ApplyAcpiPatches(&Patches, temp, DsdtLen);
+    FreeAcpiPatches(&Patches);
   }
 
   //renaming Devices
@@ -5475,14 +5858,23 @@ VOID FixBiosDsdt (UINT8* temp, EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* fadt,
     DsdtLen = AddHDEF(temp, DsdtLen, OSVersion);
   }
 
-  //Always add MCHC for PM
-  if ((gCPUStructure.Family == 0x06)  && (gSettings.FixDsdt & FIX_MCHC)) {
-//    DBG("patch MCHC in DSDT \n");
-    DsdtLen = AddMCHC(temp, DsdtLen);
-  }
-  //add IMEI
-  if ((gSettings.FixDsdt & FIX_IMEI)) {
-    DsdtLen = AddIMEI(temp, DsdtLen);
+  //MCHC and IMEI are added as edits of one tree
+  AddMchc = (gCPUStructure.Family == 0x06) && (gSettings.FixDsdt & FIX_MCHC);
+  if (AddMchc || (gSettings.FixDsdt & FIX_IMEI)) {
+    Tree = aml_parse_tree(temp, DsdtLen);
+    //Always add MCHC for PM
+    if (AddMchc) {
+//      DBG("patch MCHC in DSDT \n");
+      DsdtLen = AddMCHC(temp, DsdtLen, &Tree);
+    }
+    //add IMEI
+    if ((gSettings.FixDsdt & FIX_IMEI)) {
+      DsdtLen = AddIMEI(temp, DsdtLen, &Tree);
+    }
+    if (Tree) {
+      DsdtLen = aml_write_tree(Tree);
+      aml_destroy_tree(Tree);
+    }
   }
   //Add HDMI device
   if ((gSettings.FixDsdt & FIX_HDMI)) {
@@ -5508,16 +5900,21 @@ VOID FixBiosDsdt (UINT8* temp, EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* fadt,
     // USB Device remove error Fix
    // DsdtLen = FIXGPE(temp, DsdtLen);
   if ((gSettings.FixDsdt & FIX_UNUSED)) {
+    Tree = aml_parse_tree(temp, DsdtLen);
     //I want these fixes even if no Display fix. We have GraphicsInjector
-    DsdtLen = DeleteDevice("CRT_", temp, DsdtLen);
-    DsdtLen = DeleteDevice("DVI_", temp, DsdtLen);
+    DsdtLen = DeleteDevice("CRT_", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("DVI_", temp, DsdtLen, &Tree);
     //good company
-    DsdtLen = DeleteDevice("SPKR", temp, DsdtLen);
-    DsdtLen = DeleteDevice("ECP_", temp, DsdtLen);
-    DsdtLen = DeleteDevice("LPT_", temp, DsdtLen);
-    DsdtLen = DeleteDevice("FDC0", temp, DsdtLen);
-    DsdtLen = DeleteDevice("ECP1", temp, DsdtLen);
-    DsdtLen = DeleteDevice("LPT1", temp, DsdtLen);
+    DsdtLen = DeleteDevice("SPKR", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("ECP_", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("LPT_", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("FDC0", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("ECP1", temp, DsdtLen, &Tree);
+    DsdtLen = DeleteDevice("LPT1", temp, DsdtLen, &Tree);
+    if (Tree) {
+      DsdtLen = aml_write_tree(Tree);
+      aml_destroy_tree(Tree);
+    }
   }
 
   if ((gSettings.FixDsdt & FIX_ACST)) {
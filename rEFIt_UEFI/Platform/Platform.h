@@ -721,6 +721,7 @@ typedef struct {
   UINTN  offset;
   VOID   *tag;
   VOID   *tagNext;
+  VOID   *index;    // ParseXMLArena: hashed keys of a dict
 
 } TagStruct, *TagPtr;
 
@@ -1181,6 +1182,8 @@ typedef struct {
   BOOLEAN                 ShowHiddenEntries;
   UINT8                   KernelScan;
   BOOLEAN                 LinuxScan;
+  BOOLEAN                 ScanCache;
+  BOOLEAN                 ThemeCache;
 //  UINT8                   pad84[3];
   CUSTOM_LOADER_ENTRY     *CustomEntries;
   CUSTOM_LEGACY_ENTRY     *CustomLegacy;
@@ -1760,6 +1763,12 @@ SetupBooterLog (
   BOOLEAN AllowGrownSize
   );
 
+VOID
+FlushDebugLog (VOID);
+
+VOID
+CloseDebugLog (VOID);
+
 EFI_STATUS
 SaveBooterLog (
   IN  EFI_FILE_HANDLE BaseDir  OPTIONAL,
@@ -1978,6 +1987,9 @@ ResetNativeNvram (VOID);
 EFI_STATUS
 GetEfiBootDeviceFromNvram (VOID);
 
+VOID
+ScanCacheIdle (VOID);
+
 EFI_GUID
 *FindGPTPartitionGuidInDevicePath (
   IN  EFI_DEVICE_PATH_PROTOCOL *DevicePath
@@ -2171,6 +2183,43 @@ FixAny (
   UINT32 LenTR
   );
 
+//
+// Enabled PatchDsdt entries of the config, grouped into batches that are
+// applied to a table in one pass each, see ApplyAcpiPatches()
+//
+typedef struct {
+  UINTN   Index;    // in gSettings.PatchDsdt*
+  UINTN   Batch;
+  BOOLEAN ByBridge; // PatchDsdtTgt rename, a batch of its own
+  BOOLEAN Ssdt;     // labels go to the debug log only, as SSDT patching had it
+  INT32   Next;     // next patch of the batch with the same first byte
+  UINT32  NextPos;  // the patch matches again from here on
+  UINT32  Hits;
+} ACPI_PATCH;
+
+typedef struct {
+  ACPI_PATCH  *Patches;
+  UINTN       Count;
+} ACPI_PATCH_LIST;
+
+VOID
+InitAcpiPatches (
+  ACPI_PATCH_LIST *List,
+  BOOLEAN         ByBridge
+  );
+
+VOID
+FreeAcpiPatches (
+  ACPI_PATCH_LIST *List
+  );
+
+UINT32
+ApplyAcpiPatches (
+  ACPI_PATCH_LIST *List,
+  UINT8           *Table,
+  UINT32          Len
+  );
+
 VOID
 GetAcpiTablesList (VOID);
 
@@ -2224,6 +2273,31 @@ ParseXML (
         UINT32 bufSize
   );
 
+EFI_STATUS
+ParseXMLArena (
+  CONST CHAR8  *buffer,
+        TagPtr *dict,
+        UINT32 bufSize
+  );
+
+EFI_STATUS
+PlistSaveBinary (
+  TagPtr dict,
+  UINT32 sourceSize,
+  UINT32 sourceCrc,
+  UINT8  **blob,
+  UINTN  *blobSize
+  );
+
+EFI_STATUS
+PlistLoadBinary (
+  UINT8  *blob,
+  UINTN  blobSize,
+  UINT32 sourceSize,
+  UINT32 sourceCrc,
+  TagPtr *dict
+  );
+
 EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize);
 //VOID RenderSVGfont(NSVGfont  *fontSVG);
 
@@ -428,6 +428,7 @@ EFI_STATUS WaitForInputEventPoll(REFIT_MENU_SCREEN *Screen, UINTN TimeoutDefault
     if (gSettings.PlayAsync) {
       CheckSyncSound();
     }
+    ScanCacheIdle();
 /*    if ((INTN)gItemID < Screen->EntryCount) {
       UpdateAnime(Screen->Entries[gItemID]->SubScreen, &(Screen->Entries[gItemID]->Place));
     } */
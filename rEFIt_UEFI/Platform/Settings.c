@@ -138,6 +138,7 @@ REFIT_CONFIG   GlobalConfig = {
   imNone,         // SCALING     BackgroundScale;
   0,              // UINTN       BackgroundSharp;
   FALSE,          // BOOLEAN     BackgroundDark;
+  SCALER_SHARP,   // SCALER_TYPE ImageScaler;
   FALSE,          // BOOLEAN     CustomIcons;
   FALSE,          // BOOLEAN     SelectionOnTop;
   FALSE,          // BOOLEAN     BootCampStyle;
@@ -608,6 +609,52 @@ VOID
   return Data;
 }
 
+//
+// Parses a plist using the binary snapshot EFI\CLOVER\misc\CacheName.bin
+// on SelfRootDir when its size and CRC32 still match the XML. Otherwise
+// parses the XML and (re)writes the snapshot for the next boot. The plist
+// itself may be on another volume, the snapshot is only written to ours.
+//
+STATIC EFI_STATUS
+ParseXMLCached (
+                IN CHAR16   *CacheName,
+                IN CHAR8    *Buffer,
+                IN UINTN    Size,
+                OUT TagPtr  *Dict)
+{
+  EFI_STATUS Status;
+  CHAR16     *BinPath;
+  UINT8      *Blob = NULL;
+  UINTN      BlobSize = 0;
+  UINT32     Crc = 0;
+
+  if (SelfRootDir == NULL || CacheName == NULL || EFI_ERROR (gBS->CalculateCrc32 (Buffer, Size, &Crc))) {
+    return ParseXMLArena ((const CHAR8*)Buffer, Dict, (UINT32)Size);
+  }
+
+  BinPath = PoolPrint (L"EFI\\CLOVER\\misc\\%s.bin", CacheName);
+  if (!EFI_ERROR (egLoadFile (SelfRootDir, BinPath, &Blob, &BlobSize))) {
+    Status = PlistLoadBinary (Blob, BlobSize, (UINT32)Size, Crc, Dict);
+    FreePool (Blob);
+    Blob = NULL;
+    if (!EFI_ERROR (Status)) {
+      DBG ("Using binary snapshot %s\n", BinPath);
+      FreePool (BinPath);
+      return Status;
+    }
+    DBG ("Binary snapshot %s is stale: %r\n", BinPath, Status);
+  }
+
+  Status = ParseXMLArena ((const CHAR8*)Buffer, Dict, (UINT32)Size);
+  if (!EFI_ERROR (Status) &&
+      !EFI_ERROR (PlistSaveBinary (*Dict, (UINT32)Size, Crc, &Blob, &BlobSize))) {
+    egSaveFile (SelfRootDir, BinPath, Blob, BlobSize);
+    FreePool (Blob);
+  }
+  FreePool (BinPath);
+  return Status;
+}
+
 EFI_STATUS
 LoadUserSettings (
                   IN EFI_FILE *RootDir,
@@ -619,6 +666,7 @@ LoadUserSettings (
   CHAR8*     gConfigPtr = NULL;
   CHAR16*    ConfigPlistPath;
   CHAR16*    ConfigOemPath;
+  CHAR16*    CacheName;
 
   //  DbgHeader("LoadUserSettings");
 
@@ -647,7 +695,9 @@ LoadUserSettings (
   }
 
   if (!EFI_ERROR (Status) && gConfigPtr != NULL) {
-    Status = ParseXML ((const CHAR8*)gConfigPtr, Dict, (UINT32)Size);
+    CacheName = PoolPrint (L"%s.plist", ConfName);
+    Status = ParseXMLCached (CacheName, gConfigPtr, Size, Dict);
+    FreePool (CacheName);
     if (EFI_ERROR (Status)) {
       //  Dict = NULL;
       DBG ("config.plist parse error Status=%r\n", Status);
@@ -3056,6 +3106,9 @@ GetEarlyUserSettings (
         }
       }
       gSettings.LinuxScan = TRUE;
+      gSettings.ScanCache = TRUE;
+      Prop = GetProperty (DictPointer, "ThemeCache");
+      gSettings.ThemeCache = !IsPropertyFalse (Prop);
       // Disable loader scan
       Prop = GetProperty (DictPointer, "Scan");
       if (Prop != NULL) {
@@ -3077,6 +3130,9 @@ GetEarlyUserSettings (
           Dict2 = GetProperty (Prop, "Linux");
           gSettings.LinuxScan = !IsPropertyFalse (Dict2);
 
+          Dict2 = GetProperty (Prop, "Cache");
+          gSettings.ScanCache = !IsPropertyFalse (Dict2);
+
           Dict2 = GetProperty (Prop, "Legacy");
           if (Dict2 != NULL) {
             if (Dict2->type == kTagTypeFalse) {
@@ -3628,6 +3684,7 @@ GetThemeTagSettings (
 
   GlobalConfig.BackgroundSharp = 0;
   GlobalConfig.BackgroundDark = 0;
+  GlobalConfig.ImageScaler = SCALER_SHARP;
 
   if (GlobalConfig.BannerFileName != NULL) {
     FreePool (GlobalConfig.BannerFileName);
@@ -3693,6 +3750,7 @@ GetThemeTagSettings (
     egFreeImage (BigBack);
     BigBack = NULL;
   }
+  BigBackKeyed = FALSE;
 
   if (BackgroundImage != NULL) {
     egFreeImage (BackgroundImage);
@@ -3703,6 +3761,7 @@ GetThemeTagSettings (
     egFreeImage (FontImage);
     FontImage = NULL;
   }
+  egFreeTextRuns ();
   FreeScrollBar();
 
   if (IconFormat != NULL) {
@@ -3744,6 +3803,17 @@ GetThemeTagSettings (
     GlobalConfig.BackgroundDark   = IsPropertyTrue(Dict2);
   }
 
+  Dict = GetProperty (DictPointer, "Scaler");
+  if (Dict != NULL && (Dict->type == kTagTypeString) && Dict->string) {
+    if (AsciiStriCmp (Dict->string, "Bilinear") == 0) {
+      GlobalConfig.ImageScaler = SCALER_BILINEAR;
+    } else if (AsciiStriCmp (Dict->string, "Box") == 0) {
+      GlobalConfig.ImageScaler = SCALER_BOX;
+    } else if (AsciiStriCmp (Dict->string, "Lanczos") == 0) {
+      GlobalConfig.ImageScaler = SCALER_LANCZOS;
+    }
+  }
+
   Dict = GetProperty (DictPointer, "Banner");
   if (Dict != NULL) {
     // retain for legacy themes.
@@ -4122,6 +4192,7 @@ LoadTheme (CHAR16 *TestTheme)
   TagPtr     ThemeDict = NULL;
   CHAR8      *ThemePtr = NULL;
   UINTN      Size      = 0;
+  CHAR16     *CacheName;
 
   if (TestTheme != NULL) {
     if (ThemePath != NULL) {
@@ -4146,6 +4217,7 @@ LoadTheme (CHAR16 *TestTheme)
       if (!EFI_ERROR (Status)) {
         Status = egLoadFile(ThemeDir, CONFIG_THEME_SVG, (UINT8**)&ThemePtr, &Size);
         if (!EFI_ERROR(Status) && (ThemePtr != NULL) && (Size != 0)) {
+          egThemeCacheOpen(TestTheme, ThemePtr, Size);
           Status = ParseSVGTheme((const CHAR8*)ThemePtr, &ThemeDict, 0);
           if (EFI_ERROR(Status)) {
             ThemeDict = NULL;
@@ -4158,7 +4230,10 @@ LoadTheme (CHAR16 *TestTheme)
         } else {
           Status = egLoadFile(ThemeDir, CONFIG_THEME_FILENAME, (UINT8**)&ThemePtr, &Size);
           if (!EFI_ERROR (Status) && (ThemePtr != NULL) && (Size != 0)) {
-            Status = ParseXML((const CHAR8*)ThemePtr, &ThemeDict, 0);
+            egThemeCacheOpen(TestTheme, ThemePtr, Size);
+            CacheName = PoolPrint(L"theme-%s.plist", TestTheme);
+            Status = ParseXMLCached(CacheName, ThemePtr, Size, &ThemeDict);
+            FreePool(CacheName);
             if (EFI_ERROR (Status)) {
               ThemeDict = NULL;
             }
@@ -4193,6 +4268,7 @@ InitTheme(
   UINTN      Rnd;
 
   DbgHeader("InitTheme");
+  egThemeCacheOpen(NULL, NULL, 0); // off until a theme is loaded
   GlobalConfig.TypeSVG = FALSE;
   GlobalConfig.BootCampStyle = FALSE;
   GlobalConfig.Scale = 1.0f;
@@ -4225,6 +4301,7 @@ InitTheme(
     egFreeImage (FontImage);
     FontImage = NULL;
   }
+  egFreeTextRuns ();
 
   Rnd = ((Time != NULL) && (ThemesNum != 0)) ? Time->Second % ThemesNum : 0;
 
@@ -4414,6 +4491,7 @@ finish:
   if (ChosenTheme != NULL) {
     FreePool (ChosenTheme);
   }
+  PreloadBuiltinIcons();
   PrepareFont();
   return Status;
 }
@@ -8130,29 +8208,22 @@ SetDevices (LOADER_ENTRY *Entry)
 
   if (StringDirty) {
     EFI_PHYSICAL_ADDRESS BufferPtr = EFI_SYSTEM_TABLE_MAX_ADDRESS; //0xFE000000;
-    device_inject_stringlength                   = device_inject_string->length * 2;
+    device_inject_stringlength                   = device_inject_string->length;
     DBG ("stringlength = %d\n", device_inject_stringlength);
-    // gDeviceProperties            = AllocateAlignedPages EFI_SIZE_TO_PAGES (device_inject_stringlength + 1), 64);
 
     Status = gBS->AllocatePages (
                                  AllocateMaxAddress,
                                  EfiACPIReclaimMemory,
-                                 EFI_SIZE_TO_PAGES (device_inject_stringlength + 1),
+                                 EFI_SIZE_TO_PAGES (device_inject_stringlength),
                                  &BufferPtr
                                  );
 
     if (!EFI_ERROR (Status)) {
       mProperties       = (UINT8*)(UINTN)BufferPtr;
-      gDeviceProperties = (VOID*)devprop_generate_string (device_inject_string);
-      gDeviceProperties[device_inject_stringlength] = 0;
-      //     DBG (gDeviceProperties);
-      //     DBG ("\n");
-      //     StringDirty = FALSE;
-      //-------
-      mPropSize = (UINT32)AsciiStrLen (gDeviceProperties) / 2;
-      //     DBG ("Preliminary size of mProperties=%d\n", mPropSize);
-      mPropSize = hex2bin (gDeviceProperties, mProperties, mPropSize);
+      // binary straight from the devices, no hex string and hex2bin round trip
+      mPropSize = devprop_generate_data (device_inject_string, mProperties, device_inject_stringlength);
       //     DBG ("Final size of mProperties=%d\n", mPropSize);
+      //     StringDirty = FALSE;
       //---------
       //      Status = egSaveFile(SelfRootDir,  L"EFI\\CLOVER\\misc\\devprop.bin", (UINT8*)mProperties, mPropSize);
       //and now we can free memory?
@@ -208,15 +208,38 @@ DevPropDevice *devprop_add_device_pci(DevPropString *StringBuf, pci_dt_t *PciDt,
 
 
 
+// grow device->data by doubling, so adding N values copies O(N) bytes
+STATIC BOOLEAN devprop_reserve(DevPropDevice *device, UINT32 size)
+{
+  UINT32 newsize;
+  UINT8 *newdata;
+
+  if (size <= device->data_allocated) {
+    return TRUE;
+  }
+  newsize = device->data_allocated ? device->data_allocated : 256;
+  while (newsize < size) {
+    if (newsize > MAX_UINT32 / 2) {
+      newsize = size;
+      break;
+    }
+    newsize *= 2;
+  }
+  newdata = (UINT8*)ReallocatePool(device->data_allocated, newsize, device->data);
+  if (!newdata) {
+    return FALSE;
+  }
+  device->data = newdata;
+  device->data_allocated = newsize;
+  return TRUE;
+}
+
 BOOLEAN devprop_add_value(DevPropDevice *device, CHAR8 *nm, UINT8 *vl, UINTN len)
 {
   UINT32 offset;
-  UINT32 off;
   UINT32 length;
   UINT8 *data;
   UINTN i, l;
-  UINT32 *datalength;
-  UINT8 *newdata;
 
   if(!device || !nm || !vl /*|| !len*/) //rehabman: allow zero length data
     return FALSE;
@@ -227,100 +250,123 @@ BOOLEAN devprop_add_value(DevPropDevice *device, CHAR8 *nm, UINT8 *vl, UINTN len
    DBG("\n"); */
   l = AsciiStrLen(nm);
   length = (UINT32)((l * 2) + len + (2 * sizeof(UINT32)) + 2);
-  data = (UINT8*)AllocateZeroPool(length);
-  if(!data)
+  offset = device->length - (24 + (6 * device->num_pci_devpaths));
+  if (!devprop_reserve(device, offset + length))
     return FALSE;
 
-  off= 0;
+  // name: size, UTF-16 chars, terminator; value: size, bytes
+  data = device->data + offset;
+  WriteUnaligned32((UINT32*)data, (UINT32)((l * 2) + 6));
+  data += 4;
+  for(i = 0 ; i < l ; i++) {
+    *data++ = *nm++;
+    *data++ = 0;
+  }
+  *data++ = 0;
+  *data++ = 0;
+  WriteUnaligned32((UINT32*)data, (UINT32)(len + 4));
+  data += 4;
+  CopyMem((VOID*)data, (VOID*)vl, len);
 
-  data[off+1] = (UINT8)(((l * 2) + 6) >> 8);
-  data[off] =   ((l * 2) + 6) & 0x00FF;
+  device->length += length;
+  device->string->length += length;
+  device->numentries++;
+  return TRUE;
+}
 
-  off += 4;
+STATIC UINT8 *devprop_put16(UINT8 *p, UINT16 v)
+{
+  WriteUnaligned16((UINT16*)p, v);
+  return p + 2;
+}
 
-  for(i = 0 ; i < l ; i++, off += 2) {
-    data[off] = *nm++;
-  }
+STATIC UINT8 *devprop_put32(UINT8 *p, UINT32 v)
+{
+  WriteUnaligned32((UINT32*)p, v);
+  return p + 4;
+}
 
-  off += 2;
-  l = len;
-  datalength = (UINT32*)&data[off];
-  *datalength = (UINT32)(l + 4);
-  off += 4;
-  for(i = 0 ; i < l ; i++, off++) {
-    data[off] = *vl++;
-  }
+// binary device-properties as handed to boot.efi; the WHAT fields are big endian
+// returns the size written, 0 if it does not fit in size
+UINT32 devprop_generate_data(DevPropString *StringBuf, UINT8 *buffer, UINT32 size)
+{
+  DevPropDevice *device;
+  UINT32 total = 12;
+  UINT32 datalen;
+  UINT8 *p = buffer;
+  INT32 i;
+  UINT32 x;
 
-  offset = device->length - (24 + (6 * device->num_pci_devpaths));
+  if(!StringBuf || !buffer)
+    return 0;
 
-  newdata = (UINT8*)AllocateZeroPool((length + offset));
-  if(!newdata)
-    return FALSE;
-  if((device->data) && (offset > 1)) {
- 		CopyMem((VOID*)newdata, (VOID*)device->data, offset);
+  for(i = 0; i < StringBuf->numentries; i++) {
+    total += StringBuf->entries[i]->length;
   }
+  if (total > size)
+    return 0;
 
-  CopyMem((VOID*)(newdata + offset), (VOID*)data, length);
+  p = devprop_put32(p, StringBuf->length);
+  p = devprop_put32(p, SwapBytes32(StringBuf->WHAT2));
+  p = devprop_put16(p, StringBuf->numentries);
+  p = devprop_put16(p, SwapBytes16(StringBuf->WHAT3));
 
-  device->length += length;
-  device->string->length += length;
-  device->numentries++;
-  device->data = newdata;
+  for(i = 0; i < StringBuf->numentries; i++) {
+    device = StringBuf->entries[i];
+    p = devprop_put32(p, device->length);
+    p = devprop_put16(p, device->numentries);
+    p = devprop_put16(p, SwapBytes16(device->WHAT2));
+
+    *p++ = device->acpi_dev_path.type;
+    *p++ = device->acpi_dev_path.subtype;
+    p = devprop_put16(p, device->acpi_dev_path.length);
+    p = devprop_put32(p, device->acpi_dev_path._HID);
+    p = devprop_put32(p, device->acpi_dev_path._UID);
+
+    for(x = 0; x < device->num_pci_devpaths; x++) {
+      *p++ = device->pci_dev_path[x].type;
+      *p++ = device->pci_dev_path[x].subtype;
+      p = devprop_put16(p, device->pci_dev_path[x].length);
+      *p++ = device->pci_dev_path[x].function;
+      *p++ = device->pci_dev_path[x].device;
+    }
 
-  FreePool(data);
-  return TRUE;
+    *p++ = device->path_end.type;
+    *p++ = device->path_end.subtype;
+    p = devprop_put16(p, device->path_end.length);
+
+    datalen = device->length - (24 + (6 * device->num_pci_devpaths));
+    if (datalen) {
+      CopyMem(p, device->data, datalen);
+      p += datalen;
+    }
+  }
+  return (UINT32)(p - buffer);
 }
 
 CHAR8 *devprop_generate_string(DevPropString *StringBuf)
 {
-  UINTN len = StringBuf->length * 2;
-  INT32 i = 0;
-  UINT32 x = 0;
-  CHAR8 *buffer = (CHAR8*)AllocatePool(len + 1);
-  CHAR8 *ptr = buffer;
+  STATIC CONST CHAR8 hex[] = "0123456789ABCDEF";
+  UINT32 len = StringBuf->length;
+  UINT32 i;
+  CHAR8 *buffer = (CHAR8*)AllocatePool(len * 2 + 1);
+  UINT8 *data;
 
   //   DBG("devprop_generate_string\n");
   if(!buffer)
     return NULL;
 
-  AsciiSPrint(buffer, len, "%08x%08x%04x%04x", SwapBytes32(StringBuf->length), StringBuf->WHAT2,
-              SwapBytes16(StringBuf->numentries), StringBuf->WHAT3);
-  buffer += 24;
-
-  while(i < StringBuf->numentries) {
-    UINT8 *dataptr = StringBuf->entries[i]->data;
-    AsciiSPrint(buffer, len, "%08x%04x%04x", SwapBytes32(StringBuf->entries[i]->length),
-                SwapBytes16(StringBuf->entries[i]->numentries), StringBuf->entries[i]->WHAT2); //FIXME: wrong buffer sizes!
-
-    buffer += 16;
-    AsciiSPrint(buffer, len, "%02x%02x%04x%08x%08x", StringBuf->entries[i]->acpi_dev_path.type,
-                StringBuf->entries[i]->acpi_dev_path.subtype,
-                SwapBytes16(StringBuf->entries[i]->acpi_dev_path.length),
-                SwapBytes32(StringBuf->entries[i]->acpi_dev_path._HID),
-                SwapBytes32(StringBuf->entries[i]->acpi_dev_path._UID));
-
-    buffer += 24;
-    for(x = 0; x < StringBuf->entries[i]->num_pci_devpaths; x++) {
-      AsciiSPrint(buffer, len, "%02x%02x%04x%02x%02x", StringBuf->entries[i]->pci_dev_path[x].type,
-                  StringBuf->entries[i]->pci_dev_path[x].subtype,
-                  SwapBytes16(StringBuf->entries[i]->pci_dev_path[x].length),
-                  StringBuf->entries[i]->pci_dev_path[x].function,
-                  StringBuf->entries[i]->pci_dev_path[x].device);
-      buffer += 12;
-    }
-
-    AsciiSPrint(buffer, len, "%02x%02x%04x", StringBuf->entries[i]->path_end.type,
-                StringBuf->entries[i]->path_end.subtype,
-                SwapBytes16(StringBuf->entries[i]->path_end.length));
-
-    buffer += 8;
-    for(x = 0; x < (StringBuf->entries[i]->length) - (24 + (6 * StringBuf->entries[i]->num_pci_devpaths)); x++) {
-      AsciiSPrint(buffer, len, "%02x", *dataptr++);
-      buffer += 2;
-    }
-    i++;
+  // encode into the upper half, then expand to hex in place from the start:
+  // byte i is read at len + i before the digits land at 2i and 2i + 1
+  data = (UINT8*)buffer + len;
+  len = devprop_generate_data(StringBuf, data, len);
+  for(i = 0; i < len; i++) {
+    UINT8 b = data[i];
+    buffer[2 * i] = hex[b >> 4];
+    buffer[2 * i + 1] = hex[b & 0x0F];
   }
-  return ptr;
+  buffer[2 * len] = '\0';
+  return buffer;
 }
 
 VOID devprop_free_string(DevPropString *StringBuf)
@@ -334,9 +380,12 @@ VOID devprop_free_string(DevPropString *StringBuf)
       if(StringBuf->entries[i]->data) {
         FreePool(StringBuf->entries[i]->data);
       }
+      FreePool(StringBuf->entries[i]);
     }
   }
-  FreePool(StringBuf->entries);
+  if (StringBuf->entries) {
+    FreePool(StringBuf->entries);
+  }
   FreePool(StringBuf);
   //	StringBuf = NULL;
 }
@@ -137,6 +137,7 @@ struct DevPropDevice {
 	// ------------------------
 	UINT8	 num_pci_devpaths;
 	struct DevPropString *string;
+	UINT32 data_allocated;	// bytes allocated at data, grows by doubling
 	// ------------------------
 };
 
@@ -164,6 +165,7 @@ DevPropString	*devprop_create_string(void);
 DevPropDevice	*devprop_add_device_pci(DevPropString *string, pci_dt_t *PciDt, EFI_DEVICE_PATH_PROTOCOL *DevicePath);
 BOOLEAN			devprop_add_value(DevPropDevice *device, CHAR8 *nm, UINT8 *vl, UINTN len);
 CHAR8			*devprop_generate_string(DevPropString *string);
+UINT32			devprop_generate_data(DevPropString *string, UINT8 *buffer, UINT32 size);
 VOID			devprop_free_string(DevPropString *string);
 
 BOOLEAN set_eth_props(pci_dt_t *eth_dev);
@@ -1720,34 +1720,62 @@ FindBootArgs(IN LOADER_ENTRY *Entry)
   }
 }
 
-BOOLEAN
-KernelUserPatch(IN UINT8 *UKernelData, LOADER_ENTRY *Entry)
+//
+// Applies user KernelToPatch/BooterPatches to Data in as few passes as the
+// order allows: a patch that may touch bytes matched or written by one of
+// the same pass starts the next one, so the result is that of applying them
+// one after another in config order.
+//
+STATIC BOOLEAN
+ApplyUserPatches(IN UINT8 *Data, IN UINT64 DataSize, IN KERNEL_PATCH *Patches, IN INT32 NrPatches, LOADER_ENTRY *Entry)
 {
-  INTN Num, i = 0, y = 0;
-  for (; i < Entry->KernelAndKextPatches->NrKernels; ++i) {
-    DBG_RT(Entry, "Patch[%d]: %a\n", i, Entry->KernelAndKextPatches->KernelPatches[i].Label);
-    if (!Entry->KernelAndKextPatches->KernelPatches[i].MenuItem.BValue) {
-      //DBG_RT(Entry, "Patch[%d]: %a :: is not allowed for booted OS %a\n", i, Entry->KernelAndKextPatches->KernelPatches[i].Label, Entry->OSVersion);
-      DBG_RT(Entry, "==> disabled\n");
+  INTN  Num, i, y = 0;
+  INTN  First = 0;
+  UINTN Slot;
+
+  PatchMatcherInit(&gPatchMatcher);
+  for (i = 0; i <= NrPatches; ++i) {
+    if (i < NrPatches && Patches[i].MenuItem.BValue &&
+        !PatchMatcherConflicts(&gPatchMatcher, Patches[i].Data, Patches[i].MaskFind, Patches[i].DataLen,
+                               Patches[i].Patch, Patches[i].MaskReplace)) {
+      PatchMatcherAdd(&gPatchMatcher, Patches[i].Data, Patches[i].MaskFind, Patches[i].DataLen,
+                      Patches[i].Patch, Patches[i].MaskReplace, Patches[i].Count);
       continue;
     }
+    if (i < NrPatches && !Patches[i].MenuItem.BValue) {
+      continue;
+    }
+
+    // the pass of patches First..i-1
+    PatchMatcherRun(&gPatchMatcher, Data, DataSize);
+    for (Slot = 0; First < i; ++First) {
+      DBG_RT(Entry, "Patch[%d]: %a\n", First, Patches[First].Label);
+      if (!Patches[First].MenuItem.BValue) {
+        DBG_RT(Entry, "==> disabled\n");
+        continue;
+      }
 
-    Num = SearchAndReplaceMask(
-                               UKernelData,
-                               KERNEL_MAX_SIZE,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Data,
-                               Entry->KernelAndKextPatches->KernelPatches[i].MaskFind,
-                               Entry->KernelAndKextPatches->KernelPatches[i].DataLen,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Patch,
-                               Entry->KernelAndKextPatches->KernelPatches[i].MaskReplace,
-                               Entry->KernelAndKextPatches->KernelPatches[i].Count
-                               );
-
-    if (Num) {
-      y++;
+      if (Slot < gPatchMatcher.Count &&
+          gPatchMatcher.Patterns[Slot].Search == Patches[First].Data &&
+          gPatchMatcher.Patterns[Slot].Replace == Patches[First].Patch) {
+        Num = (INTN)gPatchMatcher.Patterns[Slot++].NumReplaces;
+      } else {
+        Num = SearchAndReplaceMask(Data, DataSize, Patches[First].Data, Patches[First].MaskFind, Patches[First].DataLen,
+                                   Patches[First].Patch, Patches[First].MaskReplace, Patches[First].Count);
+      }
+
+      if (Num) {
+        y++;
+      }
+
+      DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
     }
 
-    DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
+    if (i < NrPatches) {
+      PatchMatcherInit(&gPatchMatcher);
+      PatchMatcherAdd(&gPatchMatcher, Patches[i].Data, Patches[i].MaskFind, Patches[i].DataLen,
+                      Patches[i].Patch, Patches[i].MaskReplace, Patches[i].Count);
+    }
   }
   if (Entry->KernelAndKextPatches->KPDebug) {
     gBS->Stall(2000000);
@@ -1756,39 +1784,20 @@ KernelUserPatch(IN UINT8 *UKernelData, LOADER_ENTRY *Entry)
   return (y != 0);
 }
 
+BOOLEAN
+KernelUserPatch(IN UINT8 *UKernelData, LOADER_ENTRY *Entry)
+{
+  return ApplyUserPatches(UKernelData, KERNEL_MAX_SIZE,
+                          Entry->KernelAndKextPatches->KernelPatches,
+                          Entry->KernelAndKextPatches->NrKernels, Entry);
+}
+
 BOOLEAN
 BooterPatch(IN UINT8 *BooterData, IN UINT64 BooterSize, LOADER_ENTRY *Entry)
 {
-  INTN Num, i = 0, y = 0;
-  for (; i < Entry->KernelAndKextPatches->NrBoots; ++i) {
-    DBG_RT(Entry, "Patch[%d]: %a\n", i, Entry->KernelAndKextPatches->BootPatches[i].Label);
-    if (!Entry->KernelAndKextPatches->BootPatches[i].MenuItem.BValue) {
-      DBG_RT(Entry, "==> disabled\n");
-      continue;
-    }
-    
-    Num = SearchAndReplaceMask(
-                               BooterData,
-                               BooterSize,
-                               Entry->KernelAndKextPatches->BootPatches[i].Data,
-                               Entry->KernelAndKextPatches->BootPatches[i].MaskFind,
-                               Entry->KernelAndKextPatches->BootPatches[i].DataLen,
-                               Entry->KernelAndKextPatches->BootPatches[i].Patch,
-                               Entry->KernelAndKextPatches->BootPatches[i].MaskReplace,
-                               Entry->KernelAndKextPatches->BootPatches[i].Count
-                               );
-    
-    if (Num) {
-      y++;
-    }
-    
-    DBG_RT(Entry, "==> %a : %d replaces done\n", Num ? "Success" : "Error", Num);
-  }
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    gBS->Stall(2000000);
-  }
-  
-  return (y != 0);
+  return ApplyUserPatches(BooterData, BooterSize,
+                          Entry->KernelAndKextPatches->BootPatches,
+                          Entry->KernelAndKextPatches->NrBoots, Entry);
 }
 
 VOID
@@ -1800,6 +1809,9 @@ KernelAndKextPatcherInit(IN LOADER_ENTRY *Entry)
 
   PatcherInited = TRUE;
 
+  // kext patch dispatch table, needs only config
+  KextPatcherInit(Entry);
+
   // KernelRelocBase will normally be 0
   // but if OsxAptioFixDrv is used, then it will be > 0
   SetKernelRelocBase();
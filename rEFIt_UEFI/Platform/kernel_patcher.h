@@ -127,6 +127,12 @@ VOID KernelAndKextsPatcherStart(IN LOADER_ENTRY *Entry);
 //
 VOID KextPatcherRegisterKexts(FSINJECTION_PROTOCOL *FSInject, FSI_STRING_LIST *ForceLoadKexts, LOADER_ENTRY *Entry);
 
+//
+// Builds kext patch dispatch table: built-in patchers and KextsToPatch
+// entries hashed by bundle identifier.
+//
+VOID KextPatcherInit(LOADER_ENTRY *Entry);
+
 //
 // Entry for all kext patches.
 // Will iterate through kext in prelinked kernel (kernelcache)
@@ -151,4 +157,36 @@ UINTN SearchAndReplace(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINTN Se
 
 UINTN SearchAndReplaceMask(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize, UINT8 *Replace, UINT8 *MaskReplace, INTN MaxReplaces);
 
+//
+// Multi-pattern patcher: applies all registered patterns in one pass.
+//
+#define PATCH_MATCHER_MAX_PATTERNS 256
+
+typedef struct {
+  UINT8   *Search;
+  UINT8   *MaskSearch;
+  UINT8   *Replace;
+  UINT8   *MaskReplace;
+  UINTN   SearchSize;
+  UINTN   Anchor;       // offset of the byte used for bucket lookup
+  INTN    MaxReplaces;
+  UINTN   NumReplaces;
+  UINT8   *NextPos;     // matches of one pattern do not overlap
+  INT32   Next;         // next pattern in the same bucket
+} PATCH_PATTERN;
+
+typedef struct {
+  UINTN         Count;
+  INT32         Bucket[256];
+  INT32         Wild;   // patterns without fully specified byte
+  PATCH_PATTERN Patterns[PATCH_MATCHER_MAX_PATTERNS];
+} PATCH_MATCHER;
+
+extern PATCH_MATCHER gPatchMatcher;
+
+VOID  PatchMatcherInit(PATCH_MATCHER *Matcher);
+INTN  PatchMatcherAdd(PATCH_MATCHER *Matcher, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize, UINT8 *Replace, UINT8 *MaskReplace, INTN MaxReplaces);
+BOOLEAN PatchMatcherConflicts(PATCH_MATCHER *Matcher, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize, UINT8 *Replace, UINT8 *MaskReplace);
+UINTN PatchMatcherRun(PATCH_MATCHER *Matcher, UINT8 *Source, UINT64 SourceSize);
+
 #endif /* !__LIBSAIO_KERNEL_PATCHER_H */
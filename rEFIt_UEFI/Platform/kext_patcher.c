@@ -124,6 +124,264 @@ UINTN SearchAndReplaceMask(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINT
   return NumReplaces;
 }
 
+//
+// Multi-pattern patcher.
+// All patches for one binary are registered in a PATCH_MATCHER and then
+// applied in a single pass over the binary instead of one pass per patch.
+// Every pattern is anchored on one fully specified byte (mask 0xFF);
+// a 256 entry bucket table keyed by that byte gives the candidates
+// for the current position. Patterns without such byte are tried at
+// every position. The matcher lives in static memory since kexts
+// and kernel are patched during ExitBootServices().
+//
+// Semantics are the same as for SearchAndReplaceMask() per pattern:
+// matches of one pattern do not overlap and MaxReplaces <= 0 means
+// no restriction. Different patterns see each other's replaces
+// in the order of their match positions, so callers put a pattern for
+// which PatchMatcherConflicts() is TRUE into the next pass: then the
+// result is that of applying the patches one after another.
+//
+
+//
+// Rough weight of a byte being a bad anchor in x86 code: the lower
+// the better. Common opcodes/prefixes and 0x00/0xFF produce many
+// false candidates.
+//
+STATIC UINTN PatchAnchorWeight(UINT8 Byte)
+{
+  switch (Byte) {
+    case 0x00:
+    case 0xFF:
+      return 4;
+    case 0x48:
+    case 0x89:
+    case 0x8B:
+    case 0x0F:
+    case 0x4C:
+    case 0xE8:
+    case 0x01:
+      return 3;
+    case 0x74:
+    case 0x75:
+    case 0x85:
+    case 0x83:
+    case 0x41:
+    case 0x45:
+    case 0x49:
+      return 2;
+    default:
+      return 1;
+  }
+}
+
+VOID PatchMatcherInit(PATCH_MATCHER *Matcher)
+{
+  UINTN Index;
+
+  Matcher->Count = 0;
+  Matcher->Wild = -1;
+  for (Index = 0; Index < 256; Index++) {
+    Matcher->Bucket[Index] = -1;
+  }
+}
+
+//
+// Registers a pattern. Returns its index or -1 if there is no room for it,
+// in which case the caller should fall back to SearchAndReplaceMask().
+//
+INTN PatchMatcherAdd(PATCH_MATCHER *Matcher, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize,
+                     UINT8 *Replace, UINT8 *MaskReplace, INTN MaxReplaces)
+{
+  PATCH_PATTERN *Pattern;
+  INT32         *Link;
+  UINTN         Index;
+  UINTN         Weight;
+  UINTN         BestWeight = 0;
+  INTN          Anchor = -1;
+
+  if (!Search || !Replace || !SearchSize || Matcher->Count >= PATCH_MATCHER_MAX_PATTERNS) {
+    return -1;
+  }
+
+  for (Index = 0; Index < SearchSize; Index++) {
+    if (MaskSearch && MaskSearch[Index] != 0xFF) {
+      continue;
+    }
+    Weight = PatchAnchorWeight(Search[Index]);
+    if (Anchor < 0 || Weight < BestWeight) {
+      Anchor = (INTN)Index;
+      BestWeight = Weight;
+      if (Weight == 1) {
+        break;
+      }
+    }
+  }
+
+  Pattern = &Matcher->Patterns[Matcher->Count];
+  Pattern->Search = Search;
+  Pattern->MaskSearch = MaskSearch;
+  Pattern->Replace = Replace;
+  Pattern->MaskReplace = MaskReplace;
+  Pattern->SearchSize = SearchSize;
+  Pattern->Anchor = (Anchor < 0) ? 0 : (UINTN)Anchor;
+  Pattern->MaxReplaces = MaxReplaces;
+  Pattern->NumReplaces = 0;
+  Pattern->Next = -1;
+
+  // append to the tail to keep config order inside a bucket
+  Link = (Anchor < 0) ? &Matcher->Wild : &Matcher->Bucket[Search[Anchor]];
+  while (*Link >= 0) {
+    Link = &Matcher->Patterns[*Link].Next;
+  }
+  *Link = (INT32)Matcher->Count;
+
+  return (INTN)Matcher->Count++;
+}
+
+//
+// Byte Index of the pattern as far as it is known: what it matches, or
+// what is there after it was replaced. Known gets the bits that are.
+//
+STATIC UINT8 PatchPatternByte(PATCH_PATTERN *Pattern, UINTN Index, BOOLEAN Replaced, UINT8 *Known)
+{
+  UINT8 MaskFind = Pattern->MaskSearch ? Pattern->MaskSearch[Index] : 0xFF;
+  UINT8 MaskWrite;
+
+  if (!Replaced) {
+    *Known = MaskFind;
+    return Pattern->Search[Index];
+  }
+  MaskWrite = Pattern->MaskReplace ? Pattern->MaskReplace[Index] : 0xFF;
+  *Known = MaskFind | MaskWrite;
+  return (UINT8)((Pattern->Replace[Index] & MaskWrite) | (Pattern->Search[Index] & ~MaskWrite));
+}
+
+// TRUE if B placed at Delta from A agrees with A on every byte they share
+STATIC BOOLEAN PatchPatternsAgree(PATCH_PATTERN *A, BOOLEAN ReplacedA, PATCH_PATTERN *B, BOOLEAN ReplacedB, INTN Delta)
+{
+  UINTN From = (Delta > 0) ? (UINTN)Delta : 0;
+  UINTN To = MIN(A->SearchSize, (UINTN)(Delta + (INTN)B->SearchSize));
+  UINTN k;
+  UINT8 ByteA, ByteB, KnownA, KnownB;
+
+  for (k = From; k < To; k++) {
+    ByteA = PatchPatternByte(A, k, ReplacedA, &KnownA);
+    ByteB = PatchPatternByte(B, k - Delta, ReplacedB, &KnownB);
+    if (((ByteA ^ ByteB) & KnownA & KnownB) != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+//
+// TRUE if the pattern can not go into the same pass as those registered:
+// there is no room, or it may match over bytes one of them matches or
+// writes, or write bytes one of them matches.
+//
+BOOLEAN PatchMatcherConflicts(PATCH_MATCHER *Matcher, UINT8 *Search, UINT8 *MaskSearch, UINTN SearchSize,
+                              UINT8 *Replace, UINT8 *MaskReplace)
+{
+  PATCH_PATTERN New;
+  PATCH_PATTERN *Old;
+  UINTN         Index;
+  INTN          Delta;
+
+  if (Matcher->Count >= PATCH_MATCHER_MAX_PATTERNS) {
+    return TRUE;
+  }
+  if (!Search || !Replace || !SearchSize) {
+    return FALSE;
+  }
+  New.Search = Search;
+  New.MaskSearch = MaskSearch;
+  New.Replace = Replace;
+  New.MaskReplace = MaskReplace;
+  New.SearchSize = SearchSize;
+
+  for (Index = 0; Index < Matcher->Count; Index++) {
+    Old = &Matcher->Patterns[Index];
+    for (Delta = 1 - (INTN)SearchSize; Delta < (INTN)Old->SearchSize; Delta++) {
+      if (PatchPatternsAgree(Old, FALSE, &New, FALSE, Delta) ||
+          PatchPatternsAgree(Old, TRUE, &New, FALSE, Delta) ||
+          PatchPatternsAgree(Old, FALSE, &New, TRUE, Delta)) {
+        return TRUE;
+      }
+    }
+  }
+  return FALSE;
+}
+
+STATIC BOOLEAN PatchMatcherTry(PATCH_PATTERN *Pattern, UINT8 *Source, UINT8 *Start, UINT8 *End)
+{
+  if (Start < Source || Start < Pattern->NextPos || (UINTN)(End - Start) < Pattern->SearchSize) {
+    return FALSE;
+  }
+  if (Pattern->MaxReplaces > 0 && Pattern->NumReplaces >= (UINTN)Pattern->MaxReplaces) {
+    return FALSE;
+  }
+  if (!CompareMemMask(Start, Pattern->Search, Pattern->MaskSearch, Pattern->SearchSize)) {
+    return FALSE;
+  }
+  CopyMemMask(Start, Pattern->Replace, Pattern->MaskReplace, Pattern->SearchSize);
+  Pattern->NumReplaces++;
+  Pattern->NextPos = Start + Pattern->SearchSize;
+  return TRUE;
+}
+
+//
+// Applies all registered patterns to Source in one pass.
+// Per pattern replace counts are left in Matcher->Patterns[i].NumReplaces.
+// Returns total number of replaces done.
+//
+UINTN PatchMatcherRun(PATCH_MATCHER *Matcher, UINT8 *Source, UINT64 SourceSize)
+{
+  UINT8         *Pos;
+  UINT8         *End;
+  PATCH_PATTERN *Pattern;
+  INT32         Index;
+  UINTN         Total = 0;
+  UINTN         Remaining = 0;
+  UINTN         i;
+
+  if (!Source || !Matcher->Count) {
+    return 0;
+  }
+
+  for (i = 0; i < Matcher->Count; i++) {
+    Matcher->Patterns[i].NumReplaces = 0;
+    Matcher->Patterns[i].NextPos = Source;
+    if (Matcher->Patterns[i].MaxReplaces <= 0) {
+      Remaining = MAX_UINTN;
+    } else if (Remaining != MAX_UINTN) {
+      Remaining += Matcher->Patterns[i].MaxReplaces;
+    }
+  }
+
+  End = Source + SourceSize;
+  for (Pos = Source; Pos < End && Remaining > 0; Pos++) {
+    for (Index = Matcher->Bucket[*Pos]; Index >= 0; Index = Pattern->Next) {
+      Pattern = &Matcher->Patterns[Index];
+      if (PatchMatcherTry(Pattern, Source, Pos - Pattern->Anchor, End)) {
+        Total++;
+        Remaining--;
+      }
+    }
+    for (Index = Matcher->Wild; Index >= 0; Index = Pattern->Next) {
+      Pattern = &Matcher->Patterns[Index];
+      if (PatchMatcherTry(Pattern, Source, Pos, End)) {
+        Total++;
+        Remaining--;
+      }
+    }
+  }
+
+  return Total;
+}
+
+// shared by kernel, booter and kext patchers - they never run concurrently
+PATCH_MATCHER gPatchMatcher;
+
 
 UINTN SearchAndReplaceTxt(UINT8 *Source, UINT64 SourceSize, UINT8 *Search, UINTN SearchSize, UINT8 *Replace, INTN MaxReplaces)
 {
@@ -335,7 +593,6 @@ VOID ATIConnectorsPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT
   
   DBG_RT(Entry, "\nATIConnectorsPatch: driverAddr = %x, driverSize = %x\nController = %s\n",
          Driver, DriverSize, Entry->KernelAndKextPatches->KPATIConnectorsController);
-  ExtractKextBundleIdentifier(InfoPlist);
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
   
   // number of occurences od Data should be 1
@@ -389,9 +646,6 @@ VOID AppleIntelCPUPMPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UI
   UINTN   Count = 0;
 
   DBG_RT(Entry, "\nAppleIntelCPUPMPatch: driverAddr = %x, driverSize = %x\n", Driver, DriverSize);
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    ExtractKextBundleIdentifier(InfoPlist);
-  }
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
 
   //TODO: we should scan only __text __TEXT
@@ -489,9 +743,6 @@ VOID AppleRTCPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 In
   UINTN   NumMoj4 = 0;
   
   DBG_RT(Entry, "\nAppleRTCPatch: driverAddr = %x, driverSize = %x\n", Driver, DriverSize);
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    ExtractKextBundleIdentifier(InfoPlist);
-  }
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
   
   if (is64BitKernel) {
@@ -589,10 +840,6 @@ VOID DellSMBIOSPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32
     UINTN gPatchCount = 0;
     
     DBG_RT(Entry, "\nDellSMBIOSPatch: driverAddr = %x, driverSize = %x\n", Driver, DriverSize);
-    if (Entry->KernelAndKextPatches->KPDebug)
-    {
-        ExtractKextBundleIdentifier(InfoPlist);
-    }
     DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
     
     //
@@ -628,9 +875,6 @@ VOID SNBE_AICPUPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32
     UINT64 os_ver = AsciiOSVersionToUint64(Entry->OSVersion);
     
     DBG_RT(Entry, "\nSNBE_AICPUPatch: driverAddr = %x, driverSize = %x\n", Driver, DriverSize);
-    if (Entry->KernelAndKextPatches->KPDebug) {
-        ExtractKextBundleIdentifier(InfoPlist);
-    }
     
     DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
     
@@ -906,9 +1150,6 @@ VOID BDWE_IOPCIPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32
   UINT64 os_ver = AsciiOSVersionToUint64(Entry->OSVersion);
     
   DBG_RT(Entry, "\nBDWE_IOPCIPatch: driverAddr = %x, driverSize = %x\n", Driver, DriverSize);
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    ExtractKextBundleIdentifier(InfoPlist);
-  }
     
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
   //
@@ -950,6 +1191,60 @@ VOID BDWE_IOPCIPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32
 // Generic kext patch functions
 //
 //
+
+// KextPatches indexes of binary patches waiting in gPatchMatcher,
+// -1 when batching is not active
+STATIC INT32  AnyKextPatchesQueue[PATCH_MATCHER_MAX_PATTERNS];
+STATIC INTN   AnyKextPatchesQueued = -1;
+
+//
+// Starts collecting binary patches for one kext into gPatchMatcher.
+//
+VOID AnyKextPatchesStart()
+{
+  PatchMatcherInit(&gPatchMatcher);
+  AnyKextPatchesQueued = 0;
+}
+
+//
+// Applies the queued binary patches to the kext in one pass.
+//
+STATIC VOID AnyKextPatchesRun(UINT8 *Driver, UINT32 DriverSize, LOADER_ENTRY *Entry)
+{
+  INTN    Ind;
+  UINTN   Num;
+
+  if (AnyKextPatchesQueued > 0) {
+    PatchMatcherRun(&gPatchMatcher, Driver, DriverSize);
+    for (Ind = 0; Ind < AnyKextPatchesQueued; Ind++) {
+      Num = gPatchMatcher.Patterns[Ind].NumReplaces;
+      DBG_RT(Entry, "\nAnyKextPatch %d: %a\n", AnyKextPatchesQueue[Ind],
+             Entry->KernelAndKextPatches->KextPatches[AnyKextPatchesQueue[Ind]].Label);
+      if (Num > 0) {
+        DBG_RT(Entry, "==> patched %d times!\n", Num);
+      } else {
+        DBG_RT(Entry, "==> NOT patched!\n");
+      }
+    }
+    if (Entry->KernelAndKextPatches->KPDebug) {
+      gBS->Stall(2000000);
+    }
+  }
+  PatchMatcherInit(&gPatchMatcher);
+  AnyKextPatchesQueued = 0;
+}
+
+//
+// Applies the binary patches still queued and stops collecting.
+//
+VOID AnyKextPatchesFlush(UINT8 *Driver, UINT32 DriverSize, LOADER_ENTRY *Entry)
+{
+  if (AnyKextPatchesQueued > 0) {
+    AnyKextPatchesRun(Driver, DriverSize, Entry);
+  }
+  AnyKextPatchesQueued = -1;
+}
+
 VOID AnyKextPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, INT32 N, LOADER_ENTRY *Entry)
 {
   UINTN   Num = 0;
@@ -963,15 +1258,35 @@ VOID AnyKextPatch(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 Inf
     return;
   }
 
-  if (Entry->KernelAndKextPatches->KPDebug) {
-    ExtractKextBundleIdentifier(InfoPlist);
-  }
 
   DBG_RT(Entry, "Kext: %a\n", gKextBundleIdentifier);
 
   if (!Entry->KernelAndKextPatches->KextPatches[N].IsPlistPatch) {
     // kext binary patch
     DBG_RT(Entry, "Binary patch\n");
+    // one that depends on the order of those queued waits for them to be applied
+    if (AnyKextPatchesQueued > 0 &&
+        PatchMatcherConflicts(&gPatchMatcher,
+                              Entry->KernelAndKextPatches->KextPatches[N].Data,
+                              Entry->KernelAndKextPatches->KextPatches[N].MaskFind,
+                              Entry->KernelAndKextPatches->KextPatches[N].DataLen,
+                              Entry->KernelAndKextPatches->KextPatches[N].Patch,
+                              Entry->KernelAndKextPatches->KextPatches[N].MaskReplace)) {
+      AnyKextPatchesRun(Driver, DriverSize, Entry);
+    }
+    if (AnyKextPatchesQueued >= 0 &&
+        PatchMatcherAdd(&gPatchMatcher,
+                        Entry->KernelAndKextPatches->KextPatches[N].Data,
+                        Entry->KernelAndKextPatches->KextPatches[N].MaskFind,
+                        Entry->KernelAndKextPatches->KextPatches[N].DataLen,
+                        Entry->KernelAndKextPatches->KextPatches[N].Patch,
+                        Entry->KernelAndKextPatches->KextPatches[N].MaskReplace,
+                        -1) >= 0) {
+      // applied together with other binary patches for this kext by AnyKextPatchesFlush()
+      AnyKextPatchesQueue[AnyKextPatchesQueued++] = N;
+      DBG_RT(Entry, "==> queued\n");
+      return;
+    }
     Num = SearchAndReplaceMask(Driver,
                                DriverSize,
                                Entry->KernelAndKextPatches->KextPatches[N].Data,
@@ -1032,13 +1347,84 @@ VOID KextPatcherRegisterKexts(FSINJECTION_PROTOCOL *FSInject, FSI_STRING_LIST *F
 }
 
 //
-// PatchKext is called for every kext from prelinked kernel (kernelcache) or from DevTree (booting with drivers).
-// Add kext detection code here and call kext specific patch function.
+// Kext patch dispatch table.
+// Built once by KextPatcherInit(): built-in patchers and KextsToPatch entries
+// with bundle id names are hashed by exact bundle identifier, KextsToPatch
+// entries with partial names (no '.') go to a separate substring list.
+// PatchKext() then costs one bundle id extraction and one lookup per kext.
+// Static storage - we are running from ExitBootServices().
 //
-VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, LOADER_ENTRY *Entry)
+#define KEXT_DISPATCH_MAX_ENTRIES 512
+#define KEXT_DISPATCH_BUCKETS     128
+
+typedef VOID (*KEXT_PATCHER)(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, LOADER_ENTRY *Entry);
+
+typedef struct {
+  CHAR8         *BundleId;
+  KEXT_PATCHER  Patcher;    // built-in patcher or NULL for KextsToPatch entry
+  BOOLEAN       *Enabled;   // built-in is enabled if *Enabled, checked at patch time
+  BOOLEAN       Exclusive;  // no other patches for this kext
+  INT32         PatchIndex; // KextsToPatch index
+  INT32         Next;
+} KEXT_DISPATCH_ENTRY;
+
+STATIC KEXT_DISPATCH_ENTRY  mKextDispatch[KEXT_DISPATCH_MAX_ENTRIES];
+STATIC INT32                mKextDispatchBucket[KEXT_DISPATCH_BUCKETS];
+STATIC INT32                mKextDispatchPartial;
+STATIC UINTN                mKextDispatchCount;
+STATIC BOOLEAN              mKextDispatchFull;
+STATIC BOOLEAN              mAlwaysEnabled = TRUE;
+
+STATIC UINTN KextDispatchHash(CHAR8 *BundleId)
 {
-  INT32 i;
-  
+  UINT32 Hash = 2166136261u;
+
+  while (*BundleId != '\0') {
+    Hash = (Hash ^ (UINT8)*BundleId++) * 16777619u;
+  }
+  return Hash % KEXT_DISPATCH_BUCKETS;
+}
+
+STATIC VOID KextDispatchAdd(CHAR8 *BundleId, KEXT_PATCHER Patcher, BOOLEAN *Enabled, BOOLEAN Exclusive, INT32 PatchIndex, BOOLEAN Partial)
+{
+  KEXT_DISPATCH_ENTRY *DispatchEntry;
+  INT32               *Link;
+
+  if (mKextDispatchCount >= KEXT_DISPATCH_MAX_ENTRIES) {
+    mKextDispatchFull = TRUE;
+    return;
+  }
+  DispatchEntry = &mKextDispatch[mKextDispatchCount];
+  DispatchEntry->BundleId = BundleId;
+  DispatchEntry->Patcher = Patcher;
+  DispatchEntry->Enabled = Enabled;
+  DispatchEntry->Exclusive = Exclusive;
+  DispatchEntry->PatchIndex = PatchIndex;
+  DispatchEntry->Next = -1;
+
+  // keep registration order - it defines patching order
+  Link = Partial ? &mKextDispatchPartial : &mKextDispatchBucket[KextDispatchHash(BundleId)];
+  while (*Link >= 0) {
+    Link = &mKextDispatch[*Link].Next;
+  }
+  *Link = (INT32)mKextDispatchCount++;
+}
+
+//
+// Builds kext patch dispatch table. Called from KernelAndKextPatcherInit().
+//
+VOID KextPatcherInit(LOADER_ENTRY *Entry)
+{
+  INT32   i;
+  CHAR8   *Name;
+
+  mKextDispatchCount = 0;
+  mKextDispatchFull = FALSE;
+  mKextDispatchPartial = -1;
+  for (i = 0; i < KEXT_DISPATCH_BUCKETS; i++) {
+    mKextDispatchBucket[i] = -1;
+  }
+
   if (Entry->KernelAndKextPatches->KPATIConnectorsController != NULL) {
     //
     // ATIConnectors
@@ -1046,73 +1432,108 @@ VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPl
     if (!ATIConnectorsPatchInited) {
       ATIConnectorsPatchInit(Entry);
     }
-    if (   AsciiStrStr(InfoPlist, ATIKextBundleId[0]) != NULL  // ATI boundle id
-        || AsciiStrStr(InfoPlist, ATIKextBundleId[1]) != NULL  // AMD boundle id
-        || AsciiStrStr(InfoPlist, "com.apple.kext.ATIFramebuffer") != NULL // SnowLeo
-        || AsciiStrStr(InfoPlist, "com.apple.kext.AMDFramebuffer") != NULL //Maverics
-        ) {
-      ATIConnectorsPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-      return;
+    KextDispatchAdd(ATIKextBundleId[0], ATIConnectorsPatch, &mAlwaysEnabled, TRUE, -1, FALSE); // ATI boundle id
+    KextDispatchAdd(ATIKextBundleId[1], ATIConnectorsPatch, &mAlwaysEnabled, TRUE, -1, FALSE); // AMD boundle id
+    KextDispatchAdd("com.apple.kext.ATIFramebuffer", ATIConnectorsPatch, &mAlwaysEnabled, TRUE, -1, FALSE); // SnowLeo
+    KextDispatchAdd("com.apple.kext.AMDFramebuffer", ATIConnectorsPatch, &mAlwaysEnabled, TRUE, -1, FALSE); // Maverics
+  }
+
+  //
+  // Only the first enabled built-in patcher is applied to a kext,
+  // so AppleIntelCPUPM takes precedence over SandyBridge-E patch.
+  // gSNBEAICPUFixRequire and gBDWEIOPCIFixRequire are set after
+  // this init, so they are checked at patch time.
+  //
+  KextDispatchAdd("com.apple.driver.AppleIntelCPUPowerManagement", AppleIntelCPUPMPatch,
+                  &Entry->KernelAndKextPatches->KPAppleIntelCPUPM, FALSE, -1, FALSE);
+  KextDispatchAdd("com.apple.driver.AppleRTC", AppleRTCPatch,
+                  &Entry->KernelAndKextPatches->KPAppleRTC, FALSE, -1, FALSE);
+  // Remap SMBIOS Table require, AppleSMBIOS and AppleACPIPlatform
+  KextDispatchAdd("com.apple.driver.AppleSMBIOS", DellSMBIOSPatch,
+                  &Entry->KernelAndKextPatches->KPDELLSMBIOS, FALSE, -1, FALSE);
+  KextDispatchAdd("com.apple.driver.AppleACPIPlatform", DellSMBIOSPatch,
+                  &Entry->KernelAndKextPatches->KPDELLSMBIOS, FALSE, -1, FALSE);
+  // Braodwell-E IOPCIFamily Patch
+  KextDispatchAdd("com.apple.iokit.IOPCIFamily", BDWE_IOPCIPatch,
+                  &gBDWEIOPCIFixRequire, FALSE, -1, FALSE);
+  // SandyBridge-E AppleIntelCPUPowerManagement Patch implemented by syscl
+  KextDispatchAdd("com.apple.driver.AppleIntelCPUPowerManagement", SNBE_AICPUPatch,
+                  &gSNBEAICPUFixRequire, FALSE, -1, FALSE);
+
+  //
+  // KextsToPatch
+  //
+  for (i = 0; i < Entry->KernelAndKextPatches->NrKexts; i++) {
+    Name = Entry->KernelAndKextPatches->KextPatches[i].Name;
+    if (Name == NULL || Entry->KernelAndKextPatches->KextPatches[i].DataLen <= 0) {
+      continue;
     }
+    KextDispatchAdd(Name, NULL, NULL, FALSE, i, AsciiStrStr(Name, ".") == NULL);
   }
-  
+}
+
+//
+// PatchKext is called for every kext from prelinked kernel (kernelcache) or from DevTree (booting with drivers).
+// Kext specific patch functions are registered in KextPatcherInit().
+//
+VOID PatchKext(UINT8 *Driver, UINT32 DriverSize, CHAR8 *InfoPlist, UINT32 InfoPlistSize, LOADER_ENTRY *Entry)
+{
+  INT32               Index;
+  BOOLEAN             BuiltinDone = FALSE;
+  KEXT_DISPATCH_ENTRY *DispatchEntry;
+
   ExtractKextBundleIdentifier(InfoPlist);
-  
-  if (Entry->KernelAndKextPatches->KPAppleIntelCPUPM &&
-      (AsciiStrStr(InfoPlist,
-                   "<string>com.apple.driver.AppleIntelCPUPowerManagement</string>") != NULL)) {
-    //
-    // AppleIntelCPUPM
-    //
-    AppleIntelCPUPMPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (Entry->KernelAndKextPatches->KPAppleRTC &&
-             (AsciiStrStr(InfoPlist, "com.apple.driver.AppleRTC") != NULL)) {
-    //
-    // AppleRTC
-    //
-    AppleRTCPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (Entry->KernelAndKextPatches->KPDELLSMBIOS &&
-           (AsciiStrStr(InfoPlist, "com.apple.driver.AppleSMBIOS") != NULL)) {
-    //
-    // DellSMBIOSPatch
-    //
-    DBG_RT(Entry, "Remap SMBIOS Table require, AppleSMBIOS...\n");
-    DellSMBIOSPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (Entry->KernelAndKextPatches->KPDELLSMBIOS &&
-             (AsciiStrStr(InfoPlist, "com.apple.driver.AppleACPIPlatform") != NULL)) {
-    //
-    // DellSMBIOS
-    //
-    // AppleACPIPlatform
-    //
-    DellSMBIOSPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (gBDWEIOPCIFixRequire && (AsciiStrStr(InfoPlist, "com.apple.iokit.IOPCIFamily") != NULL)) {
-    //
-    // Braodwell-E IOPCIFamily Patch
-    //
-    BDWE_IOPCIPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
-  } else if (gSNBEAICPUFixRequire && (AsciiStrStr(InfoPlist, "com.apple.driver.AppleIntelCPUPowerManagement") != NULL)) {
-    //
-    // SandyBridge-E AppleIntelCPUPowerManagement Patch implemented by syscl
-    //
-    SNBE_AICPUPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
+  if (gKextBundleIdentifier[0] == '\0') {
+    return;
   }
-  //else {
-    //
-    //others
-    //
-    for (i = 0; i < Entry->KernelAndKextPatches->NrKexts; i++) {
-      CHAR8 *Name = Entry->KernelAndKextPatches->KextPatches[i].Name;
-      BOOLEAN   isBundle = (AsciiStrStr(Name, ".") != NULL);
-      if ((Entry->KernelAndKextPatches->KextPatches[i].DataLen > 0) &&
-          isBundle?(AsciiStrCmp(gKextBundleIdentifier, Name) == 0):(AsciiStrStr(gKextBundleIdentifier, Name) != NULL)) {
-      //    (AsciiStrStr(InfoPlist, Entry->KernelAndKextPatches->KextPatches[i].Name) != NULL)) {
-        DBG_RT(Entry, "\n\nPatch kext: %a\n", Entry->KernelAndKextPatches->KextPatches[i].Name);
-        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, i, Entry);
+
+  //
+  // built-in patchers
+  //
+  for (Index = mKextDispatchBucket[KextDispatchHash(gKextBundleIdentifier)]; Index >= 0; Index = DispatchEntry->Next) {
+    DispatchEntry = &mKextDispatch[Index];
+    if (DispatchEntry->Patcher == NULL || BuiltinDone || !*DispatchEntry->Enabled ||
+        AsciiStrCmp(gKextBundleIdentifier, DispatchEntry->BundleId) != 0) {
+      continue;
+    }
+    DispatchEntry->Patcher(Driver, DriverSize, InfoPlist, InfoPlistSize, Entry);
+    if (DispatchEntry->Exclusive) {
+      return;
+    }
+    BuiltinDone = TRUE;
+  }
+
+  //
+  //others
+  //
+  AnyKextPatchesStart();
+  if (mKextDispatchFull) {
+    // table overflow - check all KextsToPatch
+    for (Index = 0; Index < Entry->KernelAndKextPatches->NrKexts; Index++) {
+      if (Entry->KernelAndKextPatches->KextPatches[Index].DataLen > 0 &&
+          isPatchNameMatch(gKextBundleIdentifier, Entry->KernelAndKextPatches->KextPatches[Index].Name)) {
+        DBG_RT(Entry, "\n\nPatch kext: %a\n", Entry->KernelAndKextPatches->KextPatches[Index].Name);
+        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, Index, Entry);
       }
     }
-//  }
-  
+  } else {
+    for (Index = mKextDispatchBucket[KextDispatchHash(gKextBundleIdentifier)]; Index >= 0; Index = DispatchEntry->Next) {
+      DispatchEntry = &mKextDispatch[Index];
+      if (DispatchEntry->Patcher == NULL && AsciiStrCmp(gKextBundleIdentifier, DispatchEntry->BundleId) == 0) {
+        DBG_RT(Entry, "\n\nPatch kext: %a\n", DispatchEntry->BundleId);
+        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, DispatchEntry->PatchIndex, Entry);
+      }
+    }
+    for (Index = mKextDispatchPartial; Index >= 0; Index = DispatchEntry->Next) {
+      DispatchEntry = &mKextDispatch[Index];
+      if (AsciiStrStr(gKextBundleIdentifier, DispatchEntry->BundleId) != NULL) {
+        DBG_RT(Entry, "\n\nPatch kext: %a\n", DispatchEntry->BundleId);
+        AnyKextPatch(Driver, DriverSize, InfoPlist, InfoPlistSize, DispatchEntry->PatchIndex, Entry);
+      }
+    }
+  }
+  AnyKextPatchesFlush(Driver, DriverSize, Entry);
+
   //
   // Check for FakeSMC (InjectKexts if no FakeSMC)
   //
@@ -1249,33 +1670,10 @@ UINT64 GetPlistHexValue(CHAR8 *Plist, CHAR8 *Key, CHAR8 *WholePlist)
 }
 
 //
-// Iterates over kexts in kernelcache
-// and calls PatchKext() for each.
+// Old way: searches every kext for its keys and the whole plist for IDREFs.
+// Used only if the prelink info does not fit into PRELINK_INDEX.
 //
-// PrelinkInfo section contains following plist, without spaces:
-// <dict>
-//   <key>_PrelinkInfoDictionary</key>
-//   <array>
-//     <!-- start of kext Info.plist -->
-//     <dict>
-//       <key>CFBundleName</key>
-//       <string>MAC Framework Pseudoextension</string>
-//       <key>_PrelinkExecutableLoadAddr</key>
-//       <integer size="64">0xffffff7f8072f000</integer>
-//       <!-- Kext size -->
-//       <key>_PrelinkExecutableSize</key>
-//       <integer size="64">0x3d0</integer>
-//       <!-- Kext address -->
-//       <key>_PrelinkExecutableSourceAddr</key>
-//       <integer size="64">0xffffff80009a3000</integer>
-//       ...
-//     </dict>
-//     <!-- start of next kext Info.plist -->
-//     <dict>
-//       ...
-//     </dict>
-//       ...
-VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
+STATIC VOID PatchPrelinkedKextsSlow(LOADER_ENTRY *Entry)
 {
   CHAR8     *WholePlist;
   CHAR8     *DictPtr;
@@ -1290,22 +1688,6 @@ VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
   
   WholePlist = (CHAR8*)(UINTN)PrelinkInfoAddr;
   
-  //
-  // Detect FakeSMC and if present then
-  // disable kext injection InjectKexts().
-  // There is some bug in the folowing code that
-  // searches for individual kexts in prelink info
-  // and FakeSMC is not found on my SnowLeo although
-  // it is present in kernelcache.
-  // But searching through the whole prelink info
-  // works and that's the reason why it is here.
-  //
-  
-  //Slice
-  // I see no reason to disable kext injection if FakeSMC found in cache
-  //since rev4240 we have manual kext inject disable
-  CheckForFakeSMC(WholePlist, Entry);
-  
   DictPtr = WholePlist;
   while ((DictPtr = AsciiStrStr(DictPtr, "dict>")) != NULL) {
     if (DictPtr[-1] == '<') {
@@ -1365,6 +1747,259 @@ VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
   }
 }
 
+//
+// Single pass index of the prelink info.
+// Kernelcaches have ~600 kexts and searching the whole plist for every
+// IDREF is quadratic, so PrelinkIndexBuild() walks the plist once and
+// records integer IDs and kext dicts into fixed tables. No allocations
+// here since we are called from ExitBootServices().
+//
+#define PRELINK_INDEX_MAX_IDS   16384
+#define PRELINK_INDEX_MAX_KEXTS 2048
+
+#define PRELINK_KEY_NONE        0
+#define PRELINK_KEY_SOURCE      1
+#define PRELINK_KEY_SIZE        2
+
+typedef struct {
+  CHAR8   *InfoPlistStart;
+  CHAR8   *InfoPlistEnd;
+  UINT64  Value[3];     // indexed by PRELINK_KEY_xxx
+  UINT32  Ref[3];       // IDREF + 1, 0 if Value is the value itself
+} PRELINK_KEXT_RECORD;
+
+typedef struct {
+  UINTN               NrKexts;
+  UINT64              IdValue[PRELINK_INDEX_MAX_IDS];
+  UINT8               IdValid[PRELINK_INDEX_MAX_IDS / 8];
+  PRELINK_KEXT_RECORD Kexts[PRELINK_INDEX_MAX_KEXTS];
+} PRELINK_INDEX;
+
+STATIC PRELINK_INDEX  mPrelinkIndex;
+
+//
+// Parses ID="123" or IDREF="123" attribute value starting at Ptr.
+//
+STATIC UINT32 PrelinkParseId(CHAR8 *Ptr)
+{
+  UINT32 Id = 0;
+
+  while (*Ptr >= '0' && *Ptr <= '9') {
+    Id = Id * 10 + (*Ptr++ - '0');
+  }
+  return Id;
+}
+
+//
+// Walks WholePlist once and fills mPrelinkIndex.
+// Returns FALSE if the tables are too small, caller should use the slow path then.
+//
+STATIC BOOLEAN PrelinkIndexBuild(CHAR8 *WholePlist)
+{
+  CHAR8               *Ptr = WholePlist;
+  CHAR8               *Attr;
+  INTN                DictLevel = 0;
+  UINTN               PendingKey = PRELINK_KEY_NONE;
+  PRELINK_KEXT_RECORD *Kext = NULL;
+  UINT32              Id;
+  BOOLEAN             HasId;
+  BOOLEAN             IsRef;
+  UINT64              Value;
+
+  SetMem(mPrelinkIndex.IdValid, sizeof(mPrelinkIndex.IdValid), 0);
+  mPrelinkIndex.NrKexts = 0;
+
+  while (*Ptr != '\0') {
+    if (*Ptr++ != '<') {
+      continue;
+    }
+    if (AsciiStrnCmp(Ptr, "dict>", 5) == 0) {
+      DictLevel++;
+      if (DictLevel == 2) {
+        // kext start
+        if (mPrelinkIndex.NrKexts >= PRELINK_INDEX_MAX_KEXTS) {
+          return FALSE;
+        }
+        Kext = &mPrelinkIndex.Kexts[mPrelinkIndex.NrKexts];
+        SetMem(Kext, sizeof(*Kext), 0);
+        Kext->InfoPlistStart = Ptr - 1;
+      }
+      PendingKey = PRELINK_KEY_NONE;
+      Ptr += 5;
+    } else if (AsciiStrnCmp(Ptr, "/dict>", 6) == 0) {
+      if (DictLevel == 2 && Kext != NULL) {
+        // kext end
+        Kext->InfoPlistEnd = Ptr + 6;
+        mPrelinkIndex.NrKexts++;
+        Kext = NULL;
+      }
+      DictLevel--;
+      PendingKey = PRELINK_KEY_NONE;
+      Ptr += 6;
+    } else if (AsciiStrnCmp(Ptr, "key>", 4) == 0) {
+      Ptr += 4;
+      PendingKey = PRELINK_KEY_NONE;
+      if (DictLevel == 2 && Kext != NULL) {
+        if (AsciiStrnCmp(Ptr, kPrelinkExecutableSourceKey "<", sizeof(kPrelinkExecutableSourceKey)) == 0) {
+          PendingKey = PRELINK_KEY_SOURCE;
+        } else if (AsciiStrnCmp(Ptr, kPrelinkExecutableSizeKey "<", sizeof(kPrelinkExecutableSizeKey)) == 0) {
+          PendingKey = PRELINK_KEY_SIZE;
+        }
+      }
+    } else if (AsciiStrnCmp(Ptr, "integer", 7) == 0) {
+      // <integer ID="26" size="64">0x2b000</integer> or <integer IDREF="26"/>
+      HasId = FALSE;
+      IsRef = FALSE;
+      Id = 0;
+      for (Attr = Ptr + 7; *Attr != '>' && *Attr != '\0'; Attr++) {
+        if (AsciiStrnCmp(Attr, " ID=\"", 5) == 0) {
+          Id = PrelinkParseId(Attr + 5);
+          HasId = TRUE;
+        } else if (AsciiStrnCmp(Attr, " IDREF=\"", 8) == 0) {
+          Id = PrelinkParseId(Attr + 8);
+          IsRef = TRUE;
+        }
+      }
+      if (*Attr == '\0') {
+        break;
+      }
+      Ptr = Attr + 1;
+      if (IsRef) {
+        if (Attr[-1] != '/') {
+          return FALSE;
+        }
+        if (PendingKey != PRELINK_KEY_NONE) {
+          Kext->Ref[PendingKey] = Id + 1;
+        }
+      } else if (Attr[-1] != '/') {
+        Value = AsciiStrHexToUint64(Ptr);
+        if (HasId) {
+          if (Id >= PRELINK_INDEX_MAX_IDS) {
+            return FALSE;
+          }
+          mPrelinkIndex.IdValue[Id] = Value;
+          mPrelinkIndex.IdValid[Id >> 3] |= (UINT8)(1 << (Id & 7));
+        }
+        if (PendingKey != PRELINK_KEY_NONE) {
+          Kext->Value[PendingKey] = Value;
+        }
+      }
+      PendingKey = PRELINK_KEY_NONE;
+    } else if (*Ptr != '/') {
+      // any other value consumes the key
+      PendingKey = PRELINK_KEY_NONE;
+    }
+  }
+
+  return TRUE;
+}
+
+STATIC UINT64 PrelinkIndexValue(PRELINK_KEXT_RECORD *Kext, UINTN Key)
+{
+  UINT32 Id;
+
+  if (Kext->Ref[Key] == 0) {
+    return Kext->Value[Key];
+  }
+  Id = Kext->Ref[Key] - 1;
+  if (Id < PRELINK_INDEX_MAX_IDS && (mPrelinkIndex.IdValid[Id >> 3] & (1 << (Id & 7))) != 0) {
+    return mPrelinkIndex.IdValue[Id];
+  }
+  return 0;
+}
+
+//
+// Iterates over kexts in kernelcache
+// and calls PatchKext() for each.
+//
+// PrelinkInfo section contains following plist, without spaces:
+// <dict>
+//   <key>_PrelinkInfoDictionary</key>
+//   <array>
+//     <!-- start of kext Info.plist -->
+//     <dict>
+//       <key>CFBundleName</key>
+//       <string>MAC Framework Pseudoextension</string>
+//       <key>_PrelinkExecutableLoadAddr</key>
+//       <integer size="64">0xffffff7f8072f000</integer>
+//       <!-- Kext size -->
+//       <key>_PrelinkExecutableSize</key>
+//       <integer size="64">0x3d0</integer>
+//       <!-- Kext address -->
+//       <key>_PrelinkExecutableSourceAddr</key>
+//       <integer size="64">0xffffff80009a3000</integer>
+//       ...
+//     </dict>
+//     <!-- start of next kext Info.plist -->
+//     <dict>
+//       ...
+//     </dict>
+//       ...
+VOID PatchPrelinkedKexts(LOADER_ENTRY *Entry)
+{
+  CHAR8               *WholePlist;
+  CHAR8               SavedValue;
+  UINT32              KextAddr;
+  UINT32              KextSize;
+  UINTN               Index;
+  PRELINK_KEXT_RECORD *Kext;
+
+  WholePlist = (CHAR8*)(UINTN)PrelinkInfoAddr;
+
+  //
+  // Detect FakeSMC and if present then
+  // disable kext injection InjectKexts().
+  // There is some bug in the folowing code that
+  // searches for individual kexts in prelink info
+  // and FakeSMC is not found on my SnowLeo although
+  // it is present in kernelcache.
+  // But searching through the whole prelink info
+  // works and that's the reason why it is here.
+  //
+
+  //Slice
+  // I see no reason to disable kext injection if FakeSMC found in cache
+  //since rev4240 we have manual kext inject disable
+  CheckForFakeSMC(WholePlist, Entry);
+
+  if (!PrelinkIndexBuild(WholePlist)) {
+    DBG_RT(Entry, "PrelinkInfo index overflow - using slow path\n");
+    PatchPrelinkedKextsSlow(Entry);
+    return;
+  }
+
+  for (Index = 0; Index < mPrelinkIndex.NrKexts; Index++) {
+    Kext = &mPrelinkIndex.Kexts[Index];
+
+    // get kext address from _PrelinkExecutableSourceAddr
+    // truncate to 32 bit to get physical addr
+    KextAddr = (UINT32)PrelinkIndexValue(Kext, PRELINK_KEY_SOURCE);
+    // KextAddr is always relative to 0x200000
+    // and if KernelSlide is != 0 then KextAddr must be adjusted
+    KextAddr += KernelSlide;
+    // and adjust for AptioFixDrv's KernelRelocBase
+    KextAddr += (UINT32)KernelRelocBase;
+
+    KextSize = (UINT32)PrelinkIndexValue(Kext, PRELINK_KEY_SIZE);
+
+    // terminate Info.plist with 0
+    SavedValue = *Kext->InfoPlistEnd;
+    *Kext->InfoPlistEnd = '\0';
+
+    // patch it
+    PatchKext(
+              (UINT8*)(UINTN)KextAddr,
+              KextSize,
+              Kext->InfoPlistStart,
+              (UINT32)(Kext->InfoPlistEnd - Kext->InfoPlistStart),
+              Entry
+              );
+
+    // return saved char
+    *Kext->InfoPlistEnd = SavedValue;
+  }
+}
+
 //
 // Iterates over kexts loaded by booter
 // and calls PatchKext() for each.
@@ -47,6 +47,32 @@ SymbolPtr gSymbolsHead = NULL;
 TagPtr    gTagsFree = NULL;
 CHAR8* buffer_start = NULL;
 
+//
+// ParseXMLArena() mode: the source copy, all tags and dict key indexes
+// live in one pool block. Strings point into the source copy instead of
+// the symbol table and the whole tree is freed by FreeTag() of its root.
+//
+typedef struct {
+  UINTN   mask;
+  TagPtr  slot[1];   // key tags, mask + 1 slots
+} PlistKeyIndex;
+
+typedef struct PlistArena PlistArena;
+struct PlistArena {
+  PlistArena  *next;
+  TagPtr      root;
+  TagStruct   *tags;
+  UINTN       tagsCount;
+  UINTN       tagsUsed;
+  UINT8       *pool;      // for PlistKeyIndex
+  UINTN       poolSize;
+  UINTN       poolUsed;
+  BOOLEAN     dataInArena;  // PlistLoadBinary() keeps <data> in the arena too
+};
+
+PlistArena *gPlistArenas = NULL;  // all live arenas
+PlistArena *gPlistArena = NULL;   // arena being filled
+
 // Forward declarations
 EFI_STATUS ParseTagList( CHAR8* buffer, TagPtr * tag, UINT32 type, UINT32 empty, UINT32* lenPtr);
 EFI_STATUS ParseTagKey( char * buffer, TagPtr * tag,UINT32* lenPtr);
@@ -256,6 +282,422 @@ EFI_STATUS ParseXML(const CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
   return EFI_SUCCESS;
 }
 
+//
+// Case insensitive hash, GetProperty uses AsciiStriCmp
+//
+STATIC UINTN PlistKeyHash(CONST CHAR8 *key)
+{
+  UINT32 hash = 2166136261u;
+  CHAR8  c;
+
+  while ((c = *key++) != '\0') {
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+    hash = (hash ^ (UINT8)c) * 16777619u;
+  }
+  return hash;
+}
+
+STATIC PlistArena* PlistArenaOf(TagPtr tag)
+{
+  PlistArena *arena;
+
+  for (arena = gPlistArenas; arena != NULL; arena = arena->next) {
+    if (tag >= arena->tags && tag < arena->tags + arena->tagsCount) {
+      return arena;
+    }
+  }
+  return NULL;
+}
+
+STATIC VOID PlistArenaFree(PlistArena *arena)
+{
+  PlistArena **link;
+  UINTN      i;
+
+  for (link = &gPlistArenas; *link != NULL; link = &(*link)->next) {
+    if (*link == arena) {
+      *link = arena->next;
+      break;
+    }
+  }
+  // decoded <data> is the only thing allocated outside of the arena
+  for (i = 0; i < arena->tagsUsed && !arena->dataInArena; i++) {
+    if (arena->tags[i].data) {
+      FreePool(arena->tags[i].data);
+    }
+  }
+  FreePool(arena);
+}
+
+//
+// Allocates an arena for tagsCount tags followed by extraSize bytes
+// returned in *extra, and links it into gPlistArenas.
+//
+STATIC PlistArena* PlistArenaNew(UINTN tagsCount, UINTN extraSize, UINT8 **extra)
+{
+  PlistArena  *arena;
+  UINTN       poolSize;
+
+  // every dict needs at most one index header and 4 slots per key
+  poolSize = tagsCount * (sizeof(PlistKeyIndex) + 4 * sizeof(TagPtr));
+
+  arena = (PlistArena*)AllocatePool(sizeof(PlistArena) + tagsCount * sizeof(TagStruct) + poolSize + extraSize);
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->root = NULL;
+  arena->tags = (TagStruct*)(arena + 1);
+  arena->tagsCount = tagsCount;
+  arena->tagsUsed = 0;
+  arena->pool = (UINT8*)(arena->tags + tagsCount);
+  arena->poolSize = poolSize;
+  arena->poolUsed = 0;
+  arena->dataInArena = FALSE;
+  *extra = arena->pool + poolSize;
+
+  arena->next = gPlistArenas;
+  gPlistArenas = arena;
+  return arena;
+}
+
+//
+// Builds hashed key index of a dict parsed into the arena.
+// If the arena pool is exhausted the dict is left for linear search.
+//
+STATIC VOID PlistArenaIndexDict(PlistArena *arena, TagPtr dict)
+{
+  PlistKeyIndex *index;
+  TagPtr        tag;
+  UINTN         count = 0;
+  UINTN         slots = 4;
+  UINTN         size;
+  UINTN         i;
+
+  for (tag = dict->tag; tag != NULL; tag = tag->tagNext) {
+    if (tag->type == kTagTypeKey && tag->string != NULL) {
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
+  while (slots < count * 2) {
+    slots <<= 1;
+  }
+  size = sizeof(PlistKeyIndex) + (slots - 1) * sizeof(TagPtr);
+  size = (size + sizeof(UINTN) - 1) & ~(sizeof(UINTN) - 1);
+  if (arena->poolUsed + size > arena->poolSize) {
+    return;
+  }
+  index = (PlistKeyIndex*)(arena->pool + arena->poolUsed);
+  arena->poolUsed += size;
+  ZeroMem(index, size);
+  index->mask = slots - 1;
+
+  for (tag = dict->tag; tag != NULL; tag = tag->tagNext) {
+    if (tag->type != kTagTypeKey || tag->string == NULL) {
+      continue;
+    }
+    for (i = PlistKeyHash(tag->string) & index->mask; index->slot[i] != NULL; i = (i + 1) & index->mask) {
+      if (!AsciiStriCmp(index->slot[i]->string, tag->string)) {
+        break;  // duplicate key, first one wins as in linear search
+      }
+    }
+    if (index->slot[i] == NULL) {
+      index->slot[i] = tag;
+    }
+  }
+  dict->index = index;
+}
+
+//
+// Same as ParseXML() but the whole tree is allocated in one arena
+// and every dict gets a hashed key index for GetProperty().
+// The tree is freed at once by FreeTag(*dict).
+//
+EFI_STATUS ParseXMLArena(const CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
+{
+  EFI_STATUS  Status;
+  UINT32      length = 0;
+  UINT32      pos = 0;
+  TagPtr      tag = NULL;
+  CHAR8*      configBuffer;
+  PlistArena  *arena;
+  UINT32      bufferSize;
+  UINTN       tagsCount = 1;
+  UINTN       i;
+
+  if(dict == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  if (bufSize) {
+    bufferSize = bufSize;
+  } else {
+    bufferSize = (UINT32)AsciiStrLen(buffer);
+  }
+
+  // every tag takes at least one '<'
+  for (i = 0; i < bufferSize; i++) {
+    if (buffer[i] == '<') {
+      tagsCount++;
+    }
+  }
+
+  arena = PlistArenaNew(tagsCount, bufferSize + 1, (UINT8**)&configBuffer);
+  if (arena == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  CopyMem(configBuffer, buffer, bufferSize);
+  configBuffer[bufferSize] = '\0';
+  for (i=0; i<bufferSize; i++) {
+    if (configBuffer[i] == 0) {
+      configBuffer[i] = 0x20;  //replace random zero bytes to spaces
+    }
+  }
+
+  gPlistArena = arena;
+  buffer_start = configBuffer;
+  while (TRUE)
+  {
+    Status = XMLParseNextTag(configBuffer + pos, &tag, &length);
+    if (EFI_ERROR(Status)) {
+      DBG("error parsing next tag\n");
+      break;
+    }
+
+    pos += length;
+
+    if (tag == NULL) {
+      continue;
+    }
+    if (tag->type == kTagTypeDict) {
+      break;
+    }
+  }
+  gPlistArena = NULL;
+
+  if (EFI_ERROR(Status)) {
+    PlistArenaFree(arena);
+    return Status;
+  }
+  arena->root = tag;
+
+  *dict = tag;
+  return EFI_SUCCESS;
+}
+
+//
+// Binary snapshot of a parsed plist.
+// PlistSaveBinary() flattens a tree into a blob keyed by size and CRC32
+// of the XML source, PlistLoadBinary() loads it back into an arena
+// without XML parsing. Layout: header, tags, then strings and data; the
+// header holds the CRC32 of the rest. Tags are written parent first, so
+// Tag and TagNext of a valid blob always point to a later tag.
+//
+#define PLIST_BIN_SIGNATURE SIGNATURE_32('C','P','L','B')
+#define PLIST_BIN_VERSION   2
+
+typedef struct {
+  UINT32  Signature;
+  UINT32  Version;
+  UINT32  SourceSize;
+  UINT32  SourceCrc;
+  UINT32  TagsCount;
+  UINT32  HeapSize;
+  UINT32  BodyCrc;
+} PLIST_BIN_HEADER;
+
+typedef struct {
+  UINT32  Type;
+  UINT32  Offset;
+  UINT64  Value;    // integer value, or string offset + 1 in the heap
+  UINT32  Data;     // data offset + 1 in the heap
+  UINT32  DataLen;
+  UINT32  Tag;      // child tag index + 1
+  UINT32  TagNext;  // next tag index + 1
+} PLIST_BIN_TAG;
+
+STATIC VOID PlistBinMeasure(TagPtr tag, UINTN *tagsCount, UINTN *heapSize)
+{
+  for (; tag != NULL; tag = tag->tagNext) {
+    (*tagsCount)++;
+    if (tag->type != kTagTypeInteger && tag->string != NULL) {
+      *heapSize += AsciiStrLen(tag->string) + 1;
+    }
+    if (tag->data != NULL) {
+      *heapSize += tag->dataLen;
+    }
+    PlistBinMeasure(tag->tag, tagsCount, heapSize);
+  }
+}
+
+//
+// Writes tag list starting at bin[*index], returns index + 1 of the first one.
+//
+STATIC UINT32 PlistBinWrite(TagPtr tag, PLIST_BIN_TAG *bin, UINT32 *index, UINT8 *heap, UINT32 *heapUsed)
+{
+  UINT32        first = 0;
+  PLIST_BIN_TAG *prev = NULL;
+  PLIST_BIN_TAG *cur;
+  UINTN         len;
+
+  for (; tag != NULL; tag = tag->tagNext) {
+    cur = &bin[*index];
+    ZeroMem(cur, sizeof(*cur));
+    (*index)++;
+    if (prev != NULL) {
+      prev->TagNext = *index;
+    } else {
+      first = *index;
+    }
+    prev = cur;
+
+    cur->Type = (UINT32)tag->type;
+    cur->Offset = (UINT32)tag->offset;
+    if (tag->type == kTagTypeInteger) {
+      cur->Value = (UINT64)(UINTN)tag->string;
+    } else if (tag->string != NULL) {
+      len = AsciiStrLen(tag->string) + 1;
+      CopyMem(heap + *heapUsed, tag->string, len);
+      cur->Value = *heapUsed + 1;
+      *heapUsed += (UINT32)len;
+    }
+    if (tag->data != NULL) {
+      CopyMem(heap + *heapUsed, tag->data, tag->dataLen);
+      cur->Data = *heapUsed + 1;
+      cur->DataLen = (UINT32)tag->dataLen;
+      *heapUsed += (UINT32)tag->dataLen;
+    }
+    cur->Tag = PlistBinWrite(tag->tag, bin, index, heap, heapUsed);
+  }
+  return first;
+}
+
+EFI_STATUS PlistSaveBinary(TagPtr dict, UINT32 sourceSize, UINT32 sourceCrc, UINT8 **blob, UINTN *blobSize)
+{
+  PLIST_BIN_HEADER  *header;
+  PLIST_BIN_TAG     *bin;
+  UINTN             tagsCount = 0;
+  UINTN             heapSize = 0;
+  UINT32            index = 0;
+  UINT32            heapUsed = 0;
+  TagPtr            next;
+
+  if (dict == NULL || blob == NULL || blobSize == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  // only the root dict, not its siblings
+  next = dict->tagNext;
+  dict->tagNext = NULL;
+  PlistBinMeasure(dict, &tagsCount, &heapSize);
+
+  *blobSize = sizeof(PLIST_BIN_HEADER) + tagsCount * sizeof(PLIST_BIN_TAG) + heapSize;
+  *blob = AllocatePool(*blobSize);
+  if (*blob == NULL) {
+    dict->tagNext = next;
+    return EFI_OUT_OF_RESOURCES;
+  }
+  header = (PLIST_BIN_HEADER*)*blob;
+  bin = (PLIST_BIN_TAG*)(header + 1);
+  header->Signature = PLIST_BIN_SIGNATURE;
+  header->Version = PLIST_BIN_VERSION;
+  header->SourceSize = sourceSize;
+  header->SourceCrc = sourceCrc;
+  header->TagsCount = (UINT32)tagsCount;
+  header->HeapSize = (UINT32)heapSize;
+  PlistBinWrite(dict, bin, &index, (UINT8*)(bin + tagsCount), &heapUsed);
+  dict->tagNext = next;
+
+  if (EFI_ERROR(gBS->CalculateCrc32(bin, *blobSize - sizeof(PLIST_BIN_HEADER), &header->BodyCrc))) {
+    FreePool(*blob);
+    *blob = NULL;
+    return EFI_UNSUPPORTED;
+  }
+  return EFI_SUCCESS;
+}
+
+//
+// Loads a blob made by PlistSaveBinary(). Returns EFI_NOT_FOUND if it does
+// not belong to the source with given size and CRC32, EFI_COMPROMISED_DATA
+// if it is damaged. The tree is freed by FreeTag(*dict).
+//
+EFI_STATUS PlistLoadBinary(UINT8 *blob, UINTN blobSize, UINT32 sourceSize, UINT32 sourceCrc, TagPtr *dict)
+{
+  PLIST_BIN_HEADER  *header = (PLIST_BIN_HEADER*)blob;
+  PLIST_BIN_TAG     *bin;
+  PlistArena        *arena;
+  UINT8             *heap;
+  TagPtr            tag;
+  UINTN             i;
+  UINT32            crc = 0;
+
+  if (blob == NULL || dict == NULL || blobSize < sizeof(PLIST_BIN_HEADER)) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (header->Signature != PLIST_BIN_SIGNATURE || header->Version != PLIST_BIN_VERSION ||
+      header->SourceSize != sourceSize || header->SourceCrc != sourceCrc) {
+    return EFI_NOT_FOUND;
+  }
+  if (header->TagsCount == 0 ||
+      blobSize != sizeof(PLIST_BIN_HEADER) + (UINTN)header->TagsCount * sizeof(PLIST_BIN_TAG) + header->HeapSize) {
+    return EFI_COMPROMISED_DATA;
+  }
+  bin = (PLIST_BIN_TAG*)(header + 1);
+  if (EFI_ERROR(gBS->CalculateCrc32(bin, blobSize - sizeof(PLIST_BIN_HEADER), &crc)) ||
+      crc != header->BodyCrc) {
+    return EFI_COMPROMISED_DATA;
+  }
+
+  arena = PlistArenaNew(header->TagsCount, header->HeapSize + 1, &heap);
+  if (arena == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  arena->dataInArena = TRUE;
+  CopyMem(heap, bin + header->TagsCount, header->HeapSize);
+  heap[header->HeapSize] = '\0';
+
+  for (i = 0; i < header->TagsCount; i++) {
+    // forward links only, so that a bad blob can not make a loop
+    if (bin[i].Type > kTagTypeArray ||
+        (bin[i].Tag != 0 && (bin[i].Tag <= i + 1 || bin[i].Tag > header->TagsCount)) ||
+        (bin[i].TagNext != 0 && (bin[i].TagNext <= i + 1 || bin[i].TagNext > header->TagsCount)) ||
+        (bin[i].Data != 0 && (UINTN)bin[i].Data - 1 + bin[i].DataLen > header->HeapSize) ||
+        (bin[i].Type != kTagTypeInteger && bin[i].Value > header->HeapSize)) {
+      PlistArenaFree(arena);
+      return EFI_COMPROMISED_DATA;
+    }
+    tag = &arena->tags[i];
+    tag->type = bin[i].Type;
+    tag->offset = bin[i].Offset;
+    if (bin[i].Type == kTagTypeInteger) {
+      tag->string = (CHAR8*)(UINTN)bin[i].Value;
+    } else {
+      tag->string = bin[i].Value ? (CHAR8*)heap + bin[i].Value - 1 : NULL;
+    }
+    tag->data = bin[i].Data ? heap + bin[i].Data - 1 : NULL;
+    tag->dataLen = bin[i].DataLen;
+    tag->tag = bin[i].Tag ? &arena->tags[bin[i].Tag - 1] : NULL;
+    tag->tagNext = bin[i].TagNext ? &arena->tags[bin[i].TagNext - 1] : NULL;
+    tag->index = NULL;
+  }
+  arena->tagsUsed = header->TagsCount;
+
+  for (i = 0; i < arena->tagsUsed; i++) {
+    if (arena->tags[i].type == kTagTypeDict) {
+      PlistArenaIndexDict(arena, &arena->tags[i]);
+    }
+  }
+
+  arena->root = &arena->tags[0];
+  *dict = arena->root;
+  return EFI_SUCCESS;
+}
+
 //
 // xml
 //
@@ -268,11 +710,23 @@ EFI_STATUS ParseXML(const CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
 TagPtr GetProperty( TagPtr dict, const CHAR8* key )
 {
   TagPtr tagList, tag;
+  PlistKeyIndex *index;
+  UINTN i;
 
   if (dict->type != kTagTypeDict) {
     return NULL;
   }
 
+  index = (PlistKeyIndex*)dict->index;
+  if (index != NULL) {
+    for (i = PlistKeyHash(key) & index->mask; index->slot[i] != NULL; i = (i + 1) & index->mask) {
+      if (!AsciiStriCmp(index->slot[i]->string, key)) {
+        return index->slot[i]->tag;
+      }
+    }
+    return NULL;
+  }
+
   tag = NULL;
   tagList = dict->tag;
   while (tagList)
@@ -512,6 +966,9 @@ EFI_STATUS ParseTagList( CHAR8* buffer, TagPtr* tag, UINT32 type, UINT32 empty,
   tmpTag->offset = (UINT32)(buffer_start ? buffer - buffer_start : 0);
   tmpTag->tag = tagList;
   tmpTag->tagNext = 0;
+  if (gPlistArena != NULL && type == kTagTypeDict) {
+    PlistArenaIndexDict(gPlistArena, tmpTag);
+  }
 
   *tag = tmpTag;
   *lenPtr=pos;
@@ -885,6 +1342,15 @@ TagPtr NewTag( void )
   UINT32  cnt;
   TagPtr  tag;
 
+  if (gPlistArena != NULL) {
+    if (gPlistArena->tagsUsed >= gPlistArena->tagsCount) {
+      return NULL;
+    }
+    tag = &gPlistArena->tags[gPlistArena->tagsUsed++];
+    ZeroMem(tag, sizeof(TagStruct));
+    return tag;
+  }
+
   if (gTagsFree == NULL) {
     tag = (TagPtr)AllocateZeroPool(TAGCACHESIZE * sizeof(TagStruct));
     if (tag == NULL) {
@@ -917,10 +1383,20 @@ TagPtr NewTag( void )
 
 void FreeTag( TagPtr tag )
 {
+  PlistArena *arena;
+
   if (tag == NULL) {
     return;
   }
 
+  if (gPlistArenas != NULL && (arena = PlistArenaOf(tag)) != NULL) {
+    // arena tags are freed all together with the root
+    if (tag == arena->root) {
+      PlistArenaFree(arena);
+    }
+    return;
+  }
+
   if (tag->type != kTagTypeInteger && tag->string)  {
     FreeSymbol(tag->string);
   }
@@ -950,6 +1426,12 @@ CHAR8* NewSymbol(CHAR8* tmpString)
 #endif
   SymbolPtr symbol;
   UINTN      len;
+
+  // arena mode: strings are slices of the arena source copy
+  if (gPlistArena != NULL) {
+    return tmpString;
+  }
+
   // Look for string in the list of symbols.
   symbol = FindSymbol(tmpString, 0);
 
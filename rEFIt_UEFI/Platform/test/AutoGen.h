@@ -0,0 +1,28 @@
+/*
+ *  AutoGen.h
+ *
+ *  Stands in for the header the EDK2 build generates for rEFIt_UEFI when
+ *  the ACPI patcher is built on a POSIX host, see README.
+ *
+ */
+
+#ifndef _ACPI_HOST_AUTOGEN_H
+#define _ACPI_HOST_AUTOGEN_H
+
+#include <Uefi.h>
+#include <Library/PcdLib.h>
+
+// PCDs read by BaseLib and BasePrintLib
+#define _PCD_GET_MODE_32_PcdMaximumAsciiStringLength    1000000
+#define _PCD_GET_MODE_32_PcdMaximumUnicodeStringLength  1000000
+#define _PCD_GET_MODE_32_PcdMaximumLinkedListLength     1000000
+#define _PCD_GET_MODE_BOOL_PcdVerifyNodeInList          FALSE
+
+extern EFI_GUID gEfiAppleBootGuid;
+extern EFI_GUID gEfiAcpiTableGuid;
+extern EFI_GUID gEfiAcpi10TableGuid;
+extern EFI_GUID gEfiAcpi20TableGuid;
+extern EFI_GUID gEfiPciIoProtocolGuid;
+extern EFI_GUID gEfiDevicePathProtocolGuid;
+
+#endif /* !_ACPI_HOST_AUTOGEN_H */
@@ -0,0 +1,419 @@
+/*
+ *  acpi_host.c
+ *
+ *  Firmware side of the host build of the ACPI patcher. Boot services are
+ *  reduced to memory allocation; there are no PCI devices, so the fixes
+ *  that need one (Display, LAN, Airport, SBUS, IDE, SATA, Firewire, HDA,
+ *  USB ...) find nothing to patch, like on a machine without such devices.
+ *  Entry points of AcpiPatcher.c that the tool does not call only get
+ *  stubs to link.
+ *
+ */
+
+#include "StateGenerator.h"
+#include "acpi_host.h"
+
+BOOLEAN                 gAcpiHostVerbose = FALSE;
+UINTN                   gAcpiHostPages = 0;
+
+typedef struct {
+  EFI_PHYSICAL_ADDRESS  Memory;
+  UINTN                 Pages;
+} HOST_PAGES;
+
+// allocations of gBS->AllocatePages(), released by AcpiHostFreeAllPages()
+STATIC HOST_PAGES       *mPages = NULL;
+STATIC UINTN            mPagesCount = 0;
+STATIC UINTN            mPagesCapacity = 0;
+
+//
+// Globals owned by modules that are not part of the host build
+//
+SETTINGS_DATA           gSettings;
+CPU_STRUCTURE           gCPUStructure;
+SLOT_DEVICE             SlotDevices[16];
+ACPI_PATCHED_AML        *ACPIPatchedAML = NULL;
+BOOLEAN                 defDSM = FALSE;
+UINT16                  dropDSM = 0xFFFF;
+BOOLEAN                 gMobile = FALSE;
+BOOLEAN                 gFirmwareClover = FALSE;
+CHAR8                   *BiosVendor = "Apple Inc.";
+CHAR16                  *OEMPath = L"EFI\\CLOVER";
+EFI_FILE                *SelfRootDir = NULL;
+REFIT_CONFIG            GlobalConfig;
+
+EFI_GUID gEfiAppleBootGuid          = { 0x7C436110, 0xAB2A, 0x4BBB, { 0xA8, 0x80, 0xFE, 0x41, 0x99, 0x5C, 0x9F, 0x82 } };
+EFI_GUID gEfiAcpiTableGuid          = { 0x8868E871, 0xE4F1, 0x11D3, { 0xBC, 0x22, 0x00, 0x80, 0xC7, 0x3C, 0x88, 0x81 } };
+EFI_GUID gEfiAcpi10TableGuid        = { 0xEB9D2D30, 0x2D88, 0x11D3, { 0x9A, 0x16, 0x00, 0x90, 0x27, 0x3F, 0xC1, 0x4D } };
+EFI_GUID gEfiAcpi20TableGuid        = { 0x8868E871, 0xE4F1, 0x11D3, { 0xBC, 0x22, 0x00, 0x80, 0xC7, 0x3C, 0x88, 0x81 } };
+EFI_GUID gEfiPciIoProtocolGuid      = { 0x4CF5B200, 0x68B8, 0x4CA5, { 0x9E, 0xEC, 0xB2, 0x3E, 0x3F, 0x50, 0x02, 0x9A } };
+EFI_GUID gEfiDevicePathProtocolGuid = { 0x09576E91, 0x6D3F, 0x11D2, { 0x8E, 0x39, 0x00, 0xA0, 0xC9, 0x69, 0x72, 0x3B } };
+
+//
+// Boot services
+//
+STATIC EFI_STATUS EFIAPI HostAllocatePages(EFI_ALLOCATE_TYPE Type, EFI_MEMORY_TYPE MemoryType,
+                                           UINTN Pages, EFI_PHYSICAL_ADDRESS *Memory)
+{
+  VOID *Buffer;
+
+  if (Type == AllocateAddress) {
+    return EFI_UNSUPPORTED;
+  }
+  if (mPagesCount == mPagesCapacity) {
+    HOST_PAGES *More = acpi_posix_realloc(mPages, (mPagesCapacity + 64) * sizeof(HOST_PAGES));
+    if (More == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    mPages = More;
+    mPagesCapacity += 64;
+  }
+  Buffer = acpi_posix_alloc_pages(Pages);
+  if (Buffer == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  if (Type == AllocateMaxAddress && (EFI_PHYSICAL_ADDRESS)(UINTN)Buffer + EFI_PAGES_TO_SIZE(Pages) - 1 > *Memory) {
+    acpi_posix_free_pages(Buffer, Pages);
+    return EFI_OUT_OF_RESOURCES;
+  }
+  *Memory = (EFI_PHYSICAL_ADDRESS)(UINTN)Buffer;
+  mPages[mPagesCount].Memory = *Memory;
+  mPages[mPagesCount].Pages = Pages;
+  mPagesCount++;
+  gAcpiHostPages += Pages;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostFreePages(EFI_PHYSICAL_ADDRESS Memory, UINTN Pages)
+{
+  UINTN Index;
+
+  for (Index = mPagesCount; Index > 0; Index--) {
+    if (mPages[Index - 1].Memory == Memory && mPages[Index - 1].Pages == Pages) {
+      mPages[Index - 1] = mPages[--mPagesCount];
+      acpi_posix_free_pages((VOID*)(UINTN)Memory, Pages);
+      gAcpiHostPages -= Pages;
+      return EFI_SUCCESS;
+    }
+  }
+  return EFI_NOT_FOUND;
+}
+
+VOID AcpiHostFreeAllPages(VOID)
+{
+  while (mPagesCount > 0) {
+    mPagesCount--;
+    acpi_posix_free_pages((VOID*)(UINTN)mPages[mPagesCount].Memory, mPages[mPagesCount].Pages);
+  }
+  gAcpiHostPages = 0;
+}
+
+STATIC EFI_STATUS EFIAPI HostAllocatePool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID **Buffer)
+{
+  *Buffer = acpi_posix_alloc(Size);
+  return (*Buffer == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostFreePool(VOID *Buffer)
+{
+  acpi_posix_free(Buffer);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostLocateHandleBuffer(EFI_LOCATE_SEARCH_TYPE SearchType, EFI_GUID *Protocol,
+                                                VOID *SearchKey, UINTN *NoHandles, EFI_HANDLE **Buffer)
+{
+  *NoHandles = 0;
+  *Buffer = NULL;
+  return EFI_NOT_FOUND;
+}
+
+STATIC EFI_STATUS EFIAPI HostHandleProtocol(EFI_HANDLE Handle, EFI_GUID *Protocol, VOID **Interface)
+{
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS EFIAPI HostLocateProtocol(EFI_GUID *Protocol, VOID *Registration, VOID **Interface)
+{
+  return EFI_NOT_FOUND;
+}
+
+STATIC VOID EFIAPI HostCopyMem(VOID *Destination, VOID *Source, UINTN Length)
+{
+  CopyMem(Destination, Source, Length);
+}
+
+STATIC VOID EFIAPI HostSetMem(VOID *Buffer, UINTN Size, UINT8 Value)
+{
+  SetMem(Buffer, Size, Value);
+}
+
+STATIC EFI_STATUS EFIAPI HostCalculateCrc32(VOID *Data, UINTN DataSize, UINT32 *Crc32)
+{
+  UINT8   *Bytes = (UINT8*)Data;
+  UINT32  Crc = 0xFFFFFFFF;
+  UINTN   Index, Bit;
+
+  if (Data == NULL || DataSize == 0 || Crc32 == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  for (Index = 0; Index < DataSize; Index++) {
+    Crc ^= Bytes[Index];
+    for (Bit = 0; Bit < 8; Bit++) {
+      Crc = (Crc >> 1) ^ (0xEDB88320 & (0 - (Crc & 1)));
+    }
+  }
+  *Crc32 = ~Crc;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC EFI_SYSTEM_TABLE   mSystemTable;
+
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+EFI_SYSTEM_TABLE          *gST = &mSystemTable;
+
+VOID AcpiHostInit(VOID)
+{
+  mBootServices.AllocatePages = HostAllocatePages;
+  mBootServices.FreePages = HostFreePages;
+  mBootServices.AllocatePool = HostAllocatePool;
+  mBootServices.FreePool = HostFreePool;
+  mBootServices.LocateHandleBuffer = HostLocateHandleBuffer;
+  mBootServices.HandleProtocol = HostHandleProtocol;
+  mBootServices.LocateProtocol = HostLocateProtocol;
+  mBootServices.CopyMem = HostCopyMem;
+  mBootServices.SetMem = HostSetMem;
+  mBootServices.CalculateCrc32 = HostCalculateCrc32;
+  mSystemTable.BootServices = &mBootServices;
+
+  // the patcher's defaults for a machine the tool knows nothing about
+  gCPUStructure.Family = 0x06;
+  gCPUStructure.Threads = 4;
+}
+
+//
+// MemoryAllocationLib
+//
+VOID* EFIAPI AllocatePool(IN UINTN AllocationSize)
+{
+  return acpi_posix_alloc(AllocationSize);
+}
+
+VOID* EFIAPI AllocateZeroPool(IN UINTN AllocationSize)
+{
+  VOID *Buffer = acpi_posix_alloc(AllocationSize);
+  if (Buffer != NULL) {
+    ZeroMem(Buffer, AllocationSize);
+  }
+  return Buffer;
+}
+
+VOID* EFIAPI AllocateCopyPool(IN UINTN AllocationSize, IN CONST VOID *Buffer)
+{
+  VOID *Copy = acpi_posix_alloc(AllocationSize);
+  if (Copy != NULL) {
+    CopyMem(Copy, Buffer, AllocationSize);
+  }
+  return Copy;
+}
+
+VOID* EFIAPI ReallocatePool(IN UINTN OldSize, IN UINTN NewSize, IN VOID *OldBuffer OPTIONAL)
+{
+  return acpi_posix_realloc(OldBuffer, NewSize);
+}
+
+VOID EFIAPI FreePool(IN VOID *Buffer)
+{
+  acpi_posix_free(Buffer);
+}
+
+//
+// Log
+//
+VOID EFIAPI DebugLog(IN INTN DebugMode, IN CONST CHAR8 *FormatString, ...)
+{
+  CHAR8   Buffer[4096];
+  VA_LIST Marker;
+
+  if (!gAcpiHostVerbose || DebugMode == 0 || FormatString == NULL) {
+    return;
+  }
+  VA_START(Marker, FormatString);
+  AsciiVSPrint(Buffer, sizeof(Buffer), FormatString, Marker);
+  VA_END(Marker);
+  acpi_posix_print(Buffer);
+}
+
+VOID DbgHeader(CHAR8 *str)
+{
+  DebugLog(1, "%a:\n", str);
+}
+
+CHAR8* EFIAPI GetMemLogBuffer(VOID)
+{
+  return NULL;
+}
+
+UINTN EFIAPI GetMemLogLen(VOID)
+{
+  return 0;
+}
+
+//
+// Clover library functions used by the patcher
+//
+VOID LowCase(IN OUT CHAR8 *Str)
+{
+  while (Str && *Str) {
+    if (*Str >= 'A' && *Str <= 'Z') {
+      *Str |= 0x20;
+    }
+    Str++;
+  }
+}
+
+INTN StriCmp(IN CONST CHAR16 *FirstString, IN CONST CHAR16 *SecondString)
+{
+  while (*FirstString != L'\0' && CharToUpper(*FirstString) == CharToUpper(*SecondString)) {
+    FirstString++;
+    SecondString++;
+  }
+  return CharToUpper(*FirstString) - CharToUpper(*SecondString);
+}
+
+STATIC INTN HexValue(CHAR8 c)
+{
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+UINT32 hex2bin(IN CHAR8 *hex, OUT UINT8 *bin, UINT32 len)
+{
+  UINT32 i;
+
+  if (hex == NULL || bin == NULL || len == 0 || AsciiStrLen(hex) < len * 2) {
+    return 0;
+  }
+  for (i = 0; i < len; i++) {
+    while (*hex == ' ' || *hex == ',') {
+      hex++;
+    }
+    if (HexValue(hex[0]) < 0 || HexValue(hex[1]) < 0) {
+      break;
+    }
+    bin[i] = (UINT8)((HexValue(hex[0]) << 4) | HexValue(hex[1]));
+    hex += 2;
+  }
+  return i;
+}
+
+CHAR16* EFIAPI PoolPrint(IN CHAR16 *fmt, ...)
+{
+  CHAR16  *Buffer;
+  VA_LIST Marker;
+
+  Buffer = AllocatePool(1024 * sizeof(CHAR16));
+  if (Buffer != NULL) {
+    VA_START(Marker, fmt);
+    UnicodeVSPrint(Buffer, 1024 * sizeof(CHAR16), fmt, Marker);
+    VA_END(Marker);
+  }
+  return Buffer;
+}
+
+//
+// No PCI devices, so nothing asks for their device paths
+//
+EFI_DEVICE_PATH_PROTOCOL* EFIAPI DevicePathFromHandle(IN EFI_HANDLE Handle)
+{
+  return NULL;
+}
+
+EFI_DEVICE_PATH_PROTOCOL* EFIAPI DuplicateDevicePath(IN CONST EFI_DEVICE_PATH_PROTOCOL *DevicePath)
+{
+  return NULL;
+}
+
+EFI_DEVICE_PATH_PROTOCOL* EFIAPI NextDevicePathNode(IN CONST VOID *Node)
+{
+  return (EFI_DEVICE_PATH_PROTOCOL*)((UINT8*)Node + DevicePathNodeLength(Node));
+}
+
+BOOLEAN EFIAPI IsDevicePathEndType(IN CONST VOID *Node)
+{
+  return (BOOLEAN)(DevicePathType(Node) == END_DEVICE_PATH_TYPE);
+}
+
+UINT8 EFIAPI DevicePathType(IN CONST VOID *Node)
+{
+  return ((EFI_DEVICE_PATH_PROTOCOL*)Node)->Type;
+}
+
+UINTN EFIAPI DevicePathNodeLength(IN CONST VOID *Node)
+{
+  return ReadUnaligned16((UINT16*)&((EFI_DEVICE_PATH_PROTOCOL*)Node)->Length[0]);
+}
+
+BOOLEAN IsHDMIAudio(EFI_HANDLE PciDevHandle)
+{
+  return FALSE;
+}
+
+//
+// Not called by the tool: PatchACPI(), table loading and dumping
+//
+EFI_STATUS EFIAPI EfiGetSystemConfigurationTable(IN EFI_GUID *TableGuid, OUT VOID **Table)
+{
+  *Table = NULL;
+  return EFI_NOT_FOUND;
+}
+
+BOOLEAN FileExists(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath)
+{
+  return FALSE;
+}
+
+VOID DirIterOpen(IN EFI_FILE *BaseDir, IN CHAR16 *RelativePath OPTIONAL, OUT REFIT_DIR_ITER *DirIter)
+{
+  DirIter->LastStatus = EFI_NOT_FOUND;
+  DirIter->DirHandle = NULL;
+  DirIter->CloseDirHandle = FALSE;
+  DirIter->LastFileInfo = NULL;
+}
+
+BOOLEAN DirIterNext(IN OUT REFIT_DIR_ITER *DirIter, IN UINTN FilterMode, IN CHAR16 *FilePattern OPTIONAL,
+                    OUT EFI_FILE_INFO **DirEntry)
+{
+  return FALSE;
+}
+
+EFI_STATUS DirIterClose(IN OUT REFIT_DIR_ITER *DirIter)
+{
+  return DirIter->LastStatus;
+}
+
+EFI_STATUS egLoadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName,
+                      OUT UINT8 **FileData, OUT UINTN *FileDataLength)
+{
+  return EFI_UNSUPPORTED;
+}
+
+EFI_STATUS egSaveFile(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *FileName,
+                      IN UINT8 *FileData, IN UINTN FileDataLength)
+{
+  return EFI_UNSUPPORTED;
+}
+
+SSDT_TABLE *generate_pss_ssdt(UINTN Number)
+{
+  return NULL;
+}
+
+SSDT_TABLE *generate_cst_ssdt(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE* fadt, UINTN Number)
+{
+  return NULL;
+}
@@ -0,0 +1,67 @@
+/*
+ *  acpi_host.h
+ *
+ *  Firmware side of the host build of the ACPI patcher: the boot services,
+ *  globals and library functions FixBiosDsdt.c and AcpiPatcher.c expect.
+ *
+ */
+
+#ifndef _ACPI_HOST_H
+#define _ACPI_HOST_H
+
+#include "Platform.h"
+#include "AmlTree.h"
+#include "acpi_posix.h"
+
+// MsgLog()/DebugLog() output goes to stdout only when set
+extern BOOLEAN  gAcpiHostVerbose;
+
+// pages handed out by gBS->AllocatePages() and not freed yet
+extern UINTN    gAcpiHostPages;
+
+VOID
+AcpiHostInit (VOID);
+
+// releases all pages, the tables of a pass included
+VOID
+AcpiHostFreeAllPages (VOID);
+
+//
+// Not exported by Platform.h
+//
+extern XSDT_TABLE   *Xsdt;
+extern OPER_REGION  *gRegions;
+
+VOID
+PatchAllTables (VOID);
+
+VOID
+DropTableFromXSDT (
+  UINT32  Signature,
+  UINT64  TableId,
+  UINT32  Length
+  );
+
+UINT32
+DeleteDevice (
+  CHAR8     *Name,
+  UINT8     *dsdt,
+  UINT32    len,
+  AML_TREE  **Tree
+  );
+
+UINT32
+AddMCHC (
+  UINT8     *dsdt,
+  UINT32    len,
+  AML_TREE  **Tree
+  );
+
+UINT32
+AddIMEI (
+  UINT8     *dsdt,
+  UINT32    len,
+  AML_TREE  **Tree
+  );
+
+#endif /* !_ACPI_HOST_H */
@@ -0,0 +1,200 @@
+/*
+ *  acpi_posix.c
+ *
+ *  POSIX side of the host build of the ACPI patcher: memory, files,
+ *  console and clock.
+ *
+ */
+
+#include "acpi_posix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+void *acpi_posix_alloc_pages(unsigned long long pages)
+{
+  void  *p;
+  int   flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_32BIT
+  flags |= MAP_32BIT;
+#endif
+  p = mmap(NULL, (size_t)pages * 4096, PROT_READ | PROT_WRITE, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  return p;
+}
+
+void acpi_posix_free_pages(void *buffer, unsigned long long pages)
+{
+  munmap(buffer, (size_t)pages * 4096);
+}
+
+void *acpi_posix_alloc(unsigned long long size)
+{
+  return malloc(size ? (size_t)size : 1);
+}
+
+void *acpi_posix_realloc(void *buffer, unsigned long long size)
+{
+  return realloc(buffer, size ? (size_t)size : 1);
+}
+
+void acpi_posix_free(void *buffer)
+{
+  free(buffer);
+}
+
+void acpi_posix_print(const char *text)
+{
+  fputs(text, stdout);
+}
+
+void acpi_posix_error(const char *text)
+{
+  fflush(stdout);
+  fputs(text, stderr);
+}
+
+void *acpi_posix_load(const char *path, unsigned long long *size)
+{
+  FILE  *f;
+  long  len;
+  char  *data;
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return NULL;
+  }
+  data = malloc((size_t)len + 1);
+  if (data != NULL && fread(data, 1, (size_t)len, f) != (size_t)len) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  if (data != NULL) {
+    data[len] = 0;  // so a plist can be parsed in place
+    *size = (unsigned long long)len;
+  }
+  return data;
+}
+
+int acpi_posix_save(const char *path, const void *data, unsigned long long size)
+{
+  FILE  *f;
+  int   ok;
+
+  f = fopen(path, "wb");
+  if (f == NULL) {
+    return 0;
+  }
+  ok = fwrite(data, 1, (size_t)size, f) == (size_t)size;
+  ok = (fclose(f) == 0) && ok;
+  return ok;
+}
+
+int acpi_posix_mkdir(const char *path)
+{
+  struct stat st;
+
+  if (stat(path, &st) == 0) {
+    return S_ISDIR(st.st_mode);
+  }
+  return mkdir(path, 0755) == 0;
+}
+
+// SSDT-2.aml before SSDT-10.aml, as DumpTables() numbers them
+static int natural_cmp(const void *a, const void *b)
+{
+  const char *s = *(const char * const *)a;
+  const char *t = *(const char * const *)b;
+
+  while (*s && *t) {
+    if (isdigit((unsigned char)*s) && isdigit((unsigned char)*t)) {
+      unsigned long x = strtoul(s, (char **)&s, 10);
+      unsigned long y = strtoul(t, (char **)&t, 10);
+      if (x != y) {
+        return x < y ? -1 : 1;
+      }
+      continue;
+    }
+    if (*s != *t) {
+      return (unsigned char)*s - (unsigned char)*t;
+    }
+    s++;
+    t++;
+  }
+  return (unsigned char)*s - (unsigned char)*t;
+}
+
+char **acpi_posix_list_dir(const char *path, unsigned long long *count)
+{
+  DIR           *dir;
+  struct dirent *de;
+  char          **names = NULL;
+  size_t        n = 0, cap = 0;
+
+  *count = 0;
+  dir = opendir(path);
+  if (dir == NULL) {
+    return NULL;
+  }
+  while ((de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+    if (n == cap) {
+      char **more;
+      cap = cap ? cap * 2 : 64;
+      more = realloc(names, cap * sizeof(char *));
+      if (more == NULL) {
+        break;
+      }
+      names = more;
+    }
+    names[n] = strdup(de->d_name);
+    if (names[n] != NULL) {
+      n++;
+    }
+  }
+  closedir(dir);
+  if (n > 1) {
+    qsort(names, n, sizeof(char *), natural_cmp);
+  }
+  *count = n;
+  return names;
+}
+
+void acpi_posix_free_list(char **names, unsigned long long count)
+{
+  unsigned long long i;
+
+  for (i = 0; i < count; i++) {
+    free(names[i]);
+  }
+  free(names);
+}
+
+unsigned long long acpi_posix_time_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
@@ -0,0 +1,34 @@
+/*
+ *  acpi_posix.h
+ *
+ *  POSIX side of the host build of the ACPI patcher. Only plain C types
+ *  cross this interface, so it can be included next to the EDK2 headers
+ *  without pulling the C library headers into the firmware sources.
+ *
+ */
+
+#ifndef _ACPI_POSIX_H
+#define _ACPI_POSIX_H
+
+// memory below 4GB, as the patcher keeps some table addresses in 32 bits
+void*               acpi_posix_alloc_pages(unsigned long long pages);
+void                acpi_posix_free_pages(void *buffer, unsigned long long pages);
+void*               acpi_posix_alloc(unsigned long long size);
+void*               acpi_posix_realloc(void *buffer, unsigned long long size);
+void                acpi_posix_free(void *buffer);
+
+void                acpi_posix_print(const char *text);
+void                acpi_posix_error(const char *text);
+
+// the whole file in a new acpi_posix_alloc() buffer, NULL on failure
+void*               acpi_posix_load(const char *path, unsigned long long *size);
+int                 acpi_posix_save(const char *path, const void *data, unsigned long long size);
+int                 acpi_posix_mkdir(const char *path);
+
+// names of the files in a directory, sorted; freed by acpi_posix_free_list()
+char**              acpi_posix_list_dir(const char *path, unsigned long long *count);
+void                acpi_posix_free_list(char **names, unsigned long long count);
+
+unsigned long long  acpi_posix_time_ns(void);
+
+#endif /* !_ACPI_POSIX_H */
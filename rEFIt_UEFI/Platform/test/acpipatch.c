@@ -0,0 +1,770 @@
+/*
+ *  acpipatch.c
+ *
+ *  Host build of the ACPI patch pipeline. Takes the tables dumped by
+ *  DumpTables()/SaveOemTables() and the ACPI section of a config.plist,
+ *  applies FixBiosDsdt() to the DSDT and PatchAllTables() to the XSDT
+ *  tables the way PatchACPI() does, writes the results and reports the
+ *  time of the pipeline and of every fix of the mask, see README.
+ *
+ */
+
+#include "StateGenerator.h"
+#include "acpi_host.h"
+
+#define FACS_SIGN   SIGNATURE_32('F','A','C','S')
+#define MAX_PASSES  1000
+
+typedef struct {
+  CHAR8   *Name;    // file name in the tables directory
+  UINT8   *Data;
+  UINT32  Length;
+} HOST_TABLE;
+
+typedef struct {
+  UINT32  Signature;
+  UINT64  TableId;
+  UINT32  Length;
+} HOST_DROP;
+
+typedef struct {
+  UINT64  Min;
+  UINT64  Total;
+} HOST_TIME;
+
+// as FixesConfig in Settings.c
+STATIC struct { CONST CHAR8 *OldName; CONST CHAR8 *NewName; UINT32 Bit; } mFixes[] =
+{
+  { "AddDTGP_0001", "AddDTGP", FIX_DTGP },
+  { "FixDarwin_0002", "FixDarwin", FIX_WARNING },
+  { "FixShutdown_0004", "FixShutdown", FIX_SHUTDOWN },
+  { "AddMCHC_0008", "AddMCHC", FIX_MCHC },
+  { "FixHPET_0010", "FixHPET", FIX_HPET },
+  { "FakeLPC_0020", "FakeLPC", FIX_LPC },
+  { "FixIPIC_0040", "FixIPIC", FIX_IPIC },
+  { "FixSBUS_0080", "FixSBUS", FIX_SBUS },
+  { "FixDisplay_0100", "FixDisplay", FIX_DISPLAY },
+  { "FixIDE_0200", "FixIDE", FIX_IDE },
+  { "FixSATA_0400", "FixSATA", FIX_SATA },
+  { "FixFirewire_0800", "FixFirewire", FIX_FIREWIRE },
+  { "FixUSB_1000", "FixUSB", FIX_USB },
+  { "FixLAN_2000", "FixLAN", FIX_LAN },
+  { "FixAirport_4000", "FixAirport", FIX_WIFI },
+  { "FixHDA_8000", "FixHDA", FIX_HDA },
+  { "FixDarwin7_10000", "FixDarwin7", FIX_DARWIN },
+  { "FIX_RTC_20000", "FixRTC", FIX_RTC },
+  { "FIX_TMR_40000", "FixTMR", FIX_TMR },
+  { "AddIMEI_80000", "AddIMEI", FIX_IMEI },
+  { "FIX_INTELGFX_100000", "FixIntelGfx", FIX_INTELGFX },
+  { "FIX_WAK_200000", "FixWAK", FIX_WAK },
+  { "DeleteUnused_400000", "DeleteUnused", FIX_UNUSED },
+  { "FIX_ADP1_800000", "FixADP1", FIX_ADP1 },
+  { "AddPNLF_1000000", "AddPNLF", FIX_PNLF },
+  { "FIX_S3D_2000000", "FixS3D", FIX_S3D },
+  { "FIX_ACST_4000000", "FixACST", FIX_ACST },
+  { "AddHDMI_8000000", "AddHDMI", FIX_HDMI },
+  { "FixRegions_10000000", "FixRegions", FIX_REGIONS },
+  { "FixHeaders_20000000", "FixHeaders", FIX_HEADERS },
+  { NULL, "FixMutex", FIX_MUTEX }
+};
+
+// keys of a DropOEM_DSM dictionary
+STATIC struct { CONST CHAR8 *Name; UINT16 Bit; } mDsmDevices[] =
+{
+  { "ATI", DEV_ATI },
+  { "NVidia", DEV_NVIDIA },
+  { "IntelGFX", DEV_INTEL },
+  { "HDA", DEV_HDA },
+  { "HDMI", DEV_HDMI },
+  { "SATA", DEV_SATA },
+  { "LAN", DEV_LAN },
+  { "WIFI", DEV_WIFI },
+  { "USB", DEV_USB },
+  { "LPC", DEV_LPC },
+  { "SmBUS", DEV_SMBUS },
+  { "Firewire", DEV_FIREWIRE },
+  { "IDE", DEV_IDE }
+};
+
+STATIC HOST_TABLE   mDsdt;
+STATIC HOST_TABLE   *mTables = NULL;    // XSDT entries, FACP first
+STATIC UINTN        mTableCount = 0;
+STATIC HOST_DROP    *mDrops = NULL;
+STATIC UINTN        mDropCount = 0;
+STATIC CHAR8        *mOSVersion = "10.14";
+
+// tables of the current pass
+STATIC UINT8                                      *mPassDsdt;
+STATIC EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE  *mPassFadt;
+
+STATIC VOID Out(CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[1024];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  acpi_posix_print(Buffer);
+}
+
+STATIC VOID Fail(CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[1024];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  acpi_posix_error(Buffer);
+}
+
+//
+// Config, the ACPI keys GetUserSettings() reads for the patcher
+//
+BOOLEAN IsPropertyTrue(TagPtr Prop)
+{
+  return Prop != NULL &&
+  ((Prop->type == kTagTypeTrue) ||
+   ((Prop->type == kTagTypeString) && Prop->string &&
+    ((Prop->string[0] == 'y') || (Prop->string[0] == 'Y'))));
+}
+
+BOOLEAN IsPropertyFalse(TagPtr Prop)
+{
+  return Prop != NULL &&
+  ((Prop->type == kTagTypeFalse) ||
+   ((Prop->type == kTagTypeString) && Prop->string &&
+    ((Prop->string[0] == 'N') || (Prop->string[0] == 'n'))));
+}
+
+INTN GetPropertyInteger(TagPtr Prop, INTN Default)
+{
+  if (Prop == NULL) {
+    return Default;
+  }
+  if (Prop->type == kTagTypeInteger) {
+    return (INTN)Prop->string;
+  } else if ((Prop->type == kTagTypeString) && Prop->string) {
+    if ((Prop->string[1] == 'x') || (Prop->string[1] == 'X')) {
+      return (INTN)AsciiStrHexToUintn(Prop->string);
+    }
+    if (Prop->string[0] == '-') {
+      return -(INTN)AsciiStrDecimalToUintn(Prop->string + 1);
+    }
+    return (INTN)AsciiStrDecimalToUintn((Prop->string[0] == '+') ? (Prop->string + 1) : Prop->string);
+  }
+  return Default;
+}
+
+STATIC UINT8 *GetData(TagPtr Dict, CONST CHAR8 *PropName, UINT32 *DataLen)
+{
+  TagPtr  Prop = GetProperty(Dict, PropName);
+  UINT8   *Data = NULL;
+  UINT32  Len = 0;
+
+  if (Prop != NULL) {
+    if (Prop->data != NULL) {
+      Len = (UINT32)Prop->dataLen;
+      Data = AllocateCopyPool(Len, Prop->data);
+    } else if (Prop->string != NULL) {
+      Len = (UINT32)AsciiStrLen(Prop->string) >> 1;
+      Data = AllocateZeroPool(Len);
+      Len = hex2bin(Prop->string, Data, Len);
+    }
+  }
+  *DataLen = Len;
+  return Data;
+}
+
+STATIC ACPI_NAME_LIST *ParseName(CHAR8 *String)
+{
+  ACPI_NAME_LIST  *List = NULL;
+  INTN            Start, End, Len, j;
+
+  Len = AsciiStrLen(String);
+  // "_SB.PCI0.RP02.PXSX" is kept as PXSX -> RP02 -> PCI0 -> _SB_
+  for (Start = 0; Start < Len; Start = End + 1) {
+    ACPI_NAME_LIST *Next = AllocateZeroPool(sizeof(ACPI_NAME_LIST));
+    Next->Name = AllocateZeroPool(5);
+    for (End = Start, j = 0; End < Len && String[End] != '.'; End++) {
+      if (j < 4) {
+        Next->Name[j++] = String[End];
+      }
+    }
+    while (j < 4) {
+      Next->Name[j++] = '_';
+    }
+    Next->Next = List;
+    List = Next;
+  }
+  return List;
+}
+
+STATIC VOID LoadDsdtSettings(TagPtr Dict)
+{
+  TagPtr  Prop, Prop2;
+  INTN    i, Count;
+  UINTN   Index;
+
+  gSettings.Rtc8Allowed = IsPropertyTrue(GetProperty(Dict, "Rtc8Allowed"));
+  gSettings.FixDsdt = (UINT32)GetPropertyInteger(GetProperty(Dict, "FixMask"), gSettings.FixDsdt);
+
+  Prop = GetProperty(Dict, "Fixes");
+  if (Prop != NULL && Prop->type == kTagTypeDict) {
+    gSettings.FixDsdt = 0;
+    for (Index = 0; Index < ARRAY_SIZE(mFixes); Index++) {
+      Prop2 = GetProperty(Prop, mFixes[Index].NewName);
+      if (!Prop2 && mFixes[Index].OldName) {
+        Prop2 = GetProperty(Prop, mFixes[Index].OldName);
+      }
+      if (IsPropertyTrue(Prop2)) {
+        gSettings.FixDsdt |= mFixes[Index].Bit;
+      }
+    }
+  }
+
+  Prop = GetProperty(Dict, "Patches");
+  Count = Prop ? GetTagCount(Prop) : 0;
+  if (Count > 0) {
+    gSettings.PatchDsdtNum      = (UINT32)Count;
+    gSettings.PatchDsdtFind     = AllocateZeroPool(Count * sizeof(UINT8*));
+    gSettings.PatchDsdtReplace  = AllocateZeroPool(Count * sizeof(UINT8*));
+    gSettings.PatchDsdtTgt      = AllocateZeroPool(Count * sizeof(UINT8*));
+    gSettings.LenToFind         = AllocateZeroPool(Count * sizeof(UINT32));
+    gSettings.LenToReplace      = AllocateZeroPool(Count * sizeof(UINT32));
+    gSettings.PatchDsdtLabel    = AllocateZeroPool(Count * sizeof(UINT8*));
+    gSettings.PatchDsdtMenuItem = AllocateZeroPool(Count * sizeof(INPUT_ITEM));
+    for (i = 0; i < Count; i++) {
+      UINT32 Size;
+      if (EFI_ERROR(GetElement(Prop, i, &Prop2)) || Prop2 == NULL) {
+        continue;
+      }
+      gSettings.PatchDsdtLabel[i] = AllocateZeroPool(256);
+      if (GetProperty(Prop2, "Comment") && GetProperty(Prop2, "Comment")->string) {
+        AsciiSPrint(gSettings.PatchDsdtLabel[i], 255, "%a", GetProperty(Prop2, "Comment")->string);
+      } else {
+        AsciiSPrint(gSettings.PatchDsdtLabel[i], 255, " (NoLabel)");
+      }
+      gSettings.PatchDsdtMenuItem[i].BValue = !IsPropertyTrue(GetProperty(Prop2, "Disabled"));
+      gSettings.PatchDsdtFind[i]    = GetData(Prop2, "Find", &Size);
+      gSettings.LenToFind[i]        = Size;
+      gSettings.PatchDsdtReplace[i] = GetData(Prop2, "Replace", &Size);
+      gSettings.LenToReplace[i]     = Size;
+      gSettings.PatchDsdtTgt[i]     = (CHAR8*)GetData(Prop2, "TgtBridge", &Size);
+    }
+  }
+
+  gSettings.ReuseFFFF = IsPropertyTrue(GetProperty(Dict, "ReuseFFFF"));
+  gSettings.SuspendOverride = IsPropertyTrue(GetProperty(Dict, "SuspendOverride"));
+
+  Prop = GetProperty(Dict, "DropOEM_DSM");
+  defDSM = (Prop != NULL);
+  if (IsPropertyTrue(Prop)) {
+    gSettings.DropOEM_DSM = 0xFFFF;
+  } else if (IsPropertyFalse(Prop)) {
+    gSettings.DropOEM_DSM = 0;
+  } else if (Prop && Prop->type == kTagTypeInteger) {
+    gSettings.DropOEM_DSM = (UINT16)(UINTN)Prop->string;
+  } else if (Prop && Prop->type == kTagTypeDict) {
+    for (Index = 0; Index < ARRAY_SIZE(mDsmDevices); Index++) {
+      if (IsPropertyTrue(GetProperty(Prop, mDsmDevices[Index].Name))) {
+        gSettings.DropOEM_DSM |= mDsmDevices[Index].Bit;
+      }
+    }
+  }
+}
+
+STATIC VOID LoadDropTables(TagPtr Prop)
+{
+  INTN    i, Count = GetTagCount(Prop);
+  TagPtr  Dict2, Prop2;
+
+  mDrops = AllocateZeroPool((Count + 1) * sizeof(HOST_DROP));
+  for (i = 0; i < Count; i++) {
+    HOST_DROP *Drop = &mDrops[mDropCount];
+    if (EFI_ERROR(GetElement(Prop, i, &Dict2)) || Dict2 == NULL) {
+      continue;
+    }
+    Prop2 = GetProperty(Dict2, "Signature");
+    if (Prop2 && Prop2->type == kTagTypeString && Prop2->string) {
+      CopyMem(&Drop->Signature, Prop2->string, MIN(AsciiStrLen(Prop2->string), 4));
+    }
+    Prop2 = GetProperty(Dict2, "TableId");
+    if (Prop2 && Prop2->string) {
+      CopyMem(&Drop->TableId, Prop2->string, MIN(AsciiStrLen(Prop2->string), 8));
+    }
+    Drop->Length = (UINT32)GetPropertyInteger(GetProperty(Dict2, "Length"), 0);
+    mDropCount++;
+  }
+}
+
+STATIC VOID LoadRenameDevices(TagPtr Prop)
+{
+  INTN    i, Count = GetTagCount(Prop);
+  TagPtr  Prop2;
+
+  gSettings.DeviceRenameCount = 0;
+  gSettings.DeviceRename = AllocateZeroPool(Count * sizeof(ACPI_NAME_LIST));
+  for (i = 0; i < Count; i++) {
+    Prop2 = NULL;
+    if (!EFI_ERROR(GetElement(Prop, i, &Prop2)) && Prop2 != NULL && Prop2->type == kTagTypeKey &&
+        Prop2->tag && ((TagPtr)Prop2->tag)->type == kTagTypeString) {
+      gSettings.DeviceRename[gSettings.DeviceRenameCount].Next = ParseName(Prop2->string);
+      gSettings.DeviceRename[gSettings.DeviceRenameCount++].Name = AllocateCopyPool(5, ((TagPtr)Prop2->tag)->string);
+    }
+  }
+}
+
+STATIC BOOLEAN LoadConfig(CONST CHAR8 *Path)
+{
+  UINT8               *Buffer;
+  unsigned long long  Size;
+  TagPtr              Dict = NULL, Acpi, Prop;
+
+  Buffer = acpi_posix_load(Path, &Size);
+  if (Buffer == NULL) {
+    Fail("%a: cannot read\n", Path);
+    return FALSE;
+  }
+  if (EFI_ERROR(ParseXML((CHAR8*)Buffer, &Dict, (UINT32)Size)) || Dict == NULL) {
+    Fail("%a: not a plist\n", Path);
+    acpi_posix_free(Buffer);
+    return FALSE;
+  }
+  Acpi = GetProperty(Dict, "ACPI");
+  if (Acpi != NULL) {
+    Prop = GetProperty(Acpi, "DropTables");
+    if (Prop != NULL) {
+      LoadDropTables(Prop);
+    }
+    Prop = GetProperty(Acpi, "DSDT");
+    if (Prop != NULL) {
+      LoadDsdtSettings(Prop);
+    }
+    Prop = GetProperty(Acpi, "SSDT");
+    if (Prop != NULL) {
+      gSettings.DropSSDT = IsPropertyTrue(GetProperty(Prop, "DropOem"));
+    }
+    gSettings.FixHeaders = IsPropertyTrue(GetProperty(Acpi, "FixHeaders"));
+    gSettings.FixMCFG = IsPropertyTrue(GetProperty(Acpi, "FixMCFG"));
+    Prop = GetProperty(Acpi, "RenameDevices");
+    if (Prop != NULL && Prop->type == kTagTypeDict) {
+      LoadRenameDevices(Prop);
+    }
+  }
+  FreeTag(Dict);
+  acpi_posix_free(Buffer);
+  return TRUE;
+}
+
+//
+// Tables
+//
+STATIC BOOLEAN IsAmlName(CONST CHAR8 *Name)
+{
+  UINTN Len = AsciiStrLen(Name);
+  return Len > 4 && AsciiStriCmp(Name + Len - 4, ".aml") == 0;
+}
+
+STATIC BOOLEAN LoadTables(CONST CHAR8 *Dir)
+{
+  CHAR8               **Names;
+  unsigned long long  Count, Index, Size;
+  CHAR8               Path[1024];
+  HOST_TABLE          Table;
+  UINT32              Signature;
+
+  Names = acpi_posix_list_dir(Dir, &Count);
+  if (Names == NULL) {
+    Fail("%a: cannot list\n", Dir);
+    return FALSE;
+  }
+  mTables = AllocateZeroPool((UINTN)(Count + 1) * sizeof(HOST_TABLE));
+  for (Index = 0; Index < Count; Index++) {
+    // dynamic SSDTs are loaded by the OS, the patcher never sees them
+    if (!IsAmlName(Names[Index]) || AsciiStrnCmp(Names[Index], "SSDT-x", 6) == 0) {
+      continue;
+    }
+    AsciiSPrint(Path, sizeof(Path), "%a/%a", Dir, Names[Index]);
+    Table.Data = acpi_posix_load(Path, &Size);
+    if (Table.Data == NULL) {
+      Fail("%a: cannot read\n", Path);
+      continue;
+    }
+    Table.Length = ((EFI_ACPI_DESCRIPTION_HEADER*)Table.Data)->Length;
+    if (Size < sizeof(EFI_ACPI_DESCRIPTION_HEADER) || Table.Length < sizeof(EFI_ACPI_DESCRIPTION_HEADER) ||
+        Table.Length > Size) {
+      acpi_posix_free(Table.Data);
+      continue;
+    }
+    Table.Name = AllocateCopyPool(AsciiStrSize(Names[Index]), Names[Index]);
+    Signature = ((EFI_ACPI_DESCRIPTION_HEADER*)Table.Data)->Signature;
+    if (Signature == EFI_ACPI_2_0_DIFFERENTIATED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE) {
+      if (mDsdt.Data == NULL) {
+        mDsdt = Table;
+      }
+    } else if (Signature == EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE) {
+      // the patcher expects FACP as the first XSDT entry
+      CopyMem(&mTables[1], &mTables[0], (UINTN)mTableCount * sizeof(HOST_TABLE));
+      mTables[0] = Table;
+      mTableCount++;
+    } else if (Signature != EFI_ACPI_2_0_EXTENDED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE &&
+               Signature != EFI_ACPI_1_0_ROOT_SYSTEM_DESCRIPTION_TABLE_SIGNATURE &&
+               Signature != FACS_SIGN) {
+      mTables[mTableCount++] = Table;
+    }
+  }
+  acpi_posix_free_list(Names, Count);
+  if (mDsdt.Data == NULL) {
+    Fail("%a: no DSDT\n", Dir);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+STATIC VOID *CopyToPages(CONST VOID *Data, UINTN Length, UINTN Size)
+{
+  EFI_PHYSICAL_ADDRESS  Buffer = EFI_SYSTEM_TABLE_MAX_ADDRESS;
+
+  if (EFI_ERROR(gBS->AllocatePages(AllocateMaxAddress, EfiACPIReclaimMemory, EFI_SIZE_TO_PAGES(Size), &Buffer))) {
+    return NULL;
+  }
+  ZeroMem((VOID*)(UINTN)Buffer, EFI_PAGES_TO_SIZE(EFI_SIZE_TO_PAGES(Size)));
+  CopyMem((VOID*)(UINTN)Buffer, Data, Length);
+  return (VOID*)(UINTN)Buffer;
+}
+
+//
+// Puts fresh copies of the tables into memory as PatchACPI() leaves them
+// before the fixes: the XSDT reallocated into a page and the DSDT with
+// room to grow. The FADT keeps its DSDT address, so it is written as read.
+//
+STATIC BOOLEAN StartPass(UINT32 FixDsdt)
+{
+  UINTN Index;
+
+  while (gRegions != NULL) {
+    OPER_REGION *Next = gRegions->next;
+    FreePool(gRegions);
+    gRegions = Next;
+  }
+  AcpiHostFreeAllPages();
+
+  Xsdt = CopyToPages(NULL, 0, EFI_PAGE_SIZE);
+  if (Xsdt == NULL) {
+    return FALSE;
+  }
+  Xsdt->Header.Signature = EFI_ACPI_2_0_EXTENDED_SYSTEM_DESCRIPTION_TABLE_SIGNATURE;
+  Xsdt->Header.Length = (UINT32)(sizeof(EFI_ACPI_DESCRIPTION_HEADER) + mTableCount * sizeof(UINT64));
+  Xsdt->Header.Revision = 1;
+  mPassFadt = NULL;
+  for (Index = 0; Index < mTableCount; Index++) {
+    VOID *Table = CopyToPages(mTables[Index].Data, mTables[Index].Length, mTables[Index].Length);
+    if (Table == NULL) {
+      return FALSE;
+    }
+    WriteUnaligned64((UINT64*)((CHAR8*)&Xsdt->Entry + Index * sizeof(UINT64)), (UINT64)(UINTN)Table);
+    if (Index == 0 && mTables[0].Data != mDsdt.Data &&
+        ((EFI_ACPI_DESCRIPTION_HEADER*)Table)->Signature == EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE) {
+      mPassFadt = Table;
+    }
+  }
+  if (mPassFadt == NULL) {
+    // FIXWAK() reads the PM blocks, a zeroed FADT makes it leave them alone
+    mPassFadt = CopyToPages(NULL, 0, sizeof(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE));
+    if (mPassFadt == NULL) {
+      return FALSE;
+    }
+    mPassFadt->Header.Signature = EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE_SIGNATURE;
+    mPassFadt->Header.Length = sizeof(EFI_ACPI_2_0_FIXED_ACPI_DESCRIPTION_TABLE);
+  }
+
+  mPassDsdt = CopyToPages(mDsdt.Data, mDsdt.Length, mDsdt.Length + mDsdt.Length / 8);
+  if (mPassDsdt == NULL) {
+    return FALSE;
+  }
+
+  gSettings.FixDsdt = FixDsdt;
+  dropDSM = defDSM ? gSettings.DropOEM_DSM : 0xFFFF;
+  if ((gSettings.FixDsdt & FIX_REGIONS) != 0) {
+    GetBiosRegions(mPassDsdt);
+  }
+  return TRUE;
+}
+
+STATIC VOID AddTime(HOST_TIME *Time, UINT64 Ns, UINTN Pass)
+{
+  if (Pass == 0 || Ns < Time->Min) {
+    Time->Min = Ns;
+  }
+  Time->Total += Ns;
+}
+
+// the whole pipeline: FixBiosDsdt(), dropping tables, PatchAllTables()
+STATIC BOOLEAN RunPipeline(UINT32 FixDsdt, HOST_TIME *Fix, HOST_TIME *Patch, UINTN Pass)
+{
+  UINT64  Start;
+  UINTN   Index;
+
+  if (!StartPass(FixDsdt)) {
+    return FALSE;
+  }
+  Start = acpi_posix_time_ns();
+  FixBiosDsdt(mPassDsdt, mPassFadt, mOSVersion);
+  AddTime(Fix, acpi_posix_time_ns() - Start, Pass);
+
+  Start = acpi_posix_time_ns();
+  for (Index = 0; Index < mDropCount; Index++) {
+    DropTableFromXSDT(mDrops[Index].Signature, mDrops[Index].TableId, mDrops[Index].Length);
+  }
+  if (gSettings.DropSSDT) {
+    DropTableFromXSDT(EFI_ACPI_4_0_SECONDARY_SYSTEM_DESCRIPTION_TABLE_SIGNATURE, 0, 0);
+  }
+  PatchAllTables();
+  AddTime(Patch, acpi_posix_time_ns() - Start, Pass);
+  return TRUE;
+}
+
+// FixBiosDsdt() with one fix of the mask, or none
+STATIC BOOLEAN RunFix(UINT32 FixDsdt, HOST_TIME *Fix, UINTN Pass)
+{
+  UINT64 Start;
+
+  if (!StartPass(FixDsdt)) {
+    return FALSE;
+  }
+  Start = acpi_posix_time_ns();
+  FixBiosDsdt(mPassDsdt, mPassFadt, mOSVersion);
+  AddTime(Fix, acpi_posix_time_ns() - Start, Pass);
+  return TRUE;
+}
+
+STATIC BOOLEAN SaveTable(CONST CHAR8 *Dir, CONST CHAR8 *Name, EFI_ACPI_DESCRIPTION_HEADER *Table)
+{
+  CHAR8 Path[1024];
+
+  AsciiSPrint(Path, sizeof(Path), "%a/%a", Dir, Name);
+  if (!acpi_posix_save(Path, Table, Table->Length)) {
+    Fail("%a: cannot write\n", Path);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// results of the last pass
+STATIC BOOLEAN SaveTables(CONST CHAR8 *Dir)
+{
+  UINTN                       Index;
+  EFI_ACPI_DESCRIPTION_HEADER *Table;
+  BOOLEAN                     Ok;
+
+  if (!acpi_posix_mkdir(Dir)) {
+    Fail("%a: cannot create\n", Dir);
+    return FALSE;
+  }
+  Ok = SaveTable(Dir, mDsdt.Name, (EFI_ACPI_DESCRIPTION_HEADER*)mPassDsdt);
+  for (Index = 0; Index < mTableCount; Index++) {
+    Table = (EFI_ACPI_DESCRIPTION_HEADER*)(UINTN)ReadUnaligned64((UINT64*)((CHAR8*)&Xsdt->Entry + Index * sizeof(UINT64)));
+    if (Table == NULL) {
+      Out("%a dropped\n", mTables[Index].Name);
+      continue;
+    }
+    Ok = SaveTable(Dir, mTables[Index].Name, Table) && Ok;
+  }
+  return Ok;
+}
+
+STATIC VOID PrintTime(CONST CHAR8 *Name, HOST_TIME *Time, UINTN Passes, HOST_TIME *Base)
+{
+  UINT64 Avg = Time->Total / Passes;
+
+  Out("  %-24a %6ld.%03ld %6ld.%03ld", Name,
+      Time->Min / 1000000, (Time->Min / 1000) % 1000, Avg / 1000000, (Avg / 1000) % 1000);
+  if (Base != NULL) {
+    INT64 Delta = (INT64)Time->Min - (INT64)Base->Min;
+    Out("  %a%ld.%03ld", Delta < 0 ? "-" : "+",
+        (Delta < 0 ? -Delta : Delta) / 1000000, ((Delta < 0 ? -Delta : Delta) / 1000) % 1000);
+  }
+  Out("\n");
+}
+
+//
+// Corpus check: the FIX_UNUSED deletions and the MCHC and IMEI additions of
+// FixBiosDsdt() on the AML tree against the same functions without a tree,
+// which move bytes as they always did
+//
+STATIC CHAR8 *mUnusedDevices[] = { "CRT_", "DVI_", "SPKR", "ECP_", "LPT_", "FDC0", "ECP1", "LPT1" };
+
+STATIC UINT32 TreeFixes(UINT8 *Dsdt, UINT32 Len, BOOLEAN UseTree)
+{
+  AML_TREE  *Tree = UseTree ? aml_parse_tree(Dsdt, Len) : NULL;
+  UINTN     Index;
+
+  for (Index = 0; Index < ARRAY_SIZE(mUnusedDevices); Index++) {
+    Len = DeleteDevice(mUnusedDevices[Index], Dsdt, Len, &Tree);
+  }
+  if (Tree) {
+    Len = aml_write_tree(Tree);
+    aml_destroy_tree(Tree);
+  }
+  Tree = UseTree ? aml_parse_tree(Dsdt, Len) : NULL;
+  Len = AddMCHC(Dsdt, Len, &Tree);
+  Len = AddIMEI(Dsdt, Len, &Tree);
+  if (Tree) {
+    Len = aml_write_tree(Tree);
+    aml_destroy_tree(Tree);
+  }
+  // moving bytes leaves the header to the caller
+  ((EFI_ACPI_DESCRIPTION_HEADER*)Dsdt)->Length = Len;
+  return Len;
+}
+
+STATIC int CheckCorpus(CONST CHAR8 *Dir)
+{
+  CHAR8               **Names;
+  unsigned long long  Count, Index, Size;
+  CHAR8               Path[1024];
+  UINT8               *Data, *ByTree, *ByBytes;
+  UINT32              Len, TreeLen, BytesLen, Pos;
+  UINTN               Failed = 0, Checked = 0;
+
+  Names = acpi_posix_list_dir(Dir, &Count);
+  if (Names == NULL) {
+    Fail("%a: cannot list\n", Dir);
+    return 1;
+  }
+  for (Index = 0; Index < Count; Index++) {
+    if (!IsAmlName(Names[Index])) {
+      continue;
+    }
+    AsciiSPrint(Path, sizeof(Path), "%a/%a", Dir, Names[Index]);
+    Data = acpi_posix_load(Path, &Size);
+    if (Data == NULL || Size < sizeof(EFI_ACPI_DESCRIPTION_HEADER) ||
+        ((EFI_ACPI_DESCRIPTION_HEADER*)Data)->Length > Size) {
+      Fail("%a: cannot read\n", Path);
+      Failed++;
+      if (Data != NULL) {
+        acpi_posix_free(Data);
+      }
+      continue;
+    }
+    Len = ((EFI_ACPI_DESCRIPTION_HEADER*)Data)->Length;
+    ByTree = CopyToPages(Data, Len, Len);
+    ByBytes = CopyToPages(Data, Len, Len);
+    acpi_posix_free(Data);
+    if (ByTree == NULL || ByBytes == NULL) {
+      Fail("out of memory\n");
+      return 1;
+    }
+    TreeLen = TreeFixes(ByTree, Len, TRUE);
+    BytesLen = TreeFixes(ByBytes, Len, FALSE);
+    Checked++;
+    for (Pos = 0; Pos < TreeLen && Pos < BytesLen && ByTree[Pos] == ByBytes[Pos]; Pos++);
+    if (TreeLen != BytesLen || Pos < TreeLen) {
+      Out("%a: %d -> %d bytes, the byte scan gives %d, first difference at 0x%x\n",
+          Names[Index], Len, TreeLen, BytesLen, Pos);
+      Failed++;
+    } else {
+      Out("%a: %d -> %d bytes, same as the byte scan\n", Names[Index], Len, TreeLen);
+    }
+    AcpiHostFreeAllPages();
+  }
+  acpi_posix_free_list(Names, Count);
+  Out("%d tables, %d failed\n", Checked, Failed);
+  return (Failed || !Checked) ? 1 : 0;
+}
+
+STATIC VOID Usage(VOID)
+{
+  Fail("usage: acpipatch [-v] [-n passes] [-o outdir] [-s osversion] <tables dir> <config.plist>\n"
+       "       acpipatch [-v] -c <dsdt dir>\n");
+}
+
+int main(int argc, char **argv)
+{
+  CHAR8     *OutDir = NULL;
+  UINTN     Passes = 1;
+  UINTN     Pass, Index, Enabled;
+  int       Arg;
+  UINT32    FixMask;
+  HOST_TIME Fix, Patch, Base;
+  HOST_TIME Fixes[ARRAY_SIZE(mFixes)];
+
+  AcpiHostInit();
+  for (Arg = 1; Arg < argc && argv[Arg][0] == '-'; Arg++) {
+    if (AsciiStrCmp(argv[Arg], "-v") == 0) {
+      gAcpiHostVerbose = TRUE;
+    } else if (AsciiStrCmp(argv[Arg], "-n") == 0 && Arg + 1 < argc) {
+      Passes = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else if (AsciiStrCmp(argv[Arg], "-o") == 0 && Arg + 1 < argc) {
+      OutDir = argv[++Arg];
+    } else if (AsciiStrCmp(argv[Arg], "-s") == 0 && Arg + 1 < argc) {
+      mOSVersion = argv[++Arg];
+    } else if (AsciiStrCmp(argv[Arg], "-c") == 0 && Arg + 2 == argc) {
+      return CheckCorpus(argv[Arg + 1]);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (argc - Arg != 2 || Passes == 0 || Passes > MAX_PASSES) {
+    Usage();
+    return 2;
+  }
+  if (!LoadConfig(argv[Arg + 1]) || !LoadTables(argv[Arg])) {
+    return 1;
+  }
+  FixMask = gSettings.FixDsdt;
+
+  for (Index = 0, Enabled = 0; Index < gSettings.PatchDsdtNum; Index++) {
+    if (gSettings.PatchDsdtMenuItem[Index].BValue) {
+      Enabled++;
+    }
+  }
+  Out("%a: %d bytes, %d more tables, %d of %d patches enabled, fix mask 0x%08x\n",
+      mDsdt.Name, mDsdt.Length, mTableCount, Enabled, gSettings.PatchDsdtNum, FixMask);
+
+  ZeroMem(&Fix, sizeof(Fix));
+  ZeroMem(&Patch, sizeof(Patch));
+  for (Pass = 0; Pass < Passes; Pass++) {
+    // the last pass stays in memory to be written
+    if (!RunPipeline(FixMask, &Fix, &Patch, Pass)) {
+      Fail("out of memory\n");
+      return 1;
+    }
+  }
+  Out("%a: %d bytes after the fixes\n", mDsdt.Name, ((EFI_ACPI_DESCRIPTION_HEADER*)mPassDsdt)->Length);
+  if (OutDir != NULL && !SaveTables(OutDir)) {
+    return 1;
+  }
+
+  // every fix of the mask on its own, compared to none
+  ZeroMem(&Base, sizeof(Base));
+  ZeroMem(Fixes, sizeof(Fixes));
+  gAcpiHostVerbose = FALSE;
+  for (Pass = 0; Pass < Passes; Pass++) {
+    if (!RunFix(0, &Base, Pass)) {
+      Fail("out of memory\n");
+      return 1;
+    }
+    for (Index = 0; Index < ARRAY_SIZE(mFixes); Index++) {
+      if ((FixMask & mFixes[Index].Bit) != 0 && !RunFix(mFixes[Index].Bit, &Fixes[Index], Pass)) {
+        Fail("out of memory\n");
+        return 1;
+      }
+    }
+  }
+
+  Out("time in ms, %d pass%a        min      avg\n", Passes, Passes == 1 ? "  " : "es");
+  PrintTime("FixBiosDsdt", &Fix, Passes, NULL);
+  PrintTime("PatchAllTables", &Patch, Passes, NULL);
+  PrintTime("patches, no fixes", &Base, Passes, NULL);
+  for (Index = 0; Index < ARRAY_SIZE(mFixes); Index++) {
+    if ((FixMask & mFixes[Index].Bit) != 0) {
+      PrintTime(mFixes[Index].NewName, &Fixes[Index], Passes, &Base);
+    }
+  }
+  AcpiHostFreeAllPages();
+  return 0;
+}
@@ -0,0 +1,358 @@
+/*
+ *  plisttest.c
+ *
+ *  Host check and benchmark of the plist parsers: ParseXMLArena() and
+ *  PlistLoadBinary() must give the same tree as ParseXML() and the hashed
+ *  GetProperty() the same values as the linear one, then the time of
+ *  parsing, freeing and looking up every key is reported, see README.
+ *
+ */
+
+#include "acpi_host.h"
+
+#define MAX_PASSES  1000
+
+typedef struct {
+  UINTN   Tags;
+  UINTN   Dicts;
+  UINTN   Keys;
+} PLIST_COUNT;
+
+typedef struct {
+  UINT64  Min;
+  UINT64  Total;
+} HOST_TIME;
+
+STATIC UINTN    mFailed = 0;
+
+STATIC VOID Out(CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[1024];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  acpi_posix_print(Buffer);
+}
+
+STATIC VOID Fail(CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[1024];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  acpi_posix_error(Buffer);
+}
+
+STATIC VOID AddTime(HOST_TIME *Time, UINT64 Start, UINTN Pass)
+{
+  UINT64 Ns = acpi_posix_time_ns() - Start;
+
+  if (Pass == 0 || Ns < Time->Min) {
+    Time->Min = Ns;
+  }
+  Time->Total += Ns;
+}
+
+STATIC VOID CountTags(TagPtr Tag, PLIST_COUNT *Count)
+{
+  for (; Tag != NULL; Tag = Tag->tagNext) {
+    Count->Tags++;
+    if (Tag->type == kTagTypeDict) {
+      Count->Dicts++;
+    } else if (Tag->type == kTagTypeKey) {
+      Count->Keys++;
+    }
+    CountTags(Tag->tag, Count);
+  }
+}
+
+//
+// Same structure, types, values and source offsets; Where names the first
+// difference by the keys leading to it
+//
+STATIC BOOLEAN SameTree(TagPtr a, TagPtr b, CONST CHAR8 *Path)
+{
+  CHAR8 Where[512];
+
+  for (; a != NULL && b != NULL; a = a->tagNext, b = b->tagNext) {
+    if (a->type != b->type || a->offset != b->offset || a->dataLen != b->dataLen ||
+        (a->data == NULL) != (b->data == NULL) ||
+        (a->data != NULL && CompareMem(a->data, b->data, a->dataLen) != 0)) {
+      Fail("  %a: tag at offset %d differs\n", Path, a->offset);
+      return FALSE;
+    }
+    if (a->type == kTagTypeInteger ? a->string != b->string :
+        ((a->string == NULL) != (b->string == NULL) ||
+         (a->string != NULL && AsciiStrCmp(a->string, b->string) != 0))) {
+      Fail("  %a: value at offset %d differs\n", Path, a->offset);
+      return FALSE;
+    }
+    if (a->type == kTagTypeKey && a->string != NULL) {
+      AsciiSPrint(Where, sizeof(Where), "%a/%a", Path, a->string);
+    } else {
+      AsciiStrCpyS(Where, sizeof(Where), Path);
+    }
+    if (!SameTree(a->tag, b->tag, Where)) {
+      return FALSE;
+    }
+  }
+  if (a != NULL || b != NULL) {
+    Fail("  %a: %a tags\n", Path, a != NULL ? "missing" : "extra");
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// number of the key of Dict whose value is Value, -1 for NULL or none
+STATIC INTN KeyNumber(TagPtr Dict, TagPtr Value)
+{
+  TagPtr  Tag;
+  INTN    Number = 0;
+
+  if (Value == NULL) {
+    return -1;
+  }
+  for (Tag = Dict->tag; Tag != NULL; Tag = Tag->tagNext, Number++) {
+    if (Tag->type == kTagTypeKey && Tag->tag == Value) {
+      return Number;
+    }
+  }
+  return -2;
+}
+
+STATIC VOID FlipCase(CHAR8 *Dst, CONST CHAR8 *Src, UINTN Size)
+{
+  AsciiStrCpyS(Dst, Size, Src);
+  for (; *Dst != '\0'; Dst++) {
+    if ((*Dst >= 'a' && *Dst <= 'z') || (*Dst >= 'A' && *Dst <= 'Z')) {
+      *Dst ^= 0x20;
+    }
+  }
+}
+
+//
+// GetProperty() on the dicts of b, hashed if it has an index, finds the
+// same key as the linear walk on a for every key, in any case, and nothing
+// for a key that is not there. The trees are the same, see SameTree().
+//
+STATIC BOOLEAN SameLookups(TagPtr a, TagPtr b, CONST CHAR8 *Path)
+{
+  TagPtr  Key, KeyB;
+  CHAR8   Flipped[256];
+  CHAR8   Where[512];
+
+  for (; a != NULL; a = a->tagNext, b = b->tagNext) {
+    if (a->type == kTagTypeDict) {
+      for (Key = a->tag; Key != NULL; Key = Key->tagNext) {
+        if (Key->type != kTagTypeKey || Key->string == NULL || AsciiStrSize(Key->string) > sizeof(Flipped)) {
+          continue;
+        }
+        FlipCase(Flipped, Key->string, sizeof(Flipped));
+        if (KeyNumber(a, GetProperty(a, Key->string)) != KeyNumber(b, GetProperty(b, Key->string)) ||
+            KeyNumber(a, GetProperty(a, Flipped)) != KeyNumber(b, GetProperty(b, Flipped))) {
+          Fail("  %a: GetProperty(\"%a\") differs\n", Path, Key->string);
+          return FALSE;
+        }
+      }
+      if (GetProperty(b, "plisttest: no such key") != NULL) {
+        Fail("  %a: GetProperty() finds a missing key\n", Path);
+        return FALSE;
+      }
+    }
+    if (a->type == kTagTypeKey && a->string != NULL) {
+      AsciiSPrint(Where, sizeof(Where), "%a/%a", Path, a->string);
+    } else {
+      AsciiStrCpyS(Where, sizeof(Where), Path);
+    }
+    if (!SameLookups(a->tag, b->tag, Where)) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// GetProperty() of every key of every dict, Repeat times
+STATIC UINTN LookupAll(TagPtr Tag, UINTN Repeat)
+{
+  TagPtr  Key;
+  UINTN   Found = 0, Round;
+
+  for (; Tag != NULL; Tag = Tag->tagNext) {
+    if (Tag->type == kTagTypeDict) {
+      for (Round = 0; Round < Repeat; Round++) {
+        for (Key = Tag->tag; Key != NULL; Key = Key->tagNext) {
+          if (Key->type == kTagTypeKey && Key->string != NULL && GetProperty(Tag, Key->string) != NULL) {
+            Found++;
+          }
+        }
+      }
+    }
+    Found += LookupAll(Tag->tag, Repeat);
+  }
+  return Found;
+}
+
+STATIC VOID PrintTime(CONST CHAR8 *Name, HOST_TIME *Time, UINTN Passes)
+{
+  Out("    %-24a %8d %8d\n", Name, Time->Min / 1000, Time->Total / Passes / 1000);
+}
+
+STATIC BOOLEAN CheckFile(CONST CHAR8 *Path, UINTN Passes, UINTN Repeat)
+{
+  CHAR8               *Buffer;
+  unsigned long long  Size;
+  TagPtr              Linear = NULL, Arena = NULL, Binary = NULL;
+  UINT8               *Blob = NULL;
+  UINTN               BlobSize = 0;
+  UINTN               Pass;
+  UINT64              Start;
+  PLIST_COUNT         Count;
+  HOST_TIME           ParseLinear, ParseArena, LoadBinary, LookupLinear, LookupHashed;
+  BOOLEAN             Ok;
+  CHAR8               Title[64];
+
+  Buffer = acpi_posix_load(Path, &Size);
+  if (Buffer == NULL) {
+    Fail("%a: cannot read\n", Path);
+    return FALSE;
+  }
+  if (EFI_ERROR(ParseXML(Buffer, &Linear, (UINT32)Size)) || Linear == NULL) {
+    Fail("%a: not a plist\n", Path);
+    acpi_posix_free(Buffer);
+    return FALSE;
+  }
+
+  ZeroMem(&Count, sizeof(Count));
+  CountTags(Linear, &Count);
+  Out("%a: %d bytes, %d tags, %d dicts, %d keys\n", Path, (UINTN)Size, Count.Tags, Count.Dicts, Count.Keys);
+
+  Ok = !EFI_ERROR(ParseXMLArena(Buffer, &Arena, (UINT32)Size)) && Arena != NULL;
+  if (!Ok) {
+    Fail("  ParseXMLArena() fails\n");
+  }
+  Ok = Ok && SameTree(Linear, Arena, "") && SameLookups(Linear, Arena, "");
+  Out("  %a ParseXMLArena() same as ParseXML()\n", Ok ? "ok  " : "FAIL");
+  if (!Ok) {
+    mFailed++;
+  }
+
+  Ok = Arena != NULL && !EFI_ERROR(PlistSaveBinary(Arena, (UINT32)Size, 0x1234, &Blob, &BlobSize)) &&
+       !EFI_ERROR(PlistLoadBinary(Blob, BlobSize, (UINT32)Size, 0x1234, &Binary)) && Binary != NULL;
+  if (!Ok) {
+    Fail("  PlistSaveBinary()/PlistLoadBinary() fail\n");
+  }
+  Ok = Ok && SameTree(Linear, Binary, "") && SameLookups(Linear, Binary, "");
+  Out("  %a PlistLoadBinary() same as ParseXML(), %d bytes\n", Ok ? "ok  " : "FAIL", BlobSize);
+  if (!Ok) {
+    mFailed++;
+  }
+  FreeTag(Binary);
+  Binary = NULL;
+
+  // a snapshot with any byte damaged is refused
+  for (Pass = 0; Ok && Pass < BlobSize; Pass += BlobSize / 256 + 1) {
+    Blob[Pass] ^= 0x10;
+    if (!EFI_ERROR(PlistLoadBinary(Blob, BlobSize, (UINT32)Size, 0x1234, &Binary))) {
+      Fail("  PlistLoadBinary() takes the snapshot with byte %d damaged\n", Pass);
+      FreeTag(Binary);
+      Binary = NULL;
+      Ok = FALSE;
+    }
+    Blob[Pass] ^= 0x10;
+  }
+  if (Blob != NULL) {
+    Out("  %a PlistLoadBinary() refuses damaged snapshots\n", Ok ? "ok  " : "FAIL");
+    if (!Ok) {
+      mFailed++;
+    }
+  }
+
+  ZeroMem(&ParseLinear, sizeof(HOST_TIME));
+  ZeroMem(&ParseArena, sizeof(HOST_TIME));
+  ZeroMem(&LoadBinary, sizeof(HOST_TIME));
+  ZeroMem(&LookupLinear, sizeof(HOST_TIME));
+  ZeroMem(&LookupHashed, sizeof(HOST_TIME));
+  for (Pass = 0; Pass < Passes && Arena != NULL && Blob != NULL; Pass++) {
+    TagPtr Dict = NULL;
+
+    Start = acpi_posix_time_ns();
+    ParseXML(Buffer, &Dict, (UINT32)Size);
+    FreeTag(Dict);
+    AddTime(&ParseLinear, Start, Pass);
+
+    Start = acpi_posix_time_ns();
+    ParseXMLArena(Buffer, &Dict, (UINT32)Size);
+    FreeTag(Dict);
+    AddTime(&ParseArena, Start, Pass);
+
+    Start = acpi_posix_time_ns();
+    PlistLoadBinary(Blob, BlobSize, (UINT32)Size, 0x1234, &Dict);
+    FreeTag(Dict);
+    AddTime(&LoadBinary, Start, Pass);
+
+    Start = acpi_posix_time_ns();
+    LookupAll(Linear, Repeat);
+    AddTime(&LookupLinear, Start, Pass);
+
+    Start = acpi_posix_time_ns();
+    LookupAll(Arena, Repeat);
+    AddTime(&LookupHashed, Start, Pass);
+  }
+  if (Arena != NULL && Blob != NULL) {
+    AsciiSPrint(Title, sizeof(Title), "time in us, %d pass%a", Passes, Passes == 1 ? "" : "es");
+    Out("  %-26a %8a %8a\n", Title, "min", "avg");
+    PrintTime("ParseXML + FreeTag", &ParseLinear, Passes);
+    PrintTime("ParseXMLArena + FreeTag", &ParseArena, Passes);
+    PrintTime("PlistLoadBinary + FreeTag", &LoadBinary, Passes);
+    Out("  every key %d times:\n", Repeat);
+    PrintTime("GetProperty, linear", &LookupLinear, Passes);
+    PrintTime("GetProperty, hashed", &LookupHashed, Passes);
+  }
+
+  if (Blob != NULL) {
+    FreePool(Blob);
+  }
+  FreeTag(Arena);
+  FreeTag(Linear);
+  acpi_posix_free(Buffer);
+  return TRUE;
+}
+
+STATIC VOID Usage(VOID)
+{
+  Fail("usage: plisttest [-n passes] [-r repeat] <plist>...\n");
+}
+
+int main(int argc, char **argv)
+{
+  UINTN Passes = 10;
+  UINTN Repeat = 10;
+  int   Arg;
+
+  AcpiHostInit();
+  for (Arg = 1; Arg < argc && argv[Arg][0] == '-'; Arg++) {
+    if (AsciiStrCmp(argv[Arg], "-n") == 0 && Arg + 1 < argc) {
+      Passes = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else if (AsciiStrCmp(argv[Arg], "-r") == 0 && Arg + 1 < argc) {
+      Repeat = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (Arg == argc || Passes == 0 || Passes > MAX_PASSES || Repeat == 0) {
+    Usage();
+    return 2;
+  }
+  for (; Arg < argc; Arg++) {
+    if (!CheckFile(argv[Arg], Passes, Repeat)) {
+      mFailed++;
+    }
+  }
+  Out("%d failed\n", mFailed);
+  return mFailed ? 1 : 0;
+}
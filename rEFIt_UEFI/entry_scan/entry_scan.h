@@ -79,6 +79,11 @@ VOID ScanLoader(VOID);
 VOID AddCustomEntries(VOID);
 BOOLEAN IsCustomBootEntry(IN LOADER_ENTRY *Entry);
 
+// scan cache
+VOID ScanCacheOpen(VOID);
+VOID ScanCacheClose(VOID);
+BOOLEAN ScanFileExists(IN REFIT_VOLUME *Volume, IN CHAR16 *RelativePath);
+
 // tool
 VOID ScanTool(VOID);
 VOID AddCustomTool(VOID);
@@ -676,7 +676,7 @@ STATIC LOADER_ENTRY *CreateLoaderEntry(IN CHAR16 *LoaderPath,
   Entry->me.ShortcutLetter = (Hotkey == 0) ? ShortcutLetter : Hotkey;
 
   // get custom volume icon if present
-  if (GlobalConfig.CustomIcons && FileExists(Volume->RootDir, L"\\.VolumeIcon.icns")){
+  if (GlobalConfig.CustomIcons && ScanFileExists(Volume, L"\\.VolumeIcon.icns")){
     Entry->me.Image = LoadIcns(Volume->RootDir, L"\\.VolumeIcon.icns", 128);
     DBG("using VolumeIcon.icns image from Volume\n");
   } else if (Image) {
@@ -964,7 +964,7 @@ STATIC BOOLEAN AddLoaderEntry(IN CHAR16 *LoaderPath, IN CHAR16 *LoaderOptions,
   LOADER_ENTRY *Entry;
   INTN          HVi;
 
-  if ((LoaderPath == NULL) || (Volume == NULL) || (Volume->RootDir == NULL) || !FileExists(Volume->RootDir, LoaderPath)) {
+  if ((LoaderPath == NULL) || (Volume == NULL) || (Volume->RootDir == NULL) || !ScanFileExists(Volume, LoaderPath)) {
     return FALSE;
   }
 
@@ -1027,9 +1027,9 @@ VOID AddPRSEntry(REFIT_VOLUME *Volume)
 //  CONST INTN Rock = 2;
 //  CONST INTN Scissor = 4;
 
-  WhatBoot |= FileExists(Volume->RootDir, RockBoot)?Rock:0;
-  WhatBoot |= FileExists(Volume->RootDir, PaperBoot)?Paper:0;
-  WhatBoot |= FileExists(Volume->RootDir, ScissorBoot)?Scissor:0;
+  WhatBoot |= ScanFileExists(Volume, RockBoot)?Rock:0;
+  WhatBoot |= ScanFileExists(Volume, PaperBoot)?Paper:0;
+  WhatBoot |= ScanFileExists(Volume, ScissorBoot)?Scissor:0;
   switch (WhatBoot) {
     case Paper:
     case (Paper | Rock):
@@ -1091,15 +1091,15 @@ VOID ScanLoader(VOID)
 
     // check for Mac OS X Install Data
     // 1st stage - createinstallmedia
-    if (FileExists(Volume->RootDir, L"\\.IABootFiles\\boot.efi")) {
-      if (FileExists(Volume->RootDir, L"\\Install OS X Mavericks.app") ||
-          FileExists(Volume->RootDir, L"\\Install OS X Yosemite.app") ||
-          FileExists(Volume->RootDir, L"\\Install OS X El Capitan.app")) {
+    if (ScanFileExists(Volume, L"\\.IABootFiles\\boot.efi")) {
+      if (ScanFileExists(Volume, L"\\Install OS X Mavericks.app") ||
+          ScanFileExists(Volume, L"\\Install OS X Yosemite.app") ||
+          ScanFileExists(Volume, L"\\Install OS X El Capitan.app")) {
         AddLoaderEntry(L"\\.IABootFiles\\boot.efi", NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.9 - 10.11
       } else {
         AddLoaderEntry(L"\\.IABootFiles\\boot.efi", NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.12 - 10.13.3
       }
-    } else if (FileExists(Volume->RootDir, L"\\.IAPhysicalMedia") && FileExists(Volume->RootDir, MACOSX_LOADER_PATH)) {
+    } else if (ScanFileExists(Volume, L"\\.IAPhysicalMedia") && ScanFileExists(Volume, MACOSX_LOADER_PATH)) {
       AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.13.4+
     }
     // 2nd stage - InstallESD/AppStore/startosinstall/Fusion Drive
@@ -1114,26 +1114,26 @@ VOID ScanLoader(VOID)
 
     // Use standard location for boot.efi, according to the install files is present
     // That file indentifies a DVD/ESD/BaseSystem/Fusion Drive Install Media, so when present, check standard path to avoid entry duplication
-    if (FileExists(Volume->RootDir, MACOSX_LOADER_PATH)) {
-      if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\Mac OS X Installer.app")) {
+    if (ScanFileExists(Volume, MACOSX_LOADER_PATH)) {
+      if (ScanFileExists(Volume, L"\\System\\Installation\\CDIS\\Mac OS X Installer.app")) {
         // InstallDVD/BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.6/10.7
-      } else if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\OS X Installer.app")) {
+      } else if (ScanFileExists(Volume, L"\\System\\Installation\\CDIS\\OS X Installer.app")) {
         // BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.8 - 10.11
-      } else if (FileExists(Volume->RootDir, L"\\System\\Installation\\CDIS\\macOS Installer.app")) {
+      } else if (ScanFileExists(Volume, L"\\System\\Installation\\CDIS\\macOS Installer.app")) {
         // BaseSystem
         AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.12+
-      } else if (FileExists(Volume->RootDir, L"\\BaseSystem.dmg") && FileExists(Volume->RootDir, L"\\mach_kernel")) {
+      } else if (ScanFileExists(Volume, L"\\BaseSystem.dmg") && ScanFileExists(Volume, L"\\mach_kernel")) {
         // InstallESD
-        if (FileExists(Volume->RootDir, L"\\MacOSX_Media_Background.png")) {
+        if (ScanFileExists(Volume, L"\\MacOSX_Media_Background.png")) {
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.7
         } else {
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.8
         }
-      } else if (FileExists(Volume->RootDir, L"\\com.apple.boot.R\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
-                 FileExists(Volume->RootDir, L"\\com.apple.boot.P\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
-                 FileExists(Volume->RootDir, L"\\com.apple.boot.S\\System\\Library\\PrelinkedKernels\\prelinkedkernel")) {
+      } else if (ScanFileExists(Volume, L"\\com.apple.boot.R\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
+                 ScanFileExists(Volume, L"\\com.apple.boot.P\\System\\Library\\PrelinkedKernels\\prelinkedkernel") ||
+                 ScanFileExists(Volume, L"\\com.apple.boot.S\\System\\Library\\PrelinkedKernels\\prelinkedkernel")) {
         if (StriStr(Volume->VolName, L"Recovery") != NULL) {
           // FileVault of HFS+
           // TODO: need info for 10.11 and lower
@@ -1142,12 +1142,12 @@ VOID ScanLoader(VOID)
           // Fusion Drive
           AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X Install", Volume, NULL, OSTYPE_OSX_INSTALLER, 0); // 10.11
         }
-      } else if (!FileExists(Volume->RootDir, L"\\.IAPhysicalMedia")) {
+      } else if (!ScanFileExists(Volume, L"\\.IAPhysicalMedia")) {
         // Installed
         if (EFI_ERROR(GetRootUUID(Volume)) || isFirstRootUUID(Volume)) {
-          if (!FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\Siri.app")) {
+          if (!ScanFileExists(Volume, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !ScanFileExists(Volume, L"\\System\\Library\\CoreServices\\Siri.app")) {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"Mac OS X", Volume, NULL, OSTYPE_OSX, 0); // 10.6 - 10.7
-          } else if (FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !FileExists(Volume->RootDir, L"\\System\\Library\\CoreServices\\Siri.app")) {
+          } else if (ScanFileExists(Volume, L"\\System\\Library\\CoreServices\\NotificationCenter.app") && !ScanFileExists(Volume, L"\\System\\Library\\CoreServices\\Siri.app")) {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"OS X", Volume, NULL, OSTYPE_OSX, 0); // 10.8 - 10.11
           } else {
             AddLoaderEntry(MACOSX_LOADER_PATH, NULL, L"macOS", Volume, NULL, OSTYPE_OSX, 0); // 10.12+
@@ -1202,10 +1202,10 @@ VOID ScanLoader(VOID)
       // check for Android loaders
       for (Index = 0; Index < AndroidEntryDataCount; ++Index) {
         UINTN aIndex, aFound;
-        if (FileExists(Volume->RootDir, AndroidEntryData[Index].Path)) {
+        if (ScanFileExists(Volume, AndroidEntryData[Index].Path)) {
           aFound = 0;
           for (aIndex = 0; aIndex < ANDX86_FINDLEN; ++aIndex) {
-            if ((AndroidEntryData[Index].Find[aIndex] == NULL) || FileExists(Volume->RootDir, AndroidEntryData[Index].Find[aIndex])) ++aFound;
+            if ((AndroidEntryData[Index].Find[aIndex] == NULL) || ScanFileExists(Volume, AndroidEntryData[Index].Find[aIndex])) ++aFound;
           }
           if (aFound && (aFound == aIndex)) {
             AddLoaderEntry(AndroidEntryData[Index].Path, L"", AndroidEntryData[Index].Title, Volume,
@@ -1593,7 +1593,7 @@ STATIC VOID AddCustomEntry(IN UINTN                CustomIndex,
       continue;
     }
     /*
-    if (StriCmp(CustomPath, MACOSX_LOADER_PATH) == 0 && FileExists(Volume->RootDir, L"\\.IAPhysicalMedia")) {
+    if (StriCmp(CustomPath, MACOSX_LOADER_PATH) == 0 && ScanFileExists(Volume, L"\\.IAPhysicalMedia")) {
       DBG("skipped standard macOS path because volume is 2nd stage Install Media\n");
       continue;
     } */
@@ -1744,7 +1744,7 @@ STATIC VOID AddCustomEntry(IN UINTN                CustomIndex,
           Custom->KernelScan = KERNEL_SCAN_ALL;
           break;
       }
-    } else if (!FileExists(Volume->RootDir, CustomPath)) {
+    } else if (!ScanFileExists(Volume, CustomPath)) {
       DBG("skipped because path does not exist\n");
       continue;
     }
@@ -0,0 +1,581 @@
+/*
+ * refit/scan/scancache.c
+ *
+ * Persistent cache of loader probes made by ScanLoader().
+ *
+ * Every boot ScanLoader() asks each volume for a few dozen well-known
+ * loader paths and almost all of them do not exist. The answers are kept
+ * in EFI\CLOVER\misc\scan.cache on the boot volume, keyed by partition
+ * GUID and device path, and guarded by a cheap volume fingerprint (size,
+ * label and root directory time). On a hit the menu is built from the
+ * cached answers and the probes are repeated a few at a time while the
+ * menu waits for input; a changed answer updates the cache and refreshes
+ * the menu.
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "entry_scan.h"
+
+#ifndef DEBUG_ALL
+#define DEBUG_SCAN_CACHE 1
+#else
+#define DEBUG_SCAN_CACHE DEBUG_ALL
+#endif
+
+#if DEBUG_SCAN_CACHE == 0
+#define DBG(...)
+#else
+#define DBG(...) DebugLog(DEBUG_SCAN_CACHE, __VA_ARGS__)
+#endif
+
+#define SCAN_CACHE_PATH       L"EFI\\CLOVER\\misc\\scan.cache"
+#define SCAN_CACHE_SIGNATURE  SIGNATURE_32('C', 'S', 'C', 'N')
+#define SCAN_CACHE_VERSION    1
+#define SCAN_CACHE_MAX_VOLUMES 64
+#define SCAN_CACHE_MAX_PROBES  512
+// probes repeated per idle tick of the menu (10ms)
+#define SCAN_CACHE_IDLE_PROBES 2
+
+//
+// On-disk layout: header, then for every volume a SCAN_CACHE_KEY,
+// a UINT32 probe count and the probes. A probe is UINT16 Exists,
+// UINT16 Length and Length CHAR16 of path without terminator.
+//
+#pragma pack(1)
+typedef struct {
+  UINT32    Signature;
+  UINT32    Version;
+  UINT32    Size;       // whole file
+  UINT32    Crc;        // of everything after the header
+  UINT32    VolumeCount;
+} SCAN_CACHE_HEADER;
+
+typedef struct {
+  EFI_GUID  PartGuid;   // zero for non-GPT volumes
+  UINT32    PathCrc;    // of the device path text
+  UINT32    LabelCrc;
+  UINT64    VolumeSize;
+  EFI_TIME  RootTime;
+} SCAN_CACHE_KEY;
+#pragma pack()
+
+typedef struct {
+  CHAR16    *Path;
+  BOOLEAN   Exists;
+  BOOLEAN   Used;       // asked for during this boot
+  BOOLEAN   FromCache;  // answered without touching the volume
+} SCAN_PROBE;
+
+typedef struct {
+  SCAN_CACHE_KEY  Key;
+  REFIT_VOLUME    *Volume;   // bound for the current scan only
+  SCAN_PROBE      *Probes;
+  UINTN           ProbeCount;
+  UINTN           ProbeMax;
+  UINTN           Checked;   // revalidation cursor
+} SCAN_CACHE_VOLUME;
+
+STATIC SCAN_CACHE_VOLUME  *mScanCache = NULL;
+STATIC UINTN              mScanCacheCount = 0;
+STATIC BOOLEAN            mScanCacheLoaded = FALSE;
+STATIC BOOLEAN            mScanCacheDirty = FALSE;
+STATIC BOOLEAN            mScanCacheStale = FALSE;
+STATIC BOOLEAN            mScanCacheRevalidate = FALSE;
+STATIC UINTN              mScanCacheHits = 0;
+STATIC UINTN              mScanCacheMisses = 0;
+
+STATIC UINT32
+ScanCacheCrc (
+  IN VOID   *Data,
+  IN UINTN  Size
+  )
+{
+  UINT32 Crc = 0;
+
+  if ((Data == NULL) || (Size == 0) || EFI_ERROR (gBS->CalculateCrc32 (Data, Size, &Crc))) {
+    return 0;
+  }
+  return Crc;
+}
+
+STATIC BOOLEAN
+ScanCacheMakeKey (
+  IN  REFIT_VOLUME    *Volume,
+  OUT SCAN_CACHE_KEY  *Key
+  )
+{
+  EFI_GUID              *PartGuid;
+  EFI_FILE_SYSTEM_INFO  *FsInfo;
+  EFI_FILE_INFO         *RootInfo;
+
+  ZeroMem (Key, sizeof (*Key));
+  if ((Volume == NULL) || (Volume->RootDir == NULL) || (Volume->DevicePathString == NULL)) {
+    return FALSE;
+  }
+
+  FsInfo = EfiLibFileSystemInfo (Volume->RootDir);
+  if (FsInfo == NULL) {
+    return FALSE;
+  }
+  Key->VolumeSize = FsInfo->VolumeSize;
+  Key->LabelCrc = ScanCacheCrc (FsInfo->VolumeLabel, StrSize (FsInfo->VolumeLabel));
+  FreePool (FsInfo);
+
+  RootInfo = EfiLibFileInfo (Volume->RootDir);
+  if (RootInfo != NULL) {
+    CopyMem (&Key->RootTime, &RootInfo->ModificationTime, sizeof (EFI_TIME));
+    FreePool (RootInfo);
+  }
+
+  PartGuid = FindGPTPartitionGuidInDevicePath (Volume->DevicePath);
+  if (PartGuid != NULL) {
+    CopyGuid (&Key->PartGuid, PartGuid);
+  }
+  Key->PathCrc = ScanCacheCrc (Volume->DevicePathString, StrSize (Volume->DevicePathString));
+  return TRUE;
+}
+
+STATIC SCAN_CACHE_VOLUME *
+ScanCacheAddVolume (
+  IN SCAN_CACHE_KEY  *Key
+  )
+{
+  SCAN_CACHE_VOLUME *Entry;
+
+  if (mScanCacheCount >= SCAN_CACHE_MAX_VOLUMES) {
+    return NULL;
+  }
+  if (mScanCache == NULL) {
+    mScanCache = AllocateZeroPool (SCAN_CACHE_MAX_VOLUMES * sizeof (SCAN_CACHE_VOLUME));
+    if (mScanCache == NULL) {
+      return NULL;
+    }
+  }
+  Entry = &mScanCache[mScanCacheCount++];
+  ZeroMem (Entry, sizeof (*Entry));
+  CopyMem (&Entry->Key, Key, sizeof (*Key));
+  return Entry;
+}
+
+STATIC VOID
+ScanCacheFreeProbes (
+  IN SCAN_CACHE_VOLUME *Entry
+  )
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Entry->ProbeCount; Index++) {
+    FreePool (Entry->Probes[Index].Path);
+  }
+  if (Entry->Probes != NULL) {
+    FreePool (Entry->Probes);
+  }
+  Entry->Probes = NULL;
+  Entry->ProbeCount = 0;
+  Entry->ProbeMax = 0;
+  Entry->Checked = 0;
+}
+
+STATIC SCAN_PROBE *
+ScanCacheAddProbe (
+  IN SCAN_CACHE_VOLUME  *Entry,
+  IN CHAR16             *Path,
+  IN UINTN              Length,
+  IN BOOLEAN            Exists
+  )
+{
+  SCAN_PROBE *Probe;
+  UINTN      NewMax;
+
+  if (Entry->ProbeCount >= SCAN_CACHE_MAX_PROBES) {
+    return NULL;
+  }
+  if (Entry->ProbeCount == Entry->ProbeMax) {
+    NewMax = (Entry->ProbeMax == 0) ? 32 : Entry->ProbeMax * 2;
+    Probe = ReallocatePool (Entry->ProbeMax * sizeof (SCAN_PROBE), NewMax * sizeof (SCAN_PROBE), Entry->Probes);
+    if (Probe == NULL) {
+      return NULL;
+    }
+    Entry->Probes = Probe;
+    Entry->ProbeMax = NewMax;
+  }
+
+  Probe = &Entry->Probes[Entry->ProbeCount];
+  Probe->Path = AllocateZeroPool ((Length + 1) * sizeof (CHAR16));
+  if (Probe->Path == NULL) {
+    return NULL;
+  }
+  CopyMem (Probe->Path, Path, Length * sizeof (CHAR16));
+  Probe->Exists = Exists;
+  Probe->Used = FALSE;
+  Probe->FromCache = FALSE;
+  Entry->ProbeCount++;
+  return Probe;
+}
+
+//
+// Parse scan.cache from the boot volume, drop it silently if it is damaged
+//
+STATIC VOID
+ScanCacheLoad (VOID)
+{
+  UINT8              *Buffer = NULL;
+  UINTN              Size = 0;
+  UINTN              Offset;
+  UINT32             VolumeIndex, ProbeIndex, ProbeCount;
+  UINT16             Exists, Length;
+  SCAN_CACHE_HEADER  Header;
+  SCAN_CACHE_KEY     Key;
+  SCAN_CACHE_VOLUME  *Entry;
+
+  if (EFI_ERROR (egLoadFile (SelfRootDir, SCAN_CACHE_PATH, &Buffer, &Size))) {
+    DBG ("ScanCache: no %s\n", SCAN_CACHE_PATH);
+    return;
+  }
+  if (Size < sizeof (Header)) {
+    goto Damaged;
+  }
+  CopyMem (&Header, Buffer, sizeof (Header));
+  if ((Header.Signature != SCAN_CACHE_SIGNATURE) || (Header.Version != SCAN_CACHE_VERSION) ||
+      (Header.Size != Size) || (Header.VolumeCount > SCAN_CACHE_MAX_VOLUMES) ||
+      (Header.Crc != ScanCacheCrc (Buffer + sizeof (Header), Size - sizeof (Header)))) {
+    goto Damaged;
+  }
+
+  Offset = sizeof (Header);
+  for (VolumeIndex = 0; VolumeIndex < Header.VolumeCount; VolumeIndex++) {
+    if (Offset + sizeof (Key) + sizeof (UINT32) > Size) {
+      goto Damaged;
+    }
+    CopyMem (&Key, Buffer + Offset, sizeof (Key));
+    Offset += sizeof (Key);
+    CopyMem (&ProbeCount, Buffer + Offset, sizeof (UINT32));
+    Offset += sizeof (UINT32);
+    Entry = ScanCacheAddVolume (&Key);
+    if ((Entry == NULL) || (ProbeCount > SCAN_CACHE_MAX_PROBES)) {
+      goto Damaged;
+    }
+    for (ProbeIndex = 0; ProbeIndex < ProbeCount; ProbeIndex++) {
+      if (Offset + 2 * sizeof (UINT16) > Size) {
+        goto Damaged;
+      }
+      CopyMem (&Exists, Buffer + Offset, sizeof (UINT16));
+      CopyMem (&Length, Buffer + Offset + sizeof (UINT16), sizeof (UINT16));
+      Offset += 2 * sizeof (UINT16);
+      if ((Length == 0) || (Offset + Length * sizeof (CHAR16) > Size)) {
+        goto Damaged;
+      }
+      if (ScanCacheAddProbe (Entry, (CHAR16 *)(Buffer + Offset), Length, (BOOLEAN)(Exists != 0)) == NULL) {
+        goto Damaged;
+      }
+      Offset += Length * sizeof (CHAR16);
+    }
+  }
+  FreePool (Buffer);
+  DBG ("ScanCache: loaded %d volumes\n", mScanCacheCount);
+  return;
+
+Damaged:
+  DBG ("ScanCache: %s is damaged, ignored\n", SCAN_CACHE_PATH);
+  FreePool (Buffer);
+  while (mScanCacheCount > 0) {
+    ScanCacheFreeProbes (&mScanCache[--mScanCacheCount]);
+  }
+}
+
+//
+// Write the records of volumes seen during this boot with the probes
+// that were asked for; everything else is left out so the file does
+// not grow with paths nobody looks for anymore.
+//
+STATIC VOID
+ScanCacheSave (VOID)
+{
+  UINT8              *Buffer, *Ptr;
+  UINTN              Size;
+  UINTN              Index, ProbeIndex;
+  UINT32             VolumeCount = 0, ProbeCount;
+  UINT16             Exists, Length;
+  SCAN_CACHE_HEADER  Header;
+  SCAN_CACHE_VOLUME  *Entry;
+  EFI_STATUS         Status;
+
+  mScanCacheDirty = FALSE;
+  if (SelfRootDir == NULL) {
+    return;
+  }
+
+  Size = sizeof (Header);
+  for (Index = 0; Index < mScanCacheCount; Index++) {
+    Entry = &mScanCache[Index];
+    if (Entry->Volume == NULL) {
+      continue;
+    }
+    Size += sizeof (SCAN_CACHE_KEY) + sizeof (UINT32);
+    for (ProbeIndex = 0; ProbeIndex < Entry->ProbeCount; ProbeIndex++) {
+      if (Entry->Probes[ProbeIndex].Used) {
+        Size += 2 * sizeof (UINT16) + StrLen (Entry->Probes[ProbeIndex].Path) * sizeof (CHAR16);
+      }
+    }
+  }
+
+  Buffer = AllocatePool (Size);
+  if (Buffer == NULL) {
+    return;
+  }
+  Ptr = Buffer + sizeof (Header);
+  for (Index = 0; Index < mScanCacheCount; Index++) {
+    Entry = &mScanCache[Index];
+    if (Entry->Volume == NULL) {
+      continue;
+    }
+    CopyMem (Ptr, &Entry->Key, sizeof (SCAN_CACHE_KEY));
+    Ptr += sizeof (SCAN_CACHE_KEY);
+    ProbeCount = 0;
+    for (ProbeIndex = 0; ProbeIndex < Entry->ProbeCount; ProbeIndex++) {
+      if (Entry->Probes[ProbeIndex].Used) {
+        ProbeCount++;
+      }
+    }
+    CopyMem (Ptr, &ProbeCount, sizeof (UINT32));
+    Ptr += sizeof (UINT32);
+    for (ProbeIndex = 0; ProbeIndex < Entry->ProbeCount; ProbeIndex++) {
+      if (!Entry->Probes[ProbeIndex].Used) {
+        continue;
+      }
+      Exists = Entry->Probes[ProbeIndex].Exists ? 1 : 0;
+      Length = (UINT16)StrLen (Entry->Probes[ProbeIndex].Path);
+      CopyMem (Ptr, &Exists, sizeof (UINT16));
+      CopyMem (Ptr + sizeof (UINT16), &Length, sizeof (UINT16));
+      Ptr += 2 * sizeof (UINT16);
+      CopyMem (Ptr, Entry->Probes[ProbeIndex].Path, Length * sizeof (CHAR16));
+      Ptr += Length * sizeof (CHAR16);
+    }
+    VolumeCount++;
+  }
+
+  Header.Signature = SCAN_CACHE_SIGNATURE;
+  Header.Version = SCAN_CACHE_VERSION;
+  Header.Size = (UINT32)Size;
+  Header.Crc = ScanCacheCrc (Buffer + sizeof (Header), Size - sizeof (Header));
+  Header.VolumeCount = VolumeCount;
+  CopyMem (Buffer, &Header, sizeof (Header));
+
+  Status = egSaveFile (SelfRootDir, SCAN_CACHE_PATH, Buffer, Size);
+  DBG ("ScanCache: saved %d volumes: %r\n", VolumeCount, Status);
+  FreePool (Buffer);
+}
+
+STATIC SCAN_CACHE_VOLUME *
+ScanCacheFindVolume (
+  IN REFIT_VOLUME *Volume
+  )
+{
+  UINTN             Index;
+  SCAN_CACHE_KEY    Key;
+  SCAN_CACHE_VOLUME *Entry;
+
+  for (Index = 0; Index < mScanCacheCount; Index++) {
+    if (mScanCache[Index].Volume == Volume) {
+      return &mScanCache[Index];
+    }
+  }
+
+  if (!ScanCacheMakeKey (Volume, &Key)) {
+    return NULL;
+  }
+  for (Index = 0; Index < mScanCacheCount; Index++) {
+    Entry = &mScanCache[Index];
+    if ((Entry->Volume == NULL) &&
+        CompareGuid (&Entry->Key.PartGuid, &Key.PartGuid) &&
+        (Entry->Key.PathCrc == Key.PathCrc)) {
+      if (CompareMem (&Entry->Key, &Key, sizeof (Key)) != 0) {
+        DBG ("ScanCache: '%s' changed, rescan\n", Volume->VolName);
+        ScanCacheFreeProbes (Entry);
+        CopyMem (&Entry->Key, &Key, sizeof (Key));
+        mScanCacheDirty = TRUE;
+      }
+      Entry->Volume = Volume;
+      return Entry;
+    }
+  }
+
+  Entry = ScanCacheAddVolume (&Key);
+  if (Entry != NULL) {
+    Entry->Volume = Volume;
+    mScanCacheDirty = TRUE;
+  }
+  return Entry;
+}
+
+//
+// Called before the entries are built: loads the cache once per boot and
+// forgets which REFIT_VOLUME every record belongs to, since ScanVolumes()
+// made new ones
+//
+VOID
+ScanCacheOpen (VOID)
+{
+  UINTN Index;
+
+  if (!gSettings.ScanCache) {
+    return;
+  }
+  if (!mScanCacheLoaded) {
+    mScanCacheLoaded = TRUE;
+    ScanCacheLoad ();
+  }
+  for (Index = 0; Index < mScanCacheCount; Index++) {
+    mScanCache[Index].Volume = NULL;
+    mScanCache[Index].Checked = 0;
+  }
+  mScanCacheStale = FALSE;
+  mScanCacheRevalidate = FALSE;
+  mScanCacheHits = 0;
+  mScanCacheMisses = 0;
+}
+
+//
+// Called after the entries are built: stores new answers and starts the
+// revalidation of the cached ones
+//
+VOID
+ScanCacheClose (VOID)
+{
+  if (!gSettings.ScanCache) {
+    return;
+  }
+  DBG ("ScanCache: %d probes from cache, %d from disk\n", mScanCacheHits, mScanCacheMisses);
+  if (mScanCacheDirty) {
+    ScanCacheSave ();
+  }
+  mScanCacheRevalidate = (mScanCacheHits != 0);
+}
+
+//
+// FileExists() for a path on a scanned volume, answered from the cache
+// when the volume is unchanged since the cache was written
+//
+BOOLEAN
+ScanFileExists (
+  IN REFIT_VOLUME *Volume,
+  IN CHAR16       *RelativePath
+  )
+{
+  SCAN_CACHE_VOLUME *Entry;
+  SCAN_PROBE        *Probe;
+  UINTN             Index;
+  BOOLEAN           Exists;
+
+  if ((Volume == NULL) || (Volume->RootDir == NULL) || (RelativePath == NULL)) {
+    return FALSE;
+  }
+  if (!gSettings.ScanCache) {
+    return FileExists (Volume->RootDir, RelativePath);
+  }
+
+  Entry = ScanCacheFindVolume (Volume);
+  if (Entry != NULL) {
+    for (Index = 0; Index < Entry->ProbeCount; Index++) {
+      Probe = &Entry->Probes[Index];
+      if (StriCmp (Probe->Path, RelativePath) == 0) {
+        if (!Probe->Used) {
+          Probe->Used = TRUE;
+          Probe->FromCache = TRUE;
+          mScanCacheHits++;
+        }
+        return Probe->Exists;
+      }
+    }
+  }
+
+  Exists = FileExists (Volume->RootDir, RelativePath);
+  mScanCacheMisses++;
+  if (Entry != NULL) {
+    Probe = ScanCacheAddProbe (Entry, RelativePath, StrLen (RelativePath), Exists);
+    if (Probe != NULL) {
+      Probe->Used = TRUE;
+      mScanCacheDirty = TRUE;
+    }
+  }
+  return Exists;
+}
+
+//
+// Called from the menu input loop. Repeats a couple of cached probes
+// against the real volume; when some answer turned out to be wrong the
+// cache is rewritten and the menu is rebuilt like on volume arrival.
+//
+VOID
+ScanCacheIdle (VOID)
+{
+  UINTN             Index;
+  UINTN             Budget = SCAN_CACHE_IDLE_PROBES;
+  SCAN_CACHE_VOLUME *Entry;
+  SCAN_PROBE        *Probe;
+  BOOLEAN           Exists;
+
+  if (!mScanCacheRevalidate) {
+    return;
+  }
+
+  for (Index = 0; (Index < mScanCacheCount) && (Budget > 0); Index++) {
+    Entry = &mScanCache[Index];
+    if ((Entry->Volume == NULL) || (Entry->Volume->RootDir == NULL)) {
+      continue;
+    }
+    while ((Entry->Checked < Entry->ProbeCount) && (Budget > 0)) {
+      Probe = &Entry->Probes[Entry->Checked++];
+      if (!Probe->FromCache) {
+        continue;
+      }
+      Probe->FromCache = FALSE;
+      Budget--;
+      Exists = FileExists (Entry->Volume->RootDir, Probe->Path);
+      if (Exists != Probe->Exists) {
+        DBG ("ScanCache: %s on '%s' is %a now\n", Probe->Path, Entry->Volume->VolName, Exists ? "present" : "gone");
+        Probe->Exists = Exists;
+        mScanCacheDirty = TRUE;
+        mScanCacheStale = TRUE;
+      }
+    }
+  }
+  if (Budget == 0) {
+    return;
+  }
+
+  // everything is checked
+  mScanCacheRevalidate = FALSE;
+  if (mScanCacheDirty) {
+    ScanCacheSave ();
+  }
+  if (mScanCacheStale) {
+    mScanCacheStale = FALSE;
+    gEvent = 1;
+  }
+}
@@ -39,6 +39,8 @@ extern void DumpFloat2 (char* s, float* t, int N);
 extern EG_IMAGE *BackgroundImage;
 extern EG_IMAGE *Banner;
 extern EG_IMAGE *BigBack;
+extern EG_CACHE_KEY BigBackKey;
+extern BOOLEAN BigBackKeyed;
 extern VOID *fontsDB;
 extern INTN BanHeight;
 extern INTN row0TileSize;
@@ -52,100 +54,231 @@ textFaces       textFace[4]; //0-help 1-message 2-menu 3-test
 NSVGparser      *mainParser = NULL;  //it must be global variable
 
 
-EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, EG_IMAGE  **Image)
+//
+// Index of the theme shapes by the ids of their groups and the groups above,
+// built once after nsvgParse() so that ParseSVGIcon() visits only the shapes
+// of its icon. The shapes of an id are kept in theme order.
+//
+typedef struct {
+  CONST CHAR8 *Id;        // NULL for a free slot
+  NSVGshape   *Last;      // shape counted last, a shape is listed once per id
+  UINTN       First;      // into mGroupShapes
+  UINTN       Count;
+} SVG_GROUP_SLOT;
+
+STATIC SVG_GROUP_SLOT *mGroupSlots = NULL;
+STATIC UINTN          mGroupSlotMask = 0;
+STATIC NSVGshape      **mGroupShapes = NULL;
+STATIC NSVGparser     *mIndexedParser = NULL;
+
+STATIC UINT32 SvgIdHash(CONST CHAR8 *Id)
+{
+  UINT32 Hash = 2166136261U;
+
+  while (*Id) {
+    Hash = (Hash ^ (UINT8)*Id++) * 16777619U;
+  }
+  return Hash;
+}
+
+STATIC SVG_GROUP_SLOT *SvgGroupSlot(CONST CHAR8 *Id, BOOLEAN Insert)
+{
+  UINTN Index = SvgIdHash(Id) & mGroupSlotMask;
+
+  while (mGroupSlots[Index].Id != NULL) {
+    if (strcmp(mGroupSlots[Index].Id, Id) == 0) {
+      return &mGroupSlots[Index];
+    }
+    Index = (Index + 1) & mGroupSlotMask;
+  }
+  if (!Insert) {
+    return NULL;
+  }
+  mGroupSlots[Index].Id = Id;
+  return &mGroupSlots[Index];
+}
+
+STATIC VOID SvgFreeGroupIndex(VOID)
+{
+  if (mGroupSlots != NULL) {
+    FreePool(mGroupSlots);
+    mGroupSlots = NULL;
+  }
+  if (mGroupShapes != NULL) {
+    FreePool(mGroupShapes);
+    mGroupShapes = NULL;
+  }
+  mGroupSlotMask = 0;
+  mIndexedParser = NULL;
+}
+
+STATIC VOID SvgBuildGroupIndex(NSVGparser *p)
+{
+  NSVGshape       *shape, *prev = NULL;
+  NSVGgroup       *group;
+  SVG_GROUP_SLOT  *Slot;
+  UINTN           Pairs = 0, Size, i, First;
+
+  SvgFreeGroupIndex();
+  // every (shape, group above it) pair; no more ids than that
+  for (shape = p->image->shapes; shape; shape = shape->next) {
+    shape->prev = prev;
+    shape->detached = FALSE;
+    prev = shape;
+    for (group = shape->group; group; group = group->next) {
+      Pairs++;
+    }
+  }
+  if (Pairs == 0) {
+    return;
+  }
+  for (Size = 16; Size < Pairs * 2; Size <<= 1);
+  mGroupSlots = (SVG_GROUP_SLOT*)AllocateZeroPool(Size * sizeof(SVG_GROUP_SLOT));
+  mGroupShapes = (NSVGshape**)AllocatePool(Pairs * sizeof(NSVGshape*));
+  if (!mGroupSlots || !mGroupShapes) {
+    SvgFreeGroupIndex();
+    return;
+  }
+  mGroupSlotMask = Size - 1;
+
+  for (shape = p->image->shapes; shape; shape = shape->next) {
+    for (group = shape->group; group; group = group->next) {
+      Slot = SvgGroupSlot(group->id, TRUE);
+      if (Slot->Last != shape) {
+        Slot->Last = shape;
+        Slot->Count++;
+      }
+    }
+  }
+  for (i = 0, First = 0; i < Size; i++) {
+    mGroupSlots[i].First = First;
+    First += mGroupSlots[i].Count;
+    mGroupSlots[i].Count = 0;
+    mGroupSlots[i].Last = NULL;
+  }
+  for (shape = p->image->shapes; shape; shape = shape->next) {
+    for (group = shape->group; group; group = group->next) {
+      Slot = SvgGroupSlot(group->id, FALSE);
+      if (Slot->Last != shape) {
+        Slot->Last = shape;
+        mGroupShapes[Slot->First + Slot->Count++] = shape;
+      }
+    }
+  }
+  mIndexedParser = p;
+}
+
+STATIC VOID SvgUnlinkShape(NSVGimage *SVGimage, NSVGshape *shape)
+{
+  if (shape->prev) {
+    shape->prev->next = shape->next;
+  } else {
+    SVGimage->shapes = shape->next;
+  }
+  if (shape->next) {
+    shape->next->prev = shape->prev;
+  }
+  shape->detached = TRUE;
+}
+
+// what the raster of an icon depends on besides its shapes
+typedef struct {
+  float     Scale;
+  float     tx;
+  float     ty;
+  INT32     Width;
+  INT32     Height;
+  EG_PIXEL  Fill;
+  BOOLEAN   BootCampStyle;
+} SVG_RASTER_STAMP;
+
+//
+// ParseSVGIcon() that also gives the theme.cache key of the raster, *Keyed
+// is FALSE when the icon was not looked up there (not mainParser, no shapes)
+//
+EFI_STATUS ParseSVGIconKeyed(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, EG_IMAGE  **Image,
+                             EG_CACHE_KEY *CacheKey, BOOLEAN *Keyed)
 {
   EFI_STATUS      Status = EFI_NOT_FOUND;
+  SVG_RASTER_STAMP Raster;
+  EG_CACHE_KEY    Key;
+  EG_IMAGE        *Cached;
   NSVGimage       *SVGimage;
   NSVGrasterizer* rast = nsvgCreateRasterizer();
   SVGimage = p->image;
   NSVGshape   *shape;
   NSVGgroup   *group;
   NSVGimage *IconImage; // = (NSVGimage*)AllocateZeroPool(sizeof(NSVGimage));
-  NSVGshape *shapeNext, *shapesTail=NULL, *shapePrev;
+  NSVGshape *shapesTail=NULL;
+  SVG_GROUP_SLOT  *Slot;
+  UINTN           i;
 //  INTN ClipCount = 0;
 
+  *Keyed = FALSE;
   NSVGparser* p2 = nsvg__createParser();
   IconImage = p2->image;
 
-  shape = SVGimage->shapes;
-  shapePrev = NULL;
-  while (shape) {
-    group = shape->group;
-    shapeNext = shape->next;
-    while (group) {
-      if (strcmp(group->id, IconName) == 0) {
-        break;
-      }
-      group = group->next;
+  // only the shapes of this icon, in theme order
+  if (p != mIndexedParser) {
+    SvgBuildGroupIndex(p);
+  }
+  Slot = (p == mIndexedParser) ? SvgGroupSlot(IconName, FALSE) : NULL;
+  for (i = 0; Slot && i < Slot->Count; i++) {
+    shape = mGroupShapes[Slot->First + i];
+    if (shape->detached) {
+      continue; //taken by an icon with the same name before
     }
-
-    if (group) { //the shape is in the group
-      // keep this sample for debug purpose
-/*    DBG("found shape %a", shape->id);
-      DBG(" from group %a\n", group->id);
-      if ((Id == BUILTIN_SELECTION_BIG) ||
-          (Id == BUILTIN_ICON_BACKGROUND) ||
-          (Id == BUILTIN_ICON_BANNER)) {
-        shape->debug = TRUE;
-      } */
-      if (GlobalConfig.BootCampStyle && (strstr(IconName, "selection_big") != NULL)) {
-        shape->opacity = 0.f;
+    SvgUnlinkShape(SVGimage, shape);
+    // keep this sample for debug purpose
+/*  DBG("found shape %a", shape->id);
+    DBG(" from group %a\n", IconName);
+    if ((Id == BUILTIN_SELECTION_BIG) ||
+        (Id == BUILTIN_ICON_BACKGROUND) ||
+        (Id == BUILTIN_ICON_BANNER)) {
+      shape->debug = TRUE;
+    } */
+    if (GlobalConfig.BootCampStyle && (strstr(IconName, "selection_big") != NULL)) {
+      shape->opacity = 0.f;
+    }
+    if (strstr(shape->id, "BoundingRect") != NULL) {
+      //there is bounds after nsvgParse()
+      IconImage->width = shape->bounds[2] - shape->bounds[0];
+      IconImage->height = shape->bounds[3] - shape->bounds[1];
+      if (!IconImage->height) {
+        IconImage->height = 200;
+      }
+//      if (Id == BUILTIN_ICON_BACKGROUND || Id == BUILTIN_ICON_BANNER) {
+//        DBG("IconImage size [%d,%d]\n", (int)IconImage->width, (int)IconImage->height);
+//        DBG("IconImage left corner x=%s y=%s\n", PoolPrintFloat(IconImage->realBounds[0]), PoolPrintFloat(IconImage->realBounds[1]));
+//        DumpFloat2("IconImage real bounds", IconImage->realBounds, 4);
+//      }
+      if ((strstr(IconName, "selection_big") != NULL) && (!GlobalConfig.SelectionOnTop)) {
+        GlobalConfig.MainEntriesSize = (int)(IconImage->width * Scale); //xxx
+        row0TileSize = GlobalConfig.MainEntriesSize + (int)(16.f * Scale);
+        DBG("main entry size = %d\n", GlobalConfig.MainEntriesSize);
+      }
+      if ((strstr(IconName, "selection_small") != NULL) && (!GlobalConfig.SelectionOnTop)) {
+        row1TileSize = (int)(IconImage->width * Scale);
       }
-      if (strstr(shape->id, "BoundingRect") != NULL) {
-        //there is bounds after nsvgParse()
-        IconImage->width = shape->bounds[2] - shape->bounds[0];
-        IconImage->height = shape->bounds[3] - shape->bounds[1];
-        if (!IconImage->height) {
-          IconImage->height = 200;
-        }
- //       if (Id == BUILTIN_ICON_BACKGROUND || Id == BUILTIN_ICON_BANNER) {
- //         DBG("IconImage size [%d,%d]\n", (int)IconImage->width, (int)IconImage->height);
- //         DBG("IconImage left corner x=%s y=%s\n", PoolPrintFloat(IconImage->realBounds[0]), PoolPrintFloat(IconImage->realBounds[1]));
- //         DumpFloat2("IconImage real bounds", IconImage->realBounds, 4);
- //       }
-        if ((strstr(IconName, "selection_big") != NULL) && (!GlobalConfig.SelectionOnTop)) {
-          GlobalConfig.MainEntriesSize = (int)(IconImage->width * Scale); //xxx
-          row0TileSize = GlobalConfig.MainEntriesSize + (int)(16.f * Scale);
-          DBG("main entry size = %d\n", GlobalConfig.MainEntriesSize);
-        }
-         if ((strstr(IconName, "selection_small") != NULL) && (!GlobalConfig.SelectionOnTop)) {
-          row1TileSize = (int)(IconImage->width * Scale);
-        }
 
 // not exclude BoundingRect from IconImage?
-        shape->flags = 0;  //invisible
-        if (shapePrev) {
-          shapePrev->next = shapeNext;
-        } else {
-          SVGimage->shapes = shapeNext;
-        }
-        shape = shapeNext;
-        continue; //while(shape) it is BoundingRect shape
+      shape->flags = 0;  //invisible
+      continue; //it is BoundingRect shape
 
-//        shape->opacity = 0.3f;
-      }
-      shape->flags = NSVG_VIS_VISIBLE;
-      // Add to tail
-//      ClipCount += shape->clip.count;
-      if (IconImage->shapes == NULL)
-        IconImage->shapes = shape;
-      else
-        shapesTail->next = shape;
-      shapesTail = shape;
-      if (shapePrev) {
-        shapePrev->next = shapeNext;
-      } else {
-        SVGimage->shapes = shapeNext;
-      }
-      shapePrev->next = shapeNext;
-    } //the shape in the group
-    else {
-      shapePrev = shape;
+//      shape->opacity = 0.3f;
     }
-    shape = shapeNext;
-  } //while shape
-  shapesTail->next = NULL;
-
+    shape->flags = NSVG_VIS_VISIBLE;
+    // Add to tail
+//    ClipCount += shape->clip.count;
+    if (IconImage->shapes == NULL)
+      IconImage->shapes = shape;
+    else
+      shapesTail->next = shape;
+    shapesTail = shape;
+  }
+  if (shapesTail) {
+    shapesTail->next = NULL;
+  }
   //add clipPaths  //xxx
   NSVGclipPath* clipPaths = SVGimage->clipPaths;
   NSVGclipPath* clipNext = NULL;
@@ -209,7 +342,35 @@ EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, E
     ty = (Height - realHeight) * 0.5f;
   }
 
-  nsvgRasterize(rast, IconImage, tx,ty,Scale,Scale, (UINT8*)NewImage->PixelData, iWidth, iHeight, iWidth*4);
+  // the shapes are taken out of the theme above either way, only the raster may come from theme.cache
+  ZeroMem(&Raster, sizeof(Raster));
+  Raster.Scale = Scale;
+  Raster.tx = tx;
+  Raster.ty = ty;
+  Raster.Width = iWidth;
+  Raster.Height = iHeight;
+  Raster.Fill = MenuBackgroundPixel;
+  Raster.BootCampStyle = GlobalConfig.BootCampStyle;
+  Key.Name = egThemeCacheCrc(IconName, AsciiStrLen(IconName));
+  Key.Stamp = egThemeCacheCrc(&Raster, sizeof(Raster));
+  Key.Flags = EG_CACHE_SVG | EG_CACHE_ALPHA;
+  if (p == mainParser) {
+    CopyMem(CacheKey, &Key, sizeof(EG_CACHE_KEY));
+    *Keyed = TRUE;
+  }
+  Cached = (p == mainParser) ? egThemeCacheFind(&Key) : NULL;
+  if (Cached != NULL && Cached->Width == iWidth && Cached->Height == iHeight) {
+    egFreeImage(NewImage);
+    NewImage = Cached;
+  } else {
+    if (Cached != NULL) {
+      egFreeImage(Cached);
+    }
+    nsvgRasterize(rast, IconImage, tx,ty,Scale,Scale, (UINT8*)NewImage->PixelData, iWidth, iHeight, iWidth*4);
+    if (p == mainParser) {
+      egThemeCacheAdd(&Key, NewImage);
+    }
+  }
 //  DBG("%a rastered, blt\n", IconImage);
 #if 0
   BltImageAlpha(NewImage,
@@ -226,6 +387,14 @@ EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, E
   return EFI_SUCCESS;
 }
 
+EFI_STATUS ParseSVGIcon(NSVGparser  *p, INTN Id, CHAR8 *IconName, float Scale, EG_IMAGE  **Image)
+{
+  EG_CACHE_KEY  Key;
+  BOOLEAN       Keyed;
+
+  return ParseSVGIconKeyed(p, Id, IconName, Scale, Image, &Key, &Keyed);
+}
+
 EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
 {
   EFI_STATUS Status;
@@ -239,6 +408,7 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
     DBG("Theme not parsed!\n");
     return EFI_NOT_STARTED;
   }
+  SvgBuildGroupIndex(mainParser);
 
 // --- Get scale as theme design height vs screen height
   float Scale;
@@ -278,17 +448,21 @@ EFI_STATUS ParseSVGTheme(CONST CHAR8* buffer, TagPtr * dict, UINT32 bufSize)
 
 // --- Make background
   BackgroundImage = egCreateFilledImage(UGAWidth, UGAHeight, TRUE, &BlackPixel);
+  egFreeTextRuns();
   if (BigBack) {
     egFreeImage(BigBack);
     BigBack = NULL;
   }
   Status = EFI_NOT_FOUND;
   if (!DayLight) {
-    Status = ParseSVGIcon(mainParser, BUILTIN_ICON_BACKGROUND, "Background_night", Scale, &BigBack);
+    Status = ParseSVGIconKeyed(mainParser, BUILTIN_ICON_BACKGROUND, "Background_night", Scale, &BigBack,
+                               &BigBackKey, &BigBackKeyed);
   }
   if (EFI_ERROR(Status)) {
-    Status = ParseSVGIcon(mainParser, BUILTIN_ICON_BACKGROUND, "Background", Scale, &BigBack);
+    Status = ParseSVGIconKeyed(mainParser, BUILTIN_ICON_BACKGROUND, "Background", Scale, &BigBack,
+                               &BigBackKey, &BigBackKeyed);
   }
+  BigBackKeyed = BigBackKeyed && !EFI_ERROR(Status) && (BigBack != NULL);
   DBG("background parsed\n");
 
 // --- Make Banner
@@ -453,6 +627,7 @@ VOID RenderSVGfont(NSVGfont  *fontSVG, UINT32 color)
     egFreeImage (FontImage);
     FontImage = NULL;
   }
+  egFreeTextRuns();
   INTN Height = FontHeight + 4;
 //  DBG("load font %a\n", fontSVG->fontFamily);
   if (fontSVG->unitsPerEm < 1.f) {
@@ -35,6 +35,7 @@
  */
 
 #include "libegint.h"
+#include "FloatLib.h"
 #if defined(LODEPNG)
 #include "lodepng.h"
 #endif //LODEPNG
@@ -109,6 +110,241 @@ EG_IMAGE * egCopyImage(IN EG_IMAGE *Image)
 }
 
 //Scaling functions
+
+//
+// Separable resampler: a horizontal pass into a temporary image, then a
+// vertical one, each with a table of fixed point weights per output pixel.
+// Colours are filtered premultiplied so transparent pixels do not bleed.
+//
+#define RESAMPLE_SHIFT  14
+#define RESAMPLE_ONE    (1 << RESAMPLE_SHIFT)
+
+typedef struct {
+  INTN    Taps;     // weights per output pixel
+  INTN    *First;   // first source pixel of each output pixel
+  INT32   *Weights; // Taps weights of each output pixel, sum RESAMPLE_ONE
+} EG_RESAMPLE_AXIS;
+
+static float egResampleKernel(IN SCALER_TYPE Mode, IN float t)
+{
+  float pt;
+
+  if (t < 0.0f) {
+    t = -t;
+  }
+  switch (Mode) {
+    case SCALER_BOX:
+      return (t <= 0.5f) ? 1.0f : 0.0f;
+    case SCALER_LANCZOS:
+      if (t < 1e-5f) {
+        return 1.0f;
+      }
+      if (t >= 3.0f) {
+        return 0.0f;
+      }
+      pt = PI * t;
+      return 3.0f * SinF(pt) * SinF(pt / 3.0f) / (pt * pt);
+    default:
+      return (t < 1.0f) ? 1.0f - t : 0.0f;
+  }
+}
+
+static VOID egFreeResampleAxis(IN EG_RESAMPLE_AXIS *Axis)
+{
+  if (Axis->First) {
+    FreePool(Axis->First);
+  }
+  if (Axis->Weights) {
+    FreePool(Axis->Weights);
+  }
+}
+
+// Out pixels from In source pixels, Scale = Out/In. Pixels past the edges repeat the edge.
+static BOOLEAN egInitResampleAxis(OUT EG_RESAMPLE_AXIS *Axis, IN INTN In, IN INTN Out, IN float Scale, IN SCALER_TYPE Mode)
+{
+  float   Support, Stretch, Center, Sum, *W;
+  INTN    o, n, Lo, Hi, Idx, Big, Total;
+  INT32   *Fixed;
+
+  Support = (Mode == SCALER_LANCZOS) ? 3.0f : ((Mode == SCALER_BOX) ? 0.5f : 1.0f);
+  // when shrinking the kernel widens over the source pixels that fall into one output pixel
+  Stretch = (Scale < 1.0f) ? 1.0f / Scale : 1.0f;
+  Support *= Stretch;
+  Axis->Taps = (INTN)(Support * 2.0f) + 2;
+  if (Axis->Taps > In) {
+    Axis->Taps = In;
+  }
+  Axis->First = (INTN*)AllocatePool(Out * sizeof(INTN));
+  Axis->Weights = (INT32*)AllocateZeroPool(Out * Axis->Taps * sizeof(INT32));
+  W = (float*)AllocatePool(Axis->Taps * sizeof(float));
+  if (!Axis->First || !Axis->Weights || !W) {
+    egFreeResampleAxis(Axis);
+    if (W) {
+      FreePool(W);
+    }
+    return FALSE;
+  }
+
+  for (o = 0; o < Out; o++) {
+    Center = ((float)o + 0.5f) / Scale - 0.5f;
+    Lo = (INTN)CeilF(Center - Support);
+    Hi = (INTN)FloorF(Center + Support);
+    if (Hi - Lo + 1 > Axis->Taps) {
+      Hi = Lo + Axis->Taps - 1;
+    }
+    Axis->First[o] = (Lo < In - Axis->Taps) ? Lo : In - Axis->Taps;
+    if (Axis->First[o] < 0) {
+      Axis->First[o] = 0;
+    }
+    SetMem(W, Axis->Taps * sizeof(float), 0);
+    Sum = 0.0f;
+    for (n = Lo; n <= Hi; n++) {
+      float k = egResampleKernel(Mode, ((float)n - Center) / Stretch);
+      Idx = (n < 0) ? 0 : ((n >= In) ? In - 1 : n);
+      W[Idx - Axis->First[o]] += k;
+      Sum += k;
+    }
+    if (Sum == 0.0f) {
+      // box between two source pixels, take the nearer one
+      Idx = (INTN)(Center + 0.5f);
+      Idx = (Idx < 0) ? 0 : ((Idx >= In) ? In - 1 : Idx);
+      W[Idx - Axis->First[o]] = 1.0f;
+      Sum = 1.0f;
+    }
+    // weights must add up exactly so that flat areas stay flat
+    Fixed = &Axis->Weights[o * Axis->Taps];
+    Total = 0;
+    Big = 0;
+    for (n = 0; n < Axis->Taps; n++) {
+      float v = W[n] * RESAMPLE_ONE / Sum;
+      Fixed[n] = (INT32)((v < 0.0f) ? v - 0.5f : v + 0.5f);
+      Total += Fixed[n];
+      if (Fixed[n] > Fixed[Big]) {
+        Big = n;
+      }
+    }
+    Fixed[Big] += (INT32)(RESAMPLE_ONE - Total);
+  }
+  FreePool(W);
+  return TRUE;
+}
+
+static inline UINT8 egResampleClamp(IN INT32 v)
+{
+  v = (v + (RESAMPLE_ONE >> 1)) >> RESAMPLE_SHIFT;
+  return (UINT8)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+//
+// Scales OldImage by Scale in both directions from the top left corner,
+// filling all of NewImage. Returns FALSE without touching NewImage if out of memory.
+//
+static BOOLEAN egResampleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage, IN float Scale, IN SCALER_TYPE Mode)
+{
+  EG_RESAMPLE_AXIS  AxisX, AxisY;
+  INTN        W1 = OldImage->Width, W2 = NewImage->Width, H2 = NewImage->Height;
+  INTN        x, y, k, Row0, Row1;
+  INT32       *Acc, *Wt, w;
+  EG_PIXEL    *Tmp, *Src, *Dest, *Line;
+  BOOLEAN     Done = FALSE;
+
+  ZeroMem(&AxisX, sizeof(AxisX));
+  ZeroMem(&AxisY, sizeof(AxisY));
+  if (!egInitResampleAxis(&AxisX, W1, W2, Scale, Mode)) {
+    return FALSE;
+  }
+  if (!egInitResampleAxis(&AxisY, OldImage->Height, H2, Scale, Mode)) {
+    egFreeResampleAxis(&AxisX);
+    return FALSE;
+  }
+  // only the source rows the vertical pass reads
+  Row0 = AxisY.First[0];
+  Row1 = AxisY.First[H2 - 1] + AxisY.Taps;
+  Tmp = (EG_PIXEL*)AllocatePool((Row1 - Row0) * W2 * sizeof(EG_PIXEL));
+  Acc = (INT32*)AllocatePool(W2 * 4 * sizeof(INT32));
+  Line = (EG_PIXEL*)AllocatePool(W1 * sizeof(EG_PIXEL));
+  if (Tmp && Acc && Line) {
+    // horizontal pass on premultiplied source rows
+    for (y = Row0; y < Row1; y++) {
+      Src = &OldImage->PixelData[y * W1];
+      for (x = 0; x < W1; x++) {
+        Line[x] = Src[x];
+        if (Src[x].a != 255) {
+          Line[x].b = (UINT8)((Src[x].b * Src[x].a + 127) / 255);
+          Line[x].g = (UINT8)((Src[x].g * Src[x].a + 127) / 255);
+          Line[x].r = (UINT8)((Src[x].r * Src[x].a + 127) / 255);
+        }
+      }
+      Dest = &Tmp[(y - Row0) * W2];
+      for (x = 0; x < W2; x++) {
+        INT32 b = 0, g = 0, r = 0, a = 0;
+        Src = &Line[AxisX.First[x]];
+        Wt = &AxisX.Weights[x * AxisX.Taps];
+        for (k = 0; k < AxisX.Taps; k++) {
+          w = Wt[k];
+          b += w * Src[k].b;
+          g += w * Src[k].g;
+          r += w * Src[k].r;
+          a += w * Src[k].a;
+        }
+        Dest->b = egResampleClamp(b);
+        Dest->g = egResampleClamp(g);
+        Dest->r = egResampleClamp(r);
+        Dest->a = egResampleClamp(a);
+        Dest++;
+      }
+    }
+    // vertical pass, row by row so the inner loop runs along the row
+    Dest = NewImage->PixelData;
+    for (y = 0; y < H2; y++) {
+      SetMem(Acc, W2 * 4 * sizeof(INT32), 0);
+      Wt = &AxisY.Weights[y * AxisY.Taps];
+      for (k = 0; k < AxisY.Taps; k++) {
+        w = Wt[k];
+        if (w == 0) {
+          continue;
+        }
+        Src = &Tmp[(AxisY.First[y] + k - Row0) * W2];
+        for (x = 0; x < W2; x++) {
+          Acc[x * 4]     += w * Src[x].b;
+          Acc[x * 4 + 1] += w * Src[x].g;
+          Acc[x * 4 + 2] += w * Src[x].r;
+          Acc[x * 4 + 3] += w * Src[x].a;
+        }
+      }
+      for (x = 0; x < W2; x++) {
+        UINT8 a = egResampleClamp(Acc[x * 4 + 3]);
+        UINT8 b = egResampleClamp(Acc[x * 4]);
+        UINT8 g = egResampleClamp(Acc[x * 4 + 1]);
+        UINT8 r = egResampleClamp(Acc[x * 4 + 2]);
+        if (a != 0 && a != 255) {
+          b = (UINT8)((b >= a) ? 255 : (b * 255 + (a >> 1)) / a);
+          g = (UINT8)((g >= a) ? 255 : (g * 255 + (a >> 1)) / a);
+          r = (UINT8)((r >= a) ? 255 : (r * 255 + (a >> 1)) / a);
+        }
+        Dest->b = b;
+        Dest->g = g;
+        Dest->r = r;
+        Dest->a = a;
+        Dest++;
+      }
+    }
+    Done = TRUE;
+  }
+  if (Tmp) {
+    FreePool(Tmp);
+  }
+  if (Acc) {
+    FreePool(Acc);
+  }
+  if (Line) {
+    FreePool(Line);
+  }
+  egFreeResampleAxis(&AxisX);
+  egFreeResampleAxis(&AxisY);
+  return Done;
+}
+
 EG_IMAGE * egCopyScaledImage(IN EG_IMAGE *OldImage, IN INTN Ratio) //will be N/16
 {
   //(c)Slice 2012
@@ -141,25 +377,27 @@ EG_IMAGE * egCopyScaledImage(IN EG_IMAGE *OldImage, IN INTN Ratio) //will be N/1
     NewImage = egCreateImage(NewW, NewH, OldImage->HasAlpha);
     if (NewImage == NULL)
       return NULL;
-
-    Dest = NewImage->PixelData;
-    for (y = 0; y < NewH; y++) {
-      y1 = (y << 4) / Ratio;
-      y0 = ((y1 > 0)?(y1-1):y1) * OldW;
-      y2 = ((y1 < (OldImage->Height - 1))?(y1+1):y1) * OldW;
-      y1 *= OldW;
-      for (x = 0; x < NewW; x++) {
-        x1 = (x << 4) / Ratio;
-        x0 = (x1 > 0)?(x1-1):x1;
-        x2 = (x1 < (OldW - 1))?(x1+1):x1;
-        Dest->b = (UINT8)(((INTN)Src[x1+y1].b * 2 + Src[x0+y1].b +
-                           Src[x2+y1].b + Src[x1+y0].b + Src[x1+y2].b) / 6);
-        Dest->g = (UINT8)(((INTN)Src[x1+y1].g * 2 + Src[x0+y1].g +
-                           Src[x2+y1].g + Src[x1+y0].g + Src[x1+y2].g) / 6);
-        Dest->r = (UINT8)(((INTN)Src[x1+y1].r * 2 + Src[x0+y1].r +
-                           Src[x2+y1].r + Src[x1+y0].r + Src[x1+y2].r) / 6);
-        Dest->a = Src[x1+y1].a;
-        Dest++;
+    if (GlobalConfig.ImageScaler == SCALER_SHARP || NewW == 0 || NewH == 0 ||
+        !egResampleImage(NewImage, OldImage, (float)Ratio / 16.0f, GlobalConfig.ImageScaler)) {
+      Dest = NewImage->PixelData;
+      for (y = 0; y < NewH; y++) {
+        y1 = (y << 4) / Ratio;
+        y0 = ((y1 > 0)?(y1-1):y1) * OldW;
+        y2 = ((y1 < (OldImage->Height - 1))?(y1+1):y1) * OldW;
+        y1 *= OldW;
+        for (x = 0; x < NewW; x++) {
+          x1 = (x << 4) / Ratio;
+          x0 = (x1 > 0)?(x1-1):x1;
+          x2 = (x1 < (OldW - 1))?(x1+1):x1;
+          Dest->b = (UINT8)(((INTN)Src[x1+y1].b * 2 + Src[x0+y1].b +
+                             Src[x2+y1].b + Src[x1+y0].b + Src[x1+y2].b) / 6);
+          Dest->g = (UINT8)(((INTN)Src[x1+y1].g * 2 + Src[x0+y1].g +
+                             Src[x2+y1].g + Src[x1+y0].g + Src[x1+y2].g) / 6);
+          Dest->r = (UINT8)(((INTN)Src[x1+y1].r * 2 + Src[x0+y1].r +
+                             Src[x2+y1].r + Src[x1+y0].r + Src[x1+y2].r) / 6);
+          Dest->a = Src[x1+y1].a;
+          Dest++;
+        }
       }
     }
   }
@@ -268,6 +506,17 @@ VOID  ScaleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage)
     f = (W2 << 12) / W1;
   }
   if (f == 0) return;
+  if (GlobalConfig.ImageScaler != SCALER_SHARP &&
+      egResampleImage(NewImage, OldImage, (float)f / 4096.0f, GlobalConfig.ImageScaler)) {
+    // the background is opaque, as the sharp scaler makes it
+    for (i = 0; i < W2 * H2; i++, Dest++) {
+      if (Dest->a == 0) {
+        Dest->r = Dest->g = Dest->b = 0x55;
+      }
+      Dest->a = 0xFF;
+    }
+    return;
+  }
   cell = ((f - 1) >> 12) + 1;
 
   for (j = 0; j < H2; j++) {
@@ -509,14 +758,89 @@ EFI_STATUS egMkDir(IN EFI_FILE_HANDLE BaseDir OPTIONAL, IN CHAR16 *DirName)
   return Status;
 }
 
-//caller is responsible for free image
-EG_IMAGE * egLoadImage(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha)
+//
+// theme.cache keys of files in ThemeDir: the file name, its size and time,
+// and how it is decoded
+//
+typedef struct {
+  UINT64    FileSize;
+  EFI_TIME  Time;
+} EG_FILE_STAMP;
+
+// reading raw pixels loses to inflating well compressed files
+#define THEME_CACHE_MAX_RATIO 16
+
+static BOOLEAN egThemeFileKey(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINT32 Flags, OUT EG_CACHE_KEY *Key)
+{
+  EFI_STATUS      Status;
+  EFI_FILE_HANDLE FileHandle = NULL;
+  EFI_FILE_INFO   *FileInfo;
+  EG_FILE_STAMP   Stamp;
+
+  if (BaseDir == NULL || BaseDir != ThemeDir || FileName == NULL || !egThemeCacheIsActive()) {
+    return FALSE;
+  }
+  Status = BaseDir->Open(BaseDir, &FileHandle, FileName, EFI_FILE_MODE_READ, 0);
+  if (EFI_ERROR(Status) || !FileHandle) {
+    return FALSE;
+  }
+  FileInfo = EfiLibFileInfo(FileHandle);
+  FileHandle->Close(FileHandle);
+  if (FileInfo == NULL) {
+    return FALSE;
+  }
+  ZeroMem(&Stamp, sizeof(Stamp));
+  Stamp.FileSize = FileInfo->FileSize;
+  CopyMem(&Stamp.Time, &FileInfo->ModificationTime, sizeof(EFI_TIME));
+  FreePool(FileInfo);
+
+  Key->Name = egThemeCacheCrc(FileName, StrSize(FileName));
+  Key->Stamp = egThemeCacheCrc(&Stamp, sizeof(Stamp));
+  Key->Flags = Flags;
+  return TRUE;
+}
+
+// decode flags of the key: egLoadIcon() images (IconSize set) always have alpha
+static UINT32 egThemeFileFlags(IN BOOLEAN WantAlpha, IN UINTN IconSize)
+{
+  if (IconSize != 0) {
+    return EG_CACHE_ALPHA | (UINT32)(IconSize << 8);
+  }
+  return WantAlpha ? EG_CACHE_ALPHA : 0;
+}
+
+//
+// The image of FileName from theme.cache, or NULL. *Keyed tells whether Key
+// is valid, so that a decoded image can be added with egThemeFileAdd().
+//
+static EG_IMAGE *egThemeFileFind(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINT32 Flags,
+                                 OUT EG_CACHE_KEY *Key, OUT BOOLEAN *Keyed)
+{
+  *Keyed = egThemeFileKey(BaseDir, FileName, Flags, Key);
+  return *Keyed ? egThemeCacheFind(Key) : NULL;
+}
+
+static VOID egThemeFileAdd(IN EG_CACHE_KEY *Key, IN EG_IMAGE *Image, IN UINTN FileDataLength)
+{
+  if (Image != NULL && Image->Width * Image->Height * sizeof(EG_PIXEL) <= FileDataLength * THEME_CACHE_MAX_RATIO) {
+    egThemeCacheAdd(Key, Image);
+  }
+}
+
+//
+// egLoadImage() that also gives the theme.cache key of this load, so that
+// an image made from it can be keyed after it. *Keyed is FALSE when the
+// file is not keyed (not in ThemeDir, cache off) or was not loaded.
+//
+EG_IMAGE * egLoadImageKeyed(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha,
+                            OUT EG_CACHE_KEY *CacheKey, OUT BOOLEAN *Keyed)
 {
   EFI_STATUS      Status;
   UINT8           *FileData = NULL;
   UINTN           FileDataLength = 0;
   EG_IMAGE        *NewImage;
 
+  *Keyed = FALSE;
   if (GlobalConfig.TypeSVG) {
     return NULL;
   }
@@ -524,21 +848,40 @@ EG_IMAGE * egLoadImage(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLE
   if (BaseDir == NULL || FileName == NULL)
     return NULL;
 
+  NewImage = egThemeFileFind(BaseDir, FileName, egThemeFileFlags(WantAlpha, 0), CacheKey, Keyed);
+  if (NewImage) {
+    return NewImage;
+  }
+
   // load file
   Status = egLoadFile(BaseDir, FileName, &FileData, &FileDataLength);
-  if (EFI_ERROR(Status))
+  if (EFI_ERROR(Status)) {
+    *Keyed = FALSE;
     return NULL;
+  }
 
   // decode it
   NewImage = egDecodePNG(FileData, FileDataLength, WantAlpha);
 
   if (!NewImage) {
     DBG("%s not decoded\n", FileName);
+    *Keyed = FALSE;
+  } else if (*Keyed) {
+    egThemeFileAdd(CacheKey, NewImage, FileDataLength);
   }
   FreePool(FileData);
   return NewImage;
 }
 
+//caller is responsible for free image
+EG_IMAGE * egLoadImage(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha)
+{
+  EG_CACHE_KEY    Key;
+  BOOLEAN         Keyed;
+
+  return egLoadImageKeyed(BaseDir, FileName, WantAlpha, &Key, &Keyed);
+}
+
 //caller is responsible for free image
 EG_IMAGE * egLoadIcon(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN IconSize)
 {
@@ -547,6 +890,8 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN
   UINTN           FileDataLength;
   EG_IMAGE        *NewImage;
   CHAR8           *IconName;
+  EG_CACHE_KEY    Key;
+  BOOLEAN         Keyed;
 
   if (!BaseDir || !FileName) {
     return NULL;
@@ -579,6 +924,11 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN
     FreePool(IconName);
     return NULL;
   }
+  NewImage = egThemeFileFind(BaseDir, FileName, egThemeFileFlags(TRUE, IconSize), &Key, &Keyed);
+  if (NewImage) {
+    return NewImage;
+  }
+
   // load file
   Status = egLoadFile(BaseDir, FileName, &FileData, &FileDataLength);
   if (EFI_ERROR(Status)) {
@@ -590,6 +940,9 @@ EG_IMAGE * egLoadIcon(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN
   if (!NewImage) {
     NewImage = egDecodeICNS(FileData, FileDataLength, IconSize, TRUE);
   }
+  if (NewImage && Keyed) {
+    egThemeFileAdd(&Key, NewImage, FileDataLength);
+  }
   
   FreePool(FileData);
   return NewImage;
@@ -693,53 +1046,81 @@ VOID egRawCopy(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
   }
 }
 
+//
+// Two 8-bit channels are blended at once in the 16-bit halves of a UINT32
+// (SWAR): B and R with the low byte mask, G and A after a shift by 8.
+// A lane holds up to 255*255, EG_DIV255_2 divides both lanes by 255
+// exactly (floor) for such values: x/255 == (x + 1 + (x >> 8)) >> 8.
+//
+#define EG_LANES_MASK           0x00FF00FF
+#define EG_DIV255_2(x)          ((((x) + 0x00010001 + (((x) >> 8) & EG_LANES_MASK)) >> 8) & EG_LANES_MASK)
+#define EG_ALPHA_MASK           0xFF000000
+
+// Comp = (Comp * (255 - TopAlpha) + Top * TopAlpha) / 255, alpha is opaque
+static inline UINT32 egBlendOpaque(IN UINT32 Top, IN UINT32 Comp, IN UINT32 TopAlpha)
+{
+  UINT32 RevAlpha = 255 - TopAlpha;
+  UINT32 RB = (Comp & EG_LANES_MASK) * RevAlpha + (Top & EG_LANES_MASK) * TopAlpha;
+  UINT32 GA = ((Comp >> 8) & EG_LANES_MASK) * RevAlpha + ((Top >> 8) & EG_LANES_MASK) * TopAlpha;
+
+  return EG_DIV255_2(RB) | (EG_DIV255_2(GA) << 8) | EG_ALPHA_MASK;
+}
+
 VOID egRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
                   IN INTN Width, IN INTN Height,
                   IN INTN CompLineOffset, IN INTN TopLineOffset)
 {
   INT64       x, y;
-  EG_PIXEL    *TopPtr, *CompPtr;
-    //To make native division we need INTN types
-  INTN      TopAlpha;
-  INTN      Alpha;
-  INTN      CompAlpha;
-  INTN      RevAlpha;
-  INTN      TempAlpha;
-//  EG_PIXEL    *CompUp;
+  UINT32      *TopPtr, *CompPtr;
+  UINT32      Top, Comp;
+  UINT32      TopAlpha;
+  UINT32      CompAlpha;
+  UINT32      TempAlpha;
+  UINT32      Alpha;
+  UINT64      Recip;
   if (!CompBasePtr || !TopBasePtr) {
     return;
   }
-//  CompUp = CompBasePtr + Width * Height;
   //Slice - my opinion
 //if TopAlpha=255 then draw Top - non transparent
 //else if TopAlpha=0 then draw Comp - full transparent
 //else draw mixture |-----comp---|--top--|
 //final alpha =(1-(1-x)*(1-y)) =(255*255-(255-topA)*(255-compA))/255
+//
+// Over an opaque Comp the sums below are multiples of 255 and the mixture
+// reduces to egBlendOpaque, over a transparent one it is just Top.
+// Otherwise each channel is (top * TopAlpha * 255 + comp * TempAlpha) / Alpha;
+// the three divisions are replaced with one reciprocal, exact because the
+// numerator is below 255 * Alpha and 255 * Alpha^2 < 2^48.
 
   for (y = 0; y < Height; y++) {
-    TopPtr = TopBasePtr;
-    CompPtr = CompBasePtr;
+    TopPtr = (UINT32 *)TopBasePtr;
+    CompPtr = (UINT32 *)CompBasePtr;
     for (x = 0; x < Width; x++) {
-      TopAlpha = TopPtr->a & 0xFF; //exclude sign
+      Top = TopPtr[x];
+      TopAlpha = Top >> 24;
 
       if (TopAlpha == 255) {
-        CompPtr->b = TopPtr->b;
-        CompPtr->g = TopPtr->g;
-        CompPtr->r = TopPtr->r;
-        CompPtr->a = (UINT8)TopAlpha;
+        CompPtr[x] = Top;
       } else if (TopAlpha != 0) {
-        CompAlpha = CompPtr->a & 0xFF;
-        RevAlpha = 255 - TopAlpha;
-        TempAlpha = CompAlpha * RevAlpha;
-        TopAlpha *= 255;
-        Alpha = TopAlpha + TempAlpha;
-
-        CompPtr->b = (UINT8)((TopPtr->b * TopAlpha + CompPtr->b * TempAlpha) / Alpha);
-        CompPtr->g = (UINT8)((TopPtr->g * TopAlpha + CompPtr->g * TempAlpha) / Alpha);
-        CompPtr->r = (UINT8)((TopPtr->r * TopAlpha + CompPtr->r * TempAlpha) / Alpha);
-        CompPtr->a = (UINT8)(Alpha / 255);
+        Comp = CompPtr[x];
+        CompAlpha = Comp >> 24;
+        if (CompAlpha == 255) {
+          CompPtr[x] = egBlendOpaque(Top, Comp, TopAlpha);
+        } else if (CompAlpha == 0) {
+          CompPtr[x] = Top;
+        } else {
+          TempAlpha = CompAlpha * (255 - TopAlpha);
+          TopAlpha *= 255;
+          Alpha = TopAlpha + TempAlpha;
+          Recip = (((UINT64)1 << 48) + Alpha - 1) / Alpha;
+
+          CompPtr[x] = (UINT32)((((Top & 0xFF) * TopAlpha + (Comp & 0xFF) * TempAlpha) * Recip) >> 48) |
+                       ((UINT32)(((((Top >> 8) & 0xFF) * TopAlpha + ((Comp >> 8) & 0xFF) * TempAlpha) * Recip) >> 48) << 8) |
+                       ((UINT32)(((((Top >> 16) & 0xFF) * TopAlpha + ((Comp >> 16) & 0xFF) * TempAlpha) * Recip) >> 48) << 16) |
+                       ((Alpha / 255) << 24);
+        }
       }
-      TopPtr++, CompPtr++;
     }
     TopBasePtr += TopLineOffset;
     CompBasePtr += CompLineOffset;
@@ -752,34 +1133,27 @@ VOID egRawComposeOnFlat(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
                   IN INTN CompLineOffset, IN INTN TopLineOffset)
 {
   INT64       x, y;
-  EG_PIXEL    *TopPtr, *CompPtr;
+  UINT32      *TopPtr, *CompPtr;
+  UINT32      Top;
   UINT32      TopAlpha;
-  UINT32      RevAlpha;
-  UINTN       Temp;
 
   if (!CompBasePtr || !TopBasePtr) {
     return;
   }
 
   for (y = 0; y < Height; y++) {
-    TopPtr = TopBasePtr;
-    CompPtr = CompBasePtr;
+    TopPtr = (UINT32 *)TopBasePtr;
+    CompPtr = (UINT32 *)CompBasePtr;
     for (x = 0; x < Width; x++) {
-      TopAlpha = TopPtr->a;
-      RevAlpha = 255 - TopAlpha;
-
-      Temp = ((UINT8)CompPtr->b * RevAlpha) + ((UINT8)TopPtr->b * TopAlpha);
-      CompPtr->b = (UINT8)(Temp / 255);
-
-      Temp = ((UINT8)CompPtr->g * RevAlpha) + ((UINT8)TopPtr->g * TopAlpha);
-      CompPtr->g = (UINT8)(Temp / 255);
-
-      Temp = ((UINT8)CompPtr->r * RevAlpha) + ((UINT8)TopPtr->r * TopAlpha);
-      CompPtr->r = (UINT8)(Temp / 255);
-
-      CompPtr->a = (UINT8)(255);
-
-      TopPtr++, CompPtr++;
+      Top = TopPtr[x];
+      TopAlpha = Top >> 24;
+      if (TopAlpha == 255) {
+        CompPtr[x] = Top;
+      } else if (TopAlpha == 0) {
+        CompPtr[x] |= EG_ALPHA_MASK;
+      } else {
+        CompPtr[x] = egBlendOpaque(Top, CompPtr[x], TopAlpha);
+      }
     }
     TopBasePtr += TopLineOffset;
     CompBasePtr += CompLineOffset;
@@ -885,54 +1259,212 @@ VOID egCopyPlane(IN UINT8 *SrcPlanePtr, IN UINT8 *DestPlanePtr, IN UINTN PixelCo
 }
 
 #if defined(LODEPNG)
+// largest PNG side decoded; the image is allocated from the header before
+// lodepng has checked the file, so a bogus header must not get that far
+#define EG_PNG_MAX_SIZE 4096
+
+// size from the PNG header, FALSE if this is not a PNG
+static BOOLEAN egPeekPNGSize(IN UINT8 *FileData, IN UINTN FileDataLength, OUT UINTN *Width, OUT UINTN *Height)
+{
+  STATIC CONST UINT8 Signature[] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+  if (FileDataLength < 33 || CompareMem(FileData, Signature, sizeof(Signature)) != 0 ||
+      CompareMem(FileData + 12, "IHDR", 4) != 0) {
+    return FALSE;
+  }
+  *Width  = ((UINTN)FileData[16] << 24) | (FileData[17] << 16) | (FileData[18] << 8) | FileData[19];
+  *Height = ((UINTN)FileData[20] << 24) | (FileData[21] << 16) | (FileData[22] << 8) | FileData[23];
+  return *Width > 0 && *Height > 0;
+}
+
+// lodepng decodes straight into the EG_PIXEL (BGRA) buffer of the new image
 EG_IMAGE * egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN BOOLEAN WantAlpha) {
   EG_IMAGE *NewImage = NULL;
-  UINTN Error, i, ImageSize, Width, Height;
-  EG_PIXEL *PixelData;
-  EG_PIXEL *Pixel, *PixelD;
-
-  Error = eglodepng_decode((UINT8**) &PixelData, &Width, &Height, (CONST UINT8*) FileData, (UINTN) FileDataLength);
+  UINTN Error, Width, Height;
 
-  if (Error) {
-    /*
-     * Error 28 incorrect PNG signature ok, because also called on ICNS files
-     */
-    if (Error != 28U) {
-      DBG("egDecodePNG(%p, %lu, %c): eglodepng_decode failed with error %lu\n",
-          FileData, FileDataLength, WantAlpha?'Y':'N', Error);
-    }
+  if (!egPeekPNGSize(FileData, FileDataLength, &Width, &Height)) {
+    // not a PNG is ok, because also called on ICNS files
     return NULL;
   }
-  if (!PixelData || Width > 4096U || Height > 4096U) {
-    DBG("egDecodePNG(%p, %lu, %c): eglodepng_decode returned suspect values, PixelData %p, Width %lu, Height %lu\n",
-        FileData, FileDataLength, WantAlpha?'Y':'N', PixelData, Width, Height);
+  if (Width > EG_PNG_MAX_SIZE || Height > EG_PNG_MAX_SIZE) {
+    DBG("egDecodePNG(%p, %lu, %c): suspect size, Width %lu, Height %lu\n",
+        FileData, FileDataLength, WantAlpha?'Y':'N', Width, Height);
+    return NULL;
   }
 
   NewImage = egCreateImage(Width, Height, WantAlpha);
   if (NewImage == NULL) return NULL;
 
-  ImageSize = (Width * Height);
-//  CopyMem(NewImage->PixelData, PixelData, sizeof(EG_PIXEL) * ImageSize);
-//  lodepng_free(PixelData);
-
-  Pixel = (EG_PIXEL*)NewImage->PixelData;
-  PixelD = PixelData;
-  for (i = 0; i < ImageSize; i++) {
-/*      UINT8 Temp;
-      Temp = Pixel->b;
-      Pixel->b = Pixel->r;
-      Pixel->r = Temp; */
-    Pixel->b = PixelD->r; //change r <-> b
-    Pixel->r = PixelD->b;
-    Pixel->g = PixelD->g;
-    Pixel->a = PixelD->a; // 255 is opaque, 0 - transparent
-    Pixel++;
-    PixelD++;
-  }
-
-  lodepng_free(PixelData);
+  Error = eglodepng_decode_bgra((UINT8*) NewImage->PixelData, Width, Height, (CONST UINT8*) FileData, (UINTN) FileDataLength);
+  if (Error) {
+    DBG("egDecodePNG(%p, %lu, %c): eglodepng_decode_bgra failed with error %lu\n",
+        FileData, FileDataLength, WantAlpha?'Y':'N', Error);
+    egFreeImage(NewImage);
+    return NULL;
+  }
   return NewImage;
 }
+
+//
+// Parallel decoding of a batch of PNG files, see egLoadImages()
+//
+
+typedef struct {
+  UINT8         *FileData;
+  UINTN         FileDataLength;
+  EG_IMAGE      *Image;     // allocated by the BSP from the header size
+  BOOLEAN       Decoded;
+  BOOLEAN       Keyed;      // Key is valid, the result goes to theme.cache
+  EG_CACHE_KEY  Key;
+} EG_DECODE_JOB;
+
+// limit for the scratch arena of one batch, the rest is decoded serially
+#define DECODE_SCRATCH_MAX (64 * 1024 * 1024)
+
+// what lodepng may allocate for the image: the compressed data and the inflated
+// scanlines growing in steps, plus the deinterlaced image for Adam7. The pixels
+// go straight into Job->Image.
+static UINTN egDecodeScratchSize(IN EG_DECODE_JOB *Job)
+{
+  STATIC CONST UINT8 Channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+  UINTN Width = Job->Image->Width;
+  UINTN Height = Job->Image->Height;
+  UINTN Bits = Job->FileData[24] * ((Job->FileData[25] < 7) ? Channels[Job->FileData[25]] : 4);
+  UINTN Inflated = Height * (1 + (Width * Bits + 7) / 8);
+
+  return Job->FileDataLength * 2 + Inflated * (Job->FileData[28] ? 5 : 4) + 0x10000;
+}
+
+// runs on any processor
+static VOID EFIAPI egDecodeJob(IN OUT VOID *Context)
+{
+  EG_DECODE_JOB *Job = (EG_DECODE_JOB *)Context;
+
+  if (Job->Image == NULL) {
+    return;
+  }
+  if (eglodepng_decode_bgra((UINT8*) Job->Image->PixelData, Job->Image->Width, Job->Image->Height,
+                            (CONST UINT8*) Job->FileData, Job->FileDataLength) != 0) {
+    return;
+  }
+  Job->Decoded = TRUE;
+}
+
+static EG_IMAGE *egLoadSerial(IN EG_IMAGE_LOAD *Load)
+{
+  if (Load->IconSize) {
+    return egLoadIcon(Load->BaseDir, Load->FileName, Load->IconSize);
+  }
+  return egLoadImage(Load->BaseDir, Load->FileName, Load->WantAlpha);
+}
+
+//
+// Loads Count images like egLoadImage() (or egLoadIcon() for entries with
+// IconSize set) would. Files are read on the BSP, then the PNG ones are
+// decoded on all processors; whatever could not be done that way goes the
+// usual serial path.
+//
+VOID egLoadImages(IN OUT EG_IMAGE_LOAD *Loads, IN UINTN Count)
+{
+  EFI_STATUS      Status;
+  EG_DECODE_JOB   *Jobs;
+  UINTN           i, Width, Height;
+  UINTN           Scratch = 0;
+  UINTN           Queued = 0;
+
+  if (Loads == NULL || Count == 0) {
+    return;
+  }
+  Jobs = (EG_DECODE_JOB *)AllocateZeroPool(Count * sizeof(EG_DECODE_JOB));
+  if (Jobs == NULL || GlobalConfig.TypeSVG) {
+    for (i = 0; i < Count; i++) {
+      Loads[i].Image = egLoadSerial(&Loads[i]);
+    }
+    if (Jobs != NULL) {
+      FreePool(Jobs);
+    }
+    return;
+  }
+
+  for (i = 0; i < Count; i++) {
+    Loads[i].Image = NULL;
+    if (Loads[i].BaseDir == NULL || Loads[i].FileName == NULL) {
+      continue;
+    }
+    // the same key as egLoadImage()/egLoadIcon(): a hit is not queued at all
+    Loads[i].Image = egThemeFileFind(Loads[i].BaseDir, Loads[i].FileName,
+                                     egThemeFileFlags(Loads[i].WantAlpha, Loads[i].IconSize),
+                                     &Jobs[i].Key, &Jobs[i].Keyed);
+    if (Loads[i].Image != NULL) {
+      continue;
+    }
+    Status = egLoadFile(Loads[i].BaseDir, Loads[i].FileName, &Jobs[i].FileData, &Jobs[i].FileDataLength);
+    if (EFI_ERROR(Status)) {
+      Jobs[i].FileData = NULL;
+      continue;
+    }
+    if (!egPeekPNGSize(Jobs[i].FileData, Jobs[i].FileDataLength, &Width, &Height) ||
+        Width > EG_PNG_MAX_SIZE || Height > EG_PNG_MAX_SIZE) {
+      continue;
+    }
+    Jobs[i].Image = egCreateImage(Width, Height, Loads[i].IconSize ? TRUE : Loads[i].WantAlpha);
+    if (Jobs[i].Image == NULL) {
+      continue;
+    }
+    if (Scratch + egDecodeScratchSize(&Jobs[i]) > DECODE_SCRATCH_MAX) {
+      egFreeImage(Jobs[i].Image);
+      Jobs[i].Image = NULL;
+      continue;
+    }
+    Scratch += egDecodeScratchSize(&Jobs[i]);
+    Queued++;
+  }
+
+  if (Queued > 1 && egScratchBegin(Scratch)) {
+    egRunJobs(egDecodeJob, Jobs, sizeof(EG_DECODE_JOB), Count);
+    egScratchEnd();
+  }
+
+  for (i = 0; i < Count; i++) {
+    if (Loads[i].Image != NULL) {
+      continue; // from theme.cache
+    }
+    if (Jobs[i].Decoded) {
+      Loads[i].Image = Jobs[i].Image;
+    } else {
+      if (Jobs[i].Image != NULL) {
+        egFreeImage(Jobs[i].Image);
+      }
+      // a missing file stays missing, anything else gets the usual decoders
+      if (Jobs[i].FileData != NULL) {
+        Loads[i].Image = egDecodePNG(Jobs[i].FileData, Jobs[i].FileDataLength, Loads[i].IconSize ? TRUE : Loads[i].WantAlpha);
+        if (Loads[i].Image == NULL && Loads[i].IconSize) {
+          Loads[i].Image = egDecodeICNS(Jobs[i].FileData, Jobs[i].FileDataLength, Loads[i].IconSize, TRUE);
+        }
+      }
+    }
+    if (Jobs[i].FileData != NULL) {
+      if (Jobs[i].Keyed) {
+        egThemeFileAdd(&Jobs[i].Key, Loads[i].Image, Jobs[i].FileDataLength);
+      }
+      FreePool(Jobs[i].FileData);
+    }
+  }
+  FreePool(Jobs);
+}
+#else
+VOID egLoadImages(IN OUT EG_IMAGE_LOAD *Loads, IN UINTN Count)
+{
+  UINTN i;
+
+  for (i = 0; Loads != NULL && i < Count; i++) {
+    if (Loads[i].IconSize) {
+      Loads[i].Image = egLoadIcon(Loads[i].BaseDir, Loads[i].FileName, Loads[i].IconSize);
+    } else {
+      Loads[i].Image = egLoadImage(Loads[i].BaseDir, Loads[i].FileName, Loads[i].WantAlpha);
+    }
+  }
+}
 #endif //LODEPNG
 
 /* EOF */
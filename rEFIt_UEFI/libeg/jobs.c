@@ -0,0 +1,213 @@
+/*
+ * Running independent jobs on all processors
+ *
+ * egRunJobs() hands the jobs out through a shared counter to the BSP and,
+ * if the firmware publishes EFI_MP_SERVICES_PROTOCOL, to every enabled AP.
+ * Without MP services all jobs simply run on the BSP.
+ *
+ * A job may run on an AP, so it must not call boot services or DBG(), and
+ * it must not allocate from the pool. Allocations it needs are taken from
+ * the scratch arena, see egScratchBegin().
+ *
+ */
+
+#include "libegint.h"
+#include <Protocol/MpService.h>
+#include <Library/SynchronizationLib.h>
+
+#ifndef DEBUG_ALL
+#define DEBUG_JOBS 1
+#else
+#define DEBUG_JOBS DEBUG_ALL
+#endif
+
+#if DEBUG_JOBS == 0
+#define DBG(...)
+#else
+#define DBG(...) DebugLog(DEBUG_JOBS, __VA_ARGS__)
+#endif
+
+static EFI_MP_SERVICES_PROTOCOL *MpServices = NULL;
+static BOOLEAN                  MpChecked = FALSE;
+static UINTN                    MpEnabled = 1;
+
+typedef struct {
+  EG_JOB_PROC     Proc;
+  UINT8           *Jobs;
+  UINTN           JobSize;
+  UINT32          Count;
+  volatile UINT32 Next;
+} EG_JOB_QUEUE;
+
+// scratch arena, a bump allocator shared by all processors
+static UINT8            *ScratchBase = NULL;
+static UINTN            ScratchSize = 0;
+static volatile UINT32  ScratchUsed = 0;
+static BOOLEAN          ScratchActive = FALSE;
+
+//
+// Number of processors egRunJobs() can use, 1 if there are no MP services
+//
+UINTN egJobProcessors(VOID)
+{
+  EFI_STATUS  Status;
+  UINTN       Total = 0;
+  UINTN       Enabled = 0;
+
+  if (!MpChecked) {
+    MpChecked = TRUE;
+    Status = gBS->LocateProtocol(&gEfiMpServiceProtocolGuid, NULL, (VOID **)&MpServices);
+    if (!EFI_ERROR(Status)) {
+      Status = MpServices->GetNumberOfProcessors(MpServices, &Total, &Enabled);
+    }
+    if (EFI_ERROR(Status) || Enabled < 2) {
+      MpServices = NULL;
+      Enabled = 1;
+    }
+    MpEnabled = Enabled;
+    DBG("jobs: %d processors\n", MpEnabled);
+  }
+  return MpEnabled;
+}
+
+static VOID EFIAPI egJobWorker(IN OUT VOID *Buffer)
+{
+  EG_JOB_QUEUE *Queue = (EG_JOB_QUEUE *)Buffer;
+  UINT32       Index;
+
+  for (;;) {
+    Index = InterlockedIncrement(&Queue->Next) - 1;
+    if (Index >= Queue->Count) {
+      break;
+    }
+    Queue->Proc(Queue->Jobs + Index * Queue->JobSize);
+  }
+}
+
+//
+// Calls Proc for each of Count jobs laid out JobSize bytes apart and returns
+// when all of them are done. The BSP takes jobs too, so a failure to start
+// the APs only costs time.
+//
+VOID egRunJobs(IN EG_JOB_PROC Proc, IN VOID *Jobs, IN UINTN JobSize, IN UINTN Count)
+{
+  EFI_STATUS    Status;
+  EG_JOB_QUEUE  Queue;
+  EFI_EVENT     Done = NULL;
+
+  if (Proc == NULL || Jobs == NULL || Count == 0) {
+    return;
+  }
+
+  Queue.Proc = Proc;
+  Queue.Jobs = (UINT8 *)Jobs;
+  Queue.JobSize = JobSize;
+  Queue.Count = (UINT32)Count;
+  Queue.Next = 0;
+
+  if (Count > 1 && egJobProcessors() > 1) {
+    Status = gBS->CreateEvent(0, 0, NULL, NULL, &Done);
+    if (!EFI_ERROR(Status)) {
+      // non-blocking, so the BSP can work while the APs do
+      Status = MpServices->StartupAllAPs(MpServices, egJobWorker, FALSE, Done, 0, &Queue, NULL);
+      if (EFI_ERROR(Status)) {
+        DBG("jobs: StartupAllAPs %r, running on BSP\n", Status);
+        gBS->CloseEvent(Done);
+        Done = NULL;
+      }
+    }
+  }
+
+  egJobWorker(&Queue);
+
+  if (Done != NULL) {
+    while (gBS->CheckEvent(Done) == EFI_NOT_READY) {
+      CpuPause();
+    }
+    gBS->CloseEvent(Done);
+  }
+}
+
+//
+// Scratch arena for jobs. Between egScratchBegin() and egScratchEnd() the
+// image decoders allocate from it instead of the pool; freeing is a no-op
+// and everything is released at once by egScratchEnd().
+//
+BOOLEAN egScratchBegin(IN UINTN Size)
+{
+  if (ScratchActive || Size == 0 || Size > MAX_UINT32) {
+    return FALSE;
+  }
+  ScratchBase = (UINT8 *)AllocatePool(Size);
+  if (ScratchBase == NULL) {
+    return FALSE;
+  }
+  ScratchSize = Size;
+  ScratchUsed = 0;
+  ScratchActive = TRUE;
+  return TRUE;
+}
+
+VOID egScratchEnd(VOID)
+{
+  if (!ScratchActive) {
+    return;
+  }
+  ScratchActive = FALSE;
+  FreePool(ScratchBase);
+  ScratchBase = NULL;
+  ScratchSize = 0;
+}
+
+BOOLEAN egScratchIsActive(VOID)
+{
+  return ScratchActive;
+}
+
+BOOLEAN egScratchOwns(IN CONST VOID *Ptr)
+{
+  return ScratchActive && (CONST UINT8 *)Ptr >= ScratchBase && (CONST UINT8 *)Ptr < ScratchBase + ScratchSize;
+}
+
+// may be called on any processor; NULL when the arena is exhausted
+VOID *egScratchAlloc(IN UINTN Size)
+{
+  UINT32 Old, New;
+
+  Size = (Size + 15) & ~(UINTN)15;
+  do {
+    Old = ScratchUsed;
+    if (Size > ScratchSize - Old) {
+      return NULL;
+    }
+    New = Old + (UINT32)Size;
+  } while (InterlockedCompareExchange32((UINT32 *)&ScratchUsed, Old, New) != Old);
+  return ScratchBase + Old;
+}
+
+// grows the block in place if nothing was allocated after it, else moves it
+VOID *egScratchRealloc(IN VOID *Ptr, IN UINTN OldSize, IN UINTN NewSize)
+{
+  UINT32  End;
+  UINTN   Grow;
+  VOID    *NewPtr;
+
+  OldSize = (OldSize + 15) & ~(UINTN)15;
+  NewSize = (NewSize + 15) & ~(UINTN)15;
+  if (NewSize <= OldSize) {
+    return Ptr;
+  }
+  End = (UINT32)((UINT8 *)Ptr - ScratchBase + OldSize);
+  Grow = NewSize - OldSize;
+  if (End == ScratchUsed && Grow <= ScratchSize - End &&
+      InterlockedCompareExchange32((UINT32 *)&ScratchUsed, End, End + (UINT32)Grow) == End) {
+    return Ptr;
+  }
+  NewPtr = egScratchAlloc(NewSize);
+  if (NewPtr != NULL) {
+    CopyMem(NewPtr, Ptr, OldSize);
+  }
+  return NewPtr;
+}
+
+/* EOF */
@@ -139,6 +139,13 @@ typedef enum {
   FONT_LOAD
 } FONT_TYPE;
 
+typedef enum {
+  SCALER_SHARP,     // edge preserving scaler for backgrounds, nearest with blur for icons
+  SCALER_BILINEAR,
+  SCALER_BOX,
+  SCALER_LANCZOS
+} SCALER_TYPE;
+
 /* This should be compatible with EFI_UGA_PIXEL */
 typedef struct {
     UINT8 b, g, r, a;
@@ -172,6 +179,19 @@ typedef struct {
   INTN     Height;
 } EG_RECT;
 
+// what a cached text line depends on besides the text itself
+typedef struct {
+  INTN      XPos;
+  INTN      YPos;
+  INTN      Width;
+  INTN      Height;
+  INTN      SelectedWidth;
+  INTN      Cursor;
+  INTN      Style;
+  INTN      Align;
+  EG_PIXEL  Color;
+} EG_TEXT_RUN_KEY;
+
 
 #define TEXT_YMARGIN (2)
 #define TEXT_XMARGIN (8)
@@ -224,6 +244,32 @@ VOID      ScaleImage(OUT EG_IMAGE *NewImage, IN EG_IMAGE *OldImage);
 EG_IMAGE * egLoadImage(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha);
 EG_IMAGE * egLoadIcon(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN IconSize);
 
+// what an image in theme.cache depends on
+typedef struct {
+  UINT32    Name;     // CRC of the file name or SVG icon name
+  UINT32    Stamp;    // CRC of the file size and time, or of the raster parameters
+  UINT32    Flags;    // EG_CACHE_*
+} EG_CACHE_KEY;
+
+#define EG_CACHE_ALPHA  (1 << 0)
+#define EG_CACHE_SVG    (1 << 1)
+#define EG_CACHE_SCREEN (1 << 2)  // scaled to the screen, see BltClearScreen()
+// egLoadIcon() size in the bits above
+
+EG_IMAGE * egLoadImageKeyed(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN BOOLEAN WantAlpha,
+                            OUT EG_CACHE_KEY *CacheKey, OUT BOOLEAN *Keyed);
+
+// one entry of a batch for egLoadImages()
+typedef struct {
+  EFI_FILE_HANDLE BaseDir;
+  CHAR16          *FileName;
+  BOOLEAN         WantAlpha;
+  UINTN           IconSize;   // not 0: load like egLoadIcon()
+  EG_IMAGE        *Image;     // OUT, caller is responsible for free
+} EG_IMAGE_LOAD;
+
+VOID       egLoadImages(IN OUT EG_IMAGE_LOAD *Loads, IN UINTN Count);
+
 EG_IMAGE * egEnsureImageSize(IN EG_IMAGE *Image, IN INTN Width, IN INTN Height, IN EG_PIXEL *Color);
 
 EFI_STATUS egLoadFile(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName,
@@ -242,6 +288,9 @@ VOID egComposeImage(IN OUT EG_IMAGE *CompImage, IN EG_IMAGE *TopImage, IN INTN P
 VOID PrepareFont(VOID);
 VOID egMeasureText(IN CHAR16 *Text, OUT INTN *Width, OUT INTN *Height);
 INTN egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage, IN INTN PosX, IN INTN PosY, IN INTN Cursor, INTN textType);
+EG_IMAGE *egFindTextRun(IN CHAR16 *Text, IN EG_TEXT_RUN_KEY *Key, OUT INTN *DrawX, OUT INTN *TextWidth);
+VOID egAddTextRun(IN CHAR16 *Text, IN EG_TEXT_RUN_KEY *Key, IN EG_IMAGE *Image, IN INTN DrawX, IN INTN TextWidth);
+VOID egFreeTextRuns(VOID);
 
 VOID egClearScreen(IN EG_PIXEL *Color);
 //VOID egDrawImage(IN EG_IMAGE *Image, IN INTN ScreenPosX, IN INTN ScreenPosY);
@@ -252,6 +301,29 @@ VOID egDrawImageArea(IN EG_IMAGE *Image,
 VOID egTakeImage(IN EG_IMAGE *Image, INTN ScreenPosX, INTN ScreenPosY,
                  IN INTN AreaWidth, IN INTN AreaHeight);
 
+VOID egBeginFrame(VOID);
+VOID egEndFrame(VOID);
+
+// themecache.c
+UINT32     egThemeCacheCrc(IN CONST VOID *Data, IN UINTN Size);
+VOID       egThemeCacheOpen(IN CHAR16 *ThemeName, IN VOID *ThemeData, IN UINTN ThemeDataSize);
+BOOLEAN    egThemeCacheIsActive(VOID);
+EG_IMAGE   *egThemeCacheFind(IN EG_CACHE_KEY *Key);
+VOID       egThemeCacheAdd(IN EG_CACHE_KEY *Key, IN EG_IMAGE *Image);
+VOID       egThemeCacheFlush(VOID);
+
+// jobs.c
+typedef VOID (EFIAPI *EG_JOB_PROC)(IN OUT VOID *Job);
+
+UINTN   egJobProcessors(VOID);
+VOID    egRunJobs(IN EG_JOB_PROC Proc, IN VOID *Jobs, IN UINTN JobSize, IN UINTN Count);
+BOOLEAN egScratchBegin(IN UINTN Size);
+VOID    egScratchEnd(VOID);
+BOOLEAN egScratchIsActive(VOID);
+BOOLEAN egScratchOwns(IN CONST VOID *Ptr);
+VOID    *egScratchAlloc(IN UINTN Size);
+VOID    *egScratchRealloc(IN VOID *Ptr, IN UINTN OldSize, IN UINTN NewSize);
+
 EFI_STATUS egScreenShot(VOID);
 
 INTN drawSVGtext(EG_IMAGE* TextBufferXY, INTN posX, INTN posY, INTN textType, const CHAR16* text, UINTN Cursor);
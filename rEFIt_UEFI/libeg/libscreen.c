@@ -64,6 +64,15 @@ static EFI_CONSOLE_CONTROL_SCREEN_MODE CurrentForcedConsoleMode = EfiConsoleCont
 static EFI_CONSOLE_CONTROL_PROTOCOL_GET_MODE ConsoleControlGetMode = NULL;
 static EFI_CONSOLE_CONTROL_PROTOCOL_SET_MODE ConsoleControlSetMode = NULL;
 
+// see egBeginFrame()
+#define EG_MAX_DIRTY_RECTS 16
+
+static EG_IMAGE *egBackBuffer = NULL;
+static BOOLEAN  egBackBufferSynced = FALSE;
+static UINTN    egFrameDepth = 0;
+static EG_RECT  egDirtyRects[EG_MAX_DIRTY_RECTS];
+static UINTN    egDirtyCount = 0;
+
 static EFI_STATUS GopSetModeAndReconnectTextOut();
 
 //
@@ -479,6 +488,9 @@ VOID egSetGraphicsModeEnabled(IN BOOLEAN Enable)
     EFI_CONSOLE_CONTROL_SCREEN_MODE CurrentMode;
     EFI_CONSOLE_CONTROL_SCREEN_MODE NewMode;
 
+    // text output does not go through the back buffer
+    egBackBufferSynced = FALSE;
+
     if (ConsoleControl != NULL) {   
         // Some UEFI bioses may cause resolution switch when switching to Text Mode via the ConsoleControl->SetMode command
         // EFI applications wishing to use text, call the ConsoleControl->GetMode() command, and depending on its result may call ConsoleControl->SetMode().
@@ -512,6 +524,148 @@ VOID egSetGraphicsModeEnabled(IN BOOLEAN Enable)
     }
 }
 
+//
+// Back buffer
+//
+// Between egBeginFrame() and egEndFrame() drawing goes to a screen-sized
+// back buffer only and the touched areas are remembered as a short list
+// of rectangles. egEndFrame() sends every merged rectangle with a single
+// Blt. Outside of a frame drawing goes to the screen as before and the
+// back buffer is kept as its copy, so areas merged into a dirty rectangle
+// but not drawn in this frame are still correct.
+//
+
+static VOID egUnionRect(IN OUT EG_RECT *Rect, IN EG_RECT *Other)
+{
+  INTN Right  = MAX(Rect->XPos + Rect->Width, Other->XPos + Other->Width);
+  INTN Bottom = MAX(Rect->YPos + Rect->Height, Other->YPos + Other->Height);
+
+  Rect->XPos   = MIN(Rect->XPos, Other->XPos);
+  Rect->YPos   = MIN(Rect->YPos, Other->YPos);
+  Rect->Width  = Right - Rect->XPos;
+  Rect->Height = Bottom - Rect->YPos;
+}
+
+// overlapping or sharing an edge
+static BOOLEAN egRectsTouch(IN EG_RECT *A, IN EG_RECT *B)
+{
+  return (A->XPos <= B->XPos + B->Width) && (B->XPos <= A->XPos + A->Width) &&
+         (A->YPos <= B->YPos + B->Height) && (B->YPos <= A->YPos + A->Height);
+}
+
+static VOID egAddDirtyRect(IN INTN XPos, IN INTN YPos, IN INTN Width, IN INTN Height)
+{
+  EG_RECT Rect;
+  EG_RECT Merged;
+  UINTN   Index;
+  UINTN   Best = 0;
+  INTN    Growth, BestGrowth = -1;
+
+  Rect.XPos = XPos;
+  Rect.YPos = YPos;
+  Rect.Width = Width;
+  Rect.Height = Height;
+
+  // merge with every touching rectangle, the union may touch more of them
+  Index = 0;
+  while (Index < egDirtyCount) {
+    if (egRectsTouch(&Rect, &egDirtyRects[Index])) {
+      egUnionRect(&Rect, &egDirtyRects[Index]);
+      egDirtyRects[Index] = egDirtyRects[--egDirtyCount];
+      Index = 0;
+      continue;
+    }
+    Index++;
+  }
+
+  if (egDirtyCount < EG_MAX_DIRTY_RECTS) {
+    egDirtyRects[egDirtyCount++] = Rect;
+    return;
+  }
+
+  // no room, join the rectangle which grows least
+  for (Index = 0; Index < egDirtyCount; Index++) {
+    Merged = egDirtyRects[Index];
+    egUnionRect(&Merged, &Rect);
+    Growth = Merged.Width * Merged.Height - egDirtyRects[Index].Width * egDirtyRects[Index].Height;
+    if (BestGrowth < 0 || Growth < BestGrowth) {
+      BestGrowth = Growth;
+      Best = Index;
+    }
+  }
+  egUnionRect(&egDirtyRects[Best], &Rect);
+}
+
+static VOID egBltToScreen(IN EG_PIXEL *PixelData, IN UINTN Delta,
+                          IN INTN AreaPosX, IN INTN AreaPosY,
+                          IN INTN ScreenPosX, IN INTN ScreenPosY,
+                          IN INTN AreaWidth, IN INTN AreaHeight)
+{
+  if (GraphicsOutput != NULL) {
+    GraphicsOutput->Blt(GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)PixelData,
+                        EfiBltBufferToVideo,
+                        (UINTN)AreaPosX, (UINTN)AreaPosY, (UINTN)ScreenPosX, (UINTN)ScreenPosY,
+                        (UINTN)AreaWidth, (UINTN)AreaHeight, Delta);
+  } else if (UgaDraw != NULL) {
+    UgaDraw->Blt(UgaDraw, (EFI_UGA_PIXEL *)PixelData, EfiUgaBltBufferToVideo,
+                 (UINTN)AreaPosX, (UINTN)AreaPosY, (UINTN)ScreenPosX, (UINTN)ScreenPosY,
+                 (UINTN)AreaWidth, (UINTN)AreaHeight, Delta);
+  }
+}
+
+VOID egBeginFrame(VOID)
+{
+  if (!egHasGraphics) {
+    return;
+  }
+  if (egFrameDepth++ > 0) {
+    return;
+  }
+
+  if (egBackBuffer != NULL &&
+      (egBackBuffer->Width != (INTN)egScreenWidth || egBackBuffer->Height != (INTN)egScreenHeight)) {
+    egFreeImage(egBackBuffer);
+    egBackBuffer = NULL;
+  }
+  if (egBackBuffer == NULL) {
+    egBackBuffer = egCreateImage(egScreenWidth, egScreenHeight, FALSE);
+    egBackBufferSynced = FALSE;
+  }
+  if (egBackBuffer == NULL) {
+    egFrameDepth = 0;
+    return;
+  }
+  if (!egBackBufferSynced) {
+    // read the screen once, afterwards every drawing keeps the copy
+    if (GraphicsOutput != NULL) {
+      GraphicsOutput->Blt(GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)egBackBuffer->PixelData,
+                          EfiBltVideoToBltBuffer,
+                          0, 0, 0, 0, egScreenWidth, egScreenHeight, 0);
+    } else if (UgaDraw != NULL) {
+      UgaDraw->Blt(UgaDraw, (EFI_UGA_PIXEL *)egBackBuffer->PixelData, EfiUgaVideoToBltBuffer,
+                   0, 0, 0, 0, egScreenWidth, egScreenHeight, 0);
+    }
+    egBackBufferSynced = TRUE;
+  }
+  egDirtyCount = 0;
+}
+
+VOID egEndFrame(VOID)
+{
+  UINTN    Index;
+  EG_RECT  *Rect;
+
+  if (egFrameDepth == 0 || --egFrameDepth > 0) {
+    return;
+  }
+  for (Index = 0; Index < egDirtyCount; Index++) {
+    Rect = &egDirtyRects[Index];
+    egBltToScreen(egBackBuffer->PixelData, (UINTN)egBackBuffer->Width * sizeof(EG_PIXEL),
+                  Rect->XPos, Rect->YPos, Rect->XPos, Rect->YPos, Rect->Width, Rect->Height);
+  }
+  egDirtyCount = 0;
+}
+
 //
 // Drawing to the screen
 //
@@ -527,6 +681,15 @@ VOID egClearScreen(IN EG_PIXEL *Color)
     FillColor.Green = Color->g;
     FillColor.Blue  = Color->b;
     FillColor.Reserved = 0;
+
+    if (egBackBuffer != NULL && (egFrameDepth > 0 || egBackBufferSynced)) {
+        egFillImage(egBackBuffer, Color);
+        if (egFrameDepth > 0) {
+            egDirtyCount = 0;
+            egAddDirtyRect(0, 0, egBackBuffer->Width, egBackBuffer->Height);
+            return;
+        }
+    }
     
     if (GraphicsOutput != NULL) {
         // EFI_GRAPHICS_OUTPUT_BLT_PIXEL and EFI_UGA_PIXEL have the same
@@ -580,16 +743,19 @@ VOID egDrawImageArea(IN EG_IMAGE *Image,
     AreaHeight = UGAHeight - ScreenPosY;
   }
   
-  if (GraphicsOutput != NULL) {
-    GraphicsOutput->Blt(GraphicsOutput, (EFI_GRAPHICS_OUTPUT_BLT_PIXEL *)Image->PixelData,
-                        EfiBltBufferToVideo,
-                        (UINTN)AreaPosX, (UINTN)AreaPosY, (UINTN)ScreenPosX, (UINTN)ScreenPosY,
-                        (UINTN)AreaWidth, (UINTN)AreaHeight, (UINTN)Image->Width * 4);
-  } else if (UgaDraw != NULL) {
-    UgaDraw->Blt(UgaDraw, (EFI_UGA_PIXEL *)Image->PixelData, EfiUgaBltBufferToVideo,
-                 (UINTN)AreaPosX, (UINTN)AreaPosY, (UINTN)ScreenPosX, (UINTN)ScreenPosY,
-                 (UINTN)AreaWidth, (UINTN)AreaHeight, (UINTN)Image->Width * 4);
+  if (egBackBuffer != NULL && (egFrameDepth > 0 || egBackBufferSynced) &&
+      ScreenPosX + AreaWidth <= egBackBuffer->Width && ScreenPosY + AreaHeight <= egBackBuffer->Height) {
+    egRawCopy(egBackBuffer->PixelData + ScreenPosY * egBackBuffer->Width + ScreenPosX,
+              Image->PixelData + AreaPosY * Image->Width + AreaPosX,
+              AreaWidth, AreaHeight, egBackBuffer->Width, Image->Width);
+    if (egFrameDepth > 0) {
+      egAddDirtyRect(ScreenPosX, ScreenPosY, AreaWidth, AreaHeight);
+      return;
+    }
   }
+
+  egBltToScreen(Image->PixelData, (UINTN)Image->Width * 4,
+                AreaPosX, AreaPosY, ScreenPosX, ScreenPosY, AreaWidth, AreaHeight);
 }
 // Blt(this, Buffer, mode, srcX, srcY, destX, destY, w, h, deltaSrc);
 VOID egTakeImage(IN EG_IMAGE *Image, INTN ScreenPosX, INTN ScreenPosY,
@@ -604,6 +770,14 @@ VOID egTakeImage(IN EG_IMAGE *Image, INTN ScreenPosX, INTN ScreenPosY,
     {
       AreaHeight = UGAHeight - ScreenPosY;
     }
+
+    if (egFrameDepth > 0 && egBackBuffer != NULL &&
+        ScreenPosX + AreaWidth <= egBackBuffer->Width && ScreenPosY + AreaHeight <= egBackBuffer->Height) {
+      egRawCopy(Image->PixelData,
+                egBackBuffer->PixelData + ScreenPosY * egBackBuffer->Width + ScreenPosX,
+                AreaWidth, AreaHeight, Image->Width, egBackBuffer->Width);
+      return;
+    }
     
     if (GraphicsOutput != NULL) {
       GraphicsOutput->Blt(GraphicsOutput,
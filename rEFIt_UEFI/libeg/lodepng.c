@@ -50,11 +50,26 @@ CONST INT32 _fltused = 0;
 // External qsort implementation used
 extern void qsort(void *a, size_t n, size_t es, int (*cmp)(const void *, const void *));
 */
+// Scratch arena of libeg/jobs.c, used while decoding on several processors
+extern BOOLEAN egScratchIsActive(VOID);
+extern BOOLEAN egScratchOwns(CONST VOID *Ptr);
+extern VOID    *egScratchAlloc(UINTN Size);
+extern VOID    *egScratchRealloc(VOID *Ptr, UINTN OldSize, UINTN NewSize);
+
 // Custom internal allocators for UEFI
 // rewrite by RehabMan
 void* lodepng_malloc(size_t size)
 {
-  size_t* p = AllocateZeroPool(size+sizeof(size_t));
+  size_t* p;
+  if (egScratchIsActive()) {
+    // no pool allocations on APs
+    p = egScratchAlloc(size+sizeof(size_t));
+    if (p) {
+      ZeroMem(p, size+sizeof(size_t));
+    }
+  } else {
+    p = AllocateZeroPool(size+sizeof(size_t));
+  }
   if (!p) {
     return NULL;
   }
@@ -64,7 +79,7 @@ void* lodepng_malloc(size_t size)
 
 void lodepng_free(void* ptr)
 {
-  if (ptr)
+  if (ptr && !egScratchOwns(ptr))
     FreePool((size_t*)ptr-1);
 }
 
@@ -75,6 +90,14 @@ void* lodepng_realloc(void* ptr, size_t new_size)
     return lodepng_malloc(new_size);
   }
   size_t* old_p = (size_t*)ptr-1;
+  if (egScratchOwns(ptr)) {
+    size_t* new_p = egScratchRealloc(old_p, *old_p, new_size+sizeof(size_t));
+    if (!new_p) {
+      return NULL;
+    }
+    *new_p = new_size+sizeof(size_t);
+    return new_p+1;
+  }
   size_t* new_p = ReallocatePool(*old_p, new_size+sizeof(size_t), old_p);
   if (!new_p) {
     return NULL;
@@ -83,8 +106,9 @@ void* lodepng_realloc(void* ptr, size_t new_size)
   return new_p+1;
 }
 
-#define memcpy(dest,source,count) gBS->CopyMem(dest,source,(UINTN)(count))
-#define memset(dest,ch,count)     gBS->SetMem(dest,(UINTN)(count),(UINT8)(ch))
+// BaseMemoryLib rather than gBS, the decoder may run on an AP
+#define memcpy(dest,source,count) CopyMem(dest,source,(UINTN)(count))
+#define memset(dest,ch,count)     SetMem(dest,(UINTN)(count),(UINT8)(ch))
 
 
 //MODSNI ^
@@ -4576,19 +4600,18 @@ static unsigned readChunk_pHYs(LodePNGInfo* info, const unsigned char* data, siz
 }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
-                          LodePNGState* state,
-                          const unsigned char* in, size_t insize)
+/*read the chunks of a PNG and inflate the image data, the result is the filtered scanlines
+(with the filter type byte per scanline, still interlaced) in the color type of the PNG*/
+static void decodeScanlines(ucvector* scanlines, unsigned* w, unsigned* h,
+                            LodePNGState* state,
+                            const unsigned char* in, size_t insize)
 {
   unsigned char IEND = 0;
   const unsigned char* chunk;
   size_t i;
   ucvector idat; /*the data from idat chunks*/
-  ucvector scanlines;
   size_t predict;
   size_t numpixels;
-  size_t outsize = 0;
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4596,8 +4619,7 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   unsigned critical_pos = 1; /*1 = after IHDR, 2 = after PLTE, 3 = after IDAT*/
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 
-  /*provide some proper output values if error will happen*/
-  *out = 0;
+  ucvector_init(scanlines);
 
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
@@ -4734,7 +4756,6 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
 
-  ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
   If the decompressed size does not match the prediction, the image must be corrupt.*/
   if(state->info_png.interlace_method == 0)
@@ -4755,15 +4776,28 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(*w > 1) predict += lodepng_get_raw_size_idat((*w + 0) >> 1, (*h + 1) >> 1, color) + ((*h + 1) >> 1);
     predict += lodepng_get_raw_size_idat((*w + 0), (*h + 0) >> 1, color) + ((*h + 0) >> 1);
   }
-  if(!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
+  if(!state->error && !ucvector_reserve(scanlines, predict)) state->error = 83; /*alloc fail*/
   if(!state->error)
   {
-    state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
+    state->error = zlib_decompress(&scanlines->data, &scanlines->size, idat.data,
                                    idat.size, &state->decoder.zlibsettings);
-    if(!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
+    if(!state->error && scanlines->size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
   }
   ucvector_cleanup(&idat);
+}
 
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+                          LodePNGState* state,
+                          const unsigned char* in, size_t insize)
+{
+  ucvector scanlines;
+  size_t outsize = 0;
+
+  /*provide some proper output values if error will happen*/
+  *out = 0;
+
+  decodeScanlines(&scanlines, w, h, state, in, insize);
   if(!state->error)
   {
     outsize = lodepng_get_raw_size(*w, *h, &state->info_png.color);
@@ -4778,6 +4812,96 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   ucvector_cleanup(&scanlines);
 }
 
+/*Clover: convert pixels of any PNG color mode to 8-bit BGRA, the EG_PIXEL layout*/
+static void getPixelColorsBGRA8(unsigned char* buffer, size_t numpixels,
+                                const unsigned char* in, const LodePNGColorMode* mode)
+{
+  size_t i;
+  unsigned char t;
+  if(mode->bitdepth == 8 && mode->colortype == LCT_RGBA)
+  {
+    for(i = 0; i != numpixels; ++i, buffer += 4, in += 4)
+    {
+      buffer[0] = in[2];
+      buffer[1] = in[1];
+      buffer[2] = in[0];
+      buffer[3] = in[3];
+    }
+  }
+  else if(mode->bitdepth == 8 && mode->colortype == LCT_RGB && !mode->key_defined)
+  {
+    for(i = 0; i != numpixels; ++i, buffer += 4, in += 3)
+    {
+      buffer[0] = in[2];
+      buffer[1] = in[1];
+      buffer[2] = in[0];
+      buffer[3] = 255;
+    }
+  }
+  else
+  {
+    getPixelColorsRGBA8(buffer, numpixels, 1, in, mode);
+    for(i = 0; i != numpixels; ++i, buffer += 4)
+    {
+      t = buffer[0];
+      buffer[0] = buffer[2];
+      buffer[2] = t;
+    }
+  }
+}
+
+/*Clover: decode into a caller buffer of w * h BGRA pixels, w and h as in the header. Without
+interlacing each scanline is unfiltered in place and converted while it is still in the cache,
+so there is neither a buffer in the PNG color type nor a converted copy of the image.*/
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned w, unsigned h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize)
+{
+  ucvector scanlines;
+  unsigned w_png = 0, h_png = 0, y;
+  unsigned bpp;
+  size_t bytewidth, linebytes;
+  unsigned char* line;
+  unsigned char* prevline = 0;
+  unsigned char* raw;
+  const LodePNGColorMode* color = &state->info_png.color;
+
+  decodeScanlines(&scanlines, &w_png, &h_png, state, in, insize);
+  if(!state->error && (w_png != w || h_png != h)) state->error = 95;
+  bpp = lodepng_get_bpp(color);
+  if(!state->error && bpp == 0) state->error = 31; /*error: invalid colortype*/
+  if(!state->error && state->info_png.interlace_method == 0)
+  {
+    bytewidth = (bpp + 7) / 8;
+    linebytes = (w * bpp + 7) / 8;
+    for(y = 0; y < h; ++y)
+    {
+      /*scanlines start at a byte, so padding bits at the end of a line need no care*/
+      line = &scanlines.data[(1 + linebytes) * y];
+      state->error = unfilterScanline(line + 1, line + 1, prevline, bytewidth, line[0], linebytes);
+      if(state->error) break;
+      prevline = line + 1;
+      getPixelColorsBGRA8(&out[(size_t)w * y * 4], w, line + 1, color);
+    }
+  }
+  else if(!state->error)
+  {
+    /*Adam7: deinterlace in the PNG color type first*/
+    size_t rawsize = lodepng_get_raw_size(w, h, color);
+    raw = (unsigned char*)lodepng_malloc(rawsize);
+    if(!raw) state->error = 83; /*alloc fail*/
+    else
+    {
+      SetMem(raw, rawsize, 0);
+      state->error = postProcessScanlines(raw, scanlines.data, w, h, &state->info_png);
+      if(!state->error) getPixelColorsBGRA8(out, (size_t)w * h, raw, color);
+      lodepng_free(raw);
+    }
+  }
+  ucvector_cleanup(&scanlines);
+  return state->error;
+}
+
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize)
@@ -6056,6 +6180,7 @@ const char* lodepng_error_text(unsigned code)
     case 92: return "too many pixels, not supported";
     case 93: return "zero width or height is invalid";
     case 94: return "header chunk must have a size of 13 bytes";
+    case 95: return "image size differs from the output buffer";
   }
   return "unknown error code";
 }
@@ -6306,6 +6431,17 @@ unsigned eglodepng_decode(unsigned char** out, size_t* w, size_t* h, const unsig
   }
   return _r;
 }
+
+// decodes into w * h EG_PIXELs at out, w and h must be the size from the header
+unsigned eglodepng_decode_bgra(unsigned char* out, size_t w, size_t h, const unsigned char* in, size_t insize)
+{
+  unsigned _r;
+  LodePNGState state;
+  lodepng_state_init(&state);
+  _r = lodepng_decode_bgra(out, (unsigned)w, (unsigned)h, &state, in, insize);
+  lodepng_state_cleanup(&state);
+  return _r;
+}
 // EXPORT FOR CLOVER <==
 
 #endif /*LODEPNG_COMPILE_DECODER*/
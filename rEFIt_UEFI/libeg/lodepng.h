@@ -675,6 +675,14 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize);
 
+/*
+Clover: decode into out, a caller buffer of w * h pixels in BGRA order with 8 bits
+per channel. w and h must be the size in the header, see lodepng_inspect.
+*/
+unsigned lodepng_decode_bgra(unsigned char* out, unsigned w, unsigned h,
+                             LodePNGState* state,
+                             const unsigned char* in, size_t insize);
+
 /*
 Read the PNG header, but not the actual data. This returns only the information
 that is in the header chunk of the PNG, such as width, height and color type. The
@@ -915,6 +923,7 @@ unsigned eglodepng_encode(unsigned char** out, size_t* outsize, const unsigned c
 
 #ifdef LODEPNG_COMPILE_DECODER
 unsigned eglodepng_decode(unsigned char** out, size_t* w, size_t* h, const unsigned char* in, size_t insize);
+unsigned eglodepng_decode_bgra(unsigned char* out, size_t w, size_t h, const unsigned char* in, size_t insize);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 /*
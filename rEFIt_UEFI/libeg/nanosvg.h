@@ -195,6 +195,8 @@ typedef struct NSVGshape
   NSVGgroup* group;      // Pointer to parent group or NULL
   NSVGclip clip;
   struct NSVGshape* next;    // Pointer to next shape, or NULL if last element.
+  struct NSVGshape* prev;    // Previous shape in image->shapes, set by the icon index
+  BOOLEAN detached;          // Taken out of image->shapes into an icon
   struct NSVGshape* link;    // pointer for reference shape
   struct NSVGfont* fontFace; //one letter - one shape
   const char *image_href;
@@ -561,8 +563,12 @@ struct NSVGrasterizer
 
   unsigned char* scanline;
   int cscanline;
+  int* accum;             // coverage deltas of a row, cscanline+2 entries
   NSVGscanlineFunction fscanline;
 
+  NSVGedge* sorted;       // radix sort buffer
+  int csorted;
+
   unsigned char* stencil;
   int stencilSize;
   int stencilStride;
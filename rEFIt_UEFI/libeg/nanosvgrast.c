@@ -119,6 +119,77 @@ void qsort(void* Array, int Num, INTN Size,
 }
 
 
+// float y0 as an unsigned key with the same order
+static inline unsigned int nsvg__edgeKey(float y)
+{
+  union { float f; unsigned int u; } k;
+  k.f = y;
+  return (k.u & 0x80000000) ? ~k.u : (k.u | 0x80000000);
+}
+
+// Stable sort of the edges by y0. Small sets by insertion, others by an LSD
+// radix sort on the bytes of the key; bytes equal for all edges are skipped.
+static void nsvg__sortEdges(NSVGrasterizer* r)
+{
+  NSVGedge *src = r->edges, *dst, *t;
+  NSVGedge tmp;
+  int n = r->nedges;
+  int i, j, pass, shift;
+  int count[256];
+  unsigned int keyAnd, keyOr, key;
+
+  if (n < 32) {
+    for (i = 1; i < n; i++) {
+      if (src[i].y0 >= src[i-1].y0) continue;
+      tmp = src[i];
+      for (j = i; j > 0 && src[j-1].y0 > tmp.y0; j--) {
+        src[j] = src[j-1];
+      }
+      src[j] = tmp;
+    }
+    return;
+  }
+
+  if (n > r->csorted) {
+    if (r->sorted) FreePool(r->sorted);
+    r->sorted = (NSVGedge*)AllocatePool(r->cedges * sizeof(NSVGedge));
+    r->csorted = r->sorted ? r->cedges : 0;
+    if (r->sorted == NULL) {
+      nsvg_qsort(src, 0, n - 1);
+      return;
+    }
+  }
+  dst = r->sorted;
+
+  keyAnd = 0xFFFFFFFF;
+  keyOr = 0;
+  for (i = 0; i < n; i++) {
+    key = nsvg__edgeKey(src[i].y0);
+    keyAnd &= key;
+    keyOr |= key;
+  }
+  for (pass = 0; pass < 4; pass++) {
+    shift = pass * 8;
+    if ((((keyAnd ^ keyOr) >> shift) & 0xFF) == 0) continue;
+    gBS->SetMem(count, sizeof(count), 0);
+    for (i = 0; i < n; i++) {
+      count[(nsvg__edgeKey(src[i].y0) >> shift) & 0xFF]++;
+    }
+    for (i = 0, j = 0; i < 256; i++) {
+      int c = count[i];
+      count[i] = j;
+      j += c;
+    }
+    for (i = 0; i < n; i++) {
+      dst[count[(nsvg__edgeKey(src[i].y0) >> shift) & 0xFF]++] = src[i];
+    }
+    t = src; src = dst; dst = t;
+  }
+  if (src != r->edges) {
+    memcpy(r->edges, src, n * sizeof(NSVGedge));
+  }
+}
+
 NSVGrasterizer* nsvgCreateRasterizer()
 {
   NSVGrasterizer* r = (NSVGrasterizer*)AllocateZeroPool(sizeof(NSVGrasterizer));
@@ -145,6 +216,8 @@ void nsvgDeleteRasterizer(NSVGrasterizer* r)
   if (r->points) FreePool(r->points);
   if (r->points2) FreePool(r->points2);
   if (r->scanline) FreePool(r->scanline);
+  if (r->accum) FreePool(r->accum);
+  if (r->sorted) FreePool(r->sorted);
   if (r->stencil) FreePool(r->stencil);
 
   FreePool(r);
@@ -961,29 +1034,38 @@ static void nsvg__freeActive(NSVGrasterizer* r, NSVGactiveEdge* z)
   r->freelist = z;
 }
 
-static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
+// Coverage goes into accum[] as differences to the pixel on the left, so a
+// span costs the same whatever its length; the row is summed up once after
+// all subsamples in nsvg__rasterizeSortedEdges().
+static void nsvg__fillScanline(int* accum, int len, int x0, int x1, int maxWeight, int* xmin, int* xmax)
 {
   int i = x0 >> NSVG__FIXSHIFT;
   int j = x1 >> NSVG__FIXSHIFT;
+  int a;
   if (i < *xmin) *xmin = i;
   if (j > *xmax) *xmax = j;
   if (i < len && j >= 0) {
     if (i == j) {
       // x0,x1 are the same pixel, so compute combined coverage
-      scanline[i] = (unsigned char)(scanline[i] + ((x1 - x0) * maxWeight >> NSVG__FIXSHIFT));
+      a = (x1 - x0) * maxWeight >> NSVG__FIXSHIFT;
+      accum[i] += a;
+      accum[i+1] -= a;
     } else {
-      if (i >= 0) // add antialiasing for x0
-        scanline[i] = (unsigned char)(scanline[i] + (((NSVG__FIX - (x0 & NSVG__FIXMASK)) * maxWeight) >> NSVG__FIXSHIFT));
-      else
-        i = -1; // clip
-
-      if (j < len) // add antialiasing for x1
-        scanline[j] = (unsigned char)(scanline[j] + (((x1 & NSVG__FIXMASK) * maxWeight) >> NSVG__FIXSHIFT));
-      else
-        j = len; // clip
+      if (i >= 0) { // add antialiasing for x0
+        a = ((NSVG__FIX - (x0 & NSVG__FIXMASK)) * maxWeight) >> NSVG__FIXSHIFT;
+        accum[i] += a;
+        accum[i+1] += maxWeight - a;
+      } else { // clip
+        accum[0] += maxWeight;
+      }
 
-      for (++i; i < j; ++i) // fill pixels between x0 and x1
-        scanline[i] = (unsigned char)(scanline[i] + maxWeight);
+      if (j < len) { // add antialiasing for x1
+        a = ((x1 & NSVG__FIXMASK) * maxWeight) >> NSVG__FIXSHIFT;
+        accum[j] += a - maxWeight;
+        accum[j+1] -= a;
+      } else { // clip
+        accum[len] -= maxWeight;
+      }
     }
   }
 }
@@ -991,7 +1073,7 @@ static void nsvg__fillScanline(unsigned char* scanline, int len, int x0, int x1,
 // note: this routine clips fills that extend off the edges... ideally this
 // wouldn't happen, but it could happen if the truetype glyph bounding boxes
 // are wrong, or if the user supplies a too-small bitmap
-static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
+static void nsvg__fillActiveEdges(int* accum, int len, NSVGactiveEdge* e, int maxWeight, int* xmin, int* xmax, char fillRule)
 {
   // non-zero winding fill
   int x0 = 0, w = 0;
@@ -1006,7 +1088,7 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
         int x1 = e->x; w += e->dir;
         // if we went to zero, we need to draw
         if (w == 0)
-          nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
+          nsvg__fillScanline(accum, len, x0, x1, maxWeight, xmin, xmax);
       }
       e = e->next;
     }
@@ -1018,7 +1100,7 @@ static void nsvg__fillActiveEdges(unsigned char* scanline, int len, NSVGactiveEd
         x0 = e->x; w = 1;
       } else {
         int x1 = e->x; w = 0;
-        nsvg__fillScanline(scanline, len, x0, x1, maxWeight, xmin, xmax);
+        nsvg__fillScanline(accum, len, x0, x1, maxWeight, xmin, xmax);
       }
       e = e->next;
     }
@@ -1074,6 +1156,30 @@ static void nsvg__scanlineBit(
   }
 }
 
+// Premultiply the colour by coverage and blend it over dst. Nothing changes
+// under zero coverage and nothing shows through an opaque pixel.
+static inline void nsvg__blendPixel(unsigned char* dst, int cr, int cg, int cb, int ca, int cover)
+{
+  int a = nsvg__div255(cover * ca);
+  int ia;
+
+  if (a == 0) {
+    return;
+  }
+  if (a == 255) {
+    dst[0] = (unsigned char)cr;
+    dst[1] = (unsigned char)cg;
+    dst[2] = (unsigned char)cb;
+    dst[3] = 255;
+    return;
+  }
+  ia = 255 - a;
+  dst[0] = (unsigned char)(nsvg__div255(cr * a) + nsvg__div255(ia * (int)dst[0]));
+  dst[1] = (unsigned char)(nsvg__div255(cg * a) + nsvg__div255(ia * (int)dst[1]));
+  dst[2] = (unsigned char)(nsvg__div255(cb * a) + nsvg__div255(ia * (int)dst[2]));
+  dst[3] = (unsigned char)(a + nsvg__div255(ia * (int)dst[3]));
+}
+
 static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* cover, int x, int y,
                                 /*  float tx, float ty, float scalex, float scaley, */ NSVGcachedPaint* cache)
 {
@@ -1081,30 +1187,34 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
   unsigned char* dst = row + x*4;
   if (cache->type == NSVG_PAINT_COLOR) {
     int i, cr, cg, cb, ca;
+    int lastCover = -1, a = 0, ia = 0, pr = 0, pg = 0, pb = 0;
     cr = cache->colors[0] & 0xff;
     cg = (cache->colors[0] >> 8) & 0xff;
     cb = (cache->colors[0] >> 16) & 0xff;
     ca = (cache->colors[0] >> 24) & 0xff;
 
     for (i = 0; i < count; i++) {
-      int r,g,b;
-      int a = nsvg__div255((int)cover[0] * ca);
-      int ia = 255 - a;
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
+      // coverage comes in runs, premultiply once per run
+      if (cover[0] != lastCover) {
+        lastCover = cover[0];
+        a = nsvg__div255(lastCover * ca);
+        ia = 255 - a;
+        pr = nsvg__div255(cr * a);
+        pg = nsvg__div255(cg * a);
+        pb = nsvg__div255(cb * a);
+      }
+      if (a == 255) {
+        dst[0] = (unsigned char)pr;
+        dst[1] = (unsigned char)pg;
+        dst[2] = (unsigned char)pb;
+        dst[3] = 255;
+      } else if (a != 0) {
+        // Blend over
+        dst[0] = (unsigned char)(pr + nsvg__div255(ia * (int)dst[0]));
+        dst[1] = (unsigned char)(pg + nsvg__div255(ia * (int)dst[1]));
+        dst[2] = (unsigned char)(pb + nsvg__div255(ia * (int)dst[2]));
+        dst[3] = (unsigned char)(a + nsvg__div255(ia * (int)dst[3]));
+      }
 
       cover++;
       dst += 4;
@@ -1116,7 +1226,7 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     float* t = cache->xform;
 
     //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
+    int i;
     unsigned int c;
     //x,y - pixels
     fx = (float)x;
@@ -1125,29 +1235,9 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     gy = fx*t[1] + fy*t[3] + t[5]; //gradient direction. Point at cut
 
     for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
       int level = cache->coarse;
       c = cache->colors[dither(nsvg__clampf(gy*(255.0f-level), 0, (float)(255-level)), level)]; //assumed gy = 0.0 ... 1.0f
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
+      nsvg__blendPixel(dst, c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff, cover[0]);
 
       cover++;
       dst += 4;
@@ -1161,7 +1251,7 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     float fx, fy, gx, gy, gd;
     float* t = cache->xform;
     //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
+    int i;
     unsigned int c;
     fx = (float)x;
     fy = (float)y;
@@ -1170,34 +1260,11 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     gy = fx*t[1] + fy*t[3] + t[5];
 
     for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
       gd = sqrtf(gx*gx + gy*gy);
       //     DBG("gx=%s gy=%s\n", PoolPrintFloat(gx), PoolPrintFloat(gy));
       int level = cache->coarse;
       c = cache->colors[dither(nsvg__clampf(gd*(255.0f-level*2), 0, (254.99f-level*2)), level)];
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
+      nsvg__blendPixel(dst, c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff, cover[0]);
 
       cover++;
       dst += 4;
@@ -1216,7 +1283,7 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     }
     INTN Width = Pattern->Width;
     INTN Height = Pattern->Height;
-    int i, cr, cg, cb, ca, ix, iy;
+    int i, ix, iy;
     INTN j;
     fx = (float)x;
     fy = (float)y;
@@ -1224,33 +1291,13 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
 
     //    unsigned int c;
     for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
       gx = fx*t[0] + fy*t[2] + t[4];
       gy = fx*t[1] + fy*t[3] + t[5];
       ix = dither(gx * Width, 2) % Width;
       iy = dither(gy * Height, 2) % Height;
       j = iy * Width + ix;
-      cr = Pattern->PixelData[j].r;
-      cb = Pattern->PixelData[j].b;
-      cg = Pattern->PixelData[j].g;
-      ca = Pattern->PixelData[j].a;
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
+      nsvg__blendPixel(dst, Pattern->PixelData[j].r, Pattern->PixelData[j].g, Pattern->PixelData[j].b,
+                       Pattern->PixelData[j].a, cover[0]);
 
       cover++;
       dst += 4;
@@ -1264,7 +1311,7 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     float fx, fy, gx, gy, gd;
     float* t = cache->xform;
     //    DumpFloat("cache grad xform", t, 6);
-    int i, cr, cg, cb, ca;
+    int i;
     unsigned int c;
 
     fx = (float)x;
@@ -1274,36 +1321,13 @@ static void nsvg__scanlineSolid(unsigned char* row, int count, unsigned char* co
     gy = fx*t[1] + fy*t[3] + t[5];
 
     for (i = 0; i < count; i++) {
-      int r,g,b,a,ia;
       if ((gx == 0.f) && (gy == 0.f)) {
         c = 0;
       } else {
         gd = (Atan2F(gy, gx) + PI) / PI2;
         c = cache->colors[dither(nsvg__clampf(gd*254.0f, 0, 253.99f), 1)];
       }
-      cr = (c) & 0xff;
-      cg = (c >> 8) & 0xff;
-      cb = (c >> 16) & 0xff;
-      ca = (c >> 24) & 0xff;
-
-      a = nsvg__div255((int)cover[0] * ca);
-      ia = 255 - a;
-
-      // Premultiply
-      r = nsvg__div255(cr * a);
-      g = nsvg__div255(cg * a);
-      b = nsvg__div255(cb * a);
-
-      // Blend over
-      r += nsvg__div255(ia * (int)dst[0]);
-      g += nsvg__div255(ia * (int)dst[1]);
-      b += nsvg__div255(ia * (int)dst[2]);
-      a += nsvg__div255(ia * (int)dst[3]);
-
-      dst[0] = (unsigned char)r;
-      dst[1] = (unsigned char)g;
-      dst[2] = (unsigned char)b;
-      dst[3] = (unsigned char)a;
+      nsvg__blendPixel(dst, c & 0xff, (c >> 8) & 0xff, (c >> 16) & 0xff, (c >> 24) & 0xff, cover[0]);
 
       cover++;
       dst += 4;
@@ -1325,7 +1349,6 @@ static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r,
   int xmin, xmax;
 
   for (y = 0; y < r->height; y++) {
-    gBS->SetMem(r->scanline, r->width, 0);
     xmin = r->width;
     xmax = 0;
     for (s = 0; s < NSVG__SUBSAMPLES; ++s) {
@@ -1392,12 +1415,20 @@ static void nsvg__rasterizeSortedEdges(NSVGrasterizer *r,
 
       // now process all active edges in non-zero fashion
       if (active != NULL)
-        nsvg__fillActiveEdges(r->scanline, r->width, active, maxWeight, &xmin, &xmax, fillRule);
+        nsvg__fillActiveEdges(r->accum, r->width, active, maxWeight, &xmin, &xmax, fillRule);
     }
     // Blit
     if (xmin < 0) xmin = 0;
     if (xmax > r->width-1) xmax = r->width-1;
     if (xmin <= xmax) {
+      // sum the deltas up to coverage, leaving accum[] zeroed for the next row
+      int sum = 0, k;
+      for (k = xmin; k <= xmax; k++) {
+        sum += r->accum[k];
+        r->accum[k] = 0;
+        r->scanline[k] = (unsigned char)sum;
+      }
+      r->accum[xmax+1] = 0;
       //    nsvg__scanlineSolid(&r->bitmap[y * r->stride] + xmin*4, xmax-xmin+1, &r->scanline[xmin], xmin, y, tx,ty, scalex, scaley, cache);
       int i, j;
       for (i = 0; i < clip->count; i++) {
@@ -1423,7 +1454,7 @@ static void nsvg__unpremultiplyAlpha(unsigned char* image, int w, int h, int str
     unsigned char *row = &image[y*stride];
     for (x = 0; x < w; x++) {
       int r = row[0], g = row[1], b = row[2], a = row[3];
-      if (a != 0) {
+      if (a != 0 && a != 255) {
         row[0] = (unsigned char)(r*255/a);
         row[1] = (unsigned char)(g*255/a);
         row[2] = (unsigned char)(b*255/a);
@@ -1630,7 +1661,16 @@ static void nsvg__rasterizeShapes(NSVGrasterizer* r,
     } else {
       r->scanline = (unsigned char*)ReallocatePool(oldw, w, r->scanline);
     }
-    if (r->scanline == NULL) return;
+    if (r->accum) FreePool(r->accum);
+    r->accum = (int*)AllocateZeroPool((w + 2) * sizeof(int));
+    if (r->scanline == NULL || r->accum == NULL) {
+      if (r->scanline) FreePool(r->scanline);
+      if (r->accum) FreePool(r->accum);
+      r->scanline = NULL;
+      r->accum = NULL;
+      r->cscanline = 0;
+      return;
+    }
   }
 
   nsvg__xformSetScale(&xform2[0], scalex, scaley);
@@ -1693,7 +1733,7 @@ static void renderShape(NSVGrasterizer* r,
     }
 
     // Rasterize edges
-    qsort(r->edges, r->nedges, sizeof(NSVGedge), NULL);
+    nsvg__sortEdges(r);
 
     // now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
     nsvg__initPaint(&cache, &shape->fill, shape, xform);
@@ -1713,7 +1753,7 @@ static void renderShape(NSVGrasterizer* r,
     }
 
     // Rasterize edges
-    qsort(r->edges, r->nedges, sizeof(NSVGedge), NULL);
+    nsvg__sortEdges(r);
 
     // now, traverse the scanlines and find the intersections on each scanline, use non-zero rule
     nsvg__initPaint(&cache, &shape->stroke, shape, xform);
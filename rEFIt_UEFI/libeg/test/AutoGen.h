@@ -0,0 +1,21 @@
+/*
+ *  AutoGen.h
+ *
+ *  Stands in for the header the EDK2 build generates for rEFIt_UEFI when
+ *  parts of libeg are built on a POSIX host, see README.
+ *
+ */
+
+#ifndef _EG_HOST_AUTOGEN_H
+#define _EG_HOST_AUTOGEN_H
+
+#include <Uefi.h>
+#include <Library/PcdLib.h>
+
+// PCDs read by BaseLib and BasePrintLib
+#define _PCD_GET_MODE_32_PcdMaximumAsciiStringLength    1000000
+#define _PCD_GET_MODE_32_PcdMaximumUnicodeStringLength  1000000
+#define _PCD_GET_MODE_32_PcdMaximumLinkedListLength     1000000
+#define _PCD_GET_MODE_BOOL_PcdVerifyNodeInList          FALSE
+
+#endif /* !_EG_HOST_AUTOGEN_H */
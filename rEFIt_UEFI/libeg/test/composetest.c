@@ -0,0 +1,365 @@
+/*
+ *  composetest.c
+ *
+ *  Host test of the blending kernels egRawCompose() and egRawComposeOnFlat()
+ *  of image.c: the results must be the same bit for bit as those of the
+ *  scalar code they replace, kept here as reference. Also measures both,
+ *  see README.
+ *
+ */
+
+#include "eg_host.h"
+
+#define BENCH_WIDTH   3840
+#define BENCH_HEIGHT  2160
+
+STATIC UINTN    mFailed = 0;
+STATIC UINT32   mSeed = 1;
+
+STATIC VOID Report(IN CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[512];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  eg_posix_print(Buffer);
+}
+
+STATIC UINT32 Random(VOID)
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return mSeed >> 8;
+}
+
+//
+// egRawCompose() and egRawComposeOnFlat() as they were before the kernels
+// blending two channels per multiply, the reference for the test
+//
+STATIC VOID RefRawCompose(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                          IN INTN Width, IN INTN Height,
+                          IN INTN CompLineOffset, IN INTN TopLineOffset)
+{
+  INT64       x, y;
+  EG_PIXEL    *TopPtr, *CompPtr;
+  INTN        TopAlpha;
+  INTN        Alpha;
+  INTN        CompAlpha;
+  INTN        RevAlpha;
+  INTN        TempAlpha;
+
+  for (y = 0; y < Height; y++) {
+    TopPtr = TopBasePtr;
+    CompPtr = CompBasePtr;
+    for (x = 0; x < Width; x++) {
+      TopAlpha = TopPtr->a & 0xFF;
+
+      if (TopAlpha == 255) {
+        CompPtr->b = TopPtr->b;
+        CompPtr->g = TopPtr->g;
+        CompPtr->r = TopPtr->r;
+        CompPtr->a = (UINT8)TopAlpha;
+      } else if (TopAlpha != 0) {
+        CompAlpha = CompPtr->a & 0xFF;
+        RevAlpha = 255 - TopAlpha;
+        TempAlpha = CompAlpha * RevAlpha;
+        TopAlpha *= 255;
+        Alpha = TopAlpha + TempAlpha;
+
+        CompPtr->b = (UINT8)((TopPtr->b * TopAlpha + CompPtr->b * TempAlpha) / Alpha);
+        CompPtr->g = (UINT8)((TopPtr->g * TopAlpha + CompPtr->g * TempAlpha) / Alpha);
+        CompPtr->r = (UINT8)((TopPtr->r * TopAlpha + CompPtr->r * TempAlpha) / Alpha);
+        CompPtr->a = (UINT8)(Alpha / 255);
+      }
+      TopPtr++, CompPtr++;
+    }
+    TopBasePtr += TopLineOffset;
+    CompBasePtr += CompLineOffset;
+  }
+}
+
+STATIC VOID RefRawComposeOnFlat(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                                IN INTN Width, IN INTN Height,
+                                IN INTN CompLineOffset, IN INTN TopLineOffset)
+{
+  INT64       x, y;
+  EG_PIXEL    *TopPtr, *CompPtr;
+  UINT32      TopAlpha;
+  UINT32      RevAlpha;
+  UINTN       Temp;
+
+  for (y = 0; y < Height; y++) {
+    TopPtr = TopBasePtr;
+    CompPtr = CompBasePtr;
+    for (x = 0; x < Width; x++) {
+      TopAlpha = TopPtr->a;
+      RevAlpha = 255 - TopAlpha;
+
+      Temp = ((UINT8)CompPtr->b * RevAlpha) + ((UINT8)TopPtr->b * TopAlpha);
+      CompPtr->b = (UINT8)(Temp / 255);
+
+      Temp = ((UINT8)CompPtr->g * RevAlpha) + ((UINT8)TopPtr->g * TopAlpha);
+      CompPtr->g = (UINT8)(Temp / 255);
+
+      Temp = ((UINT8)CompPtr->r * RevAlpha) + ((UINT8)TopPtr->r * TopAlpha);
+      CompPtr->r = (UINT8)(Temp / 255);
+
+      CompPtr->a = (UINT8)(255);
+
+      TopPtr++, CompPtr++;
+    }
+    TopBasePtr += TopLineOffset;
+    CompBasePtr += CompLineOffset;
+  }
+}
+
+typedef VOID (*COMPOSE_PROC)(IN OUT EG_PIXEL *CompBasePtr, IN EG_PIXEL *TopBasePtr,
+                             IN INTN Width, IN INTN Height,
+                             IN INTN CompLineOffset, IN INTN TopLineOffset);
+
+// first pixel where Comp and Ref differ, -1 if none
+STATIC INTN FirstDiff(IN EG_PIXEL *Comp, IN EG_PIXEL *Ref, IN UINTN Count)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (*(UINT32 *)&Comp[Index] != *(UINT32 *)&Ref[Index]) {
+      return (INTN)Index;
+    }
+  }
+  return -1;
+}
+
+//
+// Runs the kernel and the reference over the same Top and Comp and compares
+// the whole Comp buffer, the pixels outside the rectangle included
+//
+STATIC BOOLEAN Compare(IN CONST CHAR8 *What, IN COMPOSE_PROC Proc, IN COMPOSE_PROC Ref,
+                       IN EG_PIXEL *Top, IN EG_PIXEL *Comp, IN EG_PIXEL *Work1, IN EG_PIXEL *Work2,
+                       IN UINTN CompCount, IN INTN Width, IN INTN Height,
+                       IN INTN CompLineOffset, IN INTN TopLineOffset)
+{
+  INTN      Diff;
+  EG_PIXEL  *T, *C, *E, *G;
+
+  CopyMem(Work1, Comp, CompCount * sizeof(EG_PIXEL));
+  CopyMem(Work2, Comp, CompCount * sizeof(EG_PIXEL));
+  Proc(Work1, Top, Width, Height, CompLineOffset, TopLineOffset);
+  Ref(Work2, Top, Width, Height, CompLineOffset, TopLineOffset);
+  Diff = FirstDiff(Work1, Work2, CompCount);
+  if (Diff < 0) {
+    return TRUE;
+  }
+  C = &Comp[Diff];
+  G = &Work1[Diff];
+  E = &Work2[Diff];
+  if (Diff / CompLineOffset >= Height || Diff % CompLineOffset >= Width) {
+    Report("  FAIL %a: pixel %d outside the rectangle changed\n", What, Diff);
+    mFailed++;
+    return FALSE;
+  }
+  // the Top pixel that went to it, the rectangle starts both buffers
+  T = &Top[(Diff / CompLineOffset) * TopLineOffset + Diff % CompLineOffset];
+  Report("  FAIL %a: pixel %d, top %02x%02x%02x%02x comp %02x%02x%02x%02x gives %02x%02x%02x%02x, not %02x%02x%02x%02x\n",
+         What, Diff, T->a, T->r, T->g, T->b, C->a, C->r, C->g, C->b,
+         G->a, G->r, G->g, G->b, E->a, E->r, E->g, E->b);
+  mFailed++;
+  return FALSE;
+}
+
+STATIC VOID SetPixel(OUT EG_PIXEL *Pixel, UINT32 a, UINT32 r, UINT32 g, UINT32 b)
+{
+  Pixel->a = (UINT8)a;
+  Pixel->r = (UINT8)r;
+  Pixel->g = (UINT8)g;
+  Pixel->b = (UINT8)b;
+}
+
+//
+// Every pair of alphas with every value of one channel of Top and Comp. The
+// blue channel takes all 65536 pairs of a row; green and red, computed the
+// same way, see them in other orders. Full covers the 2^32 combinations of
+// both alphas and both blue values, else the channel values step by 17.
+//
+STATIC VOID TestCompose(IN BOOLEAN Full)
+{
+  UINTN     Step = Full ? 1 : 17;
+  UINTN     Count = (255 / Step + 1) * (255 / Step + 1);
+  EG_PIXEL  *Top = AllocatePool(Count * sizeof(EG_PIXEL));
+  EG_PIXEL  *Comp = AllocatePool(Count * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work1 = AllocatePool(Count * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work2 = AllocatePool(Count * sizeof(EG_PIXEL));
+  UINTN     TopAlpha, CompAlpha, t, c, Index;
+  BOOLEAN   Ok = TRUE;
+
+  for (TopAlpha = 0; TopAlpha < 256 && Ok; TopAlpha++) {
+    for (CompAlpha = 0; CompAlpha < 256 && Ok; CompAlpha++) {
+      Index = 0;
+      for (t = 0; t < 256; t += Step) {
+        for (c = 0; c < 256; c += Step) {
+          SetPixel(&Top[Index], TopAlpha, c, 255 - t, t);
+          SetPixel(&Comp[Index], CompAlpha, 255 - t, c ^ 0x55, c);
+          Index++;
+        }
+      }
+      Ok = Compare("egRawCompose", egRawCompose, RefRawCompose, Top, Comp, Work1, Work2,
+                   Count, Count, 1, Count, Count);
+    }
+  }
+  Report("  %a egRawCompose: all alpha pairs, channel values step %d\n", Ok ? "ok  " : "FAIL", Step);
+  FreePool(Top);
+  FreePool(Comp);
+  FreePool(Work1);
+  FreePool(Work2);
+}
+
+// every top alpha with every top and comp value, whatever the comp alpha
+STATIC VOID TestComposeOnFlat(VOID)
+{
+  EG_PIXEL  *Top = AllocatePool(65536 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Comp = AllocatePool(65536 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work1 = AllocatePool(65536 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work2 = AllocatePool(65536 * sizeof(EG_PIXEL));
+  UINTN     TopAlpha, Index;
+  BOOLEAN   Ok = TRUE;
+
+  for (TopAlpha = 0; TopAlpha < 256 && Ok; TopAlpha++) {
+    for (Index = 0; Index < 65536; Index++) {
+      SetPixel(&Top[Index], TopAlpha, Index & 0xFF, Index >> 8, Index >> 8);
+      SetPixel(&Comp[Index], Index * 7, Index >> 8, Index & 0xFF, Index >> 8);
+    }
+    Ok = Compare("egRawComposeOnFlat", egRawComposeOnFlat, RefRawComposeOnFlat, Top, Comp, Work1, Work2,
+                 65536, 65536, 1, 65536, 65536);
+  }
+  Report("  %a egRawComposeOnFlat: all top alphas and channel values\n", Ok ? "ok  " : "FAIL");
+  FreePool(Top);
+  FreePool(Comp);
+  FreePool(Work1);
+  FreePool(Work2);
+}
+
+//
+// Random images: icons placed in a larger Comp with both line offsets,
+// odd sizes and random alphas, 0 and 255 more often as in real icons
+//
+STATIC UINT8 RandomAlpha(VOID)
+{
+  UINT32 r = Random() % 4;
+
+  return (UINT8)((r == 0) ? 0 : (r == 1) ? 255 : Random());
+}
+
+STATIC VOID TestRectangles(IN UINTN Rounds)
+{
+  EG_PIXEL  *Top = AllocatePool(256 * 256 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Comp = AllocatePool(300 * 300 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work1 = AllocatePool(300 * 300 * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work2 = AllocatePool(300 * 300 * sizeof(EG_PIXEL));
+  UINTN     Round, Index;
+  INTN      Width, Height;
+  BOOLEAN   Ok = TRUE;
+
+  for (Round = 0; Round < Rounds && Ok; Round++) {
+    for (Index = 0; Index < 256 * 256; Index++) {
+      SetPixel(&Top[Index], RandomAlpha(), Random(), Random(), Random());
+    }
+    for (Index = 0; Index < 300 * 300; Index++) {
+      SetPixel(&Comp[Index], (Round & 1) ? 255 : RandomAlpha(), Random(), Random(), Random());
+    }
+    Width = 1 + Random() % 256;
+    Height = 1 + Random() % 256;
+    Ok = Compare("egRawCompose", egRawCompose, RefRawCompose, Top, Comp, Work1, Work2,
+                 300 * 300, Width, Height, 300, 256) &&
+         Compare("egRawComposeOnFlat", egRawComposeOnFlat, RefRawComposeOnFlat, Top, Comp, Work1, Work2,
+                 300 * 300, Width, Height, 300, 256);
+  }
+  Report("  %a both: %d random rectangles in a larger image\n", Ok ? "ok  " : "FAIL", Rounds);
+  FreePool(Top);
+  FreePool(Comp);
+  FreePool(Work1);
+  FreePool(Work2);
+}
+
+//
+// Throughput on a 4K screen: best of Passes, in Mpixel/s
+//
+STATIC UINT64 Bench(IN COMPOSE_PROC Proc, IN EG_PIXEL *Top, IN EG_PIXEL *Comp, IN EG_PIXEL *Work,
+                    IN UINTN Passes)
+{
+  UINTN   Pass;
+  UINT64  Start, Time, Best = MAX_UINT64;
+
+  for (Pass = 0; Pass < Passes; Pass++) {
+    CopyMem(Work, Comp, BENCH_WIDTH * BENCH_HEIGHT * sizeof(EG_PIXEL));
+    Start = eg_posix_time_ns();
+    Proc(Work, Top, BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH, BENCH_WIDTH);
+    Time = eg_posix_time_ns() - Start;
+    if (Time < Best) {
+      Best = Time;
+    }
+  }
+  return (UINT64)BENCH_WIDTH * BENCH_HEIGHT * 1000 / (Best ? Best : 1);
+}
+
+STATIC VOID Benchmark(IN UINTN Passes)
+{
+  UINTN     Count = BENCH_WIDTH * BENCH_HEIGHT;
+  EG_PIXEL  *Top = AllocatePool(Count * sizeof(EG_PIXEL));
+  EG_PIXEL  *Comp = AllocatePool(Count * sizeof(EG_PIXEL));
+  EG_PIXEL  *Work = AllocatePool(Count * sizeof(EG_PIXEL));
+  UINTN     Index, Case;
+
+  Report("Mpixel/s, %dx%d, best of %d:        new    old\n", BENCH_WIDTH, BENCH_HEIGHT, Passes);
+  for (Case = 0; Case < 3; Case++) {
+    for (Index = 0; Index < Count; Index++) {
+      SetPixel(&Top[Index], (Case == 0) ? RandomAlpha() : Random(), Random(), Random(), Random());
+      SetPixel(&Comp[Index], (Case == 2) ? Random() : 255, Random(), Random(), Random());
+    }
+    Report("  %a %6ld %6ld\n",
+           (Case == 0) ? "egRawCompose, icon over opaque  " :
+           (Case == 1) ? "egRawCompose, any over opaque   " : "egRawCompose, any over any      ",
+           Bench(egRawCompose, Top, Comp, Work, Passes), Bench(RefRawCompose, Top, Comp, Work, Passes));
+  }
+  Report("  egRawComposeOnFlat, any alpha    %6ld %6ld\n",
+         Bench(egRawComposeOnFlat, Top, Comp, Work, Passes), Bench(RefRawComposeOnFlat, Top, Comp, Work, Passes));
+  FreePool(Top);
+  FreePool(Comp);
+  FreePool(Work);
+}
+
+STATIC VOID Usage(VOID)
+{
+  eg_posix_error("usage: composetest [-x] [-n passes]\n");
+}
+
+int main(int argc, char **argv)
+{
+  int       Arg;
+  BOOLEAN   Full = FALSE;
+  UINTN     Passes = 5;
+
+  EgHostInit();
+  for (Arg = 1; Arg < argc; Arg++) {
+    if (AsciiStrCmp(argv[Arg], "-x") == 0) {
+      Full = TRUE;
+    } else if (AsciiStrCmp(argv[Arg], "-n") == 0 && Arg + 1 < argc) {
+      Passes = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (Passes == 0 || Passes > 1000) {
+    Usage();
+    return 2;
+  }
+
+  Report("same as the scalar code:\n");
+  TestCompose(Full);
+  TestComposeOnFlat();
+  TestRectangles(200);
+  Benchmark(Passes);
+  Report("%d failed\n", mFailed);
+  return mFailed ? 1 : 0;
+}
@@ -0,0 +1,400 @@
+/*
+ *  eg_host.c
+ *
+ *  Firmware side of the host builds of libeg. Boot services are reduced to
+ *  pool, events and LocateProtocol(); the only protocol there is is an
+ *  EFI_MP_SERVICES_PROTOCOL whose APs are POSIX threads, started anew by
+ *  every StartupAllAPs(). Files, decoders, fonts and the theme cache that
+ *  image.c and nanosvg.c call only get stubs to link.
+ *
+ */
+
+#include "eg_host.h"
+#include "nanosvg.h"
+#include <Protocol/MpService.h>
+#include <Library/SynchronizationLib.h>
+
+BOOLEAN                 gEgHostVerbose = FALSE;
+UINTN                   gEgHostProcessors = 1;
+BOOLEAN                 gEgHostFailStartup = FALSE;
+UINTN                   gEgHostStartups = 0;
+
+typedef struct {
+  VOID                  *Threads;   // eg_posix thread group still to join
+  BOOLEAN               Signaled;
+} HOST_EVENT;
+
+typedef struct {
+  EFI_AP_PROCEDURE      Procedure;
+  VOID                  *Argument;
+} HOST_AP_CALL;
+
+STATIC HOST_AP_CALL     mApCall;
+STATIC HOST_EVENT       *mApEvent = NULL;   // event of the APs now running
+
+EFI_GUID gEfiMpServiceProtocolGuid = { 0x3FDDA605, 0xA76E, 0x4F46, { 0xAD, 0x29, 0x12, 0xF4, 0x53, 0x1B, 0x3D, 0x08 } };
+
+//
+// Boot services
+//
+STATIC EFI_STATUS EFIAPI HostAllocatePool(EFI_MEMORY_TYPE PoolType, UINTN Size, VOID **Buffer)
+{
+  *Buffer = eg_posix_alloc(Size);
+  return (*Buffer == NULL) ? EFI_OUT_OF_RESOURCES : EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostFreePool(VOID *Buffer)
+{
+  eg_posix_free(Buffer);
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostCreateEvent(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction,
+                                         VOID *NotifyContext, EFI_EVENT *Event)
+{
+  HOST_EVENT *New;
+
+  if (Event == NULL || NotifyFunction != NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  New = eg_posix_alloc(sizeof(HOST_EVENT));
+  if (New == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  New->Threads = NULL;
+  New->Signaled = FALSE;
+  *Event = New;
+  return EFI_SUCCESS;
+}
+
+// the APs of the event are done: join them and signal it
+STATIC VOID HostFinishAps(HOST_EVENT *Event)
+{
+  eg_posix_join_threads(Event->Threads);
+  Event->Threads = NULL;
+  Event->Signaled = TRUE;
+  if (mApEvent == Event) {
+    mApEvent = NULL;
+  }
+}
+
+STATIC EFI_STATUS EFIAPI HostCheckEvent(EFI_EVENT Event)
+{
+  HOST_EVENT *Host = (HOST_EVENT *)Event;
+
+  if (Host->Threads != NULL && eg_posix_threads_done(Host->Threads)) {
+    HostFinishAps(Host);
+  }
+  if (!Host->Signaled) {
+    return EFI_NOT_READY;
+  }
+  Host->Signaled = FALSE;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostCloseEvent(EFI_EVENT Event)
+{
+  HOST_EVENT *Host = (HOST_EVENT *)Event;
+
+  // firmware lets the APs run on; a thread group must not be lost
+  if (Host->Threads != NULL) {
+    HostFinishAps(Host);
+  }
+  eg_posix_free(Host);
+  return EFI_SUCCESS;
+}
+
+STATIC VOID EFIAPI HostCopyMem(VOID *Destination, VOID *Source, UINTN Length)
+{
+  CopyMem(Destination, Source, Length);
+}
+
+STATIC VOID EFIAPI HostSetMem(VOID *Buffer, UINTN Size, UINT8 Value)
+{
+  SetMem(Buffer, Size, Value);
+}
+
+//
+// MP services
+//
+STATIC EFI_STATUS EFIAPI HostGetNumberOfProcessors(EFI_MP_SERVICES_PROTOCOL *This,
+                                                   UINTN *NumberOfProcessors, UINTN *NumberOfEnabledProcessors)
+{
+  *NumberOfProcessors = gEgHostProcessors;
+  *NumberOfEnabledProcessors = gEgHostProcessors;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostGetProcessorInfo(EFI_MP_SERVICES_PROTOCOL *This, UINTN ProcessorNumber,
+                                              EFI_PROCESSOR_INFORMATION *ProcessorInfoBuffer)
+{
+  return EFI_UNSUPPORTED;
+}
+
+STATIC VOID HostApMain(VOID *Arg)
+{
+  HOST_AP_CALL *Call = (HOST_AP_CALL *)Arg;
+
+  Call->Procedure(Call->Argument);
+}
+
+STATIC EFI_STATUS EFIAPI HostStartupAllAPs(EFI_MP_SERVICES_PROTOCOL *This, EFI_AP_PROCEDURE Procedure,
+                                           BOOLEAN SingleThread, EFI_EVENT WaitEvent, UINTN TimeoutInMicroSeconds,
+                                           VOID *ProcedureArgument, UINTN **FailedCpuList)
+{
+  VOID *Threads;
+
+  if (Procedure == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+  if (eg_posix_thread_id() != 0) {
+    return EFI_DEVICE_ERROR;    // not called on the BSP
+  }
+  if (mApEvent != NULL) {
+    return EFI_NOT_READY;
+  }
+  if (SingleThread || gEgHostProcessors < 2) {
+    return EFI_UNSUPPORTED;
+  }
+  if (gEgHostFailStartup) {
+    return EFI_NOT_STARTED;
+  }
+
+  mApCall.Procedure = Procedure;
+  mApCall.Argument = ProcedureArgument;
+  Threads = eg_posix_start_threads((unsigned long)(gEgHostProcessors - 1), HostApMain, &mApCall);
+  if (Threads == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+  gEgHostStartups++;
+  if (FailedCpuList != NULL) {
+    *FailedCpuList = NULL;
+  }
+  if (WaitEvent == NULL) {
+    eg_posix_join_threads(Threads);
+    return EFI_SUCCESS;
+  }
+  mApEvent = (HOST_EVENT *)WaitEvent;
+  mApEvent->Threads = Threads;
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_STATUS EFIAPI HostStartupThisAP(EFI_MP_SERVICES_PROTOCOL *This, EFI_AP_PROCEDURE Procedure,
+                                           UINTN ProcessorNumber, EFI_EVENT WaitEvent, UINTN TimeoutInMicroseconds,
+                                           VOID *ProcedureArgument, BOOLEAN *Finished)
+{
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS EFIAPI HostSwitchBSP(EFI_MP_SERVICES_PROTOCOL *This, UINTN ProcessorNumber, BOOLEAN EnableOldBSP)
+{
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS EFIAPI HostEnableDisableAP(EFI_MP_SERVICES_PROTOCOL *This, UINTN ProcessorNumber,
+                                             BOOLEAN EnableAP, UINT32 *HealthFlag)
+{
+  return EFI_UNSUPPORTED;
+}
+
+STATIC EFI_STATUS EFIAPI HostWhoAmI(EFI_MP_SERVICES_PROTOCOL *This, UINTN *ProcessorNumber)
+{
+  *ProcessorNumber = eg_posix_thread_id();
+  return EFI_SUCCESS;
+}
+
+STATIC EFI_MP_SERVICES_PROTOCOL mMpServices = {
+  HostGetNumberOfProcessors,
+  HostGetProcessorInfo,
+  HostStartupAllAPs,
+  HostStartupThisAP,
+  HostSwitchBSP,
+  HostEnableDisableAP,
+  HostWhoAmI
+};
+
+STATIC EFI_STATUS EFIAPI HostLocateProtocol(EFI_GUID *Protocol, VOID *Registration, VOID **Interface)
+{
+  if (CompareGuid(Protocol, &gEfiMpServiceProtocolGuid) && gEgHostProcessors > 1) {
+    *Interface = &mMpServices;
+    return EFI_SUCCESS;
+  }
+  return EFI_NOT_FOUND;
+}
+
+STATIC EFI_BOOT_SERVICES  mBootServices;
+STATIC EFI_SYSTEM_TABLE   mSystemTable;
+
+EFI_BOOT_SERVICES         *gBS = &mBootServices;
+EFI_SYSTEM_TABLE          *gST = &mSystemTable;
+
+VOID EgHostInit(VOID)
+{
+  eg_posix_thread_id();   // the caller is the BSP
+  mBootServices.AllocatePool = HostAllocatePool;
+  mBootServices.FreePool = HostFreePool;
+  mBootServices.CreateEvent = HostCreateEvent;
+  mBootServices.CheckEvent = HostCheckEvent;
+  mBootServices.CloseEvent = HostCloseEvent;
+  mBootServices.LocateProtocol = HostLocateProtocol;
+  mBootServices.CopyMem = HostCopyMem;
+  mBootServices.SetMem = HostSetMem;
+  mSystemTable.BootServices = &mBootServices;
+}
+
+//
+// Globals and functions image.c and nanosvg.c need from modules that are
+// not part of the host builds: there are no files to load, no theme and
+// no fonts
+//
+REFIT_CONFIG            GlobalConfig;
+EG_IMAGE                *BackgroundImage = NULL;
+EFI_FILE                *ThemeDir = NULL;
+MISC_ICONS              OSIconsTable[1];
+BOOLEAN                 DayLight = TRUE;
+VOID                    *fontsDB = NULL;
+textFaces               textFace[4];
+
+EFI_GUID gEfiPartTypeSystemPartGuid = { 0xC12A7328, 0xF81F, 0x11D2, { 0xBA, 0x4B, 0x00, 0xA0, 0xC9, 0x3E, 0xC9, 0x3B } };
+
+EFI_FILE_HANDLE EfiLibOpenRoot(IN EFI_HANDLE DeviceHandle)
+{
+  return NULL;
+}
+
+EFI_FILE_INFO* EfiLibFileInfo(IN EFI_FILE_HANDLE FHand)
+{
+  return NULL;
+}
+
+EG_IMAGE* egDecodePNG(IN UINT8 *FileData, IN UINTN FileDataLength, IN BOOLEAN WantAlpha)
+{
+  return NULL;
+}
+
+EG_IMAGE* egDecodeICNS(IN UINT8 *FileData, IN UINTN FileDataLength, IN UINTN IconSize, IN BOOLEAN WantAlpha)
+{
+  return NULL;
+}
+
+UINT32 hex2bin(IN CHAR8 *hex, OUT UINT8 *bin, UINT32 len)
+{
+  return 0;
+}
+
+BOOLEAN IsHexDigit(CHAR8 c)
+{
+  return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+// ASCII only
+CHAR8* GetUnicodeChar(CHAR8 *s, CHAR16* UnicodeChar)
+{
+  *UnicodeChar = (UINT8)*s;
+  return s + 1;
+}
+
+UINT32 egThemeCacheCrc(IN CONST VOID *Data, IN UINTN Size)
+{
+  return 0;
+}
+
+BOOLEAN egThemeCacheIsActive(VOID)
+{
+  return FALSE;
+}
+
+EG_IMAGE* egThemeCacheFind(IN EG_CACHE_KEY *Key)
+{
+  return NULL;
+}
+
+VOID egThemeCacheAdd(IN EG_CACHE_KEY *Key, IN EG_IMAGE *Image)
+{
+}
+
+//
+// MemoryAllocationLib
+//
+VOID* EFIAPI AllocatePool(IN UINTN AllocationSize)
+{
+  return eg_posix_alloc(AllocationSize);
+}
+
+VOID* EFIAPI AllocateZeroPool(IN UINTN AllocationSize)
+{
+  VOID *Buffer = eg_posix_alloc(AllocationSize);
+  if (Buffer != NULL) {
+    ZeroMem(Buffer, AllocationSize);
+  }
+  return Buffer;
+}
+
+VOID* EFIAPI AllocateCopyPool(IN UINTN AllocationSize, IN CONST VOID *Buffer)
+{
+  VOID *Copy = eg_posix_alloc(AllocationSize);
+  if (Copy != NULL) {
+    CopyMem(Copy, Buffer, AllocationSize);
+  }
+  return Copy;
+}
+
+VOID* EFIAPI ReallocatePool(IN UINTN OldSize, IN UINTN NewSize, IN VOID *OldBuffer OPTIONAL)
+{
+  return eg_posix_realloc(OldBuffer, NewSize);
+}
+
+VOID EFIAPI FreePool(IN VOID *Buffer)
+{
+  eg_posix_free(Buffer);
+}
+
+CHAR16* EFIAPI PoolPrint(IN CHAR16 *fmt, ...)
+{
+  CHAR16  *Buffer;
+  VA_LIST Marker;
+
+  Buffer = AllocatePool(1024 * sizeof(CHAR16));
+  if (Buffer != NULL) {
+    VA_START(Marker, fmt);
+    UnicodeVSPrint(Buffer, 1024 * sizeof(CHAR16), fmt, Marker);
+    VA_END(Marker);
+  }
+  return Buffer;
+}
+
+//
+// SynchronizationLib, on the lock prefixed instructions of BaseSynchronizationLib
+// (X64/GccInline.c); the spin locks are left out
+//
+UINT32 EFIAPI InternalSyncIncrement(IN volatile UINT32 *Value);
+UINT32 EFIAPI InternalSyncCompareExchange32(IN OUT volatile UINT32 *Value, IN UINT32 CompareValue,
+                                            IN UINT32 ExchangeValue);
+
+UINT32 EFIAPI InterlockedIncrement(IN volatile UINT32 *Value)
+{
+  return InternalSyncIncrement(Value);
+}
+
+UINT32 EFIAPI InterlockedCompareExchange32(IN OUT volatile UINT32 *Value, IN UINT32 CompareValue,
+                                           IN UINT32 ExchangeValue)
+{
+  return InternalSyncCompareExchange32(Value, CompareValue, ExchangeValue);
+}
+
+//
+// Log
+//
+VOID EFIAPI DebugLog(IN INTN DebugMode, IN CONST CHAR8 *FormatString, ...)
+{
+  CHAR8   Buffer[4096];
+  VA_LIST Marker;
+
+  if (!gEgHostVerbose || DebugMode == 0 || FormatString == NULL) {
+    return;
+  }
+  VA_START(Marker, FormatString);
+  AsciiVSPrint(Buffer, sizeof(Buffer), FormatString, Marker);
+  VA_END(Marker);
+  eg_posix_print(Buffer);
+}
@@ -0,0 +1,30 @@
+/*
+ *  eg_host.h
+ *
+ *  Firmware side of the host builds of libeg: the boot services, the MP
+ *  services and library functions the libeg sources expect.
+ *
+ */
+
+#ifndef _EG_HOST_H
+#define _EG_HOST_H
+
+#include "libegint.h"
+#include "eg_posix.h"
+
+// DebugLog() output goes to stdout only when set
+extern BOOLEAN  gEgHostVerbose;
+
+// processors the MP services report, the BSP included; 1 leaves them out
+extern UINTN    gEgHostProcessors;
+
+// StartupAllAPs() fails while set, as on firmware with busy or broken APs
+extern BOOLEAN  gEgHostFailStartup;
+
+// calls of StartupAllAPs() that started the APs
+extern UINTN    gEgHostStartups;
+
+VOID
+EgHostInit (VOID);
+
+#endif /* !_EG_HOST_H */
@@ -0,0 +1,160 @@
+/*
+ *  eg_posix.c
+ *
+ *  POSIX side of the host builds of libeg: memory, files, console, clock
+ *  and the threads that stand in for the application processors.
+ *
+ */
+
+#include "eg_posix.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct {
+  pthread_t       *threads;
+  unsigned long   count;
+  void            (*proc)(void *arg);
+  void            *arg;
+  unsigned long   running;
+} thread_group;
+
+static unsigned long  next_thread_id = 0;
+static __thread long  thread_id = -1;
+
+void *eg_posix_alloc(unsigned long long size)
+{
+  return malloc(size ? (size_t)size : 1);
+}
+
+void *eg_posix_realloc(void *buffer, unsigned long long size)
+{
+  return realloc(buffer, size ? (size_t)size : 1);
+}
+
+void eg_posix_free(void *buffer)
+{
+  free(buffer);
+}
+
+void eg_posix_print(const char *text)
+{
+  fputs(text, stdout);
+}
+
+void eg_posix_error(const char *text)
+{
+  fflush(stdout);
+  fputs(text, stderr);
+}
+
+void *eg_posix_load(const char *path, unsigned long long *size)
+{
+  FILE  *f;
+  long  len;
+  char  *data;
+
+  f = fopen(path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return NULL;
+  }
+  data = malloc((size_t)len + 1);
+  if (data != NULL && fread(data, 1, (size_t)len, f) != (size_t)len) {
+    free(data);
+    data = NULL;
+  }
+  fclose(f);
+  if (data != NULL) {
+    data[len] = 0;
+    *size = (unsigned long long)len;
+  }
+  return data;
+}
+
+unsigned long long eg_posix_time_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+unsigned long eg_posix_processors(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (unsigned long)n : 1;
+}
+
+unsigned long eg_posix_thread_id(void)
+{
+  if (thread_id < 0) {
+    thread_id = (long)__atomic_fetch_add(&next_thread_id, 1, __ATOMIC_SEQ_CST);
+  }
+  return (unsigned long)thread_id;
+}
+
+static void *thread_main(void *arg)
+{
+  thread_group *group = arg;
+
+  eg_posix_thread_id();
+  group->proc(group->arg);
+  __atomic_fetch_sub(&group->running, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+void *eg_posix_start_threads(unsigned long count, void (*proc)(void *arg), void *arg)
+{
+  thread_group  *group;
+  unsigned long i;
+
+  eg_posix_thread_id();
+  group = calloc(1, sizeof(*group));
+  if (group == NULL) {
+    return NULL;
+  }
+  group->threads = calloc(count ? count : 1, sizeof(pthread_t));
+  if (group->threads == NULL) {
+    free(group);
+    return NULL;
+  }
+  group->proc = proc;
+  group->arg = arg;
+  group->running = count;
+  for (i = 0; i < count; i++) {
+    if (pthread_create(&group->threads[i], NULL, thread_main, group) != 0) {
+      // the ones already started still run, wait for them
+      __atomic_fetch_sub(&group->running, count - i, __ATOMIC_RELEASE);
+      group->count = i;
+      eg_posix_join_threads(group);
+      return NULL;
+    }
+    group->count = i + 1;
+  }
+  return group;
+}
+
+int eg_posix_threads_done(void *group)
+{
+  return __atomic_load_n(&((thread_group *)group)->running, __ATOMIC_ACQUIRE) == 0;
+}
+
+void eg_posix_join_threads(void *group)
+{
+  thread_group  *g = group;
+  unsigned long i;
+
+  for (i = 0; i < g->count; i++) {
+    pthread_join(g->threads[i], NULL);
+  }
+  free(g->threads);
+  free(g);
+}
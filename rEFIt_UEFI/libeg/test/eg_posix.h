@@ -0,0 +1,37 @@
+/*
+ *  eg_posix.h
+ *
+ *  POSIX side of the host builds of libeg. Only plain C types cross this
+ *  interface, so it can be included next to the EDK2 headers without
+ *  pulling the C library headers into the firmware sources.
+ *
+ */
+
+#ifndef _EG_POSIX_H
+#define _EG_POSIX_H
+
+void*               eg_posix_alloc(unsigned long long size);
+void*               eg_posix_realloc(void *buffer, unsigned long long size);
+void                eg_posix_free(void *buffer);
+
+void                eg_posix_print(const char *text);
+void                eg_posix_error(const char *text);
+
+// the whole file and a zero after it in a new eg_posix_alloc() buffer, NULL on failure
+void*               eg_posix_load(const char *path, unsigned long long *size);
+
+unsigned long long  eg_posix_time_ns(void);
+
+// online processors of the host
+unsigned long       eg_posix_processors(void);
+
+// a small number for the calling thread, 0 for the one that ran main()
+unsigned long       eg_posix_thread_id(void);
+
+// starts count threads calling proc(arg); NULL if not all of them started
+void*               eg_posix_start_threads(unsigned long count, void (*proc)(void *arg), void *arg);
+// nonzero once all threads returned; eg_posix_join_threads() frees the group
+int                 eg_posix_threads_done(void *group);
+void                eg_posix_join_threads(void *group);
+
+#endif /* !_EG_POSIX_H */
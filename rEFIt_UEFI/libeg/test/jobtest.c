@@ -0,0 +1,285 @@
+/*
+ *  jobtest.c
+ *
+ *  Host test of the job scheduler of jobs.c: egRunJobs() with and without
+ *  MP services and the scratch arena, with POSIX threads standing in for
+ *  the application processors, see README.
+ *
+ */
+
+#include "eg_host.h"
+#include <Library/SynchronizationLib.h>
+
+#define JOBS          1000
+#define SCRATCH_SIZE  (256 * 1024)
+
+typedef struct {
+  volatile UINT32 Runs;
+  UINTN           Thread;
+  UINT32          Work;       // iterations of busy work
+  UINT32          Result;
+  UINT8           *Block;     // from the scratch arena
+  UINT32          BlockSize;
+} TEST_JOB;
+
+STATIC TEST_JOB   mJobs[JOBS];
+STATIC UINTN      mFailed = 0;
+
+STATIC VOID Report(IN CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[512];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  eg_posix_print(Buffer);
+}
+
+STATIC VOID Check(IN BOOLEAN Ok, IN CONST CHAR8 *What)
+{
+  Report("  %a %a\n", Ok ? "ok  " : "FAIL", What);
+  if (!Ok) {
+    mFailed++;
+  }
+}
+
+STATIC UINT32 BusyWork(UINT32 Seed, UINT32 Count)
+{
+  while (Count-- > 0) {
+    Seed = Seed * 1664525 + 1013904223;
+    Seed ^= Seed >> 13;
+  }
+  return Seed;
+}
+
+STATIC VOID EFIAPI CountJob(IN OUT VOID *Job)
+{
+  TEST_JOB *Test = (TEST_JOB *)Job;
+
+  InterlockedIncrement(&Test->Runs);
+  Test->Thread = eg_posix_thread_id();
+  Test->Result = BusyWork((UINT32)(UINTN)Job, Test->Work);
+}
+
+// fills a scratch block with the index of the job, grown once in place if it can
+STATIC VOID EFIAPI ScratchJob(IN OUT VOID *Job)
+{
+  TEST_JOB  *Test = (TEST_JOB *)Job;
+  UINT8     Mark = (UINT8)(Test - mJobs);
+  UINT8     *Block;
+
+  InterlockedIncrement(&Test->Runs);
+  Test->Thread = eg_posix_thread_id();
+  Block = egScratchAlloc(Test->BlockSize / 2);
+  if (Block != NULL) {
+    Block = egScratchRealloc(Block, Test->BlockSize / 2, Test->BlockSize);
+  }
+  Test->Block = Block;
+  if (Block != NULL) {
+    SetMem(Block, Test->BlockSize, Mark);
+  }
+}
+
+STATIC VOID ResetJobs(UINT32 Work)
+{
+  UINTN Index;
+
+  ZeroMem(mJobs, sizeof(mJobs));
+  for (Index = 0; Index < JOBS; Index++) {
+    mJobs[Index].Work = Work;
+    mJobs[Index].BlockSize = 16 + (UINT32)(Index * 37 % 700);
+  }
+}
+
+STATIC BOOLEAN AllRanOnce(UINTN Count)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < Count; Index++) {
+    if (mJobs[Index].Runs != 1) {
+      return FALSE;
+    }
+  }
+  for (; Index < JOBS; Index++) {
+    if (mJobs[Index].Runs != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// number of different threads that ran the jobs
+STATIC UINTN ThreadsUsed(VOID)
+{
+  UINT8 Seen[256];
+  UINTN Index, Count = 0;
+
+  ZeroMem(Seen, sizeof(Seen));
+  for (Index = 0; Index < JOBS; Index++) {
+    if (mJobs[Index].Runs != 0 && !Seen[mJobs[Index].Thread & 0xFF]) {
+      Seen[mJobs[Index].Thread & 0xFF] = 1;
+      Count++;
+    }
+  }
+  return Count;
+}
+
+STATIC BOOLEAN OnlyOnBsp(VOID)
+{
+  UINTN Index;
+
+  for (Index = 0; Index < JOBS; Index++) {
+    if (mJobs[Index].Runs != 0 && mJobs[Index].Thread != 0) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+STATIC VOID TestRunJobs(UINTN Processors)
+{
+  UINTN Startups;
+
+  Report("egRunJobs:\n");
+  Check(egJobProcessors() == Processors, "egJobProcessors() gives the enabled processors");
+
+  ResetJobs(2000);
+  Startups = gEgHostStartups;
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), JOBS);
+  Check(AllRanOnce(JOBS), "every job runs once");
+  if (Processors > 1) {
+    Check(gEgHostStartups == Startups + 1, "the APs are started once");
+    Report("       %d jobs on %d of %d processors\n", JOBS, ThreadsUsed(), Processors);
+  } else {
+    Check(gEgHostStartups == Startups && OnlyOnBsp(), "without MP services all jobs run on the BSP");
+  }
+
+  ResetJobs(10);
+  Startups = gEgHostStartups;
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), 1);
+  Check(AllRanOnce(1) && OnlyOnBsp() && gEgHostStartups == Startups, "a single job runs on the BSP");
+
+  ResetJobs(10);
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), 0);
+  egRunJobs(NULL, mJobs, sizeof(TEST_JOB), JOBS);
+  egRunJobs(CountJob, NULL, sizeof(TEST_JOB), JOBS);
+  Check(AllRanOnce(0) && gEgHostStartups == Startups, "no jobs, no procedure or no job array do nothing");
+
+  ResetJobs(100);
+  gEgHostFailStartup = TRUE;
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), JOBS);
+  gEgHostFailStartup = FALSE;
+  Check(AllRanOnce(JOBS) && OnlyOnBsp(), "if StartupAllAPs() fails all jobs run on the BSP");
+
+  ResetJobs(100);
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), JOBS);
+  egRunJobs(CountJob, mJobs + JOBS / 2, sizeof(TEST_JOB), JOBS / 2);
+  Check(AllRanOnce(JOBS / 2) == FALSE && mJobs[0].Runs == 1 && mJobs[JOBS - 1].Runs == 2,
+        "a second run right after the first starts the APs again");
+}
+
+STATIC VOID TestScratch(VOID)
+{
+  UINTN   Index, Offset, Count = 0, Used = 0;
+  BOOLEAN Ok = TRUE, Inside = TRUE, Aligned = TRUE;
+  UINT8   *Block;
+
+  Report("scratch arena:\n");
+  Check(egScratchBegin(SCRATCH_SIZE) && !egScratchBegin(SCRATCH_SIZE), "one arena at a time");
+
+  ResetJobs(0);
+  egRunJobs(ScratchJob, mJobs, sizeof(TEST_JOB), JOBS);
+  for (Index = 0; Index < JOBS; Index++) {
+    Block = mJobs[Index].Block;
+    if (Block == NULL) {
+      continue;
+    }
+    Count++;
+    Used += mJobs[Index].BlockSize;
+    Inside = Inside && egScratchOwns(Block) && egScratchOwns(Block + mJobs[Index].BlockSize - 1);
+    Aligned = Aligned && ((UINTN)Block & 15) == 0;
+    for (Offset = 0; Offset < mJobs[Index].BlockSize; Offset++) {
+      if (Block[Offset] != (UINT8)Index) {
+        Ok = FALSE;
+        break;
+      }
+    }
+  }
+  Check(AllRanOnce(JOBS), "every job runs once");
+  Check(Inside && Aligned, "blocks are in the arena and 16 byte aligned");
+  Check(Ok, "blocks of different jobs do not overlap");
+  Check(Count > 0 && Count < JOBS && Used <= SCRATCH_SIZE, "an exhausted arena gives NULL");
+  Report("       %d of %d blocks, %d of %d bytes\n", Count, JOBS, Used, SCRATCH_SIZE);
+
+  egScratchEnd();
+  Check(!egScratchIsActive() && !egScratchOwns(mJobs[0].Block), "egScratchEnd() releases the arena");
+
+  egScratchBegin(SCRATCH_SIZE);
+  Block = egScratchAlloc(100);
+  Check(egScratchRealloc(Block, 100, 1000) == Block, "the last block grows in place");
+  egScratchAlloc(10);
+  Check(egScratchRealloc(Block, 1000, 2000) != Block, "an earlier block is moved");
+  Check(egScratchRealloc(Block, 1000, 500) == Block, "shrinking keeps the block");
+  Check(egScratchAlloc(SCRATCH_SIZE) == NULL, "a block larger than the rest gives NULL");
+  egScratchEnd();
+}
+
+STATIC VOID TimeJobs(UINTN Processors)
+{
+  UINT64  Start, Serial, Parallel;
+
+  ResetJobs(200000);
+  gEgHostFailStartup = TRUE;
+  Start = eg_posix_time_ns();
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), JOBS);
+  Serial = eg_posix_time_ns() - Start;
+  gEgHostFailStartup = FALSE;
+
+  ResetJobs(200000);
+  Start = eg_posix_time_ns();
+  egRunJobs(CountJob, mJobs, sizeof(TEST_JOB), JOBS);
+  Parallel = eg_posix_time_ns() - Start;
+
+  if (Processors > 1) {
+    Report("time: %d jobs on the BSP %ld us, on %d processors %ld us\n",
+           JOBS, Serial / 1000, Processors, Parallel / 1000);
+  } else {
+    Report("time: %d jobs on the BSP %ld us\n", JOBS, Parallel / 1000);
+  }
+}
+
+STATIC VOID Usage(VOID)
+{
+  eg_posix_error("usage: jobtest [-v] [-p processors]\n");
+}
+
+int main(int argc, char **argv)
+{
+  int   Arg;
+  UINTN Processors;
+
+  EgHostInit();
+  Processors = eg_posix_processors();
+  for (Arg = 1; Arg < argc; Arg++) {
+    if (AsciiStrCmp(argv[Arg], "-v") == 0) {
+      gEgHostVerbose = TRUE;
+    } else if (AsciiStrCmp(argv[Arg], "-p") == 0 && Arg + 1 < argc) {
+      Processors = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (Processors == 0 || Processors > 255) {
+    Usage();
+    return 2;
+  }
+  gEgHostProcessors = Processors;
+
+  TestRunJobs(Processors);
+  TestScratch();
+  TimeJobs(Processors);
+  Report("%d failed\n", mFailed);
+  return mFailed ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+/*
+ *  svgref.c
+ *
+ *  The nanosvg rasterizer before the coverage accumulation buffer and the
+ *  radix sort of edges, as reference for svgtest. ref_nanosvgrast.c is
+ *  that version of nanosvgrast.c, taken from git into this folder (see
+ *  README); its global functions are renamed so it links next to the
+ *  current one.
+ *
+ */
+
+#define nsvgCreateRasterizer      refCreateRasterizer
+#define nsvgDeleteRasterizer      refDeleteRasterizer
+#define nsvgRasterize             refRasterize
+#define nsvg__rasterizeClipPaths  ref__rasterizeClipPaths
+#define nsvg_qsort                ref_qsort
+#define qsort                     ref_qsortEdges
+#define DumpFloat                 refDumpFloat
+
+#include "ref_nanosvgrast.c"
@@ -0,0 +1,283 @@
+/*
+ *  svgtest.c
+ *
+ *  Host benchmark of the nanosvg rasterizer against the version before the
+ *  coverage accumulation buffer (svgref.c): both rasterize the same SVG
+ *  images, the pixels are compared and the times reported, see README.
+ *
+ */
+
+#include "eg_host.h"
+#include "nanosvg.h"
+
+#define MAX_PASSES  1000
+#define MAX_SVG     (512 * 1024)     // below PcdMaximumAsciiStringLength
+
+// svgref.c
+NSVGrasterizer* refCreateRasterizer(VOID);
+void refRasterize(NSVGrasterizer* r, NSVGimage* image, float tx, float ty, float scalex, float scaley,
+                  unsigned char* dst, int w, int h, int stride);
+void refDeleteRasterizer(NSVGrasterizer* r);
+
+typedef struct {
+  UINTN   Bytes;      // color bytes that differ
+  UINTN   Pixels;
+  UINTN   MaxDiff;
+} PIXEL_DIFF;
+
+STATIC UINTN    mFailed = 0;
+STATIC UINT32   mSeed = 1;
+STATIC CHAR8    *mSvg = NULL;
+STATIC UINTN    mSvgLen = 0;
+
+STATIC VOID Report(IN CONST CHAR8 *Format, ...)
+{
+  CHAR8   Buffer[512];
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  AsciiVSPrint(Buffer, sizeof(Buffer), Format, Marker);
+  VA_END(Marker);
+  eg_posix_print(Buffer);
+}
+
+STATIC UINT32 Random(UINT32 Range)
+{
+  mSeed = mSeed * 1103515245 + 12345;
+  return (mSeed >> 8) % Range;
+}
+
+STATIC VOID Append(IN CONST CHAR8 *Format, ...)
+{
+  VA_LIST Marker;
+
+  VA_START(Marker, Format);
+  mSvgLen += AsciiVSPrint(mSvg + mSvgLen, MAX_SVG - mSvgLen, Format, Marker);
+  VA_END(Marker);
+}
+
+STATIC VOID AppendColor(VOID)
+{
+  Append("#%02x%02x%02x", Random(256), Random(256), Random(256));
+}
+
+//
+// A random scene of Width x Height: polygons and curves, filled nonzero
+// or even-odd, stroked with every join and cap, solid or with linear and
+// radial gradients, mostly translucent
+//
+STATIC VOID MakeScene(UINTN Shapes, UINTN Width, UINTN Height)
+{
+  STATIC CONST CHAR8 *Joins[] = { "miter", "round", "bevel" };
+  STATIC CONST CHAR8 *Caps[] = { "butt", "round", "square" };
+  UINTN   Index, Point, Points, Kind;
+  UINT32  x, y, Size;
+
+  mSvgLen = 0;
+  Append("<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+         Width, Height, Width, Height);
+  Append("<defs>\n");
+  for (Index = 0; Index < 8; Index++) {
+    if (Index < 4) {
+      Append("<linearGradient id=\"g%d\" x1=\"%d%%\" y1=\"%d%%\" x2=\"%d%%\" y2=\"%d%%\">",
+             Index, Random(100), Random(100), Random(100), Random(100));
+    } else {
+      Append("<radialGradient id=\"g%d\" cx=\"%d%%\" cy=\"%d%%\" r=\"%d%%\">",
+             Index, Random(100), Random(100), 10 + Random(90));
+    }
+    for (Point = 0; Point < 3; Point++) {
+      Append("<stop offset=\"%d%%\" stop-color=\"", Point * 50);
+      AppendColor();
+      Append("\" stop-opacity=\"0.%d\"/>", 3 + Random(7));
+    }
+    Append(Index < 4 ? "</linearGradient>\n" : "</radialGradient>\n");
+  }
+  Append("</defs>\n");
+
+  for (Index = 0; Index < Shapes; Index++) {
+    Size = 20 + Random((UINT32)Height / 2);
+    x = Random((UINT32)Width);
+    y = Random((UINT32)Height);
+    Points = 3 + Random(10);
+    Append("<path d=\"M%d.%02d %d.%02d", x, Random(100), y, Random(100));
+    for (Point = 1; Point < Points; Point++) {
+      if (Random(3) == 0) {
+        Append(" C%d %d %d %d %d %d", x + Random(Size) - Size / 2, y + Random(Size) - Size / 2,
+               x + Random(Size) - Size / 2, y + Random(Size) - Size / 2,
+               x + Random(Size) - Size / 2, y + Random(Size) - Size / 2);
+      } else {
+        Append(" L%d.%02d %d.%02d", x + Random(Size) - Size / 2, Random(100), y + Random(Size) - Size / 2, Random(100));
+      }
+    }
+    Append(" Z\"");
+    Kind = Random(4);
+    if (Kind == 0) {
+      Append(" fill=\"none\" stroke=\"");
+      AppendColor();
+      Append("\" stroke-width=\"%d.%d\" stroke-linejoin=\"%a\" stroke-linecap=\"%a\"",
+             1 + Random(20), Random(10), Joins[Random(3)], Caps[Random(3)]);
+    } else if (Kind == 1) {
+      Append(" fill=\"url(#g%d)\"", Random(8));
+    } else {
+      Append(" fill=\"");
+      AppendColor();
+      Append("\"");
+    }
+    if (Random(2) == 0) {
+      Append(" fill-rule=\"evenodd\"");
+    }
+    if (Random(3) != 0) {
+      Append(" opacity=\"0.%d\"", 2 + Random(8));
+    }
+    Append("/>\n");
+  }
+  Append("</svg>\n");
+}
+
+STATIC VOID CompareImages(IN UINT8 *New, IN UINT8 *Ref, IN UINTN Pixels, OUT PIXEL_DIFF *Diff)
+{
+  UINTN Index, Byte, Delta;
+  BOOLEAN Differs;
+
+  ZeroMem(Diff, sizeof(*Diff));
+  for (Index = 0; Index < Pixels; Index++) {
+    Differs = FALSE;
+    for (Byte = 0; Byte < 4; Byte++) {
+      Delta = (New[Index * 4 + Byte] > Ref[Index * 4 + Byte]) ? New[Index * 4 + Byte] - Ref[Index * 4 + Byte] :
+                                                                Ref[Index * 4 + Byte] - New[Index * 4 + Byte];
+      if (Delta != 0) {
+        Diff->Bytes++;
+        Differs = TRUE;
+        if (Delta > Diff->MaxDiff) {
+          Diff->MaxDiff = Delta;
+        }
+      }
+    }
+    if (Differs) {
+      Diff->Pixels++;
+    }
+  }
+}
+
+//
+// Rasterizes Svg, scaled to fit Width x Height, with both rasterizers and
+// compares; Passes more runs of each are timed
+//
+STATIC VOID RunScene(IN CONST CHAR8 *Name, IN CHAR8 *Svg, IN UINTN Width, IN UINTN Height, IN UINTN Passes)
+{
+  NSVGparser      *Parser;
+  NSVGrasterizer  *Rast, *RefRast;
+  UINT8           *New, *Ref;
+  UINTN           Pass;
+  UINT64          Start, Time, NewTime = MAX_UINT64, RefTime = MAX_UINT64;
+  float           Scale, ScaleY;
+  PIXEL_DIFF      Diff;
+
+  Parser = nsvgParse(Svg, 72, 1.0f);
+  if (Parser == NULL || Parser->image == NULL || Parser->image->shapes == NULL) {
+    Report("  FAIL %a: not parsed\n", Name);
+    mFailed++;
+    return;
+  }
+  Scale = (Parser->viewWidth > 0) ? (float)Width / Parser->viewWidth : 1.0f;
+  ScaleY = (Parser->viewHeight > 0) ? (float)Height / Parser->viewHeight : 1.0f;
+  if (ScaleY < Scale) {
+    Scale = ScaleY;
+  }
+
+  New = AllocateZeroPool(Width * Height * 4);
+  Ref = AllocateZeroPool(Width * Height * 4);
+  Rast = nsvgCreateRasterizer();
+  RefRast = refCreateRasterizer();
+  for (Pass = 0; Pass <= Passes; Pass++) {
+    ZeroMem(New, Width * Height * 4);
+    Start = eg_posix_time_ns();
+    nsvgRasterize(Rast, Parser->image, 0, 0, Scale, Scale, New, (int)Width, (int)Height, (int)Width * 4);
+    Time = eg_posix_time_ns() - Start;
+    if (Pass > 0 && Time < NewTime) {
+      NewTime = Time;
+    }
+    ZeroMem(Ref, Width * Height * 4);
+    Start = eg_posix_time_ns();
+    refRasterize(RefRast, Parser->image, 0, 0, Scale, Scale, Ref, (int)Width, (int)Height, (int)Width * 4);
+    Time = eg_posix_time_ns() - Start;
+    if (Pass > 0 && Time < RefTime) {
+      RefTime = Time;
+    }
+  }
+
+  CompareImages(New, Ref, Width * Height, &Diff);
+  Report("  %a %-34a %7ld %7ld   %d bytes in %d pixels, max %d\n",
+         Diff.MaxDiff <= 1 ? "ok  " : "FAIL", Name, NewTime / 1000, RefTime / 1000,
+         Diff.Bytes, Diff.Pixels, Diff.MaxDiff);
+  if (Diff.MaxDiff > 1) {
+    mFailed++;
+  }
+
+  nsvgDeleteRasterizer(Rast);
+  refDeleteRasterizer(RefRast);
+  FreePool(New);
+  FreePool(Ref);
+  // not nsvg__deleteParser(): it frees the <g> chains of every attribute
+  // slot and those share their tails, so themes with nested groups would
+  // be freed twice; the parser itself is left to the process exit
+  nsvgDelete(Parser->image);
+}
+
+STATIC VOID Usage(VOID)
+{
+  eg_posix_error("usage: svgtest [-n passes] [-r scenes] [-s width height] [file.svg ...]\n");
+}
+
+int main(int argc, char **argv)
+{
+  UINTN     Passes = 3;
+  UINTN     Scenes = 10;
+  UINTN     Width = 1920, Height = 1080;
+  UINTN     Index;
+  int       Arg;
+  CHAR8     Name[64];
+  CHAR8     *File;
+  unsigned long long  Size;
+
+  EgHostInit();
+  for (Arg = 1; Arg < argc && argv[Arg][0] == '-'; Arg++) {
+    if (AsciiStrCmp(argv[Arg], "-n") == 0 && Arg + 1 < argc) {
+      Passes = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else if (AsciiStrCmp(argv[Arg], "-r") == 0 && Arg + 1 < argc) {
+      Scenes = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else if (AsciiStrCmp(argv[Arg], "-s") == 0 && Arg + 2 < argc) {
+      Width = AsciiStrDecimalToUintn(argv[++Arg]);
+      Height = AsciiStrDecimalToUintn(argv[++Arg]);
+    } else {
+      Usage();
+      return 2;
+    }
+  }
+  if (Passes == 0 || Passes > MAX_PASSES || Width == 0 || Height == 0 || Width > 8192 || Height > 8192) {
+    Usage();
+    return 2;
+  }
+
+  mSvg = AllocatePool(MAX_SVG);
+  Report("%dx%d, us best of %d:                       new     old   differences\n", Width, Height, Passes);
+  for (Index = 0; Index < Scenes; Index++) {
+    mSeed = (UINT32)Index + 1;
+    MakeScene((Index & 1) ? 300 : 20, Width, Height);
+    AsciiSPrint(Name, sizeof(Name), "random %d, %d shapes", Index + 1, (Index & 1) ? 300 : 20);
+    RunScene(Name, mSvg, Width, Height, Passes);
+  }
+  for (; Arg < argc; Arg++) {
+    File = eg_posix_load(argv[Arg], &Size);
+    if (File == NULL) {
+      Report("  FAIL %a: cannot read\n", argv[Arg]);
+      mFailed++;
+      continue;
+    }
+    RunScene(argv[Arg], File, Width, Height, Passes);
+    eg_posix_free(File);
+  }
+  FreePool(mSvg);
+  Report("%d failed\n", mFailed);
+  return mFailed ? 1 : 0;
+}
@@ -63,6 +63,28 @@ VOID *fontsDB = NULL;
 
 CONST EG_PIXEL SemiWhitePixel = {255, 255, 255, 210}; //semitransparent
 
+// empty columns at the right of every glyph, see PrepareGlyphMetrics()
+STATIC INTN     GlyphRightSpace[256];
+STATIC EG_IMAGE *GlyphMetricsFont = NULL;
+
+// rendered text runs, see egFindTextRun()
+#define TEXT_RUN_CACHE_SIZE   64
+#define TEXT_RUN_CACHE_PIXELS (2 * 1024 * 1024)
+
+typedef struct {
+  CHAR16           *Text;
+  EG_TEXT_RUN_KEY  Key;
+  EG_IMAGE         *Image;
+  INTN             DrawX;
+  INTN             TextWidth;
+  UINTN            LastUse;
+} EG_TEXT_RUN;
+
+STATIC EG_TEXT_RUN TextRuns[TEXT_RUN_CACHE_SIZE];
+STATIC UINTN       TextRunsCount = 0;
+STATIC UINTN       TextRunsPixels = 0;
+STATIC UINTN       TextRunsClock = 0;
+
 //
 // Text rendering
 //
@@ -173,6 +195,7 @@ VOID PrepareFont()
     egFreeImage(FontImage);
     FontImage = NULL;
   }
+  egFreeTextRuns();
 
   if (gLanguage == korean) {
     FontImage = egLoadFontImage(FALSE, 10, 28);
@@ -246,6 +269,112 @@ INTN GetEmpty(EG_PIXEL *Ptr, EG_PIXEL *FirstPixel, INTN MaxWidth, INTN Step, INT
   return m;
 }
 
+//
+// GetEmpty() over a glyph cell depends on the font only, so it is done once
+// per font for the whole 16x16 matrix instead of for every drawn character
+//
+STATIC VOID PrepareGlyphMetrics(VOID)
+{
+  INTN c;
+
+  for (c = 0; c < 256; c++) {
+    GlyphRightSpace[c] = GetEmpty(FontImage->PixelData + c * FontWidth, FontImage->PixelData,
+                                  FontWidth, 1, FontImage->Width);
+  }
+  GlyphMetricsFont = FontImage;
+}
+
+//
+// Cache of text lines as they were put on the screen. The caller describes
+// everything its result depends on besides the text in EG_TEXT_RUN_KEY;
+// egFreeTextRuns() must be called when the font or the background changes.
+//
+
+VOID egFreeTextRuns(VOID)
+{
+  UINTN Index;
+
+  GlyphMetricsFont = NULL;
+  for (Index = 0; Index < TextRunsCount; Index++) {
+    FreePool(TextRuns[Index].Text);
+    egFreeImage(TextRuns[Index].Image);
+  }
+  TextRunsCount = 0;
+  TextRunsPixels = 0;
+}
+
+STATIC VOID FreeTextRun(IN UINTN Index)
+{
+  TextRunsPixels -= TextRuns[Index].Image->Width * TextRuns[Index].Image->Height;
+  FreePool(TextRuns[Index].Text);
+  egFreeImage(TextRuns[Index].Image);
+  TextRuns[Index] = TextRuns[--TextRunsCount];
+}
+
+EG_IMAGE *egFindTextRun(IN CHAR16 *Text, IN EG_TEXT_RUN_KEY *Key, OUT INTN *DrawX, OUT INTN *TextWidth)
+{
+  UINTN Index;
+
+  if (!Text || !Key) {
+    return NULL;
+  }
+  for (Index = 0; Index < TextRunsCount; Index++) {
+    if (CompareMem(&TextRuns[Index].Key, Key, sizeof(EG_TEXT_RUN_KEY)) == 0 &&
+        StrCmp(TextRuns[Index].Text, Text) == 0) {
+      TextRuns[Index].LastUse = ++TextRunsClock;
+      if (DrawX) {
+        *DrawX = TextRuns[Index].DrawX;
+      }
+      if (TextWidth) {
+        *TextWidth = TextRuns[Index].TextWidth;
+      }
+      return TextRuns[Index].Image;
+    }
+  }
+  return NULL;
+}
+
+// the cache takes the Image
+VOID egAddTextRun(IN CHAR16 *Text, IN EG_TEXT_RUN_KEY *Key, IN EG_IMAGE *Image, IN INTN DrawX, IN INTN TextWidth)
+{
+  UINTN       Index, Oldest;
+  UINTN       Pixels;
+  EG_TEXT_RUN *Run;
+
+  if (!Text || !Key || !Image) {
+    return;
+  }
+  Pixels = Image->Width * Image->Height;
+  if (Pixels > TEXT_RUN_CACHE_PIXELS / 4) {
+    egFreeImage(Image);
+    return;
+  }
+  while (TextRunsCount > 0 &&
+         (TextRunsCount == TEXT_RUN_CACHE_SIZE || TextRunsPixels + Pixels > TEXT_RUN_CACHE_PIXELS)) {
+    Oldest = 0;
+    for (Index = 1; Index < TextRunsCount; Index++) {
+      if (TextRuns[Index].LastUse < TextRuns[Oldest].LastUse) {
+        Oldest = Index;
+      }
+    }
+    FreeTextRun(Oldest);
+  }
+
+  Run = &TextRuns[TextRunsCount];
+  Run->Text = EfiStrDuplicate(Text);
+  if (!Run->Text) {
+    egFreeImage(Image);
+    return;
+  }
+  CopyMem(&Run->Key, Key, sizeof(EG_TEXT_RUN_KEY));
+  Run->Image = Image;
+  Run->DrawX = DrawX;
+  Run->TextWidth = TextWidth;
+  Run->LastUse = ++TextRunsClock;
+  TextRunsPixels += Pixels;
+  TextRunsCount++;
+}
+
 INTN egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage,
                   IN INTN PosX, IN INTN PosY, IN INTN Cursor, INTN textType)
 {
@@ -282,6 +411,9 @@ INTN egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage,
   FirstPixelBuf = BufferPtr;
   FontPixelData = FontImage->PixelData;
   FontLineOffset = FontImage->Width;
+  if (GlyphMetricsFont != FontImage && gLanguage != korean) {
+    PrepareGlyphMetrics();
+  }
 //  DBG("BufferLineOffset=%d  FontLineOffset=%d\n", BufferLineOffset, FontLineOffset);
 
   if (ScaledWidth < FontWidth) {
@@ -306,7 +438,7 @@ INTN egRenderText(IN CHAR16 *Text, IN OUT EG_IMAGE *CompImage,
           RightSpace = 1;
           RealWidth = (ScaledWidth >> 1) + 1;
         } else {
-          RightSpace = GetEmpty(FontPixelData + c * FontWidth, FontPixelData, FontWidth, 1, FontLineOffset);
+          RightSpace = GlyphRightSpace[c];
           if (RightSpace >= ScaledWidth + Shift) {
             RightSpace = 0; //empty place for invisible characters
           }
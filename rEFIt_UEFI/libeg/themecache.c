@@ -0,0 +1,324 @@
+/*
+ * Decoded theme images kept on the boot volume
+ *
+ * The same theme PNGs are inflated and the same SVG icons rasterized at
+ * every boot, though the theme and the screen mode rarely change. The
+ * results are kept as raw BGRA in EFI\CLOVER\misc\theme.cache, read in one
+ * call when the theme is loaded. The whole file belongs to one theme: its
+ * name, the CRC of theme.plist or theme.svg and the screen size are in the
+ * header, anything else drops the file. Each image has its own key, see
+ * EG_CACHE_KEY.
+ *
+ */
+
+#include "libegint.h"
+
+#ifndef DEBUG_ALL
+#define DEBUG_THEME_CACHE 1
+#else
+#define DEBUG_THEME_CACHE DEBUG_ALL
+#endif
+
+#if DEBUG_THEME_CACHE == 0
+#define DBG(...)
+#else
+#define DBG(...) DebugLog(DEBUG_THEME_CACHE, __VA_ARGS__)
+#endif
+
+#define THEME_CACHE_PATH        L"EFI\\CLOVER\\misc\\theme.cache"
+#define THEME_CACHE_SIGNATURE   SIGNATURE_32('C', 'T', 'H', 'M')
+#define THEME_CACHE_VERSION     1
+#define THEME_CACHE_MAX_ENTRIES 512
+#define THEME_CACHE_MAX_PIXELS  (48 * 1024 * 1024)
+
+//
+// On-disk layout: header, EntryCount entries, then the pixels of each
+// entry at its Offset. The CRC covers the entries only, the pixels are
+// too many to check at every boot.
+//
+#pragma pack(1)
+typedef struct {
+  UINT32        Signature;
+  UINT32        Version;
+  UINT32        Size;         // whole file
+  UINT32        Crc;          // of the entries
+  UINT32        ThemeCrc;     // theme.plist or theme.svg
+  UINT32        NameCrc;      // theme name
+  UINT32        ScreenWidth;
+  UINT32        ScreenHeight;
+  UINT32        EntryCount;
+} THEME_CACHE_HEADER;
+
+typedef struct {
+  EG_CACHE_KEY  Key;
+  UINT16        Width;
+  UINT16        Height;
+  UINT32        HasAlpha;
+  UINT32        Offset;
+} THEME_CACHE_ENTRY;
+#pragma pack()
+
+static THEME_CACHE_HEADER mHeader;
+static THEME_CACHE_ENTRY  *mEntries = NULL;
+static EG_PIXEL           **mPixels = NULL;  // of the entries added this boot
+static UINTN              mCount = 0;
+static UINTN              mPixelBytes = 0;
+static UINT8              *mFile = NULL;     // theme.cache as read
+static UINTN              mFileSize = 0;
+static BOOLEAN            mActive = FALSE;
+static BOOLEAN            mDirty = FALSE;
+
+UINT32 egThemeCacheCrc(IN CONST VOID *Data, IN UINTN Size)
+{
+  UINT32 Crc = 0;
+
+  if (Data == NULL || Size == 0 || EFI_ERROR(gBS->CalculateCrc32((VOID *)Data, Size, &Crc))) {
+    return 0;
+  }
+  return Crc;
+}
+
+static VOID egThemeCacheFree(VOID)
+{
+  UINTN i;
+
+  if (mPixels != NULL) {
+    for (i = 0; i < mCount; i++) {
+      if (mPixels[i] != NULL) {
+        FreePool(mPixels[i]);
+      }
+    }
+    FreePool(mPixels);
+    mPixels = NULL;
+  }
+  if (mEntries != NULL) {
+    FreePool(mEntries);
+    mEntries = NULL;
+  }
+  if (mFile != NULL) {
+    FreePool(mFile);
+    mFile = NULL;
+  }
+  mCount = 0;
+  mPixelBytes = 0;
+  mFileSize = 0;
+  mActive = FALSE;
+  mDirty = FALSE;
+}
+
+// takes the entries of theme.cache if it was made for the same theme and screen
+static VOID egThemeCacheLoad(VOID)
+{
+  THEME_CACHE_HEADER  Header;
+  UINTN               i, Bytes;
+
+  if (EFI_ERROR(egLoadFile(SelfRootDir, THEME_CACHE_PATH, &mFile, &mFileSize))) {
+    mFile = NULL;
+    return;
+  }
+  if (mFileSize < sizeof(Header)) {
+    goto Drop;
+  }
+  CopyMem(&Header, mFile, sizeof(Header));
+  if (Header.Signature != THEME_CACHE_SIGNATURE || Header.Version != THEME_CACHE_VERSION ||
+      Header.Size != mFileSize || Header.EntryCount > THEME_CACHE_MAX_ENTRIES ||
+      sizeof(Header) + Header.EntryCount * sizeof(THEME_CACHE_ENTRY) > mFileSize ||
+      Header.Crc != egThemeCacheCrc(mFile + sizeof(Header), Header.EntryCount * sizeof(THEME_CACHE_ENTRY))) {
+    DBG("ThemeCache: damaged\n");
+    goto Drop;
+  }
+  if (Header.ThemeCrc != mHeader.ThemeCrc || Header.NameCrc != mHeader.NameCrc ||
+      Header.ScreenWidth != mHeader.ScreenWidth || Header.ScreenHeight != mHeader.ScreenHeight) {
+    DBG("ThemeCache: made for another theme or screen\n");
+    goto Drop;
+  }
+  CopyMem(mEntries, mFile + sizeof(Header), Header.EntryCount * sizeof(THEME_CACHE_ENTRY));
+  for (i = 0; i < Header.EntryCount; i++) {
+    Bytes = (UINTN)mEntries[i].Width * mEntries[i].Height * sizeof(EG_PIXEL);
+    if (mEntries[i].Offset > mFileSize || Bytes > mFileSize - mEntries[i].Offset) {
+      DBG("ThemeCache: damaged\n");
+      goto Drop;
+    }
+    mPixelBytes += Bytes;
+  }
+  mCount = Header.EntryCount;
+  DBG("ThemeCache: %d images\n", mCount);
+  return;
+
+Drop:
+  FreePool(mFile);
+  mFile = NULL;
+  mFileSize = 0;
+  mPixelBytes = 0;
+}
+
+//
+// Starts the cache for a theme whose description (theme.plist or
+// theme.svg) is ThemeData. With ThemeName NULL the cache is switched off
+// until the next call, as for the embedded theme.
+//
+VOID egThemeCacheOpen(IN CHAR16 *ThemeName, IN VOID *ThemeData, IN UINTN ThemeDataSize)
+{
+  INTN Width = 0, Height = 0;
+
+  egThemeCacheFree();
+  if (ThemeName == NULL || ThemeData == NULL || !gSettings.ThemeCache || SelfRootDir == NULL) {
+    return;
+  }
+  mEntries = (THEME_CACHE_ENTRY *)AllocateZeroPool(THEME_CACHE_MAX_ENTRIES * sizeof(THEME_CACHE_ENTRY));
+  mPixels = (EG_PIXEL **)AllocateZeroPool(THEME_CACHE_MAX_ENTRIES * sizeof(EG_PIXEL *));
+  if (mEntries == NULL || mPixels == NULL) {
+    egThemeCacheFree();
+    return;
+  }
+  egGetScreenSize(&Width, &Height);
+  ZeroMem(&mHeader, sizeof(mHeader));
+  mHeader.ThemeCrc = egThemeCacheCrc(ThemeData, ThemeDataSize);
+  mHeader.NameCrc = egThemeCacheCrc(ThemeName, StrSize(ThemeName));
+  mHeader.ScreenWidth = (UINT32)Width;
+  mHeader.ScreenHeight = (UINT32)Height;
+  mActive = TRUE;
+  egThemeCacheLoad();
+}
+
+BOOLEAN egThemeCacheIsActive(VOID)
+{
+  return mActive;
+}
+
+static INTN egThemeCacheIndex(IN EG_CACHE_KEY *Key)
+{
+  UINTN i;
+
+  for (i = 0; i < mCount; i++) {
+    if (CompareMem(&mEntries[i].Key, Key, sizeof(EG_CACHE_KEY)) == 0) {
+      return (INTN)i;
+    }
+  }
+  return -1;
+}
+
+// a copy of the cached image, or NULL
+EG_IMAGE *egThemeCacheFind(IN EG_CACHE_KEY *Key)
+{
+  INTN      Index;
+  EG_IMAGE  *Image;
+  EG_PIXEL  *Pixels;
+
+  if (!mActive || Key == NULL) {
+    return NULL;
+  }
+  Index = egThemeCacheIndex(Key);
+  if (Index < 0) {
+    return NULL;
+  }
+  Image = egCreateImage(mEntries[Index].Width, mEntries[Index].Height, (BOOLEAN)(mEntries[Index].HasAlpha != 0));
+  if (Image == NULL) {
+    return NULL;
+  }
+  Pixels = (mPixels[Index] != NULL) ? mPixels[Index] : (EG_PIXEL *)(mFile + mEntries[Index].Offset);
+  CopyMem(Image->PixelData, Pixels, Image->Width * Image->Height * sizeof(EG_PIXEL));
+  return Image;
+}
+
+//
+// Remembers a copy of Image under Key. An entry with the same name and
+// flags but another stamp is a changed file and is replaced.
+//
+VOID egThemeCacheAdd(IN EG_CACHE_KEY *Key, IN EG_IMAGE *Image)
+{
+  UINTN     i, Bytes;
+  EG_PIXEL  *Pixels;
+
+  if (!mActive || Key == NULL || Image == NULL || Image->PixelData == NULL ||
+      Image->Width <= 0 || Image->Height <= 0 || Image->Width > MAX_UINT16 || Image->Height > MAX_UINT16) {
+    return;
+  }
+  Bytes = Image->Width * Image->Height * sizeof(EG_PIXEL);
+  for (i = 0; i < mCount; i++) {
+    if (mEntries[i].Key.Name == Key->Name && mEntries[i].Key.Flags == Key->Flags) {
+      break;
+    }
+  }
+  if (i < mCount) {
+    mPixelBytes -= (UINTN)mEntries[i].Width * mEntries[i].Height * sizeof(EG_PIXEL);
+  } else if (mCount >= THEME_CACHE_MAX_ENTRIES) {
+    return;
+  }
+  if (mPixelBytes + Bytes > THEME_CACHE_MAX_PIXELS) {
+    return;
+  }
+  Pixels = (EG_PIXEL *)AllocateCopyPool(Bytes, Image->PixelData);
+  if (Pixels == NULL) {
+    return;
+  }
+  if (i < mCount && mPixels[i] != NULL) {
+    FreePool(mPixels[i]);
+  }
+  CopyMem(&mEntries[i].Key, Key, sizeof(EG_CACHE_KEY));
+  mEntries[i].Width = (UINT16)Image->Width;
+  mEntries[i].Height = (UINT16)Image->Height;
+  mEntries[i].HasAlpha = Image->HasAlpha;
+  mEntries[i].Offset = 0;
+  mPixels[i] = Pixels;
+  mPixelBytes += Bytes;
+  if (i == mCount) {
+    mCount++;
+  }
+  mDirty = TRUE;
+}
+
+//
+// Writes theme.cache if images were added since it was read or written.
+// The cache stays active, images decoded later are written next time.
+//
+VOID egThemeCacheFlush(VOID)
+{
+  EFI_STATUS  Status;
+  UINT8       *Buffer;
+  UINTN       Size, Offset, Bytes, i;
+  EG_PIXEL    *Pixels;
+
+  if (!mActive || !mDirty) {
+    return;
+  }
+  Size = sizeof(THEME_CACHE_HEADER) + mCount * sizeof(THEME_CACHE_ENTRY) + mPixelBytes;
+  Buffer = (UINT8 *)AllocatePool(Size);
+  if (Buffer == NULL) {
+    return;
+  }
+  Offset = sizeof(THEME_CACHE_HEADER) + mCount * sizeof(THEME_CACHE_ENTRY);
+  for (i = 0; i < mCount; i++) {
+    Bytes = (UINTN)mEntries[i].Width * mEntries[i].Height * sizeof(EG_PIXEL);
+    Pixels = (mPixels[i] != NULL) ? mPixels[i] : (EG_PIXEL *)(mFile + mEntries[i].Offset);
+    CopyMem(Buffer + Offset, Pixels, Bytes);
+    mEntries[i].Offset = (UINT32)Offset;
+    Offset += Bytes;
+  }
+  CopyMem(Buffer + sizeof(THEME_CACHE_HEADER), mEntries, mCount * sizeof(THEME_CACHE_ENTRY));
+  mHeader.Signature = THEME_CACHE_SIGNATURE;
+  mHeader.Version = THEME_CACHE_VERSION;
+  mHeader.Size = (UINT32)Size;
+  mHeader.EntryCount = (UINT32)mCount;
+  mHeader.Crc = egThemeCacheCrc(Buffer + sizeof(THEME_CACHE_HEADER), mCount * sizeof(THEME_CACHE_ENTRY));
+  CopyMem(Buffer, &mHeader, sizeof(THEME_CACHE_HEADER));
+
+  Status = egSaveFile(SelfRootDir, THEME_CACHE_PATH, Buffer, Size);
+  DBG("ThemeCache: saved %d images: %r\n", mCount, Status);
+
+  // the new file is now the backing store of every entry
+  for (i = 0; i < mCount; i++) {
+    if (mPixels[i] != NULL) {
+      FreePool(mPixels[i]);
+      mPixels[i] = NULL;
+    }
+  }
+  if (mFile != NULL) {
+    FreePool(mFile);
+  }
+  mFile = Buffer;
+  mFileSize = Size;
+  mDirty = FALSE;
+}
+
+/* EOF */
@@ -129,6 +129,50 @@ CHAR16 * GetIconsExt(IN CHAR16 *Icon, IN CHAR16 *Def)
   return PoolPrint(L"%s.%s", Icon, ((GlobalConfig.IconFormat != ICON_FORMAT_DEF) && (IconFormat != NULL)) ? IconFormat : Def);
 }
 
+//
+// Decodes the theme's PNG function and volume icons in one batch on all
+// processors instead of one by one on the first BuiltinIcon() call for each.
+// The banner and selection images are left to their own loaders.
+//
+VOID PreloadBuiltinIcons(VOID)
+{
+  EG_IMAGE_LOAD Loads[BUILTIN_ICON_BANNER];
+  UINTN         Ids[BUILTIN_ICON_BANNER];
+  UINTN         Id, Count = 0, i;
+  CHAR16        *Path;
+  UINTN         Len;
+
+  if (!ThemeDir || GlobalConfig.TypeSVG || GlobalConfig.TextOnly || egJobProcessors() < 2) {
+    return;
+  }
+
+  for (Id = 0; Id < BUILTIN_ICON_BANNER; Id++) {
+    if (BuiltinIconTable[Id].Image != NULL) {
+      continue;
+    }
+    Path = GetIconsExt(BuiltinIconTable[Id].Path, BuiltinIconTable[Id].Format);
+    Len = StrLen(Path);
+    // icns are decoded lazily, only PNG is worth the batch
+    if (Len < 4 || StriCmp(Path + Len - 4, L".png") != 0) {
+      FreePool(Path);
+      continue;
+    }
+    ZeroMem(&Loads[Count], sizeof(EG_IMAGE_LOAD));
+    Loads[Count].BaseDir = ThemeDir;
+    Loads[Count].FileName = Path;
+    Loads[Count].IconSize = BuiltinIconTable[Id].PixelSize;
+    Ids[Count++] = Id;
+  }
+
+  egLoadImages(Loads, Count);
+
+  for (i = 0; i < Count; i++) {
+    BuiltinIconTable[Ids[i]].Image = Loads[i].Image;
+    FreePool(Loads[i].FileName);
+  }
+  DBG("preloaded %d builtin icons\n", Count);
+}
+
 EG_IMAGE * BuiltinIcon(IN UINTN Id)
 {
   INTN      Size;
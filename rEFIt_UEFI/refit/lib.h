@@ -430,6 +430,7 @@ struct _refit_menu_screen {
   UINTN             FrameTime; //ms
   EG_RECT           FilmPlace;
   EG_IMAGE          **Film;
+  UINT8             *FilmFailed; //bitmap of frames that could not be loaded
 };
 
 #define VOLTYPE_OPTICAL    (0x0001)
@@ -493,6 +494,7 @@ typedef struct {
   SCALING     BackgroundScale;
   UINTN       BackgroundSharp;
   BOOLEAN     BackgroundDark;
+  SCALER_TYPE ImageScaler;
   BOOLEAN     CustomIcons;
   BOOLEAN     SelectionOnTop;
   BOOLEAN     BootCampStyle;
@@ -687,6 +689,8 @@ extern UINTN            VolumesCount;
 
 extern EG_IMAGE         *Banner;
 extern EG_IMAGE         *BigBack;
+extern EG_CACHE_KEY     BigBackKey;
+extern BOOLEAN          BigBackKeyed;
 extern EG_IMAGE         *FontImage;
 extern EG_IMAGE         *SelectionImages[];
 extern EG_IMAGE         *Buttons[];
@@ -826,6 +830,7 @@ BOOLEAN CheckError(IN EFI_STATUS Status, IN CHAR16 *where);
 VOID SwitchToGraphicsAndClear(VOID);
 VOID BltClearScreen(IN BOOLEAN ShowBanner);
 VOID BltImage(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos);
+EG_IMAGE *ComposeImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale);
 VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale);
 VOID BltImageComposite(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN INTN XPos, IN INTN YPos);
 VOID BltImageCompositeBadge(IN EG_IMAGE *BaseImage, IN EG_IMAGE *TopImage, IN EG_IMAGE *BadgeImage, IN INTN XPos, IN INTN YPos, INTN Scale);
@@ -846,6 +851,7 @@ EG_IMAGE * LoadIcns(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN Pi
 EG_IMAGE * LoadIcnsFallback(IN EFI_FILE_HANDLE BaseDir, IN CHAR16 *FileName, IN UINTN PixelSize);
 EG_IMAGE * DummyImage(IN UINTN PixelSize);
 EG_IMAGE * BuiltinIcon(IN UINTN Id);
+VOID       PreloadBuiltinIcons(VOID);
 CHAR16   * GetIconsExt(IN CHAR16 *Icon, IN CHAR16 *Def);
 EG_IMAGE * GetSmallHover(IN UINTN Id);
 
@@ -197,7 +197,10 @@ static EFI_STATUS StartEFILoadedImage(IN EFI_HANDLE ChildImageHandle,
   //DBG("Image loaded at: %p\n", ChildLoadedImage->ImageBase);
   //PauseForKey(L"continue");
   
+  // images decoded while the menus ran, the scaled background among them
+  egThemeCacheFlush();
   // close open file handles
+  FlushDebugLog();
   UninitRefitLib();
 
   // turn control over to the image
@@ -2493,12 +2496,14 @@ RefitMain (IN EFI_HANDLE           ImageHandle,
     GetSmcKeys(TRUE);
     
     // Add custom entries
+    ScanCacheOpen();
     AddCustomEntries();
     if (gSettings.DisableEntryScan) {
       DBG("Entry scan disabled\n");
     } else {
       ScanLoader();
     }
+    ScanCacheClose();
 
     if (!GlobalConfig.FastBoot) {
 
@@ -2583,6 +2588,8 @@ RefitMain (IN EFI_HANDLE           ImageHandle,
         MenuExit = MENU_EXIT_TIMEOUT;
       } else {
         MainMenu.AnimeRun = MainAnime;
+        // keep what was decoded for this menu in theme.cache
+        egThemeCacheFlush();
         MenuExit = RunMainMenu(&MainMenu, DefaultIndex, &ChosenEntry);
       }
       DBG("exit from MainMenu %d\n", MenuExit); //MENU_EXIT_ENTER=(1) MENU_EXIT_DETAILS=3
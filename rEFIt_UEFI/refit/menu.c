@@ -2480,7 +2480,8 @@ UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC StyleFunc,
   // when coming with a key press from timeout=0, for example
   while (ReadAllKeyStrokes()) gBS->Stall(500 * 1000);
   while (!MenuExit) {
-    // update the screen
+    // update the screen, all elements are sent to the screen at once
+    egBeginFrame();
     if (State.PaintAll) {
       StyleFunc(Screen, &State, MENU_FUNCTION_PAINT_ALL, NULL);
       State.PaintAll = FALSE;
@@ -2494,6 +2495,7 @@ UINTN RunGenericMenu(IN REFIT_MENU_SCREEN *Screen, IN MENU_STYLE_FUNC StyleFunc,
       StyleFunc(Screen, &State, MENU_FUNCTION_PAINT_TIMEOUT, TimeoutMessage);
       FreePool(TimeoutMessage);
     }
+    egEndFrame();
 
     if (gEvent) { //for now used at CD eject.
       MenuExit = MENU_EXIT_ESCAPE;
@@ -3010,6 +3012,8 @@ INTN DrawTextXY(IN CHAR16 *Text, IN INTN XPos, IN INTN YPos, IN UINT8 XAlign)
   INTN      Height;
   INTN      TextXYStyle = 1;
   EG_IMAGE  *TextBufferXY = NULL;
+  EG_IMAGE  *TextImage;
+  EG_TEXT_RUN_KEY Key;
 
   if (!Text) {
     return 0;
@@ -3041,6 +3045,22 @@ INTN DrawTextXY(IN CHAR16 *Text, IN INTN XPos, IN INTN YPos, IN UINT8 XAlign)
     Height = TextHeight;
   }
 
+  // the same line at the same place is taken as it was drawn last time
+  ZeroMem(&Key, sizeof(Key));
+  Key.XPos = XPos;
+  Key.YPos = YPos;
+  Key.Width = TextWidth;
+  Key.Height = Height;
+  Key.Cursor = 0xFFFF;
+  Key.Style = TextXYStyle;
+  Key.Align = XAlign;
+  Key.Color = MenuBackgroundPixel;
+  TextImage = egFindTextRun(Text, &Key, &XText, &TextWidth);
+  if (TextImage) {
+    BltImage(TextImage, XText, YPos);
+    return TextWidth;
+  }
+
   TextBufferXY = egCreateFilledImage(TextWidth, Height, TRUE, &MenuBackgroundPixel);
 
   // render the text
@@ -3052,8 +3072,12 @@ INTN DrawTextXY(IN CHAR16 *Text, IN INTN XPos, IN INTN YPos, IN UINT8 XAlign)
   }
 //  DBG("draw text %s\n", Text);
 //  DBG("pos=%d width=%d xtext=%d Height=%d Y=%d\n", XPos, TextWidth, XText, Height, YPos);
-  BltImageAlpha(TextBufferXY, XText, YPos,  &MenuBackgroundPixel, 16);
+  TextImage = ComposeImageAlpha(TextBufferXY, XText, YPos,  &MenuBackgroundPixel, 16);
   egFreeImage(TextBufferXY);
+  if (TextImage) {
+    BltImage(TextImage, XText, YPos);
+    egAddTextRun(Text, &Key, TextImage, XText, TextWidth);
+  }
 
   return TextWidth;
 }
@@ -3177,6 +3201,10 @@ VOID DrawMenuText(IN CHAR16 *Text, IN INTN SelectedWidth, IN INTN XPos, IN INTN
 
 VOID DrawMenuText(IN CHAR16 *Text, IN INTN SelectedWidth, IN INTN XPos, IN INTN YPos, IN INTN Cursor)
 {
+  EG_IMAGE        *TextImage;
+  EG_TEXT_RUN_KEY Key;
+  INTN            DrawX;
+
   //use Text=null to reinit the buffer
   if (!Text) {
     if (TextBuffer) {
@@ -3186,6 +3214,22 @@ VOID DrawMenuText(IN CHAR16 *Text, IN INTN SelectedWidth, IN INTN XPos, IN INTN
     return;
   }
 
+  // an unchanged line is taken as it was drawn last time
+  ZeroMem(&Key, sizeof(Key));
+  Key.XPos = XPos;
+  Key.YPos = YPos;
+  Key.Width = UGAWidth - XPos;
+  Key.Height = TextHeight;
+  Key.SelectedWidth = SelectedWidth;
+  Key.Cursor = Cursor;
+  Key.Style = TextStyle;
+  Key.Color = (Cursor != 0xFFFF) ? MenuBackgroundPixel : InputBackgroundPixel;
+  TextImage = egFindTextRun(Text, &Key, &DrawX, NULL);
+  if (TextImage) {
+    BltImage(TextImage, DrawX, YPos);
+    return;
+  }
+
   if (TextBuffer && (TextBuffer->Height != TextHeight)) {
     egFreeImage(TextBuffer);
     TextBuffer = NULL;
@@ -3217,7 +3261,11 @@ VOID DrawMenuText(IN CHAR16 *Text, IN INTN SelectedWidth, IN INTN XPos, IN INTN
   } else {
     egRenderText(Text, TextBuffer, TEXT_XMARGIN, TEXT_YMARGIN, Cursor, TextStyle);
   }
-  BltImageAlpha(TextBuffer, (INTN)XPos, (INTN)YPos, &MenuBackgroundPixel, 16);
+  TextImage = ComposeImageAlpha(TextBuffer, (INTN)XPos, (INTN)YPos, &MenuBackgroundPixel, 16);
+  if (TextImage) {
+    BltImage(TextImage, XPos, YPos);
+    egAddTextRun(Text, &Key, TextImage, XPos, 0);
+  }
 }
 
 
@@ -90,6 +90,8 @@ EG_PIXEL BlackPixel  = { 0x00, 0x00, 0x00, 0xff};
 EG_IMAGE *BackgroundImage = NULL;
 EG_IMAGE *Banner = NULL;
 EG_IMAGE *BigBack = NULL;
+EG_CACHE_KEY BigBackKey;        // theme.cache key BigBack was loaded under
+BOOLEAN BigBackKeyed = FALSE;
 
 static BOOLEAN GraphicsScreenDirty;
 
@@ -408,6 +410,56 @@ typedef struct {
 */
 
 
+//
+// BigBack scaled to the screen goes to theme.cache next to BigBack itself,
+// keyed after it with the screen size added.
+//
+static BOOLEAN ScaledBackKey(OUT EG_CACHE_KEY *Key)
+{
+  INTN Scaled[3];
+
+  if (!BigBackKeyed) {
+    return FALSE;
+  }
+  Scaled[0] = BigBackKey.Stamp;
+  Scaled[1] = UGAWidth;
+  Scaled[2] = UGAHeight;
+  Key->Name = BigBackKey.Name;
+  Key->Stamp = egThemeCacheCrc(Scaled, sizeof(Scaled));
+  Key->Flags = BigBackKey.Flags | EG_CACHE_SCREEN;
+  return TRUE;
+}
+
+static BOOLEAN FindScaledBack(VOID)
+{
+  EG_CACHE_KEY  Key;
+  EG_IMAGE      *Scaled;
+  BOOLEAN       Found = FALSE;
+
+  if (!ScaledBackKey(&Key)) {
+    return FALSE;
+  }
+  Scaled = egThemeCacheFind(&Key);
+  if (Scaled != NULL) {
+    if (Scaled->Width == BackgroundImage->Width && Scaled->Height == BackgroundImage->Height) {
+      CopyMem(BackgroundImage->PixelData, Scaled->PixelData,
+              BackgroundImage->Width * BackgroundImage->Height * sizeof(EG_PIXEL));
+      Found = TRUE;
+    }
+    egFreeImage(Scaled);
+  }
+  return Found;
+}
+
+static VOID AddScaledBack(VOID)
+{
+  EG_CACHE_KEY  Key;
+
+  if (ScaledBackKey(&Key)) {
+    egThemeCacheAdd(&Key, BackgroundImage);
+  }
+}
+
 VOID BltClearScreen(IN BOOLEAN ShowBanner) //ShowBanner always TRUE
 {
   EG_PIXEL *p1;
@@ -494,7 +546,7 @@ VOID BltClearScreen(IN BOOLEAN ShowBanner) //ShowBanner always TRUE
   
   // Load Background and scale
   if (!BigBack && (GlobalConfig.BackgroundName != NULL)) {
-    BigBack = egLoadImage(ThemeDir, GlobalConfig.BackgroundName, FALSE);
+    BigBack = egLoadImageKeyed(ThemeDir, GlobalConfig.BackgroundName, FALSE, &BigBackKey, &BigBackKeyed);
   }
   
   if (BackgroundImage != NULL && (BackgroundImage->Width != UGAWidth || BackgroundImage->Height != UGAHeight)) {
@@ -504,6 +556,7 @@ VOID BltClearScreen(IN BOOLEAN ShowBanner) //ShowBanner always TRUE
   }
   
   if (BackgroundImage == NULL) {
+    egFreeTextRuns();
 /*    DBG("BltClearScreen(%c): calling egCreateFilledImage UGAWidth %ld, UGAHeight %ld, BlueBackgroundPixel %02x%02x%02x%02x\n",
         ShowBanner?'Y':'N', UGAWidth, UGAHeight,
         BlueBackgroundPixel.r, BlueBackgroundPixel.g, BlueBackgroundPixel.b, BlueBackgroundPixel.a); */
@@ -513,7 +566,10 @@ VOID BltClearScreen(IN BOOLEAN ShowBanner) //ShowBanner always TRUE
   if (BigBack != NULL) {
     switch (GlobalConfig.BackgroundScale) {
       case imScale:
-        ScaleImage(BackgroundImage, BigBack);
+        if (!FindScaledBack()) {
+          ScaleImage(BackgroundImage, BigBack);
+          AddScaledBack();
+        }
         break;
       case imCrop:
         x = UGAWidth - BigBack->Width;
@@ -590,14 +646,14 @@ VOID BltImage(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos)
   GraphicsScreenDirty = TRUE;
 }
 
-VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale)
+// Image composed on BackgroundPixel and the background at the place, as BltImageAlpha() puts it on the screen
+EG_IMAGE *ComposeImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale)
 {
   EG_IMAGE *CompImage;
   EG_IMAGE *NewImage = NULL;
   INTN Width = Scale << 3;
   INTN Height = Width;
 
-  GraphicsScreenDirty = TRUE;
   if (Image) {
     NewImage = egCopyScaledImage(Image, Scale); //will be Scale/16
     Width = NewImage->Width;
@@ -611,12 +667,13 @@ VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *
     egFreeImage(NewImage);
   }
   if (!BackgroundImage) {
-    egDrawImageArea(CompImage, 0, 0, 0, 0, XPos, YPos);
-    egFreeImage(CompImage);
-    return;
+    return CompImage;
   }
   NewImage = egCreateImage(Width, Height, FALSE);
-  if (!NewImage) return;
+  if (!NewImage) {
+    egFreeImage(CompImage);
+    return NULL;
+  }
 //  DBG("draw on background\n");
   egRawCopy(NewImage->PixelData,
             BackgroundImage->PixelData + YPos * BackgroundImage->Width + XPos,
@@ -625,6 +682,16 @@ VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *
             BackgroundImage->Width);
   egComposeImage(NewImage, CompImage, 0, 0);
   egFreeImage(CompImage);
+  return NewImage;
+}
+
+VOID BltImageAlpha(IN EG_IMAGE *Image, IN INTN XPos, IN INTN YPos, IN EG_PIXEL *BackgroundPixel, INTN Scale)
+{
+  EG_IMAGE *NewImage;
+
+  GraphicsScreenDirty = TRUE;
+  NewImage = ComposeImageAlpha(Image, XPos, YPos, BackgroundPixel, Scale);
+  if (!NewImage) return;
 
   // blit to screen and clean up
   egDrawImageArea(NewImage, 0, 0, 0, 0, XPos, YPos);
@@ -912,6 +979,70 @@ static INTN HybridRepositioning(INTN Edge, INTN Value, INTN ImageDimension, INTN
 
 static EG_IMAGE *AnimeImage = NULL;
 
+//
+// Frames of the film are decoded when they are about to be shown. Up to
+// ANIME_FRAMES_BUDGET bytes of them stay resident, longer films keep only
+// the first frame (its size places the film) and a short window ahead of
+// the current one, filled while the menu waits for the next frame time.
+// SVG frames all stay: ParseSVGIcon() takes a frame's shapes out of the
+// theme image, so a frame can be made only once.
+//
+#define ANIME_FRAMES_BUDGET (8 * 1024 * 1024)
+#define ANIME_LOOKAHEAD     3
+
+static BOOLEAN AnimeFrameFailed(REFIT_MENU_SCREEN *Screen, INTN Index)
+{
+  return Screen->FilmFailed != NULL && (Screen->FilmFailed[Index >> 3] & (1 << (Index & 7))) != 0;
+}
+
+// a frame that fails once is not tried again, UpdateAnime() runs every tick
+static EG_IMAGE *LoadAnimeFrame(REFIT_MENU_SCREEN *Screen, INTN Index)
+{
+  CHAR16      FileName[256];
+  GUI_ANIME   *Anime;
+  EG_IMAGE    *Frame = NULL;
+
+  if (AnimeFrameFailed(Screen, Index)) {
+    return NULL;
+  }
+  if (GlobalConfig.TypeSVG) {
+    Frame = LoadSvgFrame(Index);
+  } else {
+    for (Anime = GuiAnime; Anime != NULL && Anime->ID != Screen->ID; Anime = Anime->Next);
+    if (Anime && Anime->Path) {
+      UnicodeSPrint(FileName, 512, L"%s\\%s_%03d.png", Anime->Path, Anime->Path, Index);
+      Frame = egLoadImage(ThemeDir, FileName, TRUE);
+    }
+  }
+  if (Frame == NULL && Screen->FilmFailed != NULL) {
+    Screen->FilmFailed[Index >> 3] |= (UINT8)(1 << (Index & 7));
+  }
+  return Frame;
+}
+
+// how many frames may be resident at once
+static INTN AnimeFramesResident(REFIT_MENU_SCREEN *Screen)
+{
+  INTN FrameSize = Screen->Film[0]->Width * Screen->Film[0]->Height * sizeof(EG_PIXEL);
+  INTN Count = (FrameSize > 0) ? ANIME_FRAMES_BUDGET / FrameSize : Screen->Frames;
+
+  return (Count > ANIME_LOOKAHEAD + 1) ? Count : ANIME_LOOKAHEAD + 1;
+}
+
+// decode at most one missing frame of the window starting at the current frame
+static VOID PrefetchAnimeFrames(REFIT_MENU_SCREEN *Screen)
+{
+  INTN i, Index;
+
+  for (i = 0; i < ANIME_LOOKAHEAD && i < Screen->Frames; i++) {
+    Index = (Screen->CurrentFrame + i) % Screen->Frames;
+    if (Screen->Film[Index] == NULL && !AnimeFrameFailed(Screen, Index)) {
+      Screen->Film[Index] = LoadAnimeFrame(Screen, Index);
+      return;
+    }
+  }
+}
+
 VOID UpdateAnime(REFIT_MENU_SCREEN *Screen, EG_RECT *Place)
 {
   UINT64      Now;
@@ -963,7 +1094,14 @@ VOID UpdateAnime(REFIT_MENU_SCREEN *Screen, EG_RECT *Place)
                 Screen->Film[Screen->Frames]->Width,
                 Screen->Film[Screen->Frames]->Height);
   }
-  if (TimeDiff(Screen->LastDraw, Now) < Screen->FrameTime) return;
+  if (TimeDiff(Screen->LastDraw, Now) < Screen->FrameTime) {
+    PrefetchAnimeFrames(Screen);
+    return;
+  }
+  if (Screen->Film[Screen->CurrentFrame] == NULL) {
+    Screen->Film[Screen->CurrentFrame] = LoadAnimeFrame(Screen, Screen->CurrentFrame);
+  }
+  // a missing frame leaves the previous one on the screen
   if (Screen->Film[Screen->CurrentFrame]) {
     egRawCopy(AnimeImage->PixelData, Screen->Film[Screen->Frames]->PixelData,
               Screen->Film[Screen->Frames]->Width, 
@@ -973,6 +1111,11 @@ VOID UpdateAnime(REFIT_MENU_SCREEN *Screen, EG_RECT *Place)
     AnimeImage->HasAlpha = FALSE;
     egComposeImage(AnimeImage, Screen->Film[Screen->CurrentFrame], 0, 0);  //aaaa
     BltImage(AnimeImage, x, y);
+    if (Screen->CurrentFrame != 0 && !GlobalConfig.TypeSVG &&
+        Screen->Frames > AnimeFramesResident(Screen)) {
+      egFreeImage(Screen->Film[Screen->CurrentFrame]);
+      Screen->Film[Screen->CurrentFrame] = NULL;
+    }
   }
   Screen->CurrentFrame++;
   if (Screen->CurrentFrame >= Screen->Frames) {
@@ -985,10 +1128,6 @@ VOID UpdateAnime(REFIT_MENU_SCREEN *Screen, EG_RECT *Place)
 
 VOID InitAnime(REFIT_MENU_SCREEN *Screen)
 {
-  CHAR16      FileName[256];
-  CHAR16      *Path;
-  EG_IMAGE    *p = NULL;
-  EG_IMAGE    *Last = NULL;
   GUI_ANIME   *Anime;
 
   if (!Screen || GlobalConfig.TextOnly) return;
@@ -1004,15 +1143,18 @@ VOID InitAnime(REFIT_MENU_SCREEN *Screen)
       //free images in the film
       INTN i;
       for (i = 0; i <= Screen->Frames; i++) { //really there are N+1 frames
-        // free only last occurrence of repeated frames
-        if (Screen->Film[i] != NULL && (i == Screen->Frames || Screen->Film[i] != Screen->Film[i+1])) {
-          FreePool(Screen->Film[i]);
+        if (Screen->Film[i] != NULL) {
+          egFreeImage(Screen->Film[i]);
         }
       }
       FreePool(Screen->Film);
       Screen->Film = NULL;
       Screen->Frames = 0;
     }
+    if (Screen->FilmFailed) {
+      FreePool(Screen->FilmFailed);
+      Screen->FilmFailed = NULL;
+    }
     if (Screen->Theme) {
       FreePool(Screen->Theme);
       Screen->Theme = NULL;
@@ -1020,41 +1162,26 @@ VOID InitAnime(REFIT_MENU_SCREEN *Screen)
   }
   // Check if we should load anime files (first run or after theme change)
   if (Anime && Screen->Film == NULL) {
-    Path = Anime->Path;
     Screen->Film = (EG_IMAGE**)AllocateZeroPool((Anime->Frames + 1) * sizeof(VOID*));
-    if ((GlobalConfig.TypeSVG || Path) && Screen->Film) {
-      // Look through contents of the directory
-      UINTN i;
-      for (i = 0; i < Anime->Frames; i++) {
-
- //       DBG("Try to load file %s\n", FileName);
-        if (GlobalConfig.TypeSVG) {
-          p = LoadSvgFrame(i);
-   //       DBG("frame %d loaded\n", i);
-        } else {
-          UnicodeSPrint(FileName, 512, L"%s\\%s_%03d.png", Path, Path, i);
-          p = egLoadImage(ThemeDir, FileName, TRUE);
-        }
-        if (!p) {
-          p = Last;
-          if (!p) break;
-        } else {
-          Last = p;
-        }
-        Screen->Film[i] = p;
-      }
+    if (Screen->FilmFailed) {
+      FreePool(Screen->FilmFailed);
+    }
+    Screen->FilmFailed = (UINT8*)AllocateZeroPool((Anime->Frames + 8) / 8);
+    if ((GlobalConfig.TypeSVG || Anime->Path) && Screen->Film && Anime->Frames > 0) {
+      // only the first frame now, the rest when UpdateAnime() needs them
+      Screen->Frames = Anime->Frames;
+      Screen->Film[0] = LoadAnimeFrame(Screen, 0);
       if (Screen->Film[0] != NULL) {
-        Screen->Frames = i;
-        DBG(" found %d frames of the anime\n", i);
+        DBG(" found anime of %d frames\n", Screen->Frames);
         // Create background frame
-        Screen->Film[i] = egCreateImage(Screen->Film[0]->Width, Screen->Film[0]->Height, FALSE);
+        Screen->Film[Screen->Frames] = egCreateImage(Screen->Film[0]->Width, Screen->Film[0]->Height, FALSE);
         // Copy some settings from Anime into Screen
         Screen->FrameTime = Anime->FrameTime;
         Screen->Once = Anime->Once;
         Screen->Theme = AllocateCopyPool(StrSize(GlobalConfig.Theme), GlobalConfig.Theme);
-      } /*else {
-        DBG("Film[0] == NULL\n");
-      } */
+      } else {
+        Screen->Frames = 0;
+      }
     }
   }
   // Check if a new style placement value has been specified